@@ -65,6 +65,7 @@ if(NOT MSVC)
   check_include_files(glusterfs/api/glfs.h HAVE_GLUSTERFS_API_GLFS_H)
 
   check_include_files(sys/prctl.h HAVE_SYS_PRCTL_H)
+  check_include_files(linux/io_uring.h HAVE_LINUX_IO_URING_H)
 
   check_include_files(sys/capability.h HAVE_SYS_CAPABILITY_H)
   check_include_files(zlib.h HAVE_ZLIB_H)
@@ -160,6 +160,11 @@ if(ENABLE_LZO)
   endif()
 endif()
 
+option(ENABLE_ZSTD "Enable Zstandard support" ON)
+if(ENABLE_ZSTD)
+  bareosfindlibraryandheaders("zstd" "zstd.h" "")
+endif()
+
 include(BareosFindLibrary)
 
 bareosfindlibrary("tirpc")
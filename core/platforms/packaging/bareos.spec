@@ -150,6 +150,7 @@ BuildRequires: libstdc++-devel
 BuildRequires: zlib-devel
 BuildRequires: openssl-devel
 BuildRequires: lzo-devel
+BuildRequires: libzstd-devel
 BuildRequires: logrotate
 BuildRequires: postgresql-devel
 BuildRequires: openssl
@@ -1177,7 +1178,11 @@ mkdir -p %{?buildroot}/%{_libdir}/bareos/plugins/vmware_plugin
 %{_sbindir}/bareos-sd
 %{script_dir}/disk-changer
 %{plugin_dir}/autoxflate-sd.so
+%{backend_dir}/libbareossd-chunked*.so
+%{backend_dir}/libbareossd-dedup*.so
 %{backend_dir}/libbareossd-file*.so
+%attr(0640, %{director_daemon_user}, %{daemon_group}) %{_sysconfdir}/%{name}/bareos-dir.d/storage/Chunked.conf.example
+%attr(0640, %{storage_daemon_user}, %{daemon_group})  %{_sysconfdir}/%{name}/bareos-sd.d/device/ChunkedStorage.conf.example
 %{_mandir}/man8/bareos-sd.8.gz
 %if 0%{?systemd_support}
 %{_unitdir}/bareos-sd.service
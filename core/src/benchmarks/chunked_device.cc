@@ -0,0 +1,177 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation, which is
+   listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+/*
+ * Throughput of the chunk pipeline of the chunked storage backend, which
+ * keeps the chunks of a volume as files in a local directory.  Every
+ * chunk transfer is delayed by an injected latency, which stands in for
+ * the round trip to an object store; with io-threads the transfers of
+ * several chunks overlap.
+ */
+
+#include <benchmark/benchmark.h>
+#include "include/bareos.h"
+#include "include/fcntl_def.h"
+
+#define STORAGE_DAEMON 1
+#include "include/jcr.h"
+#include "lib/parse_conf.h"
+#include "stored/butil.h"
+#include "stored/sd_backends.h"
+#include "stored/stored_conf.h"
+#include "stored/stored_globals.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace bm = benchmark;
+using namespace storagedaemon;
+
+static const char* bench_dir = "chunked_device_bench";
+static constexpr std::size_t volume_size = 100 * 1024 * 1024;
+static constexpr std::size_t block_size = 1024 * 1024;
+
+static std::string DeviceName(int64_t io_threads, int64_t latency_ms)
+{
+  return "chunked-" + std::to_string(io_threads) + "-"
+         + std::to_string(latency_ms);
+}
+
+// One device per combination of io-threads and latency benchmarked below.
+static bool InitConfig()
+{
+  std::filesystem::path dir = std::filesystem::absolute(bench_dir);
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir / "storage");
+
+  std::ofstream conf(dir / "bareos-sd.conf");
+  conf << "Storage {\n"
+       << "  Name = bench-sd\n"
+#if defined(SD_BACKEND_DIR)
+       << "  Backend Directory = " SD_BACKEND_DIR "\n"
+#endif
+       << "  Working Directory = " << dir.string() << "\n"
+       << "}\n";
+  for (int io_threads : {0, 4}) {
+    for (int latency_ms : {0, 20}) {
+      conf << "Device {\n"
+           << "  Name = " << DeviceName(io_threads, latency_ms) << "\n"
+           << "  Media Type = Chunked\n"
+           << "  Device Type = chunked\n"
+           << "  Archive Device = " << (dir / "storage").string() << "\n"
+           << "  Device Options = \"iothreads=" << io_threads
+           << ",readahead=" << io_threads << ",latency=" << latency_ms
+           << "\"\n"
+           << "}\n";
+    }
+  }
+  conf.close();
+
+  OSDependentInit();
+  configfile = strdup((dir / "bareos-sd.conf").string().c_str());
+  my_config = InitSdConfig(configfile, M_ERROR_TERM);
+  return ParseSdConfig(configfile, M_ERROR_TERM);
+}
+[[maybe_unused]] static bool config_initialized = InitConfig();
+
+class ChunkedVolume {
+ public:
+  explicit ChunkedVolume(bm::State& state)
+      : jcr_(SetupDummyJcr("chunked_device_bench", nullptr, nullptr))
+  {
+    auto* device_resource = static_cast<DeviceResource*>(
+        my_config->GetResWithName(R_DEVICE,
+                                  DeviceName(state.range(0), state.range(1))
+                                      .c_str()));
+    dev_ = FactoryCreateDevice(jcr_, device_resource);
+    dev_->setVolCatName(volname_);
+  }
+
+  ~ChunkedVolume()
+  {
+    delete dev_;
+    FreeJcr(jcr_);
+  }
+
+  bool Write(const std::vector<char>& block)
+  {
+    int fd = dev_->d_open(volname_, O_CREAT | O_RDWR | O_BINARY, 0640);
+    if (fd < 0 || !dev_->d_truncate(nullptr)) { return false; }
+    for (std::size_t done = 0; done < volume_size; done += block.size()) {
+      if (dev_->d_write(fd, block.data(), block.size())
+          != static_cast<ssize_t>(block.size())) {
+        return false;
+      }
+    }
+    return dev_->d_flush(nullptr) && dev_->d_close(fd) == 0;
+  }
+
+  bool Read(std::vector<char>& block)
+  {
+    int fd = dev_->d_open(volname_, O_RDONLY | O_BINARY, 0640);
+    if (fd < 0) { return false; }
+    for (std::size_t done = 0; done < volume_size; done += block.size()) {
+      if (dev_->d_read(fd, block.data(), block.size())
+          != static_cast<ssize_t>(block.size())) {
+        return false;
+      }
+    }
+    return dev_->d_close(fd) == 0;
+  }
+
+ private:
+  JobControlRecord* jcr_;
+  Device* dev_;
+  const char* volname_ = "Bench-0001";
+};
+
+static void BM_ChunkedWrite(bm::State& state)
+{
+  ChunkedVolume volume(state);
+  std::vector<char> block(block_size, 'w');
+  for (auto _ : state) {
+    if (!volume.Write(block)) { state.SkipWithError("write failed"); }
+  }
+  state.SetBytesProcessed(state.iterations() * volume_size);
+}
+BENCHMARK(BM_ChunkedWrite)
+    ->ArgNames({"iothreads", "latency_ms"})
+    ->ArgsProduct({{0, 4}, {0, 20}})
+    ->Unit(bm::kMillisecond)
+    ->UseRealTime();
+
+static void BM_ChunkedRead(bm::State& state)
+{
+  ChunkedVolume volume(state);
+  std::vector<char> block(block_size, 'r');
+  if (!volume.Write(block)) { state.SkipWithError("write failed"); }
+  for (auto _ : state) {
+    if (!volume.Read(block)) { state.SkipWithError("read failed"); }
+  }
+  state.SetBytesProcessed(state.iterations() * volume_size);
+}
+BENCHMARK(BM_ChunkedRead)
+    ->ArgNames({"iothreads", "latency_ms"})
+    ->ArgsProduct({{0, 4}, {0, 20}})
+    ->Unit(bm::kMillisecond)
+    ->UseRealTime();
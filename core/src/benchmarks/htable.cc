@@ -0,0 +1,124 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include <benchmark/benchmark.h>
+#include "include/bareos.h"
+#include "lib/htable.h"
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace bm = benchmark;
+
+struct PathItem {
+  char* key;
+  hlink link;
+};
+
+struct IdItem {
+  uint64_t key;
+  hlink link;
+};
+
+// Paths shaped like the ones accurate mode and the restore tree hash.
+static std::vector<std::string> MakePaths(std::size_t count, const char* tag)
+{
+  std::vector<std::string> paths;
+  paths.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    paths.push_back("/home/user" + std::to_string(i % 97) + "/dir"
+                    + std::to_string(i / 1000) + "/" + tag + "file"
+                    + std::to_string(i));
+  }
+  return paths;
+}
+
+static void BM_InsertPaths(bm::State& state)
+{
+  auto paths = MakePaths(state.range(0), "");
+  for (auto _ : state) {
+    htable<char*, PathItem> table;
+    for (auto& path : paths) {
+      PathItem* item = (PathItem*)table.hash_malloc(sizeof(PathItem));
+      item->key = const_cast<char*>(path.c_str());
+      table.insert(item->key, item);
+    }
+    bm::DoNotOptimize(table.size());
+  }
+  state.SetItemsProcessed(state.iterations() * paths.size());
+}
+BENCHMARK(BM_InsertPaths)->Range(1 << 10, 1 << 20);
+
+static void BM_LookupPaths(bm::State& state)
+{
+  auto paths = MakePaths(state.range(0), "");
+  auto missing = MakePaths(state.range(0), "missing");
+  htable<char*, PathItem> table;
+  for (auto& path : paths) {
+    PathItem* item = (PathItem*)table.hash_malloc(sizeof(PathItem));
+    item->key = const_cast<char*>(path.c_str());
+    table.insert(item->key, item);
+  }
+
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+      bm::DoNotOptimize(table.lookup(const_cast<char*>(paths[i].c_str())));
+      bm::DoNotOptimize(table.lookup(const_cast<char*>(missing[i].c_str())));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * paths.size() * 2);
+}
+BENCHMARK(BM_LookupPaths)->Range(1 << 10, 1 << 20);
+
+static void BM_InsertLookupIds(bm::State& state)
+{
+  const uint64_t count = state.range(0);
+  for (auto _ : state) {
+    htable<uint64_t, IdItem> table;
+    for (uint64_t i = 0; i < count; ++i) {
+      IdItem* item = (IdItem*)table.hash_malloc(sizeof(IdItem));
+      item->key = i * 4096;
+      table.insert(item->key, item);
+    }
+    for (uint64_t i = 0; i < count; ++i) {
+      bm::DoNotOptimize(table.lookup(i * 4096));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * count * 2);
+}
+BENCHMARK(BM_InsertLookupIds)->Range(1 << 10, 1 << 20);
+
+// Baseline for the numbers above.
+static void BM_UnorderedMapPaths(bm::State& state)
+{
+  auto paths = MakePaths(state.range(0), "");
+  for (auto _ : state) {
+    std::unordered_map<std::string_view, std::size_t> table;
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+      table.emplace(paths[i], i);
+    }
+    for (auto& path : paths) { bm::DoNotOptimize(table.find(path)); }
+  }
+  state.SetItemsProcessed(state.iterations() * paths.size() * 2);
+}
+BENCHMARK(BM_UnorderedMapPaths)->Range(1 << 10, 1 << 20);
@@ -0,0 +1,138 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+/*
+ * Encoding throughput of the rows of the batch file table: the text COPY
+ * format as formerly used, one PQputCopyData() per row, and the binary
+ * format with many rows per call.  The data is not sent anywhere, every
+ * would-be PQputCopyData() call just copies into a sink buffer.
+ */
+
+#include <benchmark/benchmark.h>
+#include "include/bareos.h"
+#include "cats/postgresql_binary_copy.h"
+#include "lib/edit.h"
+
+#include <string>
+#include <vector>
+
+namespace bm = benchmark;
+
+struct Row {
+  uint32_t file_index;
+  uint32_t job_id;
+  std::string path;
+  std::string name;
+  std::string lstat;
+  std::string digest;
+  uint32_t delta_seq;
+  uint64_t fhinfo;
+  uint64_t fhnode;
+};
+
+static std::vector<Row> MakeRows(std::size_t count)
+{
+  std::vector<Row> rows;
+  rows.reserve(count);
+  for (std::size_t i = 0; i < count; i++) {
+    rows.push_back(Row{
+        static_cast<uint32_t>(i + 1), 4711,
+        "/srv/data/project-" + std::to_string(i / 100) + "/src/module/",
+        "file_" + std::to_string(i) + ((i % 10) ? ".cc" : "\twith tab.cc"),
+        "P0A CCAB IGk B A A A gAA BAA Y BmPU7N BmPU7N BmPU7N A A C",
+        "9eKdMxs4XFVC0zfkbN3Fyg", 0, i * 131ULL, i * 7ULL});
+  }
+  return rows;
+}
+
+static void CountRows(bm::State& state, const std::string& sink)
+{
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.counters["bytes_per_row"]
+      = static_cast<double>(sink.size()) / state.range(0);
+}
+
+static void BM_TextCopyRows(bm::State& state)
+{
+  std::vector<Row> rows = MakeRows(state.range(0));
+  POOLMEM* cmd = GetPoolMemory(PM_MESSAGE);
+  POOLMEM* esc_name = GetPoolMemory(PM_FNAME);
+  POOLMEM* esc_path = GetPoolMemory(PM_FNAME);
+  std::string sink;
+  char ed1[50], ed2[50], ed3[50];
+
+  for (auto _ : state) {
+    sink.clear();
+    for (const Row& row : rows) {
+      esc_name = CheckPoolMemorySize(esc_name, row.name.size() * 2 + 1);
+      PgCopyEscape(esc_name, row.name.c_str(), row.name.size());
+      esc_path = CheckPoolMemorySize(esc_path, row.path.size() * 2 + 1);
+      PgCopyEscape(esc_path, row.path.c_str(), row.path.size());
+      int len = Mmsg(cmd, "%u\t%s\t%s\t%s\t%s\t%s\t%u\t%s\t%s\n",
+                     row.file_index, edit_int64(row.job_id, ed1), esc_path,
+                     esc_name, row.lstat.c_str(), row.digest.c_str(),
+                     row.delta_seq, edit_uint64(row.fhinfo, ed2),
+                     edit_uint64(row.fhnode, ed3));
+      sink.append(cmd, len);
+    }
+    bm::DoNotOptimize(sink.data());
+  }
+  CountRows(state, sink);
+
+  FreePoolMemory(esc_path);
+  FreePoolMemory(esc_name);
+  FreePoolMemory(cmd);
+}
+BENCHMARK(BM_TextCopyRows)->Range(1 << 10, 1 << 16);
+
+static void BM_BinaryCopyRows(bm::State& state)
+{
+  std::vector<Row> rows = MakeRows(state.range(0));
+  PgBinaryCopyBuffer buffer;
+  std::string sink;
+
+  for (auto _ : state) {
+    sink.clear();
+    buffer.Start();
+    for (const Row& row : rows) {
+      buffer.StartRow(9);
+      buffer.AddInt32(row.file_index);
+      buffer.AddInt32(row.job_id);
+      buffer.AddText(row.path.data(), row.path.size());
+      buffer.AddText(row.name.data(), row.name.size());
+      buffer.AddText(row.lstat.data(), row.lstat.size());
+      buffer.AddText(row.digest.data(), row.digest.size());
+      buffer.AddInt16(row.delta_seq);
+      buffer.AddNumeric(row.fhinfo);
+      buffer.AddNumeric(row.fhnode);
+      if (buffer.NeedsFlush()) {
+        sink.append(buffer.data(), buffer.size());
+        buffer.clear();
+      }
+    }
+    buffer.Finish();
+    sink.append(buffer.data(), buffer.size());
+    buffer.clear();
+    bm::DoNotOptimize(sink.data());
+  }
+  CountRows(state, sink);
+}
+BENCHMARK(BM_BinaryCopyRows)->Range(1 << 10, 1 << 16);
@@ -31,6 +31,8 @@
 #include "dird/ua.h"
 #include "dird/ua_restore.cc"
 
+#include <sys/resource.h>
+
 using namespace directordaemon;
 
 UaContext ua;
@@ -56,7 +58,9 @@ void InitContexts(UaContext* t_ua, TreeContext* t_tree)
   t_ua->automount = true;
   t_ua->send = new OutputFormatter(sprintit, t_ua, filterit, t_ua);
 
+  if (t_tree->root) { FreeTree(t_tree->root); }
   t_tree->root = new_tree(1);
+  t_tree->cnt = 0;
   t_tree->ua = t_ua;
   t_tree->all = false;
   t_tree->FileEstimate = 100;
@@ -121,6 +125,16 @@ void PopulateTree(int quantity, TreeContext* t_tree)
 static void BM_populatetree(benchmark::State& state)
 {
   for (auto _ : state) { PopulateTree(state.range(0), &tree); }
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  state.counters["files"] = tree.cnt;
+  state.counters["tree_bytes"] = benchmark::Counter(
+      tree.root->total_size, benchmark::Counter::kDefaults,
+      benchmark::Counter::OneK::kIs1024);
+  state.counters["max_rss_bytes"] = benchmark::Counter(
+      usage.ru_maxrss * 1024.0, benchmark::Counter::kDefaults,
+      benchmark::Counter::OneK::kIs1024);
 }
 
 static void BM_markallfiles(benchmark::State& state)
@@ -155,7 +169,16 @@ BENCHMARK(BM_markallfiles)
 /*
  * Over ten million files requires quiet a bit a ram, so if you are going to
  * use the higher numbers, make sure you have enough ressources, otherwise the
- * benchmark will crash
+ * benchmark will crash. A hundred million files need about 12 GB.
  */
 
+BENCHMARK(BM_populatetree)
+    ->Arg(HIGH_FILE_NUMBERS::hundred_million)
+    ->Unit(benchmark::kSecond)
+    ->Iterations(1);
+BENCHMARK(BM_markallfiles)
+    ->Arg(HIGH_FILE_NUMBERS::hundred_million)
+    ->Unit(benchmark::kSecond)
+    ->Iterations(1);
+
 BENCHMARK_MAIN();
@@ -129,11 +129,12 @@ bail_out:
  */
 bool BareosDb::UpdatePathHierarchyCache(JobControlRecord* jcr,
                                         pathid_cache& ppathid_cache,
-                                        JobId_t JobId)
+                                        JobId_t JobId,
+                                        const BvfsProgressHandler& progress)
 {
   Dmsg0(dbglevel, "UpdatePathHierarchyCache()\n");
   bool retval = false;
-  uint32_t num;
+  uint32_t num, total;
   char jobid[50];
   edit_uint64(JobId, jobid);
 
@@ -208,6 +209,8 @@ bool BareosDb::UpdatePathHierarchyCache(JobControlRecord* jcr,
    * catalog descriptor again.
    */
   num = SqlNumRows();
+  total = num;
+  if (progress) { progress(JobId, 0, total); }
   if (num > 0) {
     char** result = (char**)malloc(num * 2 * sizeof(char*));
 
@@ -232,6 +235,9 @@ bool BareosDb::UpdatePathHierarchyCache(JobControlRecord* jcr,
       free(result[i++]);
       free(result[i++]);
       num--;
+      if (progress && (total - num) % 1000 == 0) {
+        progress(JobId, total - num, total);
+      }
     }
     free(result);
 
@@ -249,6 +255,7 @@ bool BareosDb::UpdatePathHierarchyCache(JobControlRecord* jcr,
 
   Mmsg(cmd, "UPDATE Job SET HasCache=1 WHERE JobId=%s", jobid);
   UPDATE_DB(jcr, cmd);
+  if (progress) { progress(JobId, total, total); }
 
 bail_out:
   EndTransaction(jcr);
@@ -284,8 +291,10 @@ void BareosDb::BvfsUpdateCache(JobControlRecord* jcr)
 }
 
 // Update the bvfs cache for given jobids (1,2,3,4)
-bool BareosDb::BvfsUpdatePathHierarchyCache(JobControlRecord* jcr,
-                                            const char* jobids)
+bool BareosDb::BvfsUpdatePathHierarchyCache(
+    JobControlRecord* jcr,
+    const char* jobids,
+    const BvfsProgressHandler& progress)
 {
   const char* p;
   int status;
@@ -304,7 +313,7 @@ bool BareosDb::BvfsUpdatePathHierarchyCache(JobControlRecord* jcr,
     }
 
     Dmsg1(dbglevel, "Updating cache for %lld\n", (uint64_t)JobId);
-    if (!UpdatePathHierarchyCache(jcr, ppathid_cache, JobId)) {
+    if (!UpdatePathHierarchyCache(jcr, ppathid_cache, JobId, progress)) {
       retval = false;
     }
   }
@@ -42,6 +42,8 @@
 #include "lib/crypto.h"
 #include "lib/base64.h"
 
+#include <atomic>
+#include <functional>
 #include <string>
 #include <stdexcept>
 #include <system_error>
@@ -462,6 +464,11 @@ typedef enum
 typedef void(DB_LIST_HANDLER)(void*, const char*);
 typedef int(DB_RESULT_HANDLER)(void*, int, char**);
 
+/* Called while the bvfs cache of a job is computed with the number of
+ * directories already processed and the total number of new directories. */
+using BvfsProgressHandler
+    = std::function<void(JobId_t JobId, uint32_t done, uint32_t total)>;
+
 class pathid_cache;
 
 // Initial size of query hash table and hint for number of pages.
@@ -491,7 +498,7 @@ class BareosDb : public BareosDbQueryEnum {
   SQL_INTERFACETYPE db_interface_type_
       = SQL_INTERFACE_TYPE_UNKNOWN;       /**< Type of backend used */
   SQL_DBTYPE db_type_ = SQL_TYPE_UNKNOWN; /**< Database type */
-  uint32_t ref_count_ = 0;                /**< Reference count */
+  std::atomic<uint32_t> ref_count_{0};    /**< Reference count */
   bool connected_ = false;                /**< Connection made to db */
   bool have_batch_insert_ = false;        /**< Have batch insert support ? */
   bool try_reconnect_ = true;    /**< Try reconnecting DB connection ? */
@@ -508,6 +515,8 @@ class BareosDb : public BareosDbQueryEnum {
   int db_port_ = 0;        /**< Port for host name address */
   int cached_path_len = 0; /**< Length of cached path */
   int changes = 0;         /**< Changes during transaction */
+  uint32_t fetch_size_
+      = kDefaultFetchSize; /**< Rows per round trip of BigSqlQuery() */
   int fnl = 0;             /**< File name length */
   int pnl = 0;             /**< Path name length */
   bool disabled_batch_insert_
@@ -543,7 +552,8 @@ class BareosDb : public BareosDbQueryEnum {
                           char* path);
   bool UpdatePathHierarchyCache(JobControlRecord* jcr,
                                 pathid_cache& ppathid_cache,
-                                JobId_t JobId);
+                                JobId_t JobId,
+                                const BvfsProgressHandler& progress);
   void FillQueryVaList(POOLMEM*& query,
                        BareosDb::SQL_QUERY predefined_query,
                        va_list arg_ptr);
@@ -560,6 +570,7 @@ class BareosDb : public BareosDbQueryEnum {
   bool BatchInsertAvailable(void) { return have_batch_insert_; }
   bool IsPrivate(void) { return is_private_; }
   void IncrementRefcount(void) { ref_count_++; }
+  uint32_t GetRefcount(void) { return ref_count_; }
 
   int SqlNumRows(void)
   {
@@ -568,7 +579,9 @@ class BareosDb : public BareosDbQueryEnum {
   }
 
   /* bvfs.c */
-  bool BvfsUpdatePathHierarchyCache(JobControlRecord* jcr, const char* jobids);
+  bool BvfsUpdatePathHierarchyCache(JobControlRecord* jcr,
+                                    const char* jobids,
+                                    const BvfsProgressHandler& progress = {});
   void BvfsUpdateCache(JobControlRecord* jcr);
   int BvfsLsDirs(PoolMem& query, void* ctx);
   int BvfsBuildLsFileQuery(PoolMem& query,
@@ -908,6 +921,11 @@ class BareosDb : public BareosDbQueryEnum {
                              FileId_t FileId,
                              char* digest,
                              int type);
+  bool AddDigestToFileRecord(JobControlRecord* jcr,
+                             JobId_t JobId,
+                             int32_t FileIndex,
+                             char* digest,
+                             int type);
   bool MarkFileRecord(JobControlRecord* jcr, FileId_t FileId, JobId_t JobId);
   void MakeInchangerUnique(JobControlRecord* jcr, MediaDbRecord* mr);
   int UpdateStats(JobControlRecord* jcr, utime_t age);
@@ -955,6 +973,15 @@ class BareosDb : public BareosDbQueryEnum {
   virtual void StartTransaction(JobControlRecord* jcr) = 0;
   virtual void EndTransaction(JobControlRecord* jcr) = 0;
 
+  static constexpr uint32_t kDefaultFetchSize = 10000;
+  void SetFetchSize(uint32_t rows) { fetch_size_ = rows > 0 ? rows : 1; }
+  uint32_t GetFetchSize() const { return fetch_size_; }
+
+  /* Discards everything a user left behind on the connection, so the pool
+   * can hand it to the next user like a freshly opened one.  Returns false
+   * if the connection can not be reused. */
+  virtual bool ResetConnection(JobControlRecord* jcr);
+
   /* By default, we use db_sql_query */
   virtual bool BigSqlQuery(const char* query,
                            DB_RESULT_HANDLER* ResultHandler,
@@ -1037,36 +1064,22 @@ class DbLocker {
   DbLocker(DbLocker&& other) = delete;
 };
 
-// Pooled backend connection.
-struct SqlPoolEntry {
-  int id = 0; /**< Unique ID, connection numbering can have holes and the pool
-             is not sorted on it */
-  int reference_count = 0; /**< Reference count for this entry */
-  time_t last_update = 0;  /**< When was this connection last updated either
-                          used  or put back on the pool */
-  BareosDb* db_handle = nullptr; /**< Connection handle to the database */
-  dlink<SqlPoolEntry> link;      /**< list management */
-};
+// Changes the fetch size of a connection until the end of the scope.
+class DbFetchSizeScope {
+  BareosDb* db_handle_;
+  uint32_t old_fetch_size_;
+
+ public:
+  DbFetchSizeScope(BareosDb* db_handle, uint32_t rows)
+      : db_handle_(db_handle), old_fetch_size_(db_handle->GetFetchSize())
+  {
+    db_handle_->SetFetchSize(rows);
+  }
+  ~DbFetchSizeScope() { db_handle_->SetFetchSize(old_fetch_size_); }
 
-// Pooled backend list descriptor (one defined per backend defined in config)
-struct SqlPoolDescriptor {
-  bool active = false;    /**< Is this an active pool, after a config reload an
-                      pool is    made inactive */
-  time_t last_update = 0; /**< When was this pool last updated */
-  int min_connections
-      = 0; /**< Minimum number of connections in the connection pool
-            */
-  int max_connections
-      = 0; /**< Maximum number of connections in the connection pool
-            */
-  int increment_connections = 0; /**< Increase/Decrease the number of
-                                connection in the pool with this value */
-  int idle_timeout = 0;     /**< Number of seconds to wait before tearing down a
-                           connection */
-  int validate_timeout = 0; /**< Number of seconds after which an idle
-                           connection should be validated */
-  int nr_connections = 0;   /**< Number of active connections in the pool */
-  dlink<SqlPoolDescriptor> link; /**< list management */
+  DbFetchSizeScope(const DbFetchSizeScope& other) = delete;
+  DbFetchSizeScope& operator=(const DbFetchSizeScope&) = delete;
+  DbFetchSizeScope(DbFetchSizeScope&& other) = delete;
 };
 
 #include "include/jcr.h"
@@ -263,8 +263,7 @@ void BareosDbPostgresql::CloseDatabase(JobControlRecord* jcr)
 {
   if (connected_) { EndTransaction(jcr); }
   lock_mutex(mutex);
-  ref_count_--;
-  if (ref_count_ == 0) {
+  if (--ref_count_ == 0) {
     if (connected_) { SqlFreeResult(); }
     db_list->remove(this);
     if (db_handle_) { PQfinish(db_handle_); }
@@ -293,6 +292,29 @@ void BareosDbPostgresql::CloseDatabase(JobControlRecord* jcr)
   unlock_mutex(mutex);
 }
 
+/**
+ * Commit what the last user left open and drop its session state: open
+ * cursors, prepared statements and temporary tables like the batch table
+ * of an unfinished batch insert.  The session settings made when the
+ * connection was opened are kept.
+ */
+bool BareosDbPostgresql::ResetConnection(JobControlRecord* jcr)
+{
+  if (!connected_) { return false; }
+  EndTransaction(jcr);
+
+  DbLocker _{this};
+  SqlFreeResult();
+  copy_buffer_.clear();
+  bool reusable = SqlQueryWithoutHandler("CLOSE ALL")
+                  && SqlQueryWithoutHandler("DEALLOCATE ALL")
+                  && SqlQueryWithoutHandler("DISCARD TEMP")
+                  && PQtransactionStatus(db_handle_) == PQTRANS_IDLE;
+  SqlFreeResult();
+
+  return BareosDb::ResetConnection(jcr) && reusable;
+}
+
 /**
  * Escape strings so that PostgreSQL is happy
  *
@@ -458,6 +480,7 @@ bool BareosDbPostgresql::BigSqlQuery(const char* query,
 {
   SQL_ROW row;
   bool retval = false;
+  bool stop = false;
   bool in_transaction = transaction_;
 
   Dmsg1(500, "BigSqlQuery starts with '%s'\n", query);
@@ -485,18 +508,22 @@ bool BareosDbPostgresql::BigSqlQuery(const char* query,
     goto bail_out;
   }
 
+  /* Every round trip fetches fetch_size_ rows, so the result handler does
+   * not wait for the server all the time. */
+  Mmsg(buf_, "FETCH %u FROM _bac_cursor", fetch_size_);
   do {
-    if (!SqlQueryWithoutHandler("FETCH 100 FROM _bac_cursor")) {
-      goto bail_out;
-    }
+    if (!SqlQueryWithoutHandler(buf_)) { goto bail_out; }
+    Dmsg1(500, "Fetching %d rows\n", num_rows_);
     while ((row = SqlFetchRow()) != NULL) {
-      Dmsg1(500, "Fetching %d rows\n", num_rows_);
-      if (ResultHandler(ctx, num_fields_, row)) break;
+      if (ResultHandler(ctx, num_fields_, row)) {
+        stop = true;
+        break;
+      }
     }
     PQclear(result_);
     result_ = NULL;
 
-  } while (num_rows_ > 0);
+  } while (num_rows_ > 0 && !stop);
 
   SqlQueryWithoutHandler("CLOSE _bac_cursor");
 
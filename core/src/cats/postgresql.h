@@ -30,6 +30,7 @@
 
 #  include "cats/column_data.h"
 #  include "cats.h"
+#  include "cats/postgresql_binary_copy.h"
 #  include "libpq-fe.h"
 
 #  include <string>
@@ -78,6 +79,7 @@ class BareosDbPostgresql : public BareosDb {
                       int32_t* len) override;
   void StartTransaction(JobControlRecord* jcr) override;
   void EndTransaction(JobControlRecord* jcr) override;
+  bool ResetConnection(JobControlRecord* jcr) override;
   bool BigSqlQuery(const char* query,
                    DB_RESULT_HANDLER* ResultHandler,
                    void* ctx) override;
@@ -100,6 +102,7 @@ class BareosDbPostgresql : public BareosDb {
   bool SqlBatchEndFileTable(JobControlRecord* jcr, const char* error) override;
   bool SqlBatchInsertFileTable(JobControlRecord* jcr,
                                AttributesDbRecord* ar) override;
+  bool SqlBatchFlushCopyData();
   bool SqlCopyStart(const std::string& table_name,
                     const std::vector<std::string>& column_names) override;
   bool SqlCopyInsert(const std::vector<DatabaseField>& data_fields) override;
@@ -123,6 +126,8 @@ class BareosDbPostgresql : public BareosDb {
   PGconn* db_handle_;
   PGresult* result_;
   POOLMEM* buf_; /**< Buffer to manipulate queries */
+  PgBinaryCopyBuffer copy_buffer_; /**< Batch rows not yet sent */
+  bool copy_failed_ = false;       /**< A batch row could not be added */
   static const char*
       query_definitions[]; /**< table of predefined sql queries */
 };
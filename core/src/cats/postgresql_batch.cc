@@ -3,7 +3,7 @@
 
    Copyright (C) 2003-2011 Free Software Foundation Europe e.V.
    Copyright (C) 2011-2016 Planets Communications B.V.
-   Copyright (C) 2013-2023 Bareos GmbH & Co. KG
+   Copyright (C) 2013-2024 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -30,13 +30,14 @@
 #  include "postgres_ext.h"     /* needed for NAMEDATALEN */
 #  include "pg_config_manual.h" /* get NAMEDATALEN on version 8.3 or later */
 #  include "postgresql.h"
+#  include "postgresql_binary_copy.h"
 #  include "lib/edit.h"
 #  include "lib/berrno.h"
 #  include "lib/dlist.h"
 
 bool BareosDbPostgresql::SqlBatchStartFileTable(JobControlRecord*)
 {
-  const char* query = "COPY batch FROM STDIN";
+  const char* query = "COPY batch FROM STDIN WITH (FORMAT binary)";
 
   Dmsg0(500, "SqlBatchStartFileTable started\n");
 
@@ -76,6 +77,9 @@ bool BareosDbPostgresql::SqlBatchStartFileTable(JobControlRecord*)
     num_fields_ = (int)PQnfields(result_);
     num_rows_ = 0;
     status_ = 1;
+    copy_buffer_.clear();
+    copy_buffer_.Start();
+    copy_failed_ = false;
   } else {
     Dmsg1(50, "Result status failed: %s\n", query);
     goto bail_out;
@@ -94,6 +98,32 @@ bail_out:
   return false;
 }
 
+// Hand the rows collected in copy_buffer_ to libpq.
+bool BareosDbPostgresql::SqlBatchFlushCopyData()
+{
+  int res;
+  int count = 30;
+
+  if (copy_buffer_.empty()) { return true; }
+
+  do {
+    res = PQputCopyData(db_handle_, copy_buffer_.data(), copy_buffer_.size());
+  } while (res == 0 && --count > 0);
+
+  copy_buffer_.clear();
+
+  if (res <= 0) {
+    Dmsg0(500, "we failed\n");
+    status_ = 0;
+    Mmsg1(errmsg, T_("error copying in batch mode: %s"),
+          PQerrorMessage(db_handle_));
+    Dmsg1(500, "failure %s\n", errmsg);
+    return false;
+  }
+
+  return true;
+}
+
 // Set error to something to abort operation
 bool BareosDbPostgresql::SqlBatchEndFileTable(JobControlRecord*,
                                               const char* error)
@@ -104,6 +134,16 @@ bool BareosDbPostgresql::SqlBatchEndFileTable(JobControlRecord*,
 
   Dmsg0(500, "SqlBatchEndFileTable started\n");
 
+  if (!error && copy_failed_) {
+    error = T_("batch row out of range");
+  } else if (!error) {
+    copy_buffer_.Finish();
+    if (!SqlBatchFlushCopyData()) {
+      error = T_("error copying in batch mode");
+    }
+  }
+  copy_buffer_.clear();
+
   do {
     res = PQputCopyEnd(db_handle_, error);
   } while (res == 0 && --count > 0);
@@ -129,85 +169,25 @@ bool BareosDbPostgresql::SqlBatchEndFileTable(JobControlRecord*,
   }
 
   PQclear(pg_result);
+  copy_failed_ = false;
 
   Dmsg0(500, "SqlBatchEndFileTable finishing\n");
 
-  return true;
+  return status_ == 1;
 }
 
-/**
- * Escape strings so that PostgreSQL is happy on COPY
- *
- *   NOTE! len is the length of the old string. Your new
- *         string must be long enough (max 2*old+1) to hold
- *         the escaped output.
+/*
+ * The rows are sent in the binary COPY format, which needs no escaping, and
+ * are collected in copy_buffer_ so that many of them go out with one call
+ * of PQputCopyData().  The values stored are the same as with the text
+ * format, e.g. an empty digest is stored as "0".  A number that does not
+ * fit into its column fails the whole batch, like the server does for the
+ * text format.
  */
-static char* pgsql_copy_escape(char* dest, const char* src, size_t len)
-{
-  char c = '\0';
-
-  while (len > 0 && *src) {
-    switch (*src) {
-      case '\b':
-        c = 'b';
-        break;
-      case '\f':
-        c = 'f';
-        break;
-      case '\n':
-        c = 'n';
-        break;
-      case '\\':
-        c = '\\';
-        break;
-      case '\t':
-        c = 't';
-        break;
-      case '\r':
-        c = 'r';
-        break;
-      case '\v':
-        c = 'v';
-        break;
-      case '\'':
-        c = '\'';
-        break;
-      default:
-        c = '\0';
-        break;
-    }
-
-    if (c) {
-      *dest = '\\';
-      dest++;
-      *dest = c;
-    } else {
-      *dest = *src;
-    }
-
-    len--;
-    src++;
-    dest++;
-  }
-
-  *dest = '\0';
-  return dest;
-}
-
 bool BareosDbPostgresql::SqlBatchInsertFileTable(JobControlRecord*,
                                                  AttributesDbRecord* ar)
 {
-  int res;
-  int count = 30;
-  size_t len;
   const char* digest;
-  char ed1[50], ed2[50], ed3[50];
-
-  esc_name = CheckPoolMemorySize(esc_name, fnl * 2 + 1);
-  pgsql_copy_escape(esc_name, fname, fnl);
-
-  esc_path = CheckPoolMemorySize(esc_path, pnl * 2 + 1);
-  pgsql_copy_escape(esc_path, path, pnl);
 
   if (ar->Digest == NULL || ar->Digest[0] == 0) {
     digest = "0";
@@ -215,29 +195,36 @@ bool BareosDbPostgresql::SqlBatchInsertFileTable(JobControlRecord*,
     digest = ar->Digest;
   }
 
-  len = Mmsg(cmd, "%u\t%s\t%s\t%s\t%s\t%s\t%u\t%s\t%s\n", ar->FileIndex,
-             edit_int64(ar->JobId, ed1), esc_path, esc_name, ar->attr, digest,
-             ar->DeltaSeq, edit_uint64(ar->Fhinfo, ed2),
-             edit_uint64(ar->Fhnode, ed3));
-
-  do {
-    res = PQputCopyData(db_handle_, cmd, len);
-  } while (res == 0 && --count > 0);
+  if (copy_failed_) { return false; }
+
+  PgBatchFileRow row;
+  row.FileIndex = ar->FileIndex;
+  row.JobId = ar->JobId;
+  row.Path = std::string_view(path, pnl);
+  row.Name = std::string_view(fname, fnl);
+  row.LStat = ar->attr;
+  row.Md5 = digest;
+  row.DeltaSeq = ar->DeltaSeq;
+  row.Fhinfo = ar->Fhinfo;
+  row.Fhnode = ar->Fhnode;
+
+  if (!AddBatchFileRow(copy_buffer_, row)) {
+    Mmsg(errmsg,
+         T_("error copying in batch mode: FileIndex %u, JobId %u or DeltaSeq "
+            "%u of %s%s out of range\n"),
+         ar->FileIndex, ar->JobId, ar->DeltaSeq, path, fname);
+    Dmsg1(500, "failure %s\n", errmsg);
+    copy_failed_ = true;
+    status_ = 0;
+    return false;
+  }
+  changes++;
 
-  if (res == 1) {
+  if (copy_buffer_.NeedsFlush() && SqlBatchFlushCopyData()) {
     Dmsg0(500, "ok\n");
-    changes++;
     status_ = 1;
   }
 
-  if (res <= 0) {
-    Dmsg0(500, "we failed\n");
-    status_ = 0;
-    Mmsg1(errmsg, T_("error copying in batch mode: %s"),
-          PQerrorMessage(db_handle_));
-    Dmsg1(500, "failure %s\n", errmsg);
-  }
-
   Dmsg0(500, "SqlBatchInsertFileTable finishing\n");
 
   return true;
@@ -330,7 +317,7 @@ bool BareosDbPostgresql::SqlCopyInsert(
   for (const auto& field : data_fields) {
     if (strlen(field.data_pointer) != 0U) {
       buffer.resize(strlen(field.data_pointer) * 2 + 1);
-      pgsql_copy_escape(buffer.data(), field.data_pointer, buffer.size());
+      PgCopyEscape(buffer.data(), field.data_pointer, buffer.size());
       query += buffer.data();
     }
     query += "\t";
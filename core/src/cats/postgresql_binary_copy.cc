@@ -0,0 +1,208 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Encoding of the PostgreSQL COPY data formats
+ *
+ * The binary format is described in the PostgreSQL documentation of the
+ * COPY command.  It starts with an 11 byte signature, a flags field and
+ * the length of a header extension, followed by the rows and a field count
+ * of -1 as trailer.  Each row is a 16 bit field count and every field a
+ * 32 bit length followed by the data in the binary send format of its type.
+ */
+
+#include "cats/postgresql_binary_copy.h"
+
+#include <limits>
+
+namespace {
+constexpr char kSignature[] = "PGCOPY\n\377\r\n";  // with its '\0': 11 bytes
+
+// The numeric type stores its digits in base 10000.
+constexpr uint64_t kNumericBase = 10000;
+constexpr uint16_t kNumericPositive = 0x0000;
+
+template <typename T> bool Fits(int64_t value)
+{
+  return value >= std::numeric_limits<T>::min()
+         && value <= std::numeric_limits<T>::max();
+}
+}  // namespace
+
+void PgBinaryCopyBuffer::Put16(uint16_t value)
+{
+  char bytes[2] = {static_cast<char>(value >> 8), static_cast<char>(value)};
+  buffer_.append(bytes, sizeof(bytes));
+}
+
+void PgBinaryCopyBuffer::Put32(uint32_t value)
+{
+  char bytes[4] = {static_cast<char>(value >> 24),
+                   static_cast<char>(value >> 16),
+                   static_cast<char>(value >> 8), static_cast<char>(value)};
+  buffer_.append(bytes, sizeof(bytes));
+}
+
+void PgBinaryCopyBuffer::Start()
+{
+  buffer_.append(kSignature, sizeof(kSignature));
+  Put32(0); /* Flags */
+  Put32(0); /* Length of the header extension */
+}
+
+void PgBinaryCopyBuffer::Finish() { Put16(static_cast<uint16_t>(-1)); }
+
+void PgBinaryCopyBuffer::StartRow(int16_t fields)
+{
+  Put16(static_cast<uint16_t>(fields));
+}
+
+bool PgBinaryCopyBuffer::AddInt16(int64_t value)
+{
+  if (!Fits<int16_t>(value)) { return false; }
+  Put32(sizeof(int16_t));
+  Put16(static_cast<uint16_t>(value));
+  return true;
+}
+
+bool PgBinaryCopyBuffer::AddInt32(int64_t value)
+{
+  if (!Fits<int32_t>(value)) { return false; }
+  Put32(sizeof(int32_t));
+  Put32(static_cast<uint32_t>(value));
+  return true;
+}
+
+/*
+ * A numeric is sent as number of digits, weight of the first digit, sign and
+ * display scale, followed by the digits.  Like PostgreSQL itself we leave out
+ * the trailing zero digits, the weight tells where the digits belong.
+ */
+void PgBinaryCopyBuffer::AddNumeric(uint64_t value)
+{
+  uint16_t digits[5]; /* 2^64 has 20 decimal digits */
+  int count = 0;
+
+  for (; value > 0; value /= kNumericBase) {
+    digits[count++] = static_cast<uint16_t>(value % kNumericBase);
+  }
+
+  int16_t weight = count > 0 ? count - 1 : 0;
+  int skip = 0;
+  while (skip < count && digits[skip] == 0) { skip++; }
+
+  Put32(4 * sizeof(uint16_t) + (count - skip) * sizeof(uint16_t));
+  Put16(count - skip);
+  Put16(weight);
+  Put16(kNumericPositive);
+  Put16(0); /* Display scale */
+  for (int i = count - 1; i >= skip; i--) { Put16(digits[i]); }
+}
+
+void PgBinaryCopyBuffer::AddText(const char* value, std::size_t length)
+{
+  Put32(length);
+  buffer_.append(value, length);
+}
+
+/*
+ * The text format sends the numbers as they are and lets the server reject
+ * the ones that do not fit into the column, so we check them up front
+ * instead of sending a truncated value.
+ */
+bool AddBatchFileRow(PgBinaryCopyBuffer& buffer, const PgBatchFileRow& row)
+{
+  if (!Fits<int32_t>(row.FileIndex) || !Fits<int32_t>(row.JobId)
+      || !Fits<int16_t>(row.DeltaSeq)) {
+    return false;
+  }
+
+  buffer.StartRow(9);
+  buffer.AddInt32(row.FileIndex);
+  buffer.AddInt32(row.JobId);
+  buffer.AddText(row.Path.data(), row.Path.size());
+  buffer.AddText(row.Name.data(), row.Name.size());
+  buffer.AddText(row.LStat.data(), row.LStat.size());
+  buffer.AddText(row.Md5.data(), row.Md5.size());
+  buffer.AddInt16(row.DeltaSeq);
+  buffer.AddNumeric(row.Fhinfo);
+  buffer.AddNumeric(row.Fhnode);
+  return true;
+}
+
+/*
+ * Escape strings so that PostgreSQL is happy on COPY in text format
+ *
+ *   NOTE! len is the length of the old string. Your new
+ *         string must be long enough (max 2*old+1) to hold
+ *         the escaped output.
+ */
+char* PgCopyEscape(char* dest, const char* src, std::size_t len)
+{
+  char c = '\0';
+
+  while (len > 0 && *src) {
+    switch (*src) {
+      case '\b':
+        c = 'b';
+        break;
+      case '\f':
+        c = 'f';
+        break;
+      case '\n':
+        c = 'n';
+        break;
+      case '\\':
+        c = '\\';
+        break;
+      case '\t':
+        c = 't';
+        break;
+      case '\r':
+        c = 'r';
+        break;
+      case '\v':
+        c = 'v';
+        break;
+      case '\'':
+        c = '\'';
+        break;
+      default:
+        c = '\0';
+        break;
+    }
+
+    if (c) {
+      *dest = '\\';
+      dest++;
+      *dest = c;
+    } else {
+      *dest = *src;
+    }
+
+    len--;
+    src++;
+    dest++;
+  }
+
+  *dest = '\0';
+  return dest;
+}
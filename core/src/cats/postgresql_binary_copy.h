@@ -0,0 +1,87 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#ifndef BAREOS_CATS_POSTGRESQL_BINARY_COPY_H_
+#define BAREOS_CATS_POSTGRESQL_BINARY_COPY_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/*
+ * Buffer for the data of a "COPY ... FROM STDIN WITH (FORMAT binary)".
+ *
+ * Every field is sent with its length in front of it, so strings are copied
+ * as they are instead of being escaped, and numbers are sent in network byte
+ * order instead of being formatted.  Many rows are collected before they are
+ * handed to PQputCopyData() in one call.
+ */
+class PgBinaryCopyBuffer {
+ public:
+  // Buffer size at which the collected rows should be sent.
+  static constexpr std::size_t kFlushSize = 64 * 1024;
+
+  // Header and trailer of the whole copy data.
+  void Start();
+  void Finish();
+
+  // A row is started with its number of fields, followed by the fields.
+  void StartRow(int16_t fields);
+  // Return false and add nothing if the value does not fit the column type.
+  bool AddInt16(int64_t value);
+  bool AddInt32(int64_t value);
+  void AddNumeric(uint64_t value);
+  void AddText(const char* value, std::size_t length);
+
+  bool NeedsFlush() const { return buffer_.size() >= kFlushSize; }
+  const char* data() const { return buffer_.data(); }
+  std::size_t size() const { return buffer_.size(); }
+  bool empty() const { return buffer_.empty(); }
+  void clear() { buffer_.clear(); }
+
+ private:
+  void Put16(uint16_t value);
+  void Put32(uint32_t value);
+
+  std::string buffer_;
+};
+
+// One row of the batch table, see BareosDbPostgresql::SqlBatchStartFileTable.
+struct PgBatchFileRow {
+  uint32_t FileIndex = 0;
+  uint32_t JobId = 0;
+  std::string_view Path;
+  std::string_view Name;
+  std::string_view LStat;
+  std::string_view Md5;
+  uint32_t DeltaSeq = 0;
+  uint64_t Fhinfo = 0;
+  uint64_t Fhnode = 0;
+};
+
+/* Add a row of the batch table.  Returns false and adds nothing if one of
+ * the numbers is out of the range of its column. */
+bool AddBatchFileRow(PgBinaryCopyBuffer& buffer, const PgBatchFileRow& row);
+
+// Escape a string for the text format of COPY, see postgresql_binary_copy.cc
+char* PgCopyEscape(char* dest, const char* src, std::size_t len);
+
+#endif  // BAREOS_CATS_POSTGRESQL_BINARY_COPY_H_
@@ -865,6 +865,23 @@ bool BareosDb::OpenBatchConnection(JobControlRecord* jcr)
   return true;
 }
 
+bool BareosDb::ResetConnection(JobControlRecord*)
+{
+  cached_path_id = 0;
+  cached_path_len = 0;
+  *cached_path = 0;
+  changes = 0;
+  fnl = 0;
+  pnl = 0;
+  num_rows_ = 0;
+  *errmsg = 0;
+  last_hash_key_ = 0;
+  last_query_text_ = nullptr;
+  fetch_size_ = kDefaultFetchSize;
+
+  return true;
+}
+
 void BareosDb::DbDebugPrint(FILE* fp)
 {
   fprintf(fp, "BareosDb=%p db_name=%s db_user=%s connected=%s\n", this,
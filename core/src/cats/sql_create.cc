@@ -787,7 +787,7 @@ bool BareosDb::WriteBatchFileRecords(JobControlRecord* jcr)
        jcr->db_batch->changes);
 
   if (!jcr->db_batch->SqlBatchEndFileTable(jcr, NULL)) {
-    Jmsg1(jcr, M_FATAL, 0, "Batch end %s\n", errmsg);
+    Jmsg1(jcr, M_FATAL, 0, "Batch end %s\n", jcr->db_batch->strerror());
     goto bail_out;
   }
 
@@ -873,7 +873,14 @@ bool BareosDb::CreateBatchFileAttributesRecord(JobControlRecord* jcr,
 
   jcr->db_batch->SplitPathAndFile(jcr, ar->fname);
 
-  return jcr->db_batch->SqlBatchInsertFileTable(jcr, ar);
+  if (!jcr->db_batch->SqlBatchInsertFileTable(jcr, ar)) {
+    if (jcr->db_batch != this) {
+      Mmsg1(errmsg, "%s", jcr->db_batch->strerror());
+    }
+    return false;
+  }
+
+  return true;
 }
 
 /**
@@ -3,7 +3,7 @@
 
    Copyright (C) 2010-2012 Free Software Foundation Europe e.V.
    Copyright (C) 2011-2016 Planets Communications B.V.
-   Copyright (C) 2013-2023 Bareos GmbH & Co. KG
+   Copyright (C) 2013-2024 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -24,6 +24,23 @@
 /**
  * @file
  * BAREOS sql pooling code that manages the database connection pools.
+ *
+ * There is one pool per catalog.  A pool owns one reference on each of its
+ * connections, every user holds another one.  So a connection with a
+ * reference count of one is idle, and a user that closes a pooled
+ * connection directly with CloseDatabase() just hands it back.
+ *
+ * Connections asked for with mult_db_connections or need_private, e.g. the
+ * batch insert connections, are handed out to a single user at a time.
+ * All other users share one connection like they do without pooling.  When
+ * all connections of a pool are in use, further users get a non-pooled
+ * connection.
+ *
+ * Idle connections are validated before they are handed out again if they
+ * were not used for the validate timeout and closed after the idle timeout
+ * as long as more than the minimum number of connections is open.  A reaper
+ * thread does the closing, so idle connections also go away when no new
+ * connections are asked for.
  */
 
 #include "include/bareos.h"
@@ -31,6 +48,14 @@
 #if HAVE_POSTGRESQL
 
 #  include "cats.h"
+#  include "sql_pooling.h"
+
+#  include <algorithm>
+#  include <chrono>
+#  include <condition_variable>
+#  include <memory>
+#  include <mutex>
+#  include <thread>
 
 /**
  * Get a non-pooled connection used when either sql pooling is
@@ -72,44 +97,306 @@ BareosDb* DbSqlGetNonPooledConnection(JobControlRecord* jcr,
   return mdb;
 }
 
+namespace {
+struct SqlPoolEntry {
+  BareosDb* db_handle = nullptr;
+  bool exclusive = false; /**< Handed out to a single user at a time */
+  bool mult_db_connections = false;
+  time_t last_update = 0; /**< When the connection was last handed back */
+};
+
+// One pool per catalog defined in the config.
+struct SqlPoolDescriptor {
+  bool active = true; /**< After a config reload the old pools are inactive */
+  std::string db_name;
+  std::string db_user;
+  std::string db_address;
+  std::string db_socket;
+  int db_port = 0;
+  int min_connections = 0;
+  int max_connections = 0;
+  int increment_connections = 0;
+  int idle_timeout = 0;
+  int validate_timeout = 0;
+  int opening = 0; /**< Connections currently being opened */
+  std::vector<std::unique_ptr<SqlPoolEntry>> entries;
+  SqlPoolStatistics stats;
+};
+
+std::mutex pool_mutex;
+std::vector<std::unique_ptr<SqlPoolDescriptor>> pools;
+
+std::condition_variable reaper_cv;
+std::thread reaper;
+bool reaper_stop = false;
+
+std::string NullToEmpty(const char* str) { return str ? str : ""; }
+
+bool InUse(const SqlPoolEntry& entry)
+{
+  return entry.db_handle->GetRefcount() > 1;
+}
+
+SqlPoolDescriptor* FindPool(const char* db_name,
+                            const char* db_user,
+                            const char* db_address,
+                            int db_port,
+                            const char* db_socket)
+{
+  for (auto& pool : pools) {
+    if (pool->active && pool->db_name == NullToEmpty(db_name)
+        && pool->db_user == NullToEmpty(db_user)
+        && pool->db_address == NullToEmpty(db_address)
+        && pool->db_port == db_port
+        && pool->db_socket == NullToEmpty(db_socket)) {
+      return pool.get();
+    }
+  }
+  return nullptr;
+}
+
+// Find the pool entry of a connection, returns nullptr if it is not pooled.
+SqlPoolEntry* FindEntry(BareosDb* mdb, SqlPoolDescriptor** pool_out)
+{
+  for (auto& pool : pools) {
+    for (auto& entry : pool->entries) {
+      if (entry->db_handle == mdb) {
+        if (pool_out) { *pool_out = pool.get(); }
+        return entry.get();
+      }
+    }
+  }
+  return nullptr;
+}
+
+void RemoveEntry(SqlPoolDescriptor* pool, SqlPoolEntry* entry)
+{
+  auto& entries = pool->entries;
+  entries.erase(std::find_if(entries.begin(), entries.end(),
+                             [entry](const std::unique_ptr<SqlPoolEntry>& e) {
+                               return e.get() == entry;
+                             }));
+  pool->stats.closed++;
+}
+
 /**
- * Initialize the sql connection pool.
- * For non pooling this is a no-op.
+ * Remove the idle connections that are not needed anymore from the pools
+ * and the inactive pools that became empty.  The caller closes the
+ * returned connections after dropping the pool_mutex.
+ */
+std::vector<BareosDb*> ShrinkPools(time_t now, bool all_idle)
+{
+  std::vector<BareosDb*> unused;
+
+  for (auto& pool : pools) {
+    auto& entries = pool->entries;
+    for (auto it = entries.begin(); it != entries.end();) {
+      SqlPoolEntry& entry = **it;
+      bool expired
+          = pool->idle_timeout > 0
+            && now - entry.last_update >= pool->idle_timeout
+            && static_cast<int>(entries.size()) > pool->min_connections;
+      if (!InUse(entry) && (all_idle || !pool->active || expired)) {
+        unused.push_back(entry.db_handle);
+        pool->stats.closed++;
+        it = entries.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  pools.erase(std::remove_if(pools.begin(), pools.end(),
+                             [](const std::unique_ptr<SqlPoolDescriptor>& p) {
+                               return !p->active && p->entries.empty()
+                                      && p->opening == 0;
+                             }),
+              pools.end());
+
+  return unused;
+}
+
+void CloseUnused(const std::vector<BareosDb*>& unused)
+{
+  for (BareosDb* mdb : unused) { mdb->CloseDatabase(nullptr); }
+}
+
+/**
+ * Seconds between two runs of the reaper, the smallest idle timeout of the
+ * active pools.  Called with the pool_mutex held.
+ */
+int ReaperInterval()
+{
+  int interval = 60;
+  for (auto& pool : pools) {
+    if (pool->active && pool->idle_timeout > 0) {
+      interval = std::min(interval, pool->idle_timeout);
+    }
+  }
+  return std::max(interval, 1);
+}
+
+// Close the connections that were idle for too long until we are stopped.
+void ReapIdleConnections()
+{
+  std::unique_lock<std::mutex> lock(pool_mutex);
+  while (!reaper_stop) {
+    reaper_cv.wait_for(lock, std::chrono::seconds(ReaperInterval()));
+    if (reaper_stop) { break; }
+    std::vector<BareosDb*> unused = ShrinkPools(time(nullptr), false);
+    if (unused.empty()) { continue; }
+    lock.unlock();
+    CloseUnused(unused);
+    lock.lock();
+  }
+}
+
+/**
+ * Pick a connection for a new user and take a reference on it.  Returns
+ * the entry it belongs to so it can be validated.
+ */
+SqlPoolEntry* TakeConnection(SqlPoolDescriptor* pool,
+                             bool exclusive,
+                             bool mult_db_connections)
+{
+  SqlPoolEntry* best = nullptr;
+
+  for (auto& entry : pool->entries) {
+    if (entry->exclusive != exclusive) { continue; }
+    if (exclusive) {
+      if (entry->mult_db_connections == mult_db_connections
+          && !InUse(*entry)) {
+        best = entry.get();
+        break;
+      }
+    } else if (!best
+               || entry->db_handle->GetRefcount()
+                      < best->db_handle->GetRefcount()) {
+      best = entry.get();
+    }
+  }
+
+  if (best) {
+    best->db_handle->IncrementRefcount();
+    pool->stats.reused++;
+  }
+
+  return best;
+}
+}  // namespace
+
+/**
+ * Initialize the sql connection pool of one catalog.
+ * A maximum of zero connections disables pooling for the catalog.
  */
 bool db_sql_pool_initialize(const char*,
+                            const char* db_name,
+                            const char* db_user,
                             const char*,
-                            const char*,
-                            const char*,
-                            const char*,
-                            int,
-                            const char*,
+                            const char* db_address,
+                            int db_port,
+                            const char* db_socket,
                             bool,
                             bool,
                             bool,
-                            int,
-                            int,
-                            int,
-                            int,
-                            int)
+                            int min_connections,
+                            int max_connections,
+                            int increment_connections,
+                            int idle_timeout,
+                            int validate_timeout)
 {
+  if (max_connections <= 0) { return true; }
+
+  if (min_connections > max_connections) {
+    Jmsg(nullptr, M_ERROR, 0,
+         T_("MinConnections (%d) must not be greater than MaxConnections "
+            "(%d).\n"),
+         min_connections, max_connections);
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(pool_mutex);
+
+  if (FindPool(db_name, db_user, db_address, db_port, db_socket)) {
+    return true;
+  }
+
+  auto pool = std::make_unique<SqlPoolDescriptor>();
+  pool->db_name = NullToEmpty(db_name);
+  pool->db_user = NullToEmpty(db_user);
+  pool->db_address = NullToEmpty(db_address);
+  pool->db_socket = NullToEmpty(db_socket);
+  pool->db_port = db_port;
+  pool->min_connections = min_connections;
+  pool->max_connections = max_connections;
+  pool->increment_connections = std::max(increment_connections, 1);
+  pool->idle_timeout = idle_timeout;
+  pool->validate_timeout = validate_timeout;
+  pool->stats.db_name = pool->db_name;
+  pool->stats.db_address = pool->db_address;
+  pool->stats.db_port = db_port;
+  pool->stats.min_connections = min_connections;
+  pool->stats.max_connections = max_connections;
+
+  Dmsg3(100, "sql pool for database %s: %d to %d connections\n", db_name,
+        min_connections, max_connections);
+  pools.push_back(std::move(pool));
+
+  if (!reaper.joinable()) {
+    reaper_stop = false;
+    reaper = std::thread(ReapIdleConnections);
+  }
+
   return true;
 }
 
 /**
  * Cleanup the sql connection pools.
- * For non pooling this is a no-op.
+ * Connections still in use are closed by their last user.
  */
-void DbSqlPoolDestroy(void) {}
+void DbSqlPoolDestroy(void)
+{
+  std::vector<BareosDb*> unused;
+  std::thread stopped;
+
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    reaper_stop = true;
+    stopped = std::move(reaper);
+    for (auto& pool : pools) { pool->active = false; }
+    unused = ShrinkPools(time(nullptr), true);
+    for (auto& pool : pools) {
+      // Give up the reference of the pool, the last user closes them.
+      for (auto& entry : pool->entries) { unused.push_back(entry->db_handle); }
+    }
+    pools.clear();
+  }
+
+  reaper_cv.notify_all();
+  if (stopped.joinable()) { stopped.join(); }
+  CloseUnused(unused);
+}
 
 /**
- * Flush the sql connection pools.
- * For non pooling this is a no-op.
+ * Flush the sql connection pools, e.g. before a config reload.
+ * The pools are made inactive and all idle connections are closed.
  */
-void DbSqlPoolFlush(void) {}
+void DbSqlPoolFlush(void)
+{
+  std::vector<BareosDb*> unused;
+
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    for (auto& pool : pools) { pool->active = false; }
+    unused = ShrinkPools(time(nullptr), true);
+  }
+
+  CloseUnused(unused);
+}
 
 /**
- * Get a new connection from the pool.
- * For non pooling we just call DbSqlGetNonPooledConnection.
+ * Get a connection from the pool.  When there is no pool for the database
+ * or the pool is exhausted we fall back to DbSqlGetNonPooledConnection.
  */
 BareosDb* DbSqlGetPooledConnection(JobControlRecord* jcr,
                                    const char* db_drivername,
@@ -125,19 +412,190 @@ BareosDb* DbSqlGetPooledConnection(JobControlRecord* jcr,
                                    bool exit_on_fatal,
                                    bool need_private)
 {
-  return DbSqlGetNonPooledConnection(
-      jcr, db_drivername, db_name, db_user, db_password, db_address, db_port,
-      db_socket, mult_db_connections, disable_batch_insert, try_reconnect,
-      exit_on_fatal, need_private);
+  bool exclusive = mult_db_connections || need_private;
+  std::vector<BareosDb*> unused;
+  SqlPoolDescriptor* pool;
+  SqlPoolEntry* entry = nullptr;
+  BareosDb* mdb = nullptr;
+  int grow = 0;
+
+  std::unique_lock<std::mutex> lock(pool_mutex);
+  time_t now = time(nullptr);
+  unused = ShrinkPools(now, false);
+
+  pool = FindPool(db_name, db_user, db_address, db_port, db_socket);
+  while (pool) {
+    entry = TakeConnection(pool, exclusive, mult_db_connections);
+    if (!entry) { break; }
+    mdb = entry->db_handle;
+
+    if (pool->validate_timeout <= 0
+        || now - entry->last_update < pool->validate_timeout
+        || (!exclusive && mdb->GetRefcount() > 2)) {
+      break;
+    }
+
+    // Make sure the connection survived its idle time.
+    lock.unlock();
+    bool alive = mdb->SqlQuery("SELECT 1");
+    lock.lock();
+
+    // The pool may have been destroyed meanwhile.
+    entry = FindEntry(mdb, &pool);
+    if (!entry) {
+      if (alive) { break; }
+      unused.push_back(mdb);
+      mdb = nullptr;
+      break;
+    }
+    if (alive) {
+      entry->last_update = time(nullptr);
+      break;
+    }
+
+    Dmsg1(100, "sql pool: dropping dead connection to database %s\n",
+          db_name);
+    pool->stats.failed_validations++;
+    RemoveEntry(pool, entry);
+    // Drop the reference just taken and the one of the pool.
+    unused.push_back(mdb);
+    unused.push_back(mdb);
+    entry = nullptr;
+    mdb = nullptr;
+    pool = FindPool(db_name, db_user, db_address, db_port, db_socket);
+  }
+
+  if (pool && !mdb) {
+    int total = static_cast<int>(pool->entries.size()) + pool->opening;
+    if (total < pool->max_connections) {
+      grow = std::min(pool->increment_connections,
+                      pool->max_connections - total);
+      pool->opening += grow;
+    } else {
+      pool->stats.overflows++;
+      Dmsg1(100, "sql pool for database %s exhausted\n", db_name);
+    }
+  }
+  lock.unlock();
+
+  CloseUnused(unused);
+  if (mdb) { return mdb; }
+
+  if (grow == 0) {
+    return DbSqlGetNonPooledConnection(
+        jcr, db_drivername, db_name, db_user, db_password, db_address, db_port,
+        db_socket, mult_db_connections, disable_batch_insert, try_reconnect,
+        exit_on_fatal, need_private);
+  }
+
+  /* Open the new connections private, so db_init_database() never shares
+   * them with a non-pooled user. */
+  std::vector<BareosDb*> opened;
+  for (int i = 0; i < grow; i++) {
+    BareosDb* new_mdb = DbSqlGetNonPooledConnection(
+        jcr, db_drivername, db_name, db_user, db_password, db_address, db_port,
+        db_socket, exclusive && mult_db_connections, disable_batch_insert,
+        try_reconnect, exit_on_fatal, true);
+    if (!new_mdb) { break; }
+    opened.push_back(new_mdb);
+  }
+
+  lock.lock();
+  bool pool_alive = std::any_of(
+      pools.begin(), pools.end(),
+      [pool](const std::unique_ptr<SqlPoolDescriptor>& p) {
+        return p.get() == pool;
+      });
+  if (!pool_alive) {
+    // Destroyed meanwhile, the first connection is simply not pooled.
+    lock.unlock();
+    if (opened.empty()) { return nullptr; }
+    for (std::size_t i = 1; i < opened.size(); i++) {
+      opened[i]->CloseDatabase(jcr);
+    }
+    return opened.front();
+  }
+
+  pool->opening -= grow;
+  now = time(nullptr);
+  for (BareosDb* new_mdb : opened) {
+    auto new_entry = std::make_unique<SqlPoolEntry>();
+    new_entry->db_handle = new_mdb;
+    new_entry->exclusive = exclusive;
+    new_entry->mult_db_connections = exclusive && mult_db_connections;
+    new_entry->last_update = now;
+    pool->entries.push_back(std::move(new_entry));
+    pool->stats.opened++;
+  }
+  if (!opened.empty()) {
+    mdb = opened.front();
+    mdb->IncrementRefcount();
+  }
+  lock.unlock();
+
+  return mdb;
 }
 
 /**
- * Put a connection back onto the pool for reuse.
- * For non pooling we just do a CloseDatabase.
+ * Put a connection back onto the pool for reuse.  Connections that are
+ * not pooled, whose pool was flushed or that are aborted are closed.
  */
-void DbSqlClosePooledConnection(JobControlRecord* jcr, BareosDb* mdb, bool)
+void DbSqlClosePooledConnection(JobControlRecord* jcr,
+                                BareosDb* mdb,
+                                bool abort)
 {
+  if (!mdb) { return; }
+
+  std::unique_lock<std::mutex> lock(pool_mutex);
+  SqlPoolDescriptor* pool = nullptr;
+  SqlPoolEntry* entry = FindEntry(mdb, &pool);
+
+  // Not pooled or not the last user, just drop the reference.
+  if (!entry || mdb->GetRefcount() > 2) {
+    lock.unlock();
+    mdb->CloseDatabase(jcr);
+    return;
+  }
+  lock.unlock();
+
+  /* As long as we hold our reference nobody else gets the connection, so
+   * it can be cleaned up without the lock. */
+  bool reusable = !abort && mdb->ResetConnection(jcr);
+
+  lock.lock();
+  entry = FindEntry(mdb, &pool);
+  if (entry) {
+    entry->last_update = time(nullptr);
+    if (!reusable || !pool->active) {
+      RemoveEntry(pool, entry);
+      lock.unlock();
+      // Also drop the reference of the pool.
+      mdb->CloseDatabase(jcr);
+      mdb->CloseDatabase(jcr);
+      return;
+    }
+  }
+  lock.unlock();
+
   mdb->CloseDatabase(jcr);
 }
 
+// Statistics of all active pools for the status output.
+std::vector<SqlPoolStatistics> DbSqlPoolStatistics()
+{
+  std::vector<SqlPoolStatistics> statistics;
+  std::lock_guard<std::mutex> lock(pool_mutex);
+
+  for (auto& pool : pools) {
+    if (!pool->active) { continue; }
+    SqlPoolStatistics stats = pool->stats;
+    stats.connections = pool->entries.size();
+    for (auto& entry : pool->entries) {
+      if (InUse(*entry)) { stats.in_use++; }
+    }
+    statistics.push_back(stats);
+  }
+
+  return statistics;
+}
 #endif /* HAVE_POSTGRESQL */
@@ -1,7 +1,7 @@
 /*
    BAREOS® - Backup Archiving REcovery Open Sourced
 
-   Copyright (C) 2018-2019 Bareos GmbH & Co. KG
+   Copyright (C) 2018-2024 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -21,8 +21,28 @@
 #ifndef BAREOS_CATS_SQL_POOLING_H_
 #define BAREOS_CATS_SQL_POOLING_H_
 
+#include <cstdint>
+#include <string>
+#include <vector>
+
 class BareosDb;
 
+// Snapshot of the state and the counters of one connection pool.
+struct SqlPoolStatistics {
+  std::string db_name;
+  std::string db_address;
+  int db_port = 0;
+  int min_connections = 0;
+  int max_connections = 0;
+  int connections = 0; /**< Connections owned by the pool */
+  int in_use = 0;      /**< Connections currently handed out */
+  uint64_t opened = 0; /**< Connections opened for the pool */
+  uint64_t closed = 0; /**< Connections closed by the pool */
+  uint64_t reused = 0; /**< Requests served by an already open connection */
+  uint64_t overflows = 0; /**< Requests served unpooled as the pool was full */
+  uint64_t failed_validations = 0; /**< Idle connections found to be dead */
+};
+
 bool db_sql_pool_initialize(const char* db_drivername,
                             const char* db_name,
                             const char* db_user,
@@ -69,5 +89,6 @@ BareosDb* DbSqlGetPooledConnection(JobControlRecord* jcr,
 void DbSqlClosePooledConnection(JobControlRecord* jcr,
                                 BareosDb* mdb,
                                 bool abort = false);
+std::vector<SqlPoolStatistics> DbSqlPoolStatistics();
 
 #endif  // BAREOS_CATS_SQL_POOLING_H_
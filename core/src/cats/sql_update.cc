@@ -64,6 +64,24 @@ bool BareosDb::AddDigestToFileRecord(JobControlRecord* jcr,
   return UPDATE_DB(jcr, cmd) > 0;
 }
 
+// Same as above for the File record of FileIndex in JobId
+bool BareosDb::AddDigestToFileRecord(JobControlRecord* jcr,
+                                     JobId_t JobId,
+                                     int32_t FileIndex,
+                                     char* digest,
+                                     int)
+{
+  int len = strlen(digest);
+
+  DbLocker _{this};
+  esc_name = CheckPoolMemorySize(esc_name, len * 2 + 1);
+  EscapeString(jcr, esc_name, digest, len);
+  Mmsg(cmd, "UPDATE File SET MD5='%s' WHERE JobId=%u AND FileIndex=%d",
+       esc_name, JobId, FileIndex);
+
+  return UPDATE_DB(jcr, cmd) > 0;
+}
+
 /* Mark the file record as being visited during database
  * verify compare. Stuff JobId into the MarkId field
  */
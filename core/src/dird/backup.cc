@@ -50,12 +50,19 @@
 #include "include/protocol_types.h"
 
 #include "cats/sql.h"
+#include "lib/accurate_pack.h"
 #include "lib/bnet.h"
 #include "lib/edit.h"
 #include "lib/berrno.h"
 #include "lib/util.h"
 #include "lib/version.h"
 #include "lib/bpipe.h"
+#include "lib/channel.h"
+
+#include <atomic>
+#include <optional>
+#include <string>
+#include <thread>
 
 namespace directordaemon {
 
@@ -196,8 +203,100 @@ static bool GetBaseJobids(JobControlRecord* jcr, db_list_ctx* jobids)
   return (!jobids->empty());
 }
 
+/*
+ * Sends the accurate list to the File daemon on its own thread, so the rows
+ * are read from the catalog while the entries before them are on the wire.
+ * The entries are collected in packs of about kPackSize bytes.  A File
+ * daemon that knows it gets a whole pack per message, older ones get one
+ * message per entry.
+ */
+class AccurateListSender {
+ public:
+  static constexpr std::size_t kPackSize = 64 * 1024;
+  static constexpr std::size_t kQueuedPacks = 4;
+
+  AccurateListSender(BareosSocket* fd, bool packed) : fd_{fd}, packed_{packed}
+  {
+    auto [in, out] = channel::CreateBufferedChannel<std::string>(kQueuedPacks);
+    in_ = std::move(in);
+    sender_ = std::thread(&AccurateListSender::Run, this, std::move(out));
+  }
+  ~AccurateListSender() { Finish(); }
+  AccurateListSender(const AccurateListSender&) = delete;
+  AccurateListSender& operator=(const AccurateListSender&) = delete;
+
+  // Returns false when the entry can no longer be sent.
+  bool Add(const char* path,
+           const char* fname,
+           const char* lstat,
+           const char* chksum,
+           const char* delta_seq)
+  {
+    AppendAccurateEntry(pack_, path, fname, lstat, chksum, delta_seq);
+
+    if (pack_.size() >= kPackSize) { return Flush(); }
+    return true;
+  }
+
+  // Waits until all entries are sent, returns false if not all of them were.
+  bool Finish()
+  {
+    if (sender_.joinable()) {
+      Flush();
+      in_.close();
+      sender_.join();
+    }
+    return ok_;
+  }
+
+ private:
+  bool Flush()
+  {
+    if (pack_.empty()) { return true; }
+
+    std::string pack;
+    pack.reserve(kPackSize + kPackSize / 4);
+    std::swap(pack, pack_);
+    return in_.emplace(std::move(pack));
+  }
+
+  void Run(channel::output<std::string> out)
+  {
+    while (std::optional pack = out.get()) {
+      if (!SendPack(*pack)) {
+        ok_ = false;
+        out.close();
+        break;
+      }
+    }
+  }
+
+  bool SendPack(const std::string& pack)
+  {
+    if (packed_) { return fd_->send(pack.data(), pack.size()); }
+
+    /* Old format, the four strings of the entry without the last '\0' */
+    const char* pos = pack.data();
+    const char* end = pos + pack.size();
+    while (pos < end) {
+      const char* entry = pos;
+      for (int i = 0; i < 4; i++) { pos += strlen(pos) + 1; }
+      if (!fd_->send(entry, pos - entry - 1)) { return false; }
+    }
+    return true;
+  }
+
+  BareosSocket* fd_;
+  bool packed_;
+  std::string pack_;
+  channel::input<std::string> in_{nullptr};
+  std::thread sender_;
+  std::atomic<bool> ok_{true};
+};
+
 struct accurate_list_handler_args {
   JobControlRecord* jcr{nullptr};
+  AccurateListSender* sender{nullptr};
   std::size_t sent{0};
   std::size_t discarded{0};
 };
@@ -220,14 +319,14 @@ static int AccurateListHandler(void* ctx, int num_fields, char** row)
   }
 
   /* sending with checksum */
+  const char* chksum = "";
   if (jcr->dir_impl->use_accurate_chksum && num_fields == 9 && row[6][0]
       && /* skip checksum = '0' */
       row[6][1]) {
-    jcr->file_bsock->fsend("%s%s%c%s%c%s%c%s", row[0], row[1], 0, row[4], 0,
-                           row[6], 0, row[5]);
-  } else {
-    jcr->file_bsock->fsend("%s%s%c%s%c%c%s", row[0], row[1], 0, row[4], 0, 0,
-                           row[5]);
+    chksum = row[6];
+  }
+  if (!args->sender->Add(row[0], row[1], row[4], chksum, row[5])) {
+    return 1;
   }
   args->sent += 1;
   return 0;
@@ -346,11 +445,15 @@ bool SendAccurateCurrentFiles(JobControlRecord* jcr)
     Jmsg(jcr, M_INFO, 0, "Sending Accurate information (estimated %s files).\n",
          count_as_str.c_str());
   }
-  jcr->file_bsock->fsend("accurate files=%s\n", count_as_str.c_str());
-
+  bool packed = jcr->dir_impl->FDVersion >= FD_VERSION_55;
+  jcr->file_bsock->fsend("accurate files=%s%s\n", count_as_str.c_str(),
+                         packed ? " packed" : "");
 
+  CatalogResource* catalog = jcr->dir_impl->res.catalog;
+  AccurateListSender sender(jcr->file_bsock, packed);
   accurate_list_handler_args args;
   args.jcr = jcr;
+  args.sender = &sender;
 
   if (jcr->HasBase) {
     jcr->nb_base_files = nb.GetFrontAsInteger();
@@ -359,6 +462,8 @@ bool SendAccurateCurrentFiles(JobControlRecord* jcr)
            jcr->db->strerror());
       return false;
     }
+    std::optional<DbFetchSizeScope> fetch_size;
+    if (catalog) { fetch_size.emplace(jcr->db, catalog->fetch_size); }
     if (!jcr->db->GetBaseFileList(jcr, jcr->dir_impl->use_accurate_chksum,
                                   AccurateListHandler, (void*)&args)) {
       Jmsg(jcr, M_FATAL, 0, "error in jcr->db->GetBaseFileList:%s\n",
@@ -371,6 +476,8 @@ bool SendAccurateCurrentFiles(JobControlRecord* jcr)
       return false; /* Fail */
     }
 
+    std::optional<DbFetchSizeScope> fetch_size;
+    if (catalog) { fetch_size.emplace(jcr->db_batch, catalog->fetch_size); }
     if (!jcr->db_batch->GetFileList(jcr, jobids.GetAsString().c_str(),
                                     jcr->dir_impl->use_accurate_chksum,
                                     false /* no delta */, AccurateListHandler,
@@ -380,6 +487,11 @@ bool SendAccurateCurrentFiles(JobControlRecord* jcr)
       return false;
     }
   }
+  if (!sender.Finish()) {
+    Jmsg(jcr, M_FATAL, 0, T_("Error sending accurate information to %s.\n"),
+         jcr->file_bsock->who());
+    return false;
+  }
   accurate_timer.stop();
 
   if (jcr->JobId) { /* display the message only for real jobs */
@@ -0,0 +1,190 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Background computation of the bvfs cache of finished jobs.
+ *
+ * Jobs with "Update Bvfs Cache = yes" are queued here when they terminate
+ * successfully. A single thread works through the queue with its own catalog
+ * connection, so neither the job nor the shared catalog connection of the
+ * director has to wait for the PathHierarchy computation.
+ */
+
+#include "include/bareos.h"
+#include "dird.h"
+#include "dird/bvfs_update.h"
+#include "dird/dird_globals.h"
+#include "dird/director_jcr_impl.h"
+#include "dird/ua_server.h"
+#include "cats/sql_pooling.h"
+#include "lib/edit.h"
+#include "lib/parse_conf.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace directordaemon {
+
+static const int debuglevel = 100;
+
+namespace {
+struct QueuedUpdate {
+  JobId_t JobId;
+  std::string catalog_name;
+};
+
+std::mutex queue_mutex;
+std::condition_variable queue_changed;
+std::deque<QueuedUpdate> queue;
+std::thread update_thread;
+bool quit = false;
+BvfsCacheUpdateStatus status;
+}  // namespace
+
+static bool UpdateBvfsCache(JobControlRecord* jcr, const QueuedUpdate& update)
+{
+  CatalogResource* catalog;
+  char ed1[50];
+
+  {
+    ResLocker _{my_config};
+    catalog = (CatalogResource*)my_config->GetResWithName(
+        R_CATALOG, update.catalog_name.c_str());
+    if (!catalog) {
+      Jmsg(jcr, M_ERROR, 0,
+           T_("Catalog \"%s\" of JobId %u not found, bvfs cache not "
+              "updated.\n"),
+           update.catalog_name.c_str(), update.JobId);
+      return false;
+    }
+
+    /* Use a private connection, the cache computation holds the connection
+     * for a long time. */
+    jcr->dir_impl->res.catalog = catalog;
+    jcr->db = DbSqlGetPooledConnection(
+        jcr, catalog->db_driver, catalog->db_name, catalog->db_user,
+        catalog->db_password.value, catalog->db_address, catalog->db_port,
+        catalog->db_socket, catalog->mult_db_connections,
+        catalog->disable_batch_insert, catalog->try_reconnect,
+        catalog->exit_on_fatal, true);
+  }
+
+  if (!jcr->db) {
+    Jmsg(jcr, M_ERROR, 0,
+         T_("Could not open database \"%s\", bvfs cache of JobId %u not "
+            "updated.\n"),
+         update.catalog_name.c_str(), update.JobId);
+    jcr->dir_impl->res.catalog = nullptr;
+    return false;
+  }
+
+  Dmsg1(debuglevel, "Updating bvfs cache of JobId %u\n", update.JobId);
+  bool retval = jcr->db->BvfsUpdatePathHierarchyCache(
+      jcr, edit_uint64(update.JobId, ed1),
+      [](JobId_t, uint32_t done, uint32_t total) {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        status.paths_done = done;
+        status.paths_total = total;
+      });
+
+  jcr->db->CloseDatabase(jcr);
+  jcr->db = nullptr;
+  jcr->dir_impl->res.catalog = nullptr;
+
+  return retval;
+}
+
+static void BvfsCacheUpdateThread()
+{
+  JobControlRecord* jcr = new_control_jcr("*BvfsCacheUpdater*", JT_SYSTEM);
+
+  Dmsg0(debuglevel, "Starting bvfs cache update thread\n");
+
+  std::unique_lock<std::mutex> lock(queue_mutex);
+  while (true) {
+    queue_changed.wait(lock, [] { return quit || !queue.empty(); });
+    if (quit) { break; }
+
+    QueuedUpdate update = std::move(queue.front());
+    queue.pop_front();
+    status.JobId = update.JobId;
+    status.paths_done = status.paths_total = 0;
+    status.queued = queue.size();
+    lock.unlock();
+
+    bool ok = UpdateBvfsCache(jcr, update);
+
+    lock.lock();
+    status.JobId = 0;
+    if (ok) {
+      status.updated++;
+    } else {
+      status.failed++;
+    }
+  }
+  lock.unlock();
+
+  FreeJcr(jcr);
+
+  Dmsg0(debuglevel, "Finished bvfs cache update thread\n");
+}
+
+void QueueBvfsCacheUpdate(JobControlRecord* jcr)
+{
+  CatalogResource* catalog = jcr->dir_impl->res.catalog;
+  if (!catalog || !jcr->JobId) { return; }
+
+  std::lock_guard<std::mutex> lock(queue_mutex);
+  if (quit) { return; }
+
+  queue.push_back({jcr->JobId, catalog->resource_name_});
+  status.queued = queue.size();
+  if (!update_thread.joinable()) {
+    update_thread = std::thread(BvfsCacheUpdateThread);
+  }
+  queue_changed.notify_one();
+}
+
+/* Jobs still queued are dropped, their cache is computed on first use. A job
+ * that is being processed is finished first, so its HasCache flag is never
+ * left in the "in progress" state. */
+void StopBvfsCacheUpdateThread()
+{
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    quit = true;
+    queue.clear();
+    status.queued = 0;
+  }
+  queue_changed.notify_one();
+  if (update_thread.joinable()) { update_thread.join(); }
+}
+
+BvfsCacheUpdateStatus GetBvfsCacheUpdateStatus()
+{
+  std::lock_guard<std::mutex> lock(queue_mutex);
+  return status;
+}
+
+} /* namespace directordaemon */
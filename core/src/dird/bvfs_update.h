@@ -0,0 +1,49 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Background computation of the bvfs cache of finished jobs.
+ */
+#ifndef BAREOS_DIRD_BVFS_UPDATE_H_
+#define BAREOS_DIRD_BVFS_UPDATE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+class JobControlRecord;
+
+namespace directordaemon {
+
+struct BvfsCacheUpdateStatus {
+  uint32_t JobId{0};       /**< Job being processed, 0 when idle */
+  uint32_t paths_done{0};  /**< New directories already processed */
+  uint32_t paths_total{0}; /**< New directories of the job */
+  std::size_t queued{0};   /**< Jobs waiting to be processed */
+  uint64_t updated{0};     /**< Jobs processed successfully */
+  uint64_t failed{0};      /**< Jobs whose cache could not be computed */
+};
+
+void QueueBvfsCacheUpdate(JobControlRecord* jcr);
+void StopBvfsCacheUpdateThread();
+BvfsCacheUpdateStatus GetBvfsCacheUpdateStatus();
+
+} /* namespace directordaemon */
+#endif  // BAREOS_DIRD_BVFS_UPDATE_H_
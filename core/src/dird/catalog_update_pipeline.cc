@@ -0,0 +1,83 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Stores the attributes sent by the Storage daemon on a separate thread
+ */
+
+#include "include/bareos.h"
+#include "include/jcr.h"
+#include "cats/cats.h"
+#include "dird/catalog_update_pipeline.h"
+#include "lib/thread_specific_data.h"
+
+#include <optional>
+
+namespace directordaemon {
+
+CatalogUpdatePipeline::CatalogUpdatePipeline(JobControlRecord* jcr,
+                                             StoreFunction store)
+    : jcr_{jcr}, store_{std::move(store)}
+{
+  auto [in, out] = channel::CreateBufferedChannel<std::string>(kQueueSize);
+  in_ = std::move(in);
+  writer_ = std::thread(&CatalogUpdatePipeline::Run, this, std::move(out));
+}
+
+void CatalogUpdatePipeline::Push(const char* msg, int32_t message_length)
+{
+  if (in_.emplace(msg, message_length)) { queued_++; }
+}
+
+void CatalogUpdatePipeline::Flush()
+{
+  std::unique_lock l(mutex_);
+  stored_cv_.wait(l, [this] { return stored_ == queued_; });
+}
+
+void CatalogUpdatePipeline::Finish()
+{
+  if (writer_.joinable()) {
+    in_.close();
+    writer_.join();
+  }
+}
+
+void CatalogUpdatePipeline::Run(channel::output<std::string> out)
+{
+  SetJcrInThreadSpecificData(jcr_);
+
+  // Everything queued up to kBatchSize messages is accounted at once.
+  while (std::optional msg = out.get()) {
+    std::size_t count = 0;
+    do {
+      if (!jcr_->IsJobCanceled()) { store_(msg->data(), msg->size()); }
+    } while (++count < kBatchSize && (msg = out.try_get()));
+
+    std::unique_lock l(mutex_);
+    stored_ += count;
+    stored_cv_.notify_all();
+  }
+
+  if (jcr_->db) { jcr_->db->ThreadCleanup(); }
+}
+
+} /* namespace directordaemon */
@@ -0,0 +1,87 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Stores the attributes sent by the Storage daemon on a separate thread
+ */
+
+#ifndef BAREOS_DIRD_CATALOG_UPDATE_PIPELINE_H_
+#define BAREOS_DIRD_CATALOG_UPDATE_PIPELINE_H_
+
+#include "lib/channel.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class JobControlRecord;
+
+namespace directordaemon {
+
+/*
+ * The attributes sent by the Storage daemon are stored in the catalog by a
+ * writer thread, so the thread reading them only copies them into a bounded
+ * queue and the Storage daemon does not have to wait for the catalog.  The
+ * attributes of a job are stored in the order they were sent, as a digest
+ * belongs to the attributes before it, so there is one writer per job.
+ * The store function takes the database lock for each message only, so
+ * other users of the job's connection are not held up by a full queue.
+ * Once the job is canceled the remaining messages are dropped.
+ */
+class CatalogUpdatePipeline {
+ public:
+  using StoreFunction = std::function<void(char* msg, int32_t length)>;
+
+  static constexpr std::size_t kQueueSize = 16 * 1024; /* Messages */
+  static constexpr std::size_t kBatchSize = 1024;      /* Messages */
+
+  CatalogUpdatePipeline(JobControlRecord* jcr, StoreFunction store);
+  ~CatalogUpdatePipeline() { Finish(); }
+  CatalogUpdatePipeline(const CatalogUpdatePipeline&) = delete;
+  CatalogUpdatePipeline& operator=(const CatalogUpdatePipeline&) = delete;
+
+  void Push(const char* msg, int32_t message_length);
+
+  // Wait until all messages pushed so far are stored or dropped.
+  void Flush();
+
+  // Store the remaining messages and stop the writer.
+  void Finish();
+
+ private:
+  void Run(channel::output<std::string> out);
+
+  JobControlRecord* jcr_;
+  StoreFunction store_;
+  channel::input<std::string> in_{nullptr};
+  std::thread writer_;
+  std::mutex mutex_;
+  std::condition_variable stored_cv_;
+  uint64_t queued_{0}; /* Only changed by the reading thread */
+  uint64_t stored_{0};
+};
+
+} /* namespace directordaemon */
+
+#endif  // BAREOS_DIRD_CATALOG_UPDATE_PIPELINE_H_
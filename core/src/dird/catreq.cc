@@ -37,6 +37,8 @@
 #include "include/filetypes.h"
 #include "include/streams.h"
 #include "dird.h"
+#include "dird/catalog_update_pipeline.h"
+#include "dird/catreq.h"
 #include "dird/next_vol.h"
 #include "dird/director_jcr_impl.h"
 #include "dird/sd_cmds.h"
@@ -362,6 +364,7 @@ void CatalogRequest(JobControlRecord* jcr, BareosSocket* bs)
   } else if (sscanf(bs->msg, Update_filelist, &Job) == 1) {
     Dmsg0(0, "Updating filelist\n");
 
+    FlushCatalogUpdates(jcr);
     if (jcr->db_batch) {
       if (!jcr->db_batch->WriteBatchFileRecords(jcr)) {
         Jmsg(jcr, M_FATAL, 0, T_("Catalog error updating File table. %s\n"),
@@ -378,6 +381,8 @@ void CatalogRequest(JobControlRecord* jcr, BareosSocket* bs)
              == 3) {
     Dmsg0(0, "Updating job record\n");
 
+    FlushCatalogUpdates(jcr);
+
     jcr->JobFiles = update_jobfiles;
     jcr->JobBytes = update_jobbytes;
 
@@ -673,6 +678,35 @@ static void UpdateAttribute(JobControlRecord* jcr,
   }
 }
 
+static void QueueCatalogUpdate(JobControlRecord* jcr,
+                               const char* msg,
+                               int32_t message_length)
+{
+  if (!jcr->dir_impl->catalog_updates) {
+    jcr->dir_impl->catalog_updates = new CatalogUpdatePipeline(
+        jcr, [jcr](char* msg, int32_t length) {
+          DbLocker _{jcr->db};
+          UpdateAttribute(jcr, msg, length);
+        });
+  }
+  jcr->dir_impl->catalog_updates->Push(msg, message_length);
+}
+
+void FlushCatalogUpdates(JobControlRecord* jcr)
+{
+  if (jcr->dir_impl->catalog_updates) {
+    jcr->dir_impl->catalog_updates->Flush();
+  }
+}
+
+void FinishCatalogUpdates(JobControlRecord* jcr)
+{
+  if (jcr->dir_impl->catalog_updates) {
+    delete jcr->dir_impl->catalog_updates;
+    jcr->dir_impl->catalog_updates = nullptr;
+  }
+}
+
 // Update File Attributes in the catalog with data sent by the Storage daemon.
 void CatalogUpdate(JobControlRecord* jcr, BareosSocket* bs)
 {
@@ -691,7 +725,7 @@ void CatalogUpdate(JobControlRecord* jcr, BareosSocket* bs)
     goto bail_out;
   }
 
-  UpdateAttribute(jcr, bs->msg, bs->message_length);
+  QueueCatalogUpdate(jcr, bs->msg, bs->message_length);
 
 bail_out:
   if (jcr->IsJobCanceled()) { CancelStorageDaemonJob(jcr); }
@@ -750,7 +784,7 @@ bool DespoolAttributesFromFile(JobControlRecord* jcr, const char* file)
     }
 
     if (!jcr->IsJobCanceled()) {
-      UpdateAttribute(jcr, msg, message_length);
+      QueueCatalogUpdate(jcr, msg, message_length);
       if (jcr->IsJobCanceled()) { goto bail_out; }
     }
   }
@@ -760,6 +794,9 @@ bool DespoolAttributesFromFile(JobControlRecord* jcr, const char* file)
 bail_out:
   if (spool_fd != -1) { close(spool_fd); }
 
+  // The caller relies on the attributes being in the catalog.
+  FlushCatalogUpdates(jcr);
+
   if (jcr->IsJobCanceled()) { CancelStorageDaemonJob(jcr); }
 
   FreePoolMemory(msg);
@@ -1,7 +1,7 @@
 /*
    BAREOS® - Backup Archiving REcovery Open Sourced
 
-   Copyright (C) 2018-2018 Bareos GmbH & Co. KG
+   Copyright (C) 2018-2024 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -27,6 +27,8 @@ namespace directordaemon {
 void CatalogRequest(JobControlRecord* jcr, BareosSocket* bs);
 void CatalogUpdate(JobControlRecord* jcr, BareosSocket* bs);
 bool DespoolAttributesFromFile(JobControlRecord* jcr, const char* file);
+void FlushCatalogUpdates(JobControlRecord* jcr);
+void FinishCatalogUpdates(JobControlRecord* jcr);
 
 } /* namespace directordaemon */
 
@@ -32,6 +32,7 @@
 #include "cats/sql_pooling.h"
 #include "dird.h"
 #include "dird_globals.h"
+#include "dird/bvfs_update.h"
 #include "dird/check_catalog.h"
 #include "dird/job.h"
 #include "dird/scheduler.h"
@@ -395,6 +396,7 @@ static
   DestroyConfigureUsageString();
   StopSocketServer();
   StopStatisticsThread();
+  StopBvfsCacheUpdateThread();
   StopWatchdog();
   DbSqlPoolDestroy();
   UnloadDirPlugins();
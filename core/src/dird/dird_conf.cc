@@ -313,15 +313,17 @@ static ResourceItem cat_items[] = {
   { "ExitOnFatal", CFG_TYPE_BOOL, ITEM(res_cat, exit_on_fatal), 0, CFG_ITEM_DEFAULT, "false",
      "15.1.0-", "Make any fatal error in the connection to the database exit the program" },
   { "MinConnections", CFG_TYPE_PINT32, ITEM(res_cat, pooling_min_connections), 0, CFG_ITEM_DEFAULT, "1", NULL,
-     "This directive is used by the experimental database pooling functionality. Only use this for non production sites. This sets the minimum number of connections to a database to keep in this database pool." },
-  { "MaxConnections", CFG_TYPE_PINT32, ITEM(res_cat, pooling_max_connections), 0, CFG_ITEM_DEFAULT, "5", NULL,
-     "This directive is used by the experimental database pooling functionality. Only use this for non production sites. This sets the maximum number of connections to a database to keep in this database pool." },
+     "Number of idle connections the catalog connection pool keeps open once they were opened." },
+  { "MaxConnections", CFG_TYPE_PINT32, ITEM(res_cat, pooling_max_connections), 0, CFG_ITEM_DEFAULT, "0", NULL,
+     "Maximum number of connections in the catalog connection pool. Pooling is off by default (0); set a positive number to enable it. When all connections of the pool are in use, further connections are opened outside of the pool and closed after use." },
   { "IncConnections", CFG_TYPE_PINT32, ITEM(res_cat, pooling_increment_connections), 0, CFG_ITEM_DEFAULT, "1", NULL,
-    "This directive is used by the experimental database pooling functionality. Only use this for non production sites. This sets the number of connections to add to a database pool when not enough connections are available on the pool anymore." },
+    "Number of connections to open at once when the catalog connection pool has to grow." },
   { "IdleTimeout", CFG_TYPE_PINT32, ITEM(res_cat, pooling_idle_timeout), 0, CFG_ITEM_DEFAULT, "30", NULL,
-     "This directive is used by the experimental database pooling functionality. Only use this for non production sites.  This sets the idle time after which a database pool should be shrinked." },
+     "Number of seconds after which an idle connection of the catalog connection pool is closed, unless only MinConnections are left." },
   { "ValidateTimeout", CFG_TYPE_PINT32, ITEM(res_cat, pooling_validate_timeout), 0, CFG_ITEM_DEFAULT, "120", NULL,
-     "This directive is used by the experimental database pooling functionality. Only use this for non production sites. This sets the validation timeout after which the database connection is polled to see if its still alive." },
+     "Number of seconds after which an idle connection of the catalog connection pool is checked to be still alive before it is handed out again." },
+  { "FetchSize", CFG_TYPE_PINT32, ITEM(res_cat, fetch_size), 0, CFG_ITEM_DEFAULT, "10000", NULL,
+     "Number of rows fetched per round trip to the catalog when a large result is read row by row, like the file list sent to the client for accurate jobs." },
   {nullptr, 0, 0, nullptr, 0, 0, nullptr, nullptr, nullptr}
 };
 
@@ -425,6 +427,8 @@ ResourceItem job_items[] = {
   { "RunOnIncomingConnectInterval", CFG_TYPE_TIME, ITEM(res_job, RunOnIncomingConnectInterval), 0, CFG_ITEM_DEFAULT, "0", "19.2.4-",
     "The interval specifies the time between the most recent successful backup (counting from start time) and the "
     "event of a client initiated connection. When this interval is exceeded the job is started automatically." },
+  { "UpdateBvfsCache", CFG_TYPE_BOOL, ITEM(res_job, UpdateBvfsCache), 0, CFG_ITEM_DEFAULT, "false", NULL,
+    "Compute the bvfs cache of a successful backup in the background after the job has finished." },
   {nullptr, 0, 0, nullptr, 0, 0, nullptr, nullptr, nullptr}
 };
 
@@ -1903,6 +1907,9 @@ void FilesetResource::PrintConfigIncludeExcludeOptions(
       case 'P': /* strip path */
         send.KeyQuotedString("Strip", GetOptionValue(&p));
         break;
+      case 'T': /* prefetch depth */
+        send.KeyQuotedString("PrefetchDepth", GetOptionValue(&p));
+        break;
       case 'R': /* Resource forks and Finder Info */
         send.KeyBool("HfsPlusSupport", true);
         break;
@@ -1995,6 +2002,16 @@ void FilesetResource::PrintConfigIncludeExcludeOptions(
                 break;
             }
             break;
+          case 's': {
+            std::string algo = "ZSTD";
+            int level = 0;
+            while (B_ISDIGIT(p[1])) {
+              p++;
+              level = level * 10 + (*p - '0');
+            }
+            send.KeyQuotedString("Compression", algo + std::to_string(level));
+            break;
+          }
           default:
             Emsg1(M_ERROR, 0,
                   T_("Unknown compression include/exclude option: %c\n"), *p);
@@ -271,6 +271,7 @@ class CatalogResource : public BareosResource {
   uint32_t pooling_validate_timeout = 0; /**< When using sql pooling set this to
                                         the number of seconds after a idle
                                         connection should be validated */
+  uint32_t fetch_size = 0; /**< Rows per round trip of large queries */
 
   /**< Methods */
   char* display(POOLMEM* dst); /**< Get catalog information */
@@ -497,6 +498,7 @@ class JobResource : public BareosResource {
   bool IgnoreDuplicateJobChecking = false; /**< Ignore Duplicate Job Checking */
   bool SaveFileHist = false; /**< Ability to disable File history saving for certain protocols */
   bool AlwaysIncremental = false; /**< Always incremental with regular consolidation */
+  bool UpdateBvfsCache = false; /**< Compute the bvfs cache after the job */
 
   std::shared_ptr<RuntimeJobStatus> rjs; /**< Runtime Job Status */
 
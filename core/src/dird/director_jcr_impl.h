@@ -44,6 +44,7 @@ class ClientResource;
 class PoolResource;
 class FilesetResource;
 class CatalogResource;
+class CatalogUpdatePipeline;
 struct RuntimeJobStatus;
 }  // namespace directordaemon
 
@@ -110,6 +111,7 @@ struct DirectorJcrImpl {
   std::shared_ptr<ConfigResourcesContainer> job_config_resources_container_;
   pthread_t SD_msg_chan{};        /**< Message channel thread id */
   bool SD_msg_chan_started{};     /**< Message channel thread started */
+  directordaemon::CatalogUpdatePipeline* catalog_updates{}; /**< Attributes not yet stored in the catalog */
   std::condition_variable term_wait{}; /**< Wait for job termination */
   pthread_cond_t nextrun_ready = PTHREAD_COND_INITIALIZER;  /**< Wait for job next run to become ready */
   Resources res;                  /**< Resources assigned */
@@ -53,6 +53,10 @@ namespace directordaemon {
 #define PERMITTED_ACCURATE_OPTIONS (const char*)"ipnugsamcd51A"
 #define PERMITTED_BASEJOB_OPTIONS (const char*)"ipnugsamcd51"
 
+// zstd takes its level as suffix of the keyword, e.g. zstd1 ... zstd19
+static constexpr int kZstdDefaultLevel = 3;
+static constexpr int kZstdMaxLevel = 19;
+
 typedef struct {
   bool configured;
   std::string default_value;
@@ -91,7 +95,8 @@ enum
   INC_KW_SIZE,
   INC_KW_SHADOWING,
   INC_KW_AUTO_EXCLUDE,
-  INC_KW_FORCE_ENCRYPTION
+  INC_KW_FORCE_ENCRYPTION,
+  INC_KW_PREFETCHDEPTH
 };
 
 /*
@@ -130,6 +135,7 @@ static struct s_kw FS_option_kw[]
        {"shadowing", INC_KW_SHADOWING},
        {"autoexclude", INC_KW_AUTO_EXCLUDE},
        {"forceencryption", INC_KW_FORCE_ENCRYPTION},
+       {"prefetchdepth", INC_KW_PREFETCHDEPTH},
        {NULL, 0}};
 
 // Options for FileSet keywords
@@ -282,6 +288,7 @@ ResourceItem options_items[] = {
   { "Shadowing", CFG_TYPE_OPTION, 0, nullptr, 0, 0, NULL, NULL, NULL },
   { "AutoExclude", CFG_TYPE_OPTION, 0, nullptr, 0, 0, NULL, NULL, NULL },
   { "ForceEncryption", CFG_TYPE_OPTION, 0, nullptr, 0, 0, NULL, NULL, NULL },
+  { "PrefetchDepth", CFG_TYPE_OPTION, 0, nullptr, 0, 0, NULL, NULL, NULL },
   { "Meta", CFG_TYPE_META, 0, nullptr, 0, 0, 0, NULL, NULL },
   { NULL, 0, 0, nullptr, 0, 0, NULL, NULL, NULL }
 };
@@ -320,6 +327,16 @@ bool FindUsedCompressalgos(PoolMem* compressalgos, JobControlRecord* jcr)
       for (char* k = fopts->opts; *k; k++) { /* Try to find one request */
         switch (*k) {
           case 'Z': /* Compression */
+            if (k[1] == 's') { /* zstd, followed by the level */
+              int level = 0;
+              for (k++; B_ISDIGIT(k[1]); k++) {
+                level = level * 10 + (k[1] - '0');
+              }
+              compressalgos->strcat(cnt > 0 ? "," : " (");
+              compressalgos->strcat(("zstd" + std::to_string(level)).c_str());
+              cnt++;
+              break;
+            }
             for (fs_opt = FS_options; fs_opt->name; fs_opt++) {
               if (fs_opt->keyword != INC_KW_COMPRESSION) { continue; }
 
@@ -417,6 +434,16 @@ static void ScanIncludeOptions(LEX* lc, int keyword, char* opts, int optlen)
     bstrncat(opts, lc->str, optlen);
     bstrncat(opts, ":", optlen); /* Terminate it */
     Dmsg3(900, "Catopts=%s option=%s optlen=%d\n", opts, option, optlen);
+  } else if (keyword == INC_KW_PREFETCHDEPTH) { /* special case */
+    if (!IsAnInteger(lc->str)) {
+      scan_err1(lc, T_("Expected a prefetch depth positive integer, got: %s:"),
+                lc->str);
+      return;
+    }
+    bstrncat(opts, "T", optlen); /* indicate prefetch depth */
+    bstrncat(opts, lc->str, optlen);
+    bstrncat(opts, ":", optlen); /* Terminate it */
+    Dmsg3(900, "Catopts=%s option=%s optlen=%d\n", opts, option, optlen);
   } else if (keyword == INC_KW_SIZE) { /* special case */
     if (!ParseSizeMatch(lc->str, &size_matching)) {
       scan_err1(lc, T_("Expected a parseable size, got: %s:"), lc->str);
@@ -426,6 +453,22 @@ static void ScanIncludeOptions(LEX* lc, int keyword, char* opts, int optlen)
     bstrncat(opts, lc->str, optlen);
     bstrncat(opts, ":", optlen); /* Terminate it */
     Dmsg3(900, "Catopts=%s option=%s optlen=%d\n", opts, option, optlen);
+  } else if (keyword == INC_KW_COMPRESSION
+             && bstrncasecmp(lc->str, "zstd", 4)) { /* special case */
+    const char* suffix = lc->str + 4;
+    int level = kZstdDefaultLevel;
+    if (*suffix) {
+      level = IsAnInteger(suffix) ? atoi(suffix) : 0;
+      if (level < 1 || level > kZstdMaxLevel) {
+        scan_err1(lc, T_("Expected a zstd compression level from 1 to 19, "
+                         "got: %s:"),
+                  lc->str);
+        return;
+      }
+    }
+    Bsnprintf(option, sizeof(option), "Zs%02d", level);
+    bstrncat(opts, option, optlen);
+    Dmsg3(900, "Catopts=%s option=%s optlen=%d\n", opts, option, optlen);
   } else {
     // Standard keyword options for Include/Exclude
     for (i = 0; FS_options[i].name; i++) {
@@ -30,9 +30,11 @@
 #include "dird.h"
 #include "dird/dird_globals.h"
 #include "dird/admin.h"
+#include "dird/catreq.h"
 #include "dird/archive.h"
 #include "dird/autoprune.h"
 #include "dird/backup.h"
+#include "dird/bvfs_update.h"
 #include "dird/consolidate.h"
 #include "dird/fd_cmds.h"
 #include "dird/get_database_connection.h"
@@ -631,6 +633,11 @@ static void* job_thread(void* arg)
       break;
   }
 
+  if (jcr->is_JobType(JT_BACKUP) && jcr->dir_impl->res.job->UpdateBvfsCache
+      && (jcr->is_JobStatus(JS_Terminated) || jcr->is_JobStatus(JS_Warnings))) {
+    QueueBvfsCacheUpdate(jcr);
+  }
+
   RunScripts(jcr, jcr->dir_impl->res.job->RunScripts, "AfterJob");
 
   // Send off any queued messages
@@ -1514,6 +1521,8 @@ void CreateUniqueJobName(JobControlRecord* jcr, const char* base_name)
 // Called directly from job rescheduling
 void DirdFreeJcrPointers(JobControlRecord* jcr)
 {
+  FinishCatalogUpdates(jcr);
+
   if (jcr->file_bsock) {
     Dmsg0(200, "Close File bsock\n");
     jcr->file_bsock->close();
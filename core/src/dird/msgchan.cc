@@ -35,6 +35,7 @@
  */
 #include "include/bareos.h"
 #include "dird.h"
+#include "dird/catreq.h"
 #include "dird/getmsg.h"
 #include "dird/job.h"
 #include "dird/director_jcr_impl.h"
@@ -429,6 +430,7 @@ extern "C" void MsgThreadCleanup(void* arg)
 {
   JobControlRecord* jcr = (JobControlRecord*)arg;
 
+  FinishCatalogUpdates(jcr);     /* Store the attributes still queued */
   jcr->db->EndTransaction(jcr); /* Terminate any open transaction */
 
   {
@@ -492,6 +494,7 @@ extern "C" void* msg_thread(void* arg)
     if (sscanf(sd->msg, Job_end, Job, &JobStatus, &JobFiles, &JobBytes,
                &JobErrors)
         == 5) {
+      FlushCatalogUpdates(jcr); /* Account all bytes before the end */
       jcr->dir_impl->SDJobStatus = JobStatus; /* termination status */
       jcr->dir_impl->SDJobFiles = JobFiles;
       jcr->dir_impl->SDJobBytes = JobBytes;
@@ -28,6 +28,7 @@
 
 #include "include/bareos.h"
 #include "dird.h"
+#include "dird/bvfs_update.h"
 #include "dird/director_jcr_impl.h"
 #include "dird/run_hour_validator.h"
 #include "dird/dird_globals.h"
@@ -61,6 +62,8 @@ static void ListScheduledJobs(UaContext* ua);
 static void ListRunningJobs(UaContext* ua);
 static void ListTerminatedJobs(UaContext* ua);
 static void ListConnectedClients(UaContext* ua);
+static void ListCatalogConnectionPools(UaContext* ua);
+static void ListBvfsCacheUpdates(UaContext* ua);
 static void DoDirectorStatus(UaContext* ua);
 static void DoSchedulerStatus(UaContext* ua);
 static bool DoSubscriptionStatus(UaContext* ua);
@@ -783,6 +786,8 @@ static void DoDirectorStatus(UaContext* ua)
   ListRunningJobs(ua);
   ListTerminatedJobs(ua);
   ListConnectedClients(ua);
+  ListCatalogConnectionPools(ua);
+  ListBvfsCacheUpdates(ua);
   ua->SendMsg("====\n");
 }
 
@@ -1290,6 +1295,70 @@ static void ListConnectedClients(UaContext* ua)
   ua->send->ArrayEnd("client-connection");
 }
 
+static void ListCatalogConnectionPools(UaContext* ua)
+{
+  const char* separator = "==========";
+  auto pools = DbSqlPoolStatistics();
+
+  if (pools.empty()) { return; }
+
+  ua->send->Decoration("\n");
+  ua->send->Decoration("Catalog Connection Pools:\n");
+  ua->send->Decoration("%-20s%-10s%-10s%-10s%-10s%-10s%-10s%-10s%-10s\n",
+                       "Database", "Open", "In use", "Max", "Opened",
+                       "Closed", "Reused", "Overflow", "Failed");
+  ua->send->Decoration("%-20s%-10s%-10s%-10s%-10s%-10s%-10s%-10s%-10s\n",
+                       "====================", separator, separator,
+                       separator, separator, separator, separator, separator,
+                       separator);
+  ua->send->ArrayStart("catalog-connection-pools");
+  for (auto& pool : pools) {
+    ua->send->ObjectStart();
+    ua->send->ObjectKeyValue("database", pool.db_name.c_str(), "%-20s");
+    ua->send->ObjectKeyValue("address", pool.db_address.c_str());
+    ua->send->ObjectKeyValue("port", pool.db_port);
+    ua->send->ObjectKeyValue("min_connections", pool.min_connections);
+    ua->send->ObjectKeyValue("connections", pool.connections, "%-10llu");
+    ua->send->ObjectKeyValue("in_use", pool.in_use, "%-10llu");
+    ua->send->ObjectKeyValue("max_connections", pool.max_connections,
+                             "%-10llu");
+    ua->send->ObjectKeyValue("opened", pool.opened, "%-10llu");
+    ua->send->ObjectKeyValue("closed", pool.closed, "%-10llu");
+    ua->send->ObjectKeyValue("reused", pool.reused, "%-10llu");
+    ua->send->ObjectKeyValue("overflows", pool.overflows, "%-10llu");
+    ua->send->ObjectKeyValue("failed_validations", pool.failed_validations,
+                             "%-10llu");
+    ua->send->ObjectEnd();
+    ua->send->Decoration("\n");
+  }
+  ua->send->ArrayEnd("catalog-connection-pools");
+}
+
+static void ListBvfsCacheUpdates(UaContext* ua)
+{
+  BvfsCacheUpdateStatus status = GetBvfsCacheUpdateStatus();
+
+  if (!status.JobId && !status.queued && !status.updated && !status.failed) {
+    return;
+  }
+
+  ua->send->Decoration("\n");
+  ua->send->Decoration("Bvfs Cache Updates:\n");
+  ua->send->ObjectStart("bvfs-cache-updates");
+  if (status.JobId) {
+    ua->send->ObjectKeyValue("jobid", status.JobId, " Updating JobId %llu: ");
+    ua->send->ObjectKeyValue("directories_done", status.paths_done, "%llu");
+    ua->send->ObjectKeyValue("directories_total", status.paths_total,
+                             "/%llu directories\n");
+  } else {
+    ua->send->Decoration(" Idle\n");
+  }
+  ua->send->ObjectKeyValue("queued", status.queued, " Queued: %llu");
+  ua->send->ObjectKeyValue("updated", status.updated, " Updated: %llu");
+  ua->send->ObjectKeyValue("failed", status.failed, " Failed: %llu\n");
+  ua->send->ObjectEnd("bvfs-cache-updates");
+}
+
 static void ContentSendInfoApi(UaContext* ua,
                                char type,
                                int Slot,
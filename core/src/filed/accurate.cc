@@ -28,6 +28,7 @@
 #include "filed/filed_globals.h"
 #include "filed/filed_jcr_impl.h"
 #include "filed/verify.h"
+#include "lib/accurate_pack.h"
 #include "lib/attribs.h"
 #include "lib/bsock.h"
 #include "lib/edit.h"
@@ -323,6 +324,28 @@ bail_out:
   return status;
 }
 
+/*
+ * A packed message holds one or more entries, see lib/accurate_pack.h.
+ * Malformed entries are skipped like in the old format.
+ */
+static void AddPackedFiles(BareosAccurateFilelist* file_list,
+                           char* msg,
+                           int32_t message_length)
+{
+  if (message_length <= 0) { return; }
+  // The entries point into msg, which AddFile() may use as it is.
+  bool ok = ParseAccuratePack(
+      msg, message_length, [file_list](const AccurateEntry& entry) {
+        file_list->AddFile(const_cast<char*>(entry.fname.data()),
+                           entry.fname.size(),
+                           const_cast<char*>(entry.lstat.data()),
+                           entry.lstat.size(),
+                           const_cast<char*>(entry.chksum.data()),
+                           entry.chksum.size(), entry.delta_seq);
+      });
+  if (!ok) { Dmsg0(100, "Skipped malformed accurate entries\n"); }
+}
+
 bool AccurateCmd(JobControlRecord* jcr)
 {
   uint32_t accurate_max_file_count;
@@ -347,6 +370,12 @@ bool AccurateCmd(JobControlRecord* jcr)
         = new BareosAccurateFilelistLmdb(jcr, accurate_max_file_count);
   }
 #endif
+  if (!jcr->fd_impl->file_list
+      && me->IsMemberPresent("CompactAccurateThreshold")
+      && accurate_max_file_count >= me->compact_accurate_threshold) {
+    jcr->fd_impl->file_list = new BareosAccurateFilelistCompact(
+        jcr, accurate_max_file_count, me->working_directory);
+  }
   if (!jcr->fd_impl->file_list) {
     jcr->fd_impl->file_list
         = new BareosAccurateFilelistHtable(jcr, accurate_max_file_count);
@@ -356,8 +385,15 @@ bool AccurateCmd(JobControlRecord* jcr)
 
   jcr->accurate = true;
 
+  bool packed = strstr(dir->msg, " packed") != nullptr;
+
   // dirmsg = fname + \0 + lstat + \0 + checksum + \0 + delta_seq + \0
   while (dir->recv() >= 0) {
+    if (packed) {
+      AddPackedFiles(jcr->fd_impl->file_list, dir->msg, dir->message_length);
+      continue;
+    }
+
     fname = dir->msg;
     fname_length = strlen(fname);
     lstat = dir->msg + fname_length + 1;
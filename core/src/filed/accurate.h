@@ -43,6 +43,8 @@
 
 #include <vector>
 #include <algorithm>
+#include <string>
+#include <string_view>
 #include "include/config.h"
 #include "include/baconfig.h"
 #include "lib/jcr.h"
@@ -157,6 +159,91 @@ class BareosAccurateFilelistHtable : public BareosAccurateFilelist {
   bool SendDeletedList() override;
 };
 
+/*
+ * Compact storage abstraction class for very large file lists.
+ *
+ * The entries are sorted by name when the load ends and stored front coded,
+ * every kEntriesPerBlock-th name in full and the others as the suffix that
+ * differs from their predecessor.  The entries are kept in an unlinked file
+ * in the working directory that is mapped into memory, so under memory
+ * pressure the kernel can page them out instead of the daemon being killed.
+ * Names are found through a hash index of eight bytes per slot.
+ */
+class BareosAccurateFilelistCompact : public BareosAccurateFilelist {
+ public:
+  static constexpr std::size_t kEntriesPerBlock = 16;
+
+ protected:
+  // Growable buffer backed by an unlinked temporary file.
+  class MappedArena {
+   public:
+    MappedArena() = default;
+    ~MappedArena() { Close(); }
+    MappedArena(const MappedArena&) = delete;
+    MappedArena& operator=(const MappedArena&) = delete;
+
+    bool Open(const char* directory);
+    bool Append(const void* data, std::size_t size);
+    void Close();
+    char* data() const { return base_; }
+    std::size_t size() const { return used_; }
+
+   private:
+    bool Reserve(std::size_t size);
+
+    int fd_{-1};
+    char* base_{nullptr};
+    std::size_t used_{0};
+    std::size_t mapped_{0};
+  };
+
+  struct IndexSlot {
+    uint32_t tag;   /* High bits of the hash of the name */
+    uint32_t entry; /* Entry number + 1, 0 for an empty slot */
+  };
+
+  std::string directory_;
+  MappedArena staging_;          /* Entries in the order they were sent */
+  std::vector<uint64_t> staged_; /* Offsets of the entries in staging_ */
+  MappedArena entries_;          /* Sorted and front coded entries */
+  std::vector<uint64_t> blocks_; /* Offsets of the blocks in entries_ */
+  std::vector<IndexSlot> index_;
+  accurate_payload payload_{};
+  std::string fname_; /* Name of the entry last decoded into payload_ */
+  std::size_t duplicate_files_{0};
+  bool failed_{false};
+
+  const char* DecodeEntry(const char* pos, std::size_t filenr);
+  bool DecodeEntry(std::size_t filenr);
+  bool AddEntry(std::string_view fname,
+                const char* lstat,
+                const char* chksum,
+                int32_t delta_seq);
+  void destroy();
+
+ public:
+  /* methods */
+  BareosAccurateFilelistCompact() = delete;
+  BareosAccurateFilelistCompact(JobControlRecord* jcr,
+                                uint32_t number_of_files,
+                                const char* directory);
+  ~BareosAccurateFilelistCompact() { destroy(); }
+
+  bool init() override;
+  bool AddFile(char* fname,
+               int fname_length,
+               char* lstat,
+               int lstat_length,
+               char* chksum,
+               int checksum_length,
+               int32_t delta_seq) override;
+  bool EndLoad() override;
+  accurate_payload* lookup_payload(char* fname) override;
+  bool UpdatePayload(char* fname, accurate_payload* payload) override;
+  bool SendBaseFileList() override;
+  bool SendDeletedList() override;
+};
+
 #ifdef HAVE_LMDB
 
 #  include "lmdb/lmdb.h"
@@ -0,0 +1,495 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * This file contains the compact, memory mapped abstraction of the accurate
+ * payload storage.
+ *
+ * While the director sends the file list, every entry is appended unchanged
+ * to a staging arena:
+ *
+ *   int32 delta_seq, uint32 fname length, fname\0 lstat\0 chksum\0
+ *
+ * When the load ends the entries are sorted by name, duplicates are dropped
+ * and the final arena is written.  Every entry in it looks like
+ *
+ *   varint shared, varint suffix length, suffix, lstat\0 chksum\0,
+ *   varint zigzag(delta_seq)
+ *
+ * where shared is the length of the prefix the name has in common with the
+ * name of the previous entry.  The first entry of every block has no
+ * predecessor, so blocks can be decoded on their own.  The position of an
+ * entry in the sorted list is its file number.
+ */
+
+#include "include/bareos.h"
+#include "include/filetypes.h"
+#include "include/streams.h"
+#include "filed/filed.h"
+#include "accurate.h"
+#include "lib/attribs.h"
+#include "lib/berrno.h"
+
+#include <functional>
+
+#if !defined(HAVE_WIN32)
+#  include <sys/mman.h>
+#endif
+
+namespace filedaemon {
+
+static int debuglevel = 100;
+
+namespace {
+constexpr std::size_t kStagedHeaderSize = 2 * sizeof(uint32_t);
+constexpr std::size_t kMinArenaSize = 1024 * 1024;
+
+void PutVarint(std::string& out, uint64_t value)
+{
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+const char* GetVarint(const char* pos, uint64_t& value)
+{
+  value = 0;
+  for (int shift = 0;; shift += 7) {
+    uint8_t byte = static_cast<uint8_t>(*pos++);
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) { return pos; }
+  }
+}
+
+uint64_t HashName(std::string_view name)
+{
+  return std::hash<std::string_view>{}(name);
+}
+
+struct StagedEntry {
+  int32_t delta_seq;
+  std::string_view fname;
+  const char* lstat;
+  const char* chksum;
+};
+
+StagedEntry GetStaged(const char* base, uint64_t offset)
+{
+  StagedEntry entry;
+  uint32_t fname_length;
+  const char* pos = base + offset;
+
+  memcpy(&entry.delta_seq, pos, sizeof(int32_t));
+  memcpy(&fname_length, pos + sizeof(int32_t), sizeof(uint32_t));
+  pos += kStagedHeaderSize;
+  entry.fname = std::string_view(pos, fname_length);
+  entry.lstat = pos + fname_length + 1;
+  entry.chksum = entry.lstat + strlen(entry.lstat) + 1;
+
+  return entry;
+}
+}  // namespace
+
+bool BareosAccurateFilelistCompact::MappedArena::Open(const char* directory)
+{
+#if !defined(HAVE_WIN32)
+  std::string name = std::string(directory) + "/.accurate_compact.XXXXXX";
+
+  fd_ = mkstemp(name.data());
+  if (fd_ < 0) { return false; }
+
+  // Nobody else needs to see the file, it goes away with the descriptor.
+  unlink(name.c_str());
+#else
+  (void)directory;
+#endif
+
+  return Reserve(kMinArenaSize);
+}
+
+bool BareosAccurateFilelistCompact::MappedArena::Reserve(std::size_t size)
+{
+  if (size <= mapped_) { return true; }
+
+  std::size_t new_size = std::max(mapped_ * 2, kMinArenaSize);
+  while (new_size < size) { new_size *= 2; }
+
+#if !defined(HAVE_WIN32)
+  if (ftruncate(fd_, new_size) != 0) { return false; }
+
+  void* mapping
+      = mmap(nullptr, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (mapping == MAP_FAILED) { return false; }
+  if (base_) { munmap(base_, mapped_); }
+  base_ = static_cast<char*>(mapping);
+#else
+  char* buffer = static_cast<char*>(realloc(base_, new_size));
+  if (!buffer) { return false; }
+  base_ = buffer;
+#endif
+
+  mapped_ = new_size;
+  return true;
+}
+
+bool BareosAccurateFilelistCompact::MappedArena::Append(const void* data,
+                                                        std::size_t size)
+{
+  if (!Reserve(used_ + size)) { return false; }
+
+  memcpy(base_ + used_, data, size);
+  used_ += size;
+
+  return true;
+}
+
+void BareosAccurateFilelistCompact::MappedArena::Close()
+{
+#if !defined(HAVE_WIN32)
+  if (base_) { munmap(base_, mapped_); }
+  if (fd_ >= 0) { close(fd_); }
+#else
+  free(base_);
+#endif
+
+  fd_ = -1;
+  base_ = nullptr;
+  used_ = 0;
+  mapped_ = 0;
+}
+
+BareosAccurateFilelistCompact::BareosAccurateFilelistCompact(
+    JobControlRecord* jcr,
+    uint32_t number_of_files,
+    const char* directory)
+    : BareosAccurateFilelist(jcr, number_of_files), directory_{directory}
+{
+  staged_.reserve(number_of_files);
+}
+
+bool BareosAccurateFilelistCompact::init()
+{
+  if (!staging_.Open(directory_.c_str())) {
+    BErrNo be;
+
+    Jmsg2(jcr_, M_FATAL, 0,
+          T_("Unable to create accurate file list in %s: ERR=%s\n"),
+          directory_.c_str(), be.bstrerror());
+    return false;
+  }
+
+  return true;
+}
+
+bool BareosAccurateFilelistCompact::AddFile(char* fname,
+                                            int fname_length,
+                                            char* lstat,
+                                            int lstat_length,
+                                            char* chksum,
+                                            int chksum_length,
+                                            int32_t delta_seq)
+{
+  if (failed_) { return false; }
+
+  uint32_t length = fname_length;
+  uint64_t offset = staging_.size();
+  char nul = '\0';
+
+  /* The strings are copied including their terminating \0, a missing
+   * checksum is stored as an empty one. */
+  if (!staging_.Append(&delta_seq, sizeof(delta_seq))
+      || !staging_.Append(&length, sizeof(length))
+      || !staging_.Append(fname, fname_length + 1)
+      || !staging_.Append(lstat, lstat_length + 1)
+      || !(chksum_length ? staging_.Append(chksum, chksum_length + 1)
+                         : staging_.Append(&nul, 1))) {
+    BErrNo be;
+
+    Jmsg1(jcr_, M_FATAL, 0, T_("Unable to store accurate file list: ERR=%s\n"),
+          be.bstrerror());
+    failed_ = true;
+    return false;
+  }
+
+  staged_.push_back(offset);
+  Dmsg2(debuglevel, "add fname=<%s> lstat=%s\n", fname, lstat);
+
+  return true;
+}
+
+bool BareosAccurateFilelistCompact::AddEntry(std::string_view fname,
+                                             const char* lstat,
+                                             const char* chksum,
+                                             int32_t delta_seq)
+{
+  std::size_t filenr = seen_bitmap_.size();
+  std::size_t shared = 0;
+  std::string entry;
+
+  if (filenr % kEntriesPerBlock == 0) {
+    blocks_.push_back(entries_.size());
+  } else {
+    std::size_t max_shared = std::min(fname.size(), fname_.size());
+    while (shared < max_shared && fname[shared] == fname_[shared]) {
+      shared++;
+    }
+  }
+
+  PutVarint(entry, shared);
+  PutVarint(entry, fname.size() - shared);
+  entry.append(fname.substr(shared));
+  entry.append(lstat, strlen(lstat) + 1);
+  entry.append(chksum, strlen(chksum) + 1);
+  PutVarint(entry, (static_cast<uint32_t>(delta_seq) << 1)
+                       ^ static_cast<uint32_t>(delta_seq >> 31));
+  if (!entries_.Append(entry.data(), entry.size())) { return false; }
+
+  uint64_t hash = HashName(fname);
+  std::size_t mask = index_.size() - 1;
+  std::size_t slot = hash & mask;
+  while (index_[slot].entry != 0) { slot = (slot + 1) & mask; }
+  index_[slot].tag = static_cast<uint32_t>(hash >> 32);
+  index_[slot].entry = static_cast<uint32_t>(filenr + 1);
+
+  fname_.assign(fname);
+  seen_bitmap_.push_back(false);
+
+  return true;
+}
+
+bool BareosAccurateFilelistCompact::EndLoad()
+{
+  if (failed_) { return false; }
+
+  const char* base = staging_.data();
+  auto by_name = [base](uint64_t lhs, uint64_t rhs) {
+    std::string_view lhs_name = GetStaged(base, lhs).fname;
+    std::string_view rhs_name = GetStaged(base, rhs).fname;
+
+    // Of several entries with the same name the first one sent is kept.
+    return lhs_name < rhs_name || (lhs_name == rhs_name && lhs < rhs);
+  };
+
+  // The director usually sends the files ordered by path already.
+  if (!std::is_sorted(staged_.begin(), staged_.end(), by_name)) {
+    std::sort(staged_.begin(), staged_.end(), by_name);
+  }
+
+  // Keep the index at most 80% full.
+  std::size_t slots = 16;
+  while (slots < staged_.size() + staged_.size() / 4) { slots *= 2; }
+  index_.assign(slots, IndexSlot{0, 0});
+  blocks_.reserve(staged_.size() / kEntriesPerBlock + 1);
+  seen_bitmap_.reserve(staged_.size());
+
+  if (!entries_.Open(directory_.c_str())) {
+    BErrNo be;
+
+    Jmsg2(jcr_, M_FATAL, 0,
+          T_("Unable to create accurate file list in %s: ERR=%s\n"),
+          directory_.c_str(), be.bstrerror());
+    return false;
+  }
+
+  for (std::size_t i = 0; i < staged_.size(); i++) {
+    StagedEntry staged = GetStaged(base, staged_[i]);
+
+    if (i > 0 && staged.fname == GetStaged(base, staged_[i - 1]).fname) {
+      duplicate_files_ += 1;
+      Dmsg1(debuglevel, "fname=<%.*s> is already registered.\n",
+            static_cast<int>(staged.fname.size()), staged.fname.data());
+      continue;
+    }
+
+    if (!AddEntry(staged.fname, staged.lstat, staged.chksum,
+                  staged.delta_seq)) {
+      BErrNo be;
+
+      Jmsg1(jcr_, M_FATAL, 0,
+            T_("Unable to store accurate file list: ERR=%s\n"),
+            be.bstrerror());
+      return false;
+    }
+  }
+
+  Dmsg3(debuglevel,
+        "compact accurate list: %llu files, %llu bytes of entries, %llu "
+        "bytes of staging\n",
+        static_cast<unsigned long long>(seen_bitmap_.size()),
+        static_cast<unsigned long long>(entries_.size()),
+        static_cast<unsigned long long>(staging_.size()));
+
+  std::vector<uint64_t>().swap(staged_);
+  staging_.Close();
+
+  if (duplicate_files_ > 0) {
+    Jmsg1(jcr_, M_ERROR, 0,
+          T_("%llu duplicate files were sent by the director and removed. This "
+             "may indicate problems with the database.\n"),
+          duplicate_files_);
+  }
+  // seen_bitmap_.size() is the number of files sent by the director
+  // without duplicates
+  if (seen_bitmap_.size() > initial_capacity_) {
+    Jmsg1(
+        jcr_, M_ERROR, 0,
+        T_("The director send too many files. %llu were sent but only %llu "
+           "were anticipated. The accurate job may be in a corrupted state.\n"),
+        seen_bitmap_.size(), initial_capacity_);
+  }
+
+  return true;
+}
+
+const char* BareosAccurateFilelistCompact::DecodeEntry(const char* pos,
+                                                       std::size_t filenr)
+{
+  uint64_t shared, suffix_length, delta_seq;
+
+  pos = GetVarint(pos, shared);
+  pos = GetVarint(pos, suffix_length);
+  fname_.resize(shared);
+  fname_.append(pos, suffix_length);
+  pos += suffix_length;
+
+  payload_.lstat = const_cast<char*>(pos);
+  pos += strlen(pos) + 1;
+  payload_.chksum = const_cast<char*>(pos);
+  pos += strlen(pos) + 1;
+
+  pos = GetVarint(pos, delta_seq);
+  payload_.delta_seq
+      = static_cast<int32_t>((delta_seq >> 1) ^ -(delta_seq & 1));
+  payload_.filenr = filenr;
+
+  return pos;
+}
+
+bool BareosAccurateFilelistCompact::DecodeEntry(std::size_t filenr)
+{
+  if (filenr >= seen_bitmap_.size()) { return false; }
+
+  std::size_t first = filenr - filenr % kEntriesPerBlock;
+  const char* pos = entries_.data() + blocks_[filenr / kEntriesPerBlock];
+  for (std::size_t nr = first; nr <= filenr; nr++) {
+    pos = DecodeEntry(pos, nr);
+  }
+
+  return true;
+}
+
+accurate_payload* BareosAccurateFilelistCompact::lookup_payload(char* fname)
+{
+  if (index_.empty()) { return nullptr; }
+
+  std::string_view name(fname);
+  uint64_t hash = HashName(name);
+  uint32_t tag = static_cast<uint32_t>(hash >> 32);
+  std::size_t mask = index_.size() - 1;
+
+  for (std::size_t slot = hash & mask; index_[slot].entry != 0;
+       slot = (slot + 1) & mask) {
+    if (index_[slot].tag == tag && DecodeEntry(index_[slot].entry - 1)
+        && fname_ == name) {
+      return &payload_;
+    }
+  }
+
+  return nullptr;
+}
+
+bool BareosAccurateFilelistCompact::UpdatePayload(char*, accurate_payload*)
+{
+  return true;
+}
+
+bool BareosAccurateFilelistCompact::SendBaseFileList()
+{
+  FindFilesPacket* ff_pkt;
+  int32_t LinkFIc;
+  struct stat statp;
+  int stream = STREAM_UNIX_ATTRIBUTES;
+
+  if (!jcr_->accurate || jcr_->getJobLevel() != L_FULL) { return true; }
+
+  ff_pkt = init_find_files();
+  ff_pkt->type = FT_BASE;
+
+  const char* pos = entries_.data();
+  for (std::size_t filenr = 0; filenr < seen_bitmap_.size(); filenr++) {
+    pos = DecodeEntry(pos, filenr);
+    if (seen_bitmap_[filenr]) {
+      Dmsg1(debuglevel, "base file fname=%s\n", fname_.c_str());
+      DecodeStat(payload_.lstat, &statp, sizeof(statp),
+                 &LinkFIc); /* decode catalog stat */
+      ff_pkt->fname = fname_.data();
+      ff_pkt->statp = statp;
+      EncodeAndSendAttributes(jcr_, ff_pkt, stream);
+    }
+  }
+
+  TermFindFiles(ff_pkt);
+  return true;
+}
+
+bool BareosAccurateFilelistCompact::SendDeletedList()
+{
+  FindFilesPacket* ff_pkt;
+  int32_t LinkFIc;
+  struct stat statp;
+  int stream = STREAM_UNIX_ATTRIBUTES;
+
+  if (!jcr_->accurate) { return true; }
+
+  ff_pkt = init_find_files();
+  ff_pkt->type = FT_DELETED;
+
+  const char* pos = entries_.data();
+  for (std::size_t filenr = 0; filenr < seen_bitmap_.size(); filenr++) {
+    pos = DecodeEntry(pos, filenr);
+    if (seen_bitmap_[filenr] || PluginCheckFile(jcr_, fname_.data())) {
+      continue;
+    }
+    Dmsg1(debuglevel, "deleted fname=%s\n", fname_.c_str());
+    ff_pkt->fname = fname_.data();
+    DecodeStat(payload_.lstat, &statp, sizeof(statp),
+               &LinkFIc); /* decode catalog stat */
+    ff_pkt->statp.st_mtime = statp.st_mtime;
+    ff_pkt->statp.st_ctime = statp.st_ctime;
+    EncodeAndSendAttributes(jcr_, ff_pkt, stream);
+  }
+
+  TermFindFiles(ff_pkt);
+  return true;
+}
+
+void BareosAccurateFilelistCompact::destroy()
+{
+  staging_.Close();
+  entries_.Close();
+  std::vector<uint64_t>().swap(staged_);
+  std::vector<uint64_t>().swap(blocks_);
+  std::vector<IndexSlot>().swap(index_);
+}
+
+} /* namespace filedaemon */
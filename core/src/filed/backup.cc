@@ -37,6 +37,7 @@
 #include "filed/crypto.h"
 #include "filed/heartbeat.h"
 #include "filed/backup.h"
+#include "filed/backup_pipeline.h"
 #include "filed/filed_jcr_impl.h"
 #include "include/ch.h"
 #include "findlib/attribs.h"
@@ -136,6 +137,12 @@ bool BlastDataToStorageDaemon(JobControlRecord* jcr, crypto_cipher_t cipher)
     return false;
   }
 
+  if (client && client->zero_copy_send && !sd->EnableZeroCopy()) {
+    Jmsg(jcr, M_INFO, 0,
+         T_("Zero copy send is not available on the connection to the "
+            "Storage Daemon.\n"));
+  }
+
   jcr->buf_size = sd->message_length;
 
   if (!AdjustCompressionBuffers(jcr)) { return false; }
@@ -1044,110 +1051,22 @@ bail_out:
 }
 
 static result<std::size_t> SendData(BareosSocket* sd,
-                                    POOLMEM* data,
-                                    size_t size)
+                                    const char* data,
+                                    size_t size,
+                                    std::shared_ptr<const void> keep_alive)
 {
-  sd->message_length = size;
-  sd->msg = data; /* set correct write buffer */
+  BnetBuffer buffer{data, size};
 
-  if (!sd->send()) {
+  if (!sd->SendBuffers(&buffer, 1, std::move(keep_alive))) {
     PoolMem error;
     Mmsg(error, "Network send error to SD. ERR=%s", sd->bstrerror());
     return error;
   }
 
-  Dmsg1(130, "Send data to SD len=%d\n", sd->message_length);
+  Dmsg1(130, "Send data to SD len=%d\n", (int)size);
   return size;
 }
 
-class data_message {
-  /* some data is prefixed by a OFFSET_FADDR_SIZE-byte number -- called header
-   * here, which basically contains the file position to which to write the
-   * following block of data.
-   * The difference between FADDR and OFFSET is that offset may be any value
-   * (given to the core by a plugin), whereas FADDR is computed by the core
-   * itself and is equal to the number of bytes already read from the file
-   * descriptor. */
-  static inline constexpr std::size_t header_size = OFFSET_FADDR_SIZE;
-  /* our bsocket functions assume that they are allowed to overwrite
-   * the four bytes directly preceding the given buffer
-   * To keep the message alignment to 8, we "allocate" full 8 bytes instead
-   * of the required 4. */
-  static inline constexpr std::size_t bnet_size = 8;
-  static inline constexpr std::size_t data_offset = header_size + bnet_size;
-
-  std::vector<char> buffer{};
-  bool has_header{false};
-
- public:
-  data_message(std::size_t data_size)
-  {
-    buffer.resize(data_size + data_offset);
-  }
-  data_message() : data_message(0) {}
-  data_message(const data_message&) = delete;
-  data_message& operator=(const data_message&) = delete;
-  data_message(data_message&&) = default;
-  data_message& operator=(data_message&&) = default;
-
-  // creates a message with the same header -- if any
-  data_message derived() const
-  {
-    data_message derived;
-
-    if (has_header) {
-      derived.has_header = true;
-      std::memcpy(derived.header_ptr(), header_ptr(), header_size);
-    }
-
-    return derived;
-  }
-
-  void set_header(std::uint64_t h)
-  {
-    has_header = true;
-    auto* ptr = header_ptr();
-    network_order::network net{h};  // save in network order
-    std::memcpy(ptr, &net, header_size);
-  }
-
-  void resize(std::size_t new_size) { buffer.resize(data_offset + new_size); }
-
-  char* header_ptr() { return &buffer[bnet_size]; }
-  char* data_ptr() { return &buffer[data_offset]; }
-  const char* header_ptr() const { return &buffer[bnet_size]; }
-  const char* data_ptr() const { return &buffer[data_offset]; }
-
-  std::size_t data_size() const
-  {
-    ASSERT(buffer.size() >= data_offset);
-    return buffer.size() - data_offset;
-  }
-
-  /* important: this is not actually a POOLMEM*; do not pass it to POOLMEM*
-   *            functions, except to pass it to BareosSocket::SendData(). */
-  POOLMEM* as_socket_message()
-  {
-    if (has_header) {
-      return header_ptr();
-    } else {
-      return data_ptr();
-    }
-  }
-
-  std::size_t message_size() const
-  {
-    auto size_with_header = buffer.size() - bnet_size;
-    if (has_header) {
-      return size_with_header;
-    } else {
-      return size_with_header - header_size;
-    }
-  }
-};
-
-using shared_message = std::shared_ptr<data_message>;
-
 static std::future<result<std::size_t>> MakeSendThread(
     thread_pool& pool,
     BareosSocket* sd,
@@ -1170,12 +1089,10 @@ static std::future<result<std::size_t>> MakeSendThread(
 
           auto& val = p.value_unchecked();
           auto size = val->message_size();
-          POOLMEM* msg = val->as_socket_message();
+          const char* msg = val->as_socket_message();
 
-          // technically we are overwriting part of message here
-          // but its only the "size" field of the message, which is not
-          // read/written to otherwise after making it a shared_message.
-          result ret = SendData(sd, msg, size);
+          // with zero copy sends the socket keeps the message alive
+          result ret = SendData(sd, msg, size, val);
           if (ret.holds_error()) {
             prom.set_value(std::move(ret.error_unchecked()));
             return;
@@ -1215,8 +1132,10 @@ static result<shared_message> DoCompressMessage(compression_context& compctx,
 
   if (csize > std::numeric_limits<std::uint32_t>::max()) {
     PoolMem error;
-    Mmsg(error, "Compressed size to big (%llu > %llu)", csize,
-         std::numeric_limits<std::uint32_t>::max());
+    Mmsg(error, "Compressed size to big (%llu > %llu)",
+         static_cast<unsigned long long>(csize),
+         static_cast<unsigned long long>(
+             std::numeric_limits<std::uint32_t>::max()));
     return error;
   }
 
@@ -1238,6 +1157,99 @@ static result<shared_message> DoCompressMessage(compression_context& compctx,
   return shared_message{new data_message{std::move(msg)}};
 }
 
+result<shared_message> DoEncryptMessage(CIPHER_CONTEXT* cipher_ctx,
+                                        const data_message& input)
+{
+  /* Note, as in EncryptData() we prepend the record length to the data
+   * before encrypting it, so that the restore side gets back records of
+   * exactly the same size as were processed during backup. */
+  if (input.data_size() > std::numeric_limits<std::uint32_t>::max()) {
+    PoolMem error;
+    Mmsg(error, "Data size to big to encrypt (%llu > %llu)",
+         static_cast<unsigned long long>(input.data_size()),
+         static_cast<unsigned long long>(
+             std::numeric_limits<std::uint32_t>::max()));
+    return error;
+  }
+
+  std::uint32_t input_len = input.data_size();
+  uint8_t packet_len[sizeof(uint32_t)];
+  {
+    ser_declare;
+    SerBegin(packet_len, sizeof(uint32_t));
+    ser_uint32(input_len); /* store data len in begin of buffer */
+    SerEnd(packet_len, sizeof(uint32_t));
+  }
+
+  /* CryptoCipherUpdate() will buffer up to (cipher_block_size - 1) bytes,
+   * so this is the most it can return for this message. */
+  auto msg = input.derived();
+  msg.resize(sizeof(packet_len) + input_len + CRYPTO_CIPHER_MAX_BLOCK_SIZE);
+
+  uint32_t initial_len = 0;
+  if (!CryptoCipherUpdate(cipher_ctx, packet_len, sizeof(packet_len),
+                          reinterpret_cast<uint8_t*>(msg.data_ptr()),
+                          &initial_len)) {
+    return PoolMem{"Encryption error"};
+  }
+
+  uint32_t encrypted_len = 0;
+  if (!CryptoCipherUpdate(
+          cipher_ctx, reinterpret_cast<const uint8_t*>(input.data_ptr()),
+          input_len, reinterpret_cast<uint8_t*>(msg.data_ptr() + initial_len),
+          &encrypted_len)) {
+    return PoolMem{"Encryption error"};
+  }
+
+  Dmsg2(400, "encrypted len=%d unencrypted len=%d\n", encrypted_len,
+        input_len);
+
+  auto total_size = initial_len + encrypted_len;
+  ASSERT(total_size <= msg.data_size());
+  msg.resize(total_size);
+
+  return shared_message{new data_message{std::move(msg)}};
+}
+
+/* The cipher is a single stream over the whole file, so encryption cannot
+ * be split up between the workers.  Instead it runs as its own stage between
+ * the workers and the sender, encrypting the messages in order.  Messages
+ * for which the cipher produced no output yet (because it is still buffering
+ * a partial block) are not forwarded at all, exactly like in the serial
+ * code path. */
+std::future<void> MakeEncryptionThread(thread_pool& pool,
+                                       CIPHER_CONTEXT* cipher_ctx,
+                                       message_channel_output out,
+                                       message_channel_input in)
+{
+  std::promise<void> promise;
+  std::future fut = promise.get_future();
+
+  pool.borrow_thread([prom = std::move(promise), out = std::move(out),
+                      in = std::move(in), cipher_ctx]() mutable {
+    for (;;) {
+      std::optional out_fut = out.get();
+      if (!out_fut) { break; }
+      result p = out_fut->get();
+      if (!p.holds_error()) {
+        p = DoEncryptMessage(cipher_ctx, *p.value_unchecked());
+      }
+
+      bool is_error = p.holds_error();
+      if (!is_error && p.value_unchecked()->data_size() == 0) { continue; }
+
+      std::promise<result<shared_message>> next;
+      next.set_value(std::move(p));
+      if (!in.emplace(next.get_future()) || is_error) { break; }
+    }
+    // make sure that nobody is waiting on us anymore
+    out.close();
+    in.close();
+    prom.set_value();
+  });
+  return fut;
+}
+
 // Send the content of a file on anything but an EFS filesystem.
 static inline bool SendPlainData(b_ctx& bctx)
 {
@@ -1248,10 +1260,6 @@ static inline bool SendPlainData(b_ctx& bctx)
   auto* flags = bctx.ff_pkt->flags;
 
   const std::size_t num_workers = me->MaxWorkersPerJob;
-  // Currently we do not support encryption while doing
-  // parallel sending/checksumming/compression/etc.
-  // This is mostly because EncryptData() is weird!
-  if (BitIsSet(FO_ENCRYPT, flags)) { return SendPlainDataSerially(bctx); }
 
   // Setting up the parallel pipeline is not worth it for small files.
   if (static_cast<std::size_t>(file_size) < 2 * max_buf_size) {
@@ -1298,6 +1306,16 @@ static inline bool SendPlainData(b_ctx& bctx)
       = channel::CreateBufferedChannel<std::future<result<shared_message>>>(
           num_workers);
 
+  std::optional<std::future<void>> encryption_fin;
+  if (BitIsSet(FO_ENCRYPT, flags)) {
+    auto [enc_in, enc_out]
+        = channel::CreateBufferedChannel<std::future<result<shared_message>>>(
+            num_workers);
+    encryption_fin = MakeEncryptionThread(threadpool, bctx.cipher_ctx,
+                                          std::move(out), std::move(enc_in));
+    out = std::move(enc_out);
+  }
+
   std::future bytes_send_fut = MakeSendThread(threadpool, sd, std::move(out));
 
   DIGEST* checksum = bctx.digest;
@@ -1407,6 +1425,9 @@ bail_out:
   latch.lock().wait(compute_fin, [](int num) { return num == 0; });
   in.close();
   if (update_digest) { update_digest->get(); }
+  // the cipher context may only be touched again once the encryption stage
+  // is done with it.
+  if (encryption_fin) { encryption_fin->get(); }
   result sendres = bytes_send_fut.get();
   if (auto* error = sendres.error()) {
     if (!bctx.jcr->IsJobCanceled()) {
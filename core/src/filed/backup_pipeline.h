@@ -0,0 +1,143 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Messages and stages of the parallel backup pipeline.
+ */
+
+#ifndef BAREOS_FILED_BACKUP_PIPELINE_H_
+#define BAREOS_FILED_BACKUP_PIPELINE_H_
+
+#include "lib/channel.h"
+#include "lib/crypto.h"
+#include "lib/network_order.h"
+#include "lib/thread_pool.h"
+#include "lib/util.h"
+
+#include <cstring>
+#include <future>
+#include <memory>
+#include <vector>
+
+namespace filedaemon {
+
+class data_message {
+  /* some data is prefixed by a OFFSET_FADDR_SIZE-byte number -- called header
+   * here, which basically contains the file position to which to write the
+   * following block of data.
+   * The difference between FADDR and OFFSET is that offset may be any value
+   * (given to the core by a plugin), whereas FADDR is computed by the core
+   * itself and is equal to the number of bytes already read from the file
+   * descriptor. */
+  static inline constexpr std::size_t header_size = OFFSET_FADDR_SIZE;
+  /* The socket sends its length header from a separate buffer, so nothing
+   * needs to be reserved in front of the message. */
+  static inline constexpr std::size_t data_offset = header_size;
+
+  std::vector<char> buffer{};
+  bool has_header{false};
+
+ public:
+  data_message(std::size_t data_size)
+  {
+    buffer.resize(data_size + data_offset);
+  }
+  data_message() : data_message(0) {}
+  data_message(const data_message&) = delete;
+  data_message& operator=(const data_message&) = delete;
+  data_message(data_message&&) = default;
+  data_message& operator=(data_message&&) = default;
+
+  // creates a message with the same header -- if any
+  data_message derived() const
+  {
+    data_message derived;
+
+    if (has_header) {
+      derived.has_header = true;
+      std::memcpy(derived.header_ptr(), header_ptr(), header_size);
+    }
+
+    return derived;
+  }
+
+  void set_header(std::uint64_t h)
+  {
+    has_header = true;
+    auto* ptr = header_ptr();
+    network_order::network net{h};  // save in network order
+    std::memcpy(ptr, &net, header_size);
+  }
+
+  void resize(std::size_t new_size) { buffer.resize(data_offset + new_size); }
+
+  char* header_ptr() { return &buffer[0]; }
+  char* data_ptr() { return &buffer[data_offset]; }
+  const char* header_ptr() const { return &buffer[0]; }
+  const char* data_ptr() const { return &buffer[data_offset]; }
+
+  std::size_t data_size() const
+  {
+    ASSERT(buffer.size() >= data_offset);
+    return buffer.size() - data_offset;
+  }
+
+  const char* as_socket_message() const
+  {
+    if (has_header) {
+      return header_ptr();
+    } else {
+      return data_ptr();
+    }
+  }
+
+  std::size_t message_size() const
+  {
+    auto size_with_header = buffer.size();
+    if (has_header) {
+      return size_with_header;
+    } else {
+      return size_with_header - header_size;
+    }
+  }
+};
+
+using shared_message = std::shared_ptr<data_message>;
+
+using message_channel_input
+    = channel::input<std::future<result<shared_message>>>;
+using message_channel_output
+    = channel::output<std::future<result<shared_message>>>;
+
+// Encrypts one message with the (file wide) cipher as EncryptData() does.
+result<shared_message> DoEncryptMessage(CIPHER_CONTEXT* cipher_ctx,
+                                        const data_message& input);
+
+/* Encrypts the messages read from out in order and writes them to in.
+ * The returned future is ready once the stage stopped. */
+std::future<void> MakeEncryptionThread(thread_pool& pool,
+                                       CIPHER_CONTEXT* cipher_ctx,
+                                       message_channel_output out,
+                                       message_channel_input in);
+
+} /* namespace filedaemon */
+
+#endif  // BAREOS_FILED_BACKUP_PIPELINE_H_
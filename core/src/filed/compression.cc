@@ -183,6 +183,16 @@ bool SetupCompressionContext(b_ctx& bctx)
         bctx.ch.level = bctx.ff_pkt->Compress_level;
         break;
       }
+#if defined(HAVE_ZSTD)
+      case COMPRESS_ZSTD:
+        // Set zstd compression level - must be done per file
+        if (!SetCompressionLevel(bctx.jcr, bctx.ff_pkt->Compress_algo,
+                                 bctx.ff_pkt->Compress_level)) {
+          goto bail_out;
+        }
+        bctx.ch.level = bctx.ff_pkt->Compress_level;
+        break;
+#endif
       default:
         break;
     }
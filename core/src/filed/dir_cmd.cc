@@ -247,6 +247,7 @@ static char OK_append[] = "3000 OK append data\n";
 
 // Commands sent to Storage Daemon
 static char append_open[] = "append open session\n";
+static char append_open_frames[] = "append open session frames\n";
 static char append_data[] = "append data %d\n";
 static char append_end[] = "append end session %d\n";
 static char append_close[] = "append close session %d\n";
@@ -1623,6 +1624,10 @@ static inline void ClearCompressionFlagInFileset(JobControlRecord* jcr)
             case COMPRESS_FZ4L:
             case COMPRESS_FZ4H:
               break;
+#if defined(HAVE_ZSTD)
+            case COMPRESS_ZSTD:
+              break;
+#endif
             default:
               /* When we get here its because the wanted compression protocol is
                * not supported with the current compile options. */
@@ -1715,6 +1720,8 @@ static bool BackupCmd(JobControlRecord* jcr)
   BareosSocket* dir = jcr->dir_bsock;
   BareosSocket* sd = jcr->store_bsock;
   crypto_cipher_t cipher = CRYPTO_CIPHER_NONE;
+  bool frames = false;
+  bool blasted = false;
 
   /* See if we are in restore only mode then we don't allow a backup to be
    * initiated. */
@@ -1790,7 +1797,7 @@ static bool BackupCmd(JobControlRecord* jcr)
   Dmsg1(110, "filed>dird: %s", dir->msg);
 
   // Send Append Open Session to Storage daemon
-  sd->fsend(append_open);
+  sd->fsend(me->small_file_frame_size ? append_open_frames : append_open);
   Dmsg1(110, ">stored: %s", sd->msg);
 
   // Expect to receive back the Ticket number
@@ -1801,6 +1808,7 @@ static bool BackupCmd(JobControlRecord* jcr)
       goto cleanup;
     }
     Dmsg1(110, "Got Ticket=%d\n", jcr->fd_impl->Ticket);
+    frames = strstr(sd->msg, " frames") != nullptr;
   } else {
     Jmsg(jcr, M_FATAL, 0, T_("Bad response from stored to open command\n"));
     goto cleanup;
@@ -1817,6 +1825,15 @@ static bool BackupCmd(JobControlRecord* jcr)
   }
   Dmsg1(110, "<stored: %s", sd->msg);
 
+  /* Small files take a few short messages each, sending them one by one
+   * would make the network writes the bottleneck. */
+  if (frames) {
+    sd->SetFrameSize(me->small_file_frame_size);
+  } else if (me->small_file_frame_size) {
+    Jmsg(jcr, M_INFO, 0,
+         T_("Storage daemon does not accept small file frames.\n"));
+  }
+
   GeneratePluginEvent(jcr, bEventStartBackupJob);
 
 #if defined(WIN32_VSS)
@@ -1915,7 +1932,10 @@ static bool BackupCmd(JobControlRecord* jcr)
 
   // Send Files to Storage daemon
   Dmsg1(110, "begin blast ff=%p\n", (FindFilesPacket*)jcr->fd_impl->ff);
-  if (!BlastDataToStorageDaemon(jcr, cipher)) {
+  blasted = BlastDataToStorageDaemon(jcr, cipher);
+  // Send what is still collected, before waiting for the answer
+  if (!sd->SetFrameSize(0)) { blasted = false; }
+  if (!blasted) {
     jcr->setJobStatusWithPriorityCheck(JS_ErrorTerminated);
     BnetSuppressErrorMessages(sd, 1);
     Dmsg0(110, "Error in blast_data.\n");
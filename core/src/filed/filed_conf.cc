@@ -93,11 +93,15 @@ static ResourceItem cli_items[] = {
   {"ScriptsDirectory", CFG_TYPE_DIR, ITEM(res_client, scripts_directory), 0, 0, NULL, NULL, NULL},
   {"MaximumConcurrentJobs", CFG_TYPE_PINT32, ITEM(res_client, MaxConcurrentJobs), 0, CFG_ITEM_DEFAULT, "20", NULL, NULL},
   {"MaximumWorkersPerJob", CFG_TYPE_PINT32, ITEM(res_client, MaxWorkersPerJob), 0, CFG_ITEM_DEFAULT, "2", "23.0.0-",
-   "The maximum number of worker threads that bareos will use during backup."},
+   "The maximum number of worker threads that bareos will use during backup and restore."},
   {"Messages", CFG_TYPE_RES, ITEM(res_client, messages), R_MSGS, 0, NULL, NULL, NULL},
   {"SdConnectTimeout", CFG_TYPE_TIME, ITEM(res_client, SDConnectTimeout), 0, CFG_ITEM_DEFAULT, "1800" /* 30 minutes */, NULL, NULL},
   {"HeartbeatInterval", CFG_TYPE_TIME, ITEM(res_client, heartbeat_interval), 0, CFG_ITEM_DEFAULT, "0", NULL, NULL},
   {"MaximumNetworkBufferSize", CFG_TYPE_PINT32, ITEM(res_client, max_network_buffer_size), 0, 0, NULL, NULL, NULL},
+  {"ZeroCopySend", CFG_TYPE_BOOL, ITEM(res_client, zero_copy_send), 0, CFG_ITEM_DEFAULT, "false", NULL,
+      "Let the kernel send the file data to the Storage Daemon directly from the buffers of the File Daemon (Linux only, without TLS)."},
+  {"SmallFileFrameSize", CFG_TYPE_SIZE32, ITEM(res_client, small_file_frame_size), 0, CFG_ITEM_DEFAULT, "0", "24.0.0-",
+      "Collect the attributes and data of small files into frames of this size (at most 512 KiB) for the Storage Daemon, instead of sending every record on its own. 0 disables this."},
   {"PkiSignatures", CFG_TYPE_BOOL, ITEM(res_client, pki_sign), 0, CFG_ITEM_DEFAULT, "false", NULL, "Enable Data Signing."},
   {"PkiEncryption", CFG_TYPE_BOOL, ITEM(res_client, pki_encrypt), 0, CFG_ITEM_DEFAULT, "false", NULL, "Enable Data Encryption."},
   {"PkiKeyPair", CFG_TYPE_DIR, ITEM(res_client, pki_keypair_file), 0, 0, NULL, NULL,
@@ -119,6 +123,8 @@ static ResourceItem cli_items[] = {
   },
   {"LmdbThreshold", CFG_TYPE_PINT32, ITEM(res_client, lmdb_threshold), 0, 0, NULL, NULL,
    "File count threshold after which bareos will use the lmdb backend to store accurate information."},
+  {"CompactAccurateThreshold", CFG_TYPE_PINT32, ITEM(res_client, compact_accurate_threshold), 0, 0, NULL, NULL,
+   "File count threshold after which bareos will use the compact memory mapped backend to store accurate information."},
   {"SecureEraseCommand", CFG_TYPE_STR, ITEM(res_client, secure_erase_cmdline), 0, 0, NULL, "15.2.1-",
       "Specify command that will be called when bareos unlinks files."},
   {"LogTimestampFormat", CFG_TYPE_STR, ITEM(res_client, log_timestamp_format), 0, CFG_ITEM_DEFAULT, "%d-%b %H:%M", "15.2.3-", NULL},
@@ -3,7 +3,7 @@
 
    Copyright (C) 2000-2007 Free Software Foundation Europe e.V.
    Copyright (C) 2011-2012 Planets Communications B.V.
-   Copyright (C) 2013-2023 Bareos GmbH & Co. KG
+   Copyright (C) 2013-2024 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -101,6 +101,8 @@ class ClientResource
   utime_t SDConnectTimeout = {0};       /* Timeout in seconds */
   utime_t heartbeat_interval = {0};     /* Interval to send heartbeats */
   uint32_t max_network_buffer_size = 0; /* Max network buf size */
+  bool zero_copy_send = false;          /* Use MSG_ZEROCOPY towards the SD */
+  uint32_t small_file_frame_size = 0;   /* Frame small messages to the SD */
   uint32_t jcr_watchdog_time = 0;       /* Absolute time after which a Job gets
                                        terminated       regardless of its progress */
   bool allow_bw_bursting = false; /* Allow bursting with bandwidth limiting */
@@ -115,6 +117,9 @@ class ClientResource
   bool always_use_lmdb = false; /* Use LMDB for accurate data */
   uint32_t lmdb_threshold = 0;  /* Switch to using LDMD when number of accurate
                                entries exceeds treshold. */
+  uint32_t compact_accurate_threshold = 0; /* Switch to the compact accurate
+                                             list when the number of entries
+                                             exceeds threshold. */
   X509_KEYPAIR* pki_keypair = nullptr; /* Shared PKI Public/Private Keypair */
 
   alist<X509_KEYPAIR*>* pki_signers = nullptr; /* Shared PKI Trusted Signers */
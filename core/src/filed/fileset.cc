@@ -404,6 +404,17 @@ static int SetOptionsAndFlags(findFOPTS* fo, const char* opts)
         SetBit(FO_STRIPPATH, fo->flags);
         Dmsg2(100, "strip=%s StripPath=%d\n", strip, fo->StripPath);
         break;
+      case 'T': /* Prefetch depth */
+        // Get integer
+        p++; /* skip T */
+        for (j = 0; *p && *p != ':'; p++) {
+          strip[j] = *p;
+          if (j < (int)sizeof(strip) - 1) { j++; }
+        }
+        strip[j] = 0;
+        fo->PrefetchDepth = atoi(strip);
+        Dmsg1(100, "PrefetchDepth=%d\n", fo->PrefetchDepth);
+        break;
       case 'p': /* Use portable data format */
         SetBit(FO_PORTABLE, fo->flags);
         break;
@@ -489,6 +500,14 @@ static int SetOptionsAndFlags(findFOPTS* fo, const char* opts)
             fo->Compress_algo = COMPRESS_FZ4H;
             fo->Compress_level = 1; /* not used with FZ4H */
           }
+        } else if (*p == 's') {
+          SetBit(FO_COMPRESS, fo->flags);
+          fo->Compress_algo = COMPRESS_ZSTD;
+          fo->Compress_level = 0;
+          while (B_ISDIGIT(p[1])) {
+            p++;
+            fo->Compress_level = fo->Compress_level * 10 + (*p - '0');
+          }
         }
         break;
       case 'z': /* Min, max or approx size or size range */
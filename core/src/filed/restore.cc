@@ -36,6 +36,7 @@
 #include "filed/compression.h"
 #include "filed/crypto.h"
 #include "filed/restore.h"
+#include "filed/restore_pipeline.h"
 #include "filed/verify.h"
 #include "include/ch.h"
 #include "findlib/create_file.h"
@@ -385,6 +386,88 @@ bail_out:
   return false;
 }
 
+// Should the data of the current file be restored with a restore_pipeline ?
+static bool UseRestorePipeline(JobControlRecord* jcr, const r_ctx& rctx)
+{
+  // setting maximum worker threads to 0 means that you do not want
+  // multithreading.
+  if (me->MaxWorkersPerJob == 0) { return false; }
+
+  // plugins expect to be called from the job thread only.
+  if (jcr->IsPlugin()) { return false; }
+
+  // Setting up the parallel pipeline is not worth it for small files.
+  return static_cast<uint64_t>(rctx.attr->statp.st_size)
+         >= 2 * static_cast<uint64_t>(jcr->buf_size);
+}
+
+/* Wait for the restore pipeline of the current file to write out all
+ * outstanding data.  Returns false if any data could not be restored. */
+static bool FinishRestorePipeline(r_ctx& rctx)
+{
+  if (!rctx.pipeline) { return true; }
+
+  result file_addr = rctx.pipeline->finish();
+  rctx.pipeline.reset();
+  if (file_addr.holds_error()) {
+    Jmsg(rctx.jcr, M_ERROR, 0, "%s", file_addr.error_unchecked().c_str());
+    return false;
+  }
+  rctx.fileAddr = file_addr.value_unchecked();
+  return true;
+}
+
+/* Same as ExtractData() for the file data, but the data is handed over to the
+ * restore pipeline after decryption. */
+static int32_t ExtractDataParallel(JobControlRecord* jcr,
+                                   r_ctx& rctx,
+                                   POOLMEM* buf,
+                                   int32_t buflen)
+{
+  char* wbuf = buf;
+  uint32_t wsize = buflen;
+  RestoreCipherContext* cipher_ctx = &rctx.cipher_ctx;
+
+  jcr->ReadBytes += wsize;
+
+  if (BitIsSet(FO_ENCRYPT, rctx.flags)) {
+    if (!DecryptData(jcr, &wbuf, &wsize, cipher_ctx)) {
+      FinishRestorePipeline(rctx);
+      return -1;
+    }
+    if (wsize == 0) { return 0; }
+  }
+
+  if (!rctx.pipeline) {
+    rctx.pipeline = std::make_unique<restore_pipeline>(
+        jcr, &rctx.bfd, rctx.stream, rctx.flags, rctx.fileAddr,
+        me->MaxWorkersPerJob);
+  }
+
+  bool ok = rctx.pipeline->push(wbuf, wsize);
+
+  // Clean up crypto buffers, the data was already copied into the pipeline
+  if (BitIsSet(FO_ENCRYPT, rctx.flags)) {
+    // Move any remaining data to start of buffer
+    if (cipher_ctx->buf_len > 0) {
+      Dmsg1(130, "Moving %u buffered bytes to start of buffer\n",
+            cipher_ctx->buf_len);
+      memmove(cipher_ctx->buf, &cipher_ctx->buf[cipher_ctx->packet_len],
+              cipher_ctx->buf_len);
+    }
+    /* The packet was successfully queued, reset the length so that the next
+     * packet length may be re-read by UnserCryptoPacketLen() */
+    cipher_ctx->packet_len = 0;
+  }
+
+  if (!ok) {
+    FinishRestorePipeline(rctx);
+    return -1;
+  }
+
+  return wsize;
+}
+
 // Restore the requested files.
 void DoRestore(JobControlRecord* jcr)
 {
@@ -519,6 +602,15 @@ void DoRestore(JobControlRecord* jcr)
     Dmsg3(130, "Got stream: %s len=%d extract=%d\n",
           stream_to_ascii(rctx.stream), sd->message_length, rctx.extract);
 
+    /* The restore pipeline only handles a single data stream, so make sure
+     * that everything is written before we handle anything else. */
+    if (rctx.pipeline && rctx.pipeline->stream() != rctx.stream) {
+      if (!FinishRestorePipeline(rctx)) {
+        rctx.extract = false;
+        bclose(&rctx.bfd);
+      }
+    }
+
     // If we change streams, close and reset alternate data streams
     if (rctx.prev_stream != rctx.stream) {
       if (IsBopen(&rctx.forkbfd)) {
@@ -809,10 +901,16 @@ void DoRestore(JobControlRecord* jcr)
               SetBit(FO_WIN32DECOMP, rctx.flags);
             }
 
-            if (ExtractData(jcr, &rctx.bfd, sd->msg, sd->message_length,
-                            &rctx.fileAddr, rctx.flags, rctx.stream,
-                            &rctx.cipher_ctx)
-                < 0) {
+            int32_t written;
+            if (rctx.pipeline || UseRestorePipeline(jcr, rctx)) {
+              written = ExtractDataParallel(jcr, rctx, sd->msg,
+                                            sd->message_length);
+            } else {
+              written = ExtractData(jcr, &rctx.bfd, sd->msg,
+                                    sd->message_length, &rctx.fileAddr,
+                                    rctx.flags, rctx.stream, &rctx.cipher_ctx);
+            }
+            if (written < 0) {
               rctx.extract = false;
               bclose(&rctx.bfd);
               continue;
@@ -1035,6 +1133,11 @@ void DoRestore(JobControlRecord* jcr)
     } /* end switch(stream) */
   }   /* end while get_msg() */
 
+  if (!FinishRestorePipeline(rctx)) {
+    rctx.extract = false;
+    bclose(&rctx.bfd);
+  }
+
   /* If output file is still open, it was the last one in the
    * archive since we just hit an end of file, so close the file. */
   if (IsBopen(&rctx.forkbfd)) {
@@ -1049,6 +1152,9 @@ bail_out:
   jcr->setJobStatusWithPriorityCheck(JS_ErrorTerminated);
 
 ok_out:
+  // nothing may be written to the files anymore once we close them below
+  FinishRestorePipeline(rctx);
+
 #ifdef HAVE_WIN32
   // Cleanup the copy thread if we restored any EFS data.
   if (jcr->cp_thread) { win32_cleanup_copy_thread(jcr); }
@@ -1178,50 +1284,58 @@ bool SparseData(JobControlRecord* jcr,
   return true;
 }
 
-bool StoreData(JobControlRecord* jcr,
+bool WriteData(JobControlRecord* jcr,
                BareosFilePacket* bfd,
                char* data,
                const int32_t length,
-               bool win32_decomp)
+               bool win32_decomp,
+               const std::string& fname,
+               PoolMem& errmsg)
 {
-  if (jcr->fd_impl->crypto.digest) {
-    CryptoDigestUpdate(jcr->fd_impl->crypto.digest, (uint8_t*)data, length);
-  }
-
   if (win32_decomp) {
     if (!processWin32BackupAPIBlock(bfd, data, length)) {
       BErrNo be;
-      Jmsg2(jcr, M_ERROR, 0,
-            T_("Write error in Win32 Block Decomposition on %s: %s\n"),
-            jcr->fd_impl->last_fname, be.bstrerror(bfd->BErrNo));
+      Mmsg(errmsg, T_("Write error in Win32 Block Decomposition on %s: %s\n"),
+           fname.c_str(), be.bstrerror(bfd->BErrNo));
       return false;
     }
 #ifdef HAVE_WIN32
-  } else {
-    if (bfd->encrypted) {
-      if (win32_send_to_copy_thread(jcr, bfd, data, length)
-          != (ssize_t)length) {
-        BErrNo be;
-        Jmsg2(jcr, M_ERROR, 0, T_("Write error on %s: %s\n"),
-              jcr->fd_impl->last_fname, be.bstrerror(bfd->BErrNo));
-        return false;
-      }
-    } else {
-      if (bwrite(bfd, data, length) != (ssize_t)length) {
-        BErrNo be;
-        Jmsg2(jcr, M_ERROR, 0, T_("Write error on %s: %s\n"),
-              jcr->fd_impl->last_fname, be.bstrerror(bfd->BErrNo));
-      }
+  } else if (bfd->encrypted) {
+    if (win32_send_to_copy_thread(jcr, bfd, data, length) != (ssize_t)length) {
+      BErrNo be;
+      Mmsg(errmsg, T_("Write error on %s: %s\n"), fname.c_str(),
+           be.bstrerror(bfd->BErrNo));
+      return false;
     }
-  }
 #else
+    (void)jcr;
+#endif
   } else if (bwrite(bfd, data, length) != (ssize_t)length) {
     BErrNo be;
-    Jmsg2(jcr, M_ERROR, 0, T_("Write error on %s: %s\n"),
-          jcr->fd_impl->last_fname, be.bstrerror(bfd->BErrNo));
+    Mmsg(errmsg, T_("Write error on %s: %s\n"), fname.c_str(),
+         be.bstrerror(bfd->BErrNo));
+    return false;
+  }
+
+  return true;
+}
+
+bool StoreData(JobControlRecord* jcr,
+               BareosFilePacket* bfd,
+               char* data,
+               const int32_t length,
+               bool win32_decomp)
+{
+  if (jcr->fd_impl->crypto.digest) {
+    CryptoDigestUpdate(jcr->fd_impl->crypto.digest, (uint8_t*)data, length);
+  }
+
+  PoolMem errmsg;
+  if (!WriteData(jcr, bfd, data, length, win32_decomp,
+                 jcr->fd_impl->last_fname, errmsg)) {
+    Jmsg(jcr, M_ERROR, 0, "%s", errmsg.c_str());
     return false;
   }
-#endif
 
   return true;
 }
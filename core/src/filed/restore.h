@@ -25,10 +25,15 @@
 
 #include "findlib/bfile.h"
 #include "lib/attr.h"
+#include <memory>
+#include <string>
+
 template <typename T> class alist;
 
 namespace filedaemon {
 
+class restore_pipeline;
+
 struct DelayedDataStream {
   int32_t stream;          /* stream less new bits */
   char* content;           /* stream data */
@@ -68,6 +73,7 @@ struct r_ctx {
   RestoreCipherContext cipher_ctx{}; /* Cryptographic restore context (if any) for file */
   RestoreCipherContext fork_cipher_ctx{}; /* Cryptographic restore context (if any)
                                               for alternative stream */
+  std::unique_ptr<restore_pipeline> pipeline{}; /* Parallel restore of the file data (if any) */
 };
 /* clang-format on */
 
@@ -86,6 +92,15 @@ bool StoreData(JobControlRecord* jcr,
                char* data,
                const int32_t length,
                bool win32_decomp);
+/* Same as StoreData() without the digest update and job messages, so that
+ * it can be used by other threads than the job thread. */
+bool WriteData(JobControlRecord* jcr,
+               BareosFilePacket* bfd,
+               char* data,
+               const int32_t length,
+               bool win32_decomp,
+               const std::string& fname,
+               PoolMem& errmsg);
 
 } /* namespace filedaemon */
 #endif  // BAREOS_FILED_RESTORE_H_
@@ -0,0 +1,201 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Parallel restore of the data stream of a file.
+ */
+
+#include "include/bareos.h"
+#include "filed/filed.h"
+#include "filed/filed_jcr_impl.h"
+#include "filed/restore.h"
+#include "filed/restore_pipeline.h"
+#include "lib/berrno.h"
+#include "lib/compression.h"
+#include "lib/edit.h"
+#include "lib/serial.h"
+
+namespace filedaemon {
+
+restore_pipeline::restore_pipeline(JobControlRecord* t_jcr,
+                                   BareosFilePacket* bfd,
+                                   int32_t t_stream,
+                                   const char* flags,
+                                   uint64_t file_addr,
+                                   std::size_t num_workers)
+    : jcr{t_jcr}
+    , fname{jcr->fd_impl->last_fname ? jcr->fd_impl->last_fname : ""}
+    , stream_{t_stream}
+    , compressed{BitIsSet(FO_COMPRESS, flags)}
+    , has_addr{BitIsSet(FO_SPARSE, flags) || BitIsSet(FO_OFFSETS, flags)}
+    , compute_group{num_workers * 3}
+{
+  auto& threadpool = jcr->fd_impl->threads;
+  for (std::size_t i = 0; i < num_workers; ++i) {
+    std::promise<void> fin;
+    workers_fin.push_back(fin.get_future());
+    threadpool.borrow_thread([this, fin = std::move(fin)]() mutable {
+      compute_group.work_until_completion();
+      fin.set_value();
+    });
+  }
+
+  auto [t_in, t_out]
+      = channel::CreateBufferedChannel<std::future<result<restore_block>>>(
+          num_workers);
+  in = std::move(t_in);
+
+  writer_fin
+      = MakeWriterThread(threadpool, bfd, file_addr,
+                         BitIsSet(FO_WIN32DECOMP, flags), std::move(t_out));
+}
+
+restore_pipeline::~restore_pipeline()
+{
+  if (!done) { finish(); }
+}
+
+bool restore_pipeline::push(const char* data, uint32_t size)
+{
+  if (push_error) { return false; }
+
+  restore_block block;
+  if (has_addr) {
+    if (size < OFFSET_FADDR_SIZE) {
+      PoolMem errmsg;
+      Mmsg(errmsg, T_("Data record too short on %s\n"), fname.c_str());
+      push_error = std::move(errmsg);
+      return false;
+    }
+    unser_declare;
+    uint64_t faddr;
+    UnserBegin(data, OFFSET_FADDR_SIZE);
+    unser_uint64(faddr);
+    block.file_addr = faddr;
+    data += OFFSET_FADDR_SIZE;
+    size -= OFFSET_FADDR_SIZE;
+  }
+  block.data.assign(data, data + size);
+
+  std::future<result<restore_block>> fut;
+  if (compressed) {
+    std::size_t max_size
+        = std::max(jcr->buf_size, (int32_t)DEFAULT_NETWORK_BUFFER_SIZE);
+    fut = compute_group.submit([block = std::move(block), stream = stream_,
+                                max_size]() mutable -> result<restore_block> {
+      restore_block decompressed{block.file_addr, {}};
+      decompressed.data.resize(max_size);
+      result size = ThreadlocalDecompress(stream, block.data.data(),
+                                          block.data.size(), decompressed.data);
+      if (size.holds_error()) { return std::move(size.error_unchecked()); }
+      decompressed.data.resize(size.value_unchecked());
+      return decompressed;
+    });
+  } else {
+    std::promise<result<restore_block>> prom;
+    prom.set_value(std::move(block));
+    fut = prom.get_future();
+  }
+
+  // this only fails if the writer has stopped because of an error
+  return in.emplace(std::move(fut));
+}
+
+result<uint64_t> restore_pipeline::finish()
+{
+  ASSERT(!done);
+  compute_group.shutdown();
+  for (auto& fin : workers_fin) { fin.wait(); }
+  in.close();
+  done = true;
+
+  std::optional<PoolMem> error = writer_fin.get();
+  if (push_error) { return std::move(*push_error); }
+  if (error) { return std::move(*error); }
+  return final_addr;
+}
+
+std::future<std::optional<PoolMem>> restore_pipeline::MakeWriterThread(
+    thread_pool& pool,
+    BareosFilePacket* bfd,
+    uint64_t file_addr,
+    bool win32_decomp,
+    channel::output<std::future<result<restore_block>>> out)
+{
+  std::promise<std::optional<PoolMem>> promise;
+  std::future fut = promise.get_future();
+
+  pool.borrow_thread([this, prom = std::move(promise), out = std::move(out),
+                      bfd, file_addr, win32_decomp]() mutable {
+    char ec1[50];
+    std::optional<PoolMem> error;
+    for (;;) {
+      std::optional out_fut = out.get();
+      if (!out_fut) { break; }
+      result p = out_fut->get();
+      if (p.holds_error()) {
+        PoolMem errmsg;
+        Mmsg(errmsg, T_("Uncompression error on file %s. ERR=%s\n"),
+             fname.c_str(), p.error_unchecked().c_str());
+        error = std::move(errmsg);
+        break;
+      }
+
+      auto& block = p.value_unchecked();
+      if (block.file_addr && *block.file_addr != file_addr) {
+        file_addr = *block.file_addr;
+        if (blseek(bfd, (boffset_t)file_addr, SEEK_SET) < 0) {
+          BErrNo be;
+          PoolMem errmsg;
+          Mmsg(errmsg, T_("Seek to %s error on %s: ERR=%s\n"),
+               edit_uint64(file_addr, ec1), fname.c_str(),
+               be.bstrerror(bfd->BErrNo));
+          error = std::move(errmsg);
+          break;
+        }
+      }
+
+      int32_t size = block.data.size();
+      if (jcr->fd_impl->crypto.digest) {
+        CryptoDigestUpdate(jcr->fd_impl->crypto.digest,
+                           (uint8_t*)block.data.data(), size);
+      }
+      PoolMem errmsg;
+      if (!WriteData(jcr, bfd, block.data.data(), size, win32_decomp, fname,
+                     errmsg)) {
+        error = std::move(errmsg);
+        break;
+      }
+      jcr->JobBytes += size;
+      file_addr += size;
+      Dmsg2(130, "Write %u bytes, JobBytes=%s\n", size,
+            edit_uint64(jcr->JobBytes, ec1));
+    }
+    // make sure that nobody is waiting on us anymore
+    out.close();
+    final_addr = file_addr;
+    prom.set_value(std::move(error));
+  });
+
+  return fut;
+}
+
+} /* namespace filedaemon */
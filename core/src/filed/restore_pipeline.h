@@ -0,0 +1,108 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Parallel restore of the data stream of a file.
+ */
+
+#ifndef BAREOS_FILED_RESTORE_PIPELINE_H_
+#define BAREOS_FILED_RESTORE_PIPELINE_H_
+
+#include "findlib/bfile.h"
+#include "lib/channel.h"
+#include "lib/thread_pool.h"
+#include "lib/util.h"
+
+#include <future>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace filedaemon {
+
+struct restore_block {
+  std::optional<uint64_t> file_addr{}; /* set for sparse/offset data */
+  std::vector<char> data{};
+};
+
+/* Restores the data records of one data stream of a file with the help of
+ * MaximumWorkersPerJob worker threads.
+ *
+ * The job thread still receives the records from the sd and decrypts them, as
+ * the cipher is one continuous stream per file.  The decompression of the
+ * records is then done by the workers and a separate writer thread updates
+ * the signature digest and stores the blocks in their original order.  The
+ * amount of records in flight is bounded by the size of the work queue and
+ * the channel to the writer.
+ *
+ * Only the job thread emits job messages: errors of the other threads are
+ * returned by finish(). */
+class restore_pipeline {
+ public:
+  restore_pipeline(JobControlRecord* t_jcr,
+                   BareosFilePacket* bfd,
+                   int32_t t_stream,
+                   const char* flags,
+                   uint64_t file_addr,
+                   std::size_t num_workers);
+
+  restore_pipeline(const restore_pipeline&) = delete;
+  restore_pipeline& operator=(const restore_pipeline&) = delete;
+
+  ~restore_pipeline();
+
+  int32_t stream() const { return stream_; }
+
+  /* Queue the (already decrypted) data of one record for restore.  Returns
+   * false if the pipeline stopped because of an error. */
+  bool push(const char* data, uint32_t size);
+
+  /* Wait until everything that was pushed is written.  Returns the file
+   * address after the last written block or the first error. */
+  result<uint64_t> finish();
+
+ private:
+  std::future<std::optional<PoolMem>> MakeWriterThread(
+      thread_pool& pool,
+      BareosFilePacket* bfd,
+      uint64_t file_addr,
+      bool win32_decomp,
+      channel::output<std::future<result<restore_block>>> out);
+
+  JobControlRecord* jcr;
+  std::string fname;
+  int32_t stream_;
+  bool compressed;
+  bool has_addr;
+  bool done{false};
+  uint64_t final_addr{0};
+  std::optional<PoolMem> push_error{};
+
+  work_group compute_group;
+  std::vector<std::future<void>> workers_fin;
+
+  channel::input<std::future<result<restore_block>>> in{nullptr};
+  std::future<std::optional<PoolMem>> writer_fin;
+};
+
+} /* namespace filedaemon */
+
+#endif  // BAREOS_FILED_RESTORE_PIPELINE_H_
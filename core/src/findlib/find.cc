@@ -38,8 +38,11 @@
 #include "include/jcr.h"
 #include "find.h"
 #include "findlib/find_one.h"
+#include "findlib/prefetch.h"
 #include "lib/util.h"
 
+#include <algorithm>
+
 #if defined(HAVE_DARWIN_OS)
 /* the MacOS linker wants symbols for the destructors of these two types, so we
  * have to force template instantiation. */
@@ -139,6 +142,7 @@ int FindFiles(JobControlRecord* jcr,
       strcpy(ff->BaseJobOpts, "Jspug5"); /* size+perm+user+group+chk  */
       ff->plugin = NULL;
       ff->opt_plugin = false;
+      int prefetch_depth = 0;
 
       /* By setting all options, we in effect OR the global options which is
        * what we want. */
@@ -150,6 +154,7 @@ int FindFiles(JobControlRecord* jcr,
         ff->Compress_algo = fo->Compress_algo;
         ff->Compress_level = fo->Compress_level;
         ff->StripPath = fo->StripPath;
+        prefetch_depth = std::max(prefetch_depth, fo->PrefetchDepth);
         ff->size_match = fo->size_match;
         ff->fstypes = fo->fstype;
         ff->drivetypes = fo->Drivetype;
@@ -171,6 +176,18 @@ int FindFiles(JobControlRecord* jcr,
       Dmsg4(50, "Verify=<%s> Accurate=<%s> BaseJob=<%s> flags=<%d>\n",
             ff->VerifyOpts, ff->AccurateOpts, ff->BaseJobOpts, ff->flags);
 
+      /* Without recursion there is nothing to read ahead.  The prefetcher
+       * stays around until the next Include{} or TermFindFiles(), as we
+       * might return early. */
+      delete ff->prefetcher;
+      ff->prefetcher = nullptr;
+      if (prefetch_depth > 0 && !BitIsSet(FO_NO_RECURSION, ff->flags)) {
+        ff->prefetcher
+            = new DirectoryPrefetcher(prefetch_depth, PrefetchFilter(ff));
+        Dmsg2(debuglevel, "Prefetching %d directories with %d threads\n",
+              prefetch_depth, (int)ff->prefetcher->NumWorkers());
+      }
+
       foreach_dlist (node, &incexe->name_list) {
         char* fname = node->c_str();
 
@@ -236,47 +253,53 @@ bool IsInFileset(FindFilesPacket* ff)
   return false;
 }
 
-bool AcceptFile(FindFilesPacket* ff)
+/**
+ * Applies the Options{} of incexe and the Exclude{} blocks of the fileset to
+ * fname.  flags is updated like ff->flags by AcceptFile() and opts returns
+ * the last Options{} block looked at.  Nothing else is modified, so this can
+ * be used by the DirectoryPrefetcher workers as well.
+ */
+bool AcceptFileName(findFILESET* fileset,
+                    findIncludeExcludeItem* incexe,
+                    const char* fname,
+                    bool is_dir,
+                    char* flags,
+                    findFOPTS** opts)
 {
   int i, j, k;
   int fnm_flags;
   const char* basename;
-  findFILESET* fileset = ff->fileset;
-  findIncludeExcludeItem* incexe = fileset->incexe;
   int (*match_func)(const char* pattern, const char* string, int flags);
 
-  Dmsg1(debuglevel, "enter AcceptFile: fname=%s\n", ff->fname);
-  if (BitIsSet(FO_ENHANCEDWILD, ff->flags)) {
+  Dmsg1(debuglevel, "enter AcceptFileName: fname=%s\n", fname);
+  if (BitIsSet(FO_ENHANCEDWILD, flags)) {
     match_func = fnmatch;
-    if ((basename = last_path_separator(ff->fname)) != NULL)
+    if ((basename = last_path_separator(fname)) != NULL)
       basename++;
     else
-      basename = ff->fname;
+      basename = fname;
   } else {
     match_func = fnmatch;
-    basename = ff->fname;
+    basename = fname;
   }
 
   for (j = 0; j < incexe->opts_list.size(); j++) {
     findFOPTS* fo;
 
     fo = (findFOPTS*)incexe->opts_list.get(j);
-    CopyBits(FO_MAX, fo->flags, ff->flags);
-    ff->Compress_algo = fo->Compress_algo;
-    ff->Compress_level = fo->Compress_level;
-    ff->fstypes = fo->fstype;
-    ff->drivetypes = fo->Drivetype;
+    CopyBits(FO_MAX, fo->flags, flags);
+    *opts = fo;
 
-    fnm_flags = BitIsSet(FO_IGNORECASE, ff->flags) ? FNM_CASEFOLD : 0;
-    fnm_flags |= BitIsSet(FO_ENHANCEDWILD, ff->flags) ? FNM_PATHNAME : 0;
+    fnm_flags = BitIsSet(FO_IGNORECASE, flags) ? FNM_CASEFOLD : 0;
+    fnm_flags |= BitIsSet(FO_ENHANCEDWILD, flags) ? FNM_PATHNAME : 0;
 
-    if (S_ISDIR(ff->statp.st_mode)) {
+    if (is_dir) {
       for (k = 0; k < fo->wilddir.size(); k++) {
-        if (match_func((char*)fo->wilddir.get(k), ff->fname, fnmode | fnm_flags)
+        if (match_func((char*)fo->wilddir.get(k), fname, fnmode | fnm_flags)
             == 0) {
-          if (BitIsSet(FO_EXCLUDE, ff->flags)) {
+          if (BitIsSet(FO_EXCLUDE, flags)) {
             Dmsg2(debuglevel, "Exclude wilddir: %s file=%s\n",
-                  (char*)fo->wilddir.get(k), ff->fname);
+                  (char*)fo->wilddir.get(k), fname);
             return false; /* reject dir */
           }
           return true; /* accept dir */
@@ -284,12 +307,12 @@ bool AcceptFile(FindFilesPacket* ff)
       }
     } else {
       for (k = 0; k < fo->wildfile.size(); k++) {
-        if (match_func((char*)fo->wildfile.get(k), ff->fname,
+        if (match_func((char*)fo->wildfile.get(k), fname,
                        fnmode | fnm_flags)
             == 0) {
-          if (BitIsSet(FO_EXCLUDE, ff->flags)) {
+          if (BitIsSet(FO_EXCLUDE, flags)) {
             Dmsg2(debuglevel, "Exclude wildfile: %s file=%s\n",
-                  (char*)fo->wildfile.get(k), ff->fname);
+                  (char*)fo->wildfile.get(k), fname);
             return false; /* reject file */
           }
           return true; /* accept file */
@@ -299,7 +322,7 @@ bool AcceptFile(FindFilesPacket* ff)
       for (k = 0; k < fo->wildbase.size(); k++) {
         if (match_func((char*)fo->wildbase.get(k), basename, fnmode | fnm_flags)
             == 0) {
-          if (BitIsSet(FO_EXCLUDE, ff->flags)) {
+          if (BitIsSet(FO_EXCLUDE, flags)) {
             Dmsg2(debuglevel, "Exclude wildbase: %s file=%s\n",
                   (char*)fo->wildbase.get(k), basename);
             return false; /* reject file */
@@ -310,22 +333,22 @@ bool AcceptFile(FindFilesPacket* ff)
     }
 
     for (k = 0; k < fo->wild.size(); k++) {
-      if (match_func((char*)fo->wild.get(k), ff->fname, fnmode | fnm_flags)
+      if (match_func((char*)fo->wild.get(k), fname, fnmode | fnm_flags)
           == 0) {
-        if (BitIsSet(FO_EXCLUDE, ff->flags)) {
+        if (BitIsSet(FO_EXCLUDE, flags)) {
           Dmsg2(debuglevel, "Exclude wild: %s file=%s\n",
-                (char*)fo->wild.get(k), ff->fname);
+                (char*)fo->wild.get(k), fname);
           return false; /* reject file */
         }
         return true; /* accept file */
       }
     }
 
-    if (S_ISDIR(ff->statp.st_mode)) {
+    if (is_dir) {
       for (k = 0; k < fo->regexdir.size(); k++) {
-        if (regexec((regex_t*)fo->regexdir.get(k), ff->fname, 0, NULL, 0)
+        if (regexec((regex_t*)fo->regexdir.get(k), fname, 0, NULL, 0)
             == 0) {
-          if (BitIsSet(FO_EXCLUDE, ff->flags)) {
+          if (BitIsSet(FO_EXCLUDE, flags)) {
             return false; /* reject file */
           }
           return true; /* accept file */
@@ -333,9 +356,9 @@ bool AcceptFile(FindFilesPacket* ff)
       }
     } else {
       for (k = 0; k < fo->regexfile.size(); k++) {
-        if (regexec((regex_t*)fo->regexfile.get(k), ff->fname, 0, NULL, 0)
+        if (regexec((regex_t*)fo->regexfile.get(k), fname, 0, NULL, 0)
             == 0) {
-          if (BitIsSet(FO_EXCLUDE, ff->flags)) {
+          if (BitIsSet(FO_EXCLUDE, flags)) {
             return false; /* reject file */
           }
           return true; /* accept file */
@@ -344,18 +367,18 @@ bool AcceptFile(FindFilesPacket* ff)
     }
 
     for (k = 0; k < fo->regex.size(); k++) {
-      if (regexec((regex_t*)fo->regex.get(k), ff->fname, 0, NULL, 0) == 0) {
-        if (BitIsSet(FO_EXCLUDE, ff->flags)) { return false; /* reject file */ }
+      if (regexec((regex_t*)fo->regex.get(k), fname, 0, NULL, 0) == 0) {
+        if (BitIsSet(FO_EXCLUDE, flags)) { return false; /* reject file */ }
         return true; /* accept file */
       }
     }
 
     // If we have an empty Options clause with exclude, then exclude the file
-    if (BitIsSet(FO_EXCLUDE, ff->flags) && fo->regex.size() == 0
+    if (BitIsSet(FO_EXCLUDE, flags) && fo->regex.size() == 0
         && fo->wild.size() == 0 && fo->regexdir.size() == 0
         && fo->wilddir.size() == 0 && fo->regexfile.size() == 0
         && fo->wildfile.size() == 0 && fo->wildbase.size() == 0) {
-      Dmsg1(debuglevel, "Empty options, rejecting: %s\n", ff->fname);
+      Dmsg1(debuglevel, "Empty options, rejecting: %s\n", fname);
       return false; /* reject file */
     }
   }
@@ -370,9 +393,9 @@ bool AcceptFile(FindFilesPacket* ff)
       findFOPTS* fo = (findFOPTS*)exclude_item->opts_list.get(j);
       fnm_flags = BitIsSet(FO_IGNORECASE, fo->flags) ? FNM_CASEFOLD : 0;
       for (k = 0; k < fo->wild.size(); k++) {
-        if (fnmatch((char*)fo->wild.get(k), ff->fname, fnmode | fnm_flags)
+        if (fnmatch((char*)fo->wild.get(k), fname, fnmode | fnm_flags)
             == 0) {
-          Dmsg1(debuglevel, "Reject wild1: %s\n", ff->fname);
+          Dmsg1(debuglevel, "Reject wild1: %s\n", fname);
           return false; /* reject file */
         }
       }
@@ -384,8 +407,8 @@ bool AcceptFile(FindFilesPacket* ff)
     foreach_dlist (node, &exclude_item->name_list) {
       char* fname = node->c_str();
 
-      if (fnmatch(fname, ff->fname, fnmode | fnm_flags) == 0) {
-        Dmsg1(debuglevel, "Reject wild2: %s\n", ff->fname);
+      if (fnmatch(fname, fname, fnmode | fnm_flags) == 0) {
+        Dmsg1(debuglevel, "Reject wild2: %s\n", fname);
         return false; /* reject file */
       }
     }
@@ -394,6 +417,24 @@ bool AcceptFile(FindFilesPacket* ff)
   return true;
 }
 
+bool AcceptFile(FindFilesPacket* ff)
+{
+  findFOPTS* fo = nullptr;
+  bool accept
+      = AcceptFileName(ff->fileset, ff->fileset->incexe, ff->fname,
+                       S_ISDIR(ff->statp.st_mode), ff->flags, &fo);
+
+  // The settings of the last Options{} block looked at apply to the file.
+  if (fo) {
+    ff->Compress_algo = fo->Compress_algo;
+    ff->Compress_level = fo->Compress_level;
+    ff->fstypes = fo->fstype;
+    ff->drivetypes = fo->Drivetype;
+  }
+
+  return accept;
+}
+
 /**
  * The code comes here for each file examined.
  * We filter the files, then call the user's callback if the file is included.
@@ -451,6 +492,7 @@ void TermFindFiles(FindFilesPacket* ff)
     if (ff->link_save) { FreePoolMemory(ff->link_save); }
     if (ff->ignoredir_fname) { FreePoolMemory(ff->ignoredir_fname); }
     TermFindOne(ff);
+    delete ff->prefetcher;
     free(ff);
   }
 }
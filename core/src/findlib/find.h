@@ -132,6 +132,7 @@ struct findFOPTS {
                              integer */
   int Compress_level{};     /**< Compression level */
   int StripPath{};          /**< Strip path count */
+  int PrefetchDepth{};      /**< Directories to read ahead */
   struct s_sz_matching* size_match{}; /**< Perform size matching ? */
   b_fileset_shadow_type shadow_type{
       check_shadow_none};        /**< Perform fileset shadowing check ? */
@@ -168,6 +169,8 @@ struct findFILESET {
   alist<findIncludeExcludeItem*> exclude_list;
 };
 
+class DirectoryPrefetcher;
+
 // OSX resource fork.
 struct HfsPlusInfo {
   unsigned long length{0}; /**< Mandatory field */
@@ -234,6 +237,9 @@ struct FindFilesPacket {
   alist<const char*> fstypes;          /**< Allowed file system types */
   alist<const char*> drivetypes;       /**< Allowed drive types */
 
+  // Reads directories ahead of the walk, if enabled
+  DirectoryPrefetcher* prefetcher{nullptr};
+
   // List of all hard linked files found
   LinkHash* linkhash{nullptr};       /**< Hard linked files */
   struct CurLink* linked{nullptr}; /**< Set if this file is hard linked */
@@ -260,6 +266,12 @@ bool MatchFiles(JobControlRecord* jcr,
 void TermFindFiles(FindFilesPacket* ff);
 bool IsInFileset(FindFilesPacket* ff);
 bool AcceptFile(FindFilesPacket* ff);
+bool AcceptFileName(findFILESET* fileset,
+                    findIncludeExcludeItem* incexe,
+                    const char* fname,
+                    bool is_dir,
+                    char* flags,
+                    findFOPTS** opts);
 findIncludeExcludeItem* allocate_new_incexe(void);
 findIncludeExcludeItem* new_exclude(findFILESET* fileset);
 findIncludeExcludeItem* new_include(findFILESET* fileset);
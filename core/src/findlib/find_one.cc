@@ -42,6 +42,7 @@
 #include "findlib/hardlink.h"
 #include "findlib/fstype.h"
 #include "findlib/drivetype.h"
+#include "findlib/prefetch.h"
 #include "lib/berrno.h"
 #ifdef HAVE_DARWIN_OS
 #  include <sys/param.h>
@@ -98,27 +99,27 @@ static void FreeDirFfPkt(FindFilesPacket* dir_ff_pkt)
  * If we do not have a list of file system types, we accept anything.
  */
 #if defined(HAVE_WIN32)
-static bool AcceptFstype(FindFilesPacket*, void*) { return true; }
+static bool AcceptFstypeOf(const char*, alist<const char*>&) { return true; }
 #else
-static bool AcceptFstype(FindFilesPacket* ff, void*)
+static bool AcceptFstypeOf(const char* fname, alist<const char*>& fstypes)
 {
   int i;
   char fs[1000];
   bool accept = true;
 
-  if (ff->fstypes.size()) {
+  if (fstypes.size()) {
     accept = false;
-    if (!fstype(ff->fname, fs, sizeof(fs))) {
-      Dmsg1(50, "Cannot determine file system type for \"%s\"\n", ff->fname);
+    if (!fstype(fname, fs, sizeof(fs))) {
+      Dmsg1(50, "Cannot determine file system type for \"%s\"\n", fname);
     } else {
-      for (i = 0; i < ff->fstypes.size(); ++i) {
-        if (bstrcmp(fs, (char*)ff->fstypes.get(i))) {
-          Dmsg2(100, "Accepting fstype %s for \"%s\"\n", fs, ff->fname);
+      for (i = 0; i < fstypes.size(); ++i) {
+        if (bstrcmp(fs, (char*)fstypes.get(i))) {
+          Dmsg2(100, "Accepting fstype %s for \"%s\"\n", fs, fname);
           accept = true;
           break;
         }
-        Dmsg3(200, "fstype %s for \"%s\" does not match %s\n", fs, ff->fname,
-              ff->fstypes.get(i));
+        Dmsg3(200, "fstype %s for \"%s\" does not match %s\n", fs, fname,
+              fstypes.get(i));
       }
     }
   }
@@ -127,6 +128,11 @@ static bool AcceptFstype(FindFilesPacket* ff, void*)
 }
 #endif
 
+static bool AcceptFstype(FindFilesPacket* ff, void*)
+{
+  return AcceptFstypeOf(ff->fname, ff->fstypes);
+}
+
 /**
  * Check to see if we allow the drive type of a file or directory.
  * If we do not have a list of drive types, we accept anything.
@@ -333,25 +339,23 @@ bool CheckChanges(JobControlRecord* jcr, FindFilesPacket* ff_pkt)
   return true;
 }
 
-static inline bool HaveIgnoredir(FindFilesPacket* ff_pkt)
+/* Is one of the IgnoreDir files of incexe in the directory dirname?  fname
+ * is the buffer for the names that are looked at. */
+static bool ContainsIgnoredir(findIncludeExcludeItem* incexe,
+                              const char* dirname,
+                              POOLMEM*& fname)
 {
   struct stat sb;
   char* ignoredir;
 
-  // Ensure that pointers are defined
-  if (!ff_pkt->fileset || !ff_pkt->fileset->incexe) { return false; }
-
-  for (int i = 0; i < ff_pkt->fileset->incexe->ignoredir.size(); i++) {
-    ignoredir = (char*)ff_pkt->fileset->incexe->ignoredir.get(i);
+  for (int i = 0; i < incexe->ignoredir.size(); i++) {
+    ignoredir = (char*)incexe->ignoredir.get(i);
 
     if (ignoredir) {
-      if (!ff_pkt->ignoredir_fname) {
-        ff_pkt->ignoredir_fname = GetPoolMemory(PM_FNAME);
-      }
-      Mmsg(ff_pkt->ignoredir_fname, "%s/%s", ff_pkt->fname, ignoredir);
-      if (stat(ff_pkt->ignoredir_fname, &sb) == 0) {
-        Dmsg2(100, "Directory '%s' ignored (found %s)\n", ff_pkt->fname,
-              ignoredir);
+      if (!fname) { fname = GetPoolMemory(PM_FNAME); }
+      Mmsg(fname, "%s/%s", dirname, ignoredir);
+      if (stat(fname, &sb) == 0) {
+        Dmsg2(100, "Directory '%s' ignored (found %s)\n", dirname, ignoredir);
         return true; /* Just ignore this directory */
       }
     }
@@ -360,6 +364,15 @@ static inline bool HaveIgnoredir(FindFilesPacket* ff_pkt)
   return false;
 }
 
+static inline bool HaveIgnoredir(FindFilesPacket* ff_pkt)
+{
+  // Ensure that pointers are defined
+  if (!ff_pkt->fileset || !ff_pkt->fileset->incexe) { return false; }
+
+  return ContainsIgnoredir(ff_pkt->fileset->incexe, ff_pkt->fname,
+                           ff_pkt->ignoredir_fname);
+}
+
 // Restore file times.
 static inline void RestoreFileTimes(FindFilesPacket* ff_pkt, char* fname)
 {
@@ -534,6 +547,67 @@ static inline int process_symlink(JobControlRecord* jcr,
   return rtn_stat;
 }
 
+/**
+ * Handling of one entry name of a directory, the part that is shared by the
+ * readdir() loops and the loop over the entries read ahead by the
+ * DirectoryPrefetcher (prefetched is set then).  link holds the canonical
+ * directory name with a trailing slash of length len in a buffer of link_len
+ * bytes, which is grown as needed.  Returns the status of the entry or
+ * rtn_stat if it was skipped.
+ */
+static int process_directory_entry(JobControlRecord* jcr,
+                                   FindFilesPacket* ff_pkt,
+                                   int HandleFile(JobControlRecord* jcr,
+                                                  FindFilesPacket* ff,
+                                                  bool top_level),
+                                   const char* name,
+                                   int name_length,
+                                   char*& link,
+                                   int len,
+                                   int& link_len,
+                                   dev_t our_device,
+                                   const PrefetchedEntry* prefetched,
+                                   int rtn_stat)
+{
+  /* Some filesystems violate against the rules and return filenames
+   * longer than _PC_NAME_MAX. Log the error and continue. */
+  if ((name_max + 1) <= ((int)sizeof(struct dirent) + name_length)) {
+    Jmsg2(jcr, M_ERROR, 0, T_("%s: File name too long [%d]\n"), name,
+          name_length);
+    return rtn_stat;
+  }
+
+  // Skip `.', `..', and excluded file names.
+  if (name[0] == '\0'
+      || (name[0] == '.'
+          && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))) {
+    return rtn_stat;
+  }
+
+  // Make sure there is enough room to store the whole name.
+  if (name_length + len >= link_len) {
+    link_len = len + name_length + 1;
+    link = (char*)realloc(link, link_len + 1);
+  }
+
+  memcpy(link + len, name, name_length);
+  link[len + name_length] = '\0';
+
+  if (!FileIsExcluded(ff_pkt, link)) {
+    rtn_stat = FindOneFile(jcr, ff_pkt, HandleFile, link, our_device, false,
+                           prefetched);
+    if (ff_pkt->linked) { ff_pkt->linked->FileIndex = ff_pkt->FileIndex; }
+  }
+
+  // Whatever was read ahead below this entry is not needed anymore.
+  if (prefetched && prefetched->stat_errno == 0
+      && S_ISDIR(prefetched->statp.st_mode)) {
+    ff_pkt->prefetcher->Release(link);
+  }
+
+  return rtn_stat;
+}
+
 // Handling of a directory.
 static inline int process_directory(JobControlRecord* jcr,
                                     FindFilesPacket* ff_pkt,
@@ -657,11 +731,22 @@ static inline int process_directory(JobControlRecord* jcr,
 
   ff_pkt->link = ff_pkt->fname; /* reset "link" */
 
-  // Descend into or "recurse" into the directory to read all the files in it.
+  /* Descend into or "recurse" into the directory to read all the files in it.
+   * With a prefetcher the entries were probably read and lstat()ed already. */
+  std::unique_ptr<PrefetchedDirectory> prefetched;
+  int open_errno = 0;
+  directory = NULL;
   errno = 0;
-  if ((directory = opendir(fname)) == NULL) {
+  if (ff_pkt->prefetcher) {
+    prefetched = ff_pkt->prefetcher->Take(fname, our_device);
+    open_errno = prefetched->open_errno;
+  } else if ((directory = opendir(fname)) == NULL) {
+    open_errno = errno;
+  }
+
+  if (prefetched ? open_errno != 0 : directory == NULL) {
     ff_pkt->type = FT_NOOPEN;
-    ff_pkt->ff_errno = errno;
+    ff_pkt->ff_errno = open_errno;
     rtn_stat = HandleFile(jcr, ff_pkt, top_level);
     if (ff_pkt->linked) { ff_pkt->linked->FileIndex = ff_pkt->FileIndex; }
     free(link);
@@ -674,98 +759,40 @@ static inline int process_directory(JobControlRecord* jcr,
    * before traversing it. */
   rtn_stat = 1;
 
-  /* Allocate some extra room so an overflow of the d_name with more then
-   * name_max bytes doesn't kill us right away. We check in the loop if
-   * an overflow has not happened. */
-#ifdef USE_READDIR_R
-  int status;
-
-  entry = (struct dirent*)malloc(sizeof(struct dirent) + name_max + 100);
-  while (!jcr->IsJobCanceled()) {
-    int name_length;
-
-    status = Readdir_r(directory, entry, &result);
-    if (status != 0 || result == NULL) { break; }
-
-    name_length = (int)NAMELEN(entry);
-
-    /* Some filesystems violate against the rules and return filenames
-     * longer than _PC_NAME_MAX. Log the error and continue. */
-    if ((name_max + 1) <= ((int)sizeof(struct dirent) + name_length)) {
-      Jmsg2(jcr, M_ERROR, 0, T_("%s: File name too long [%d]\n"), entry->d_name,
-            name_length);
-      continue;
-    }
-
-    // Skip `.', `..', and excluded file names.
-    if (entry->d_name[0] == '\0'
-        || (entry->d_name[0] == '.'
-            && (entry->d_name[1] == '\0'
-                || (entry->d_name[1] == '.' && entry->d_name[2] == '\0')))) {
-      continue;
-    }
-
-    // Make sure there is enough room to store the whole name.
-    if (name_length + len >= link_len) {
-      link_len = len + name_length + 1;
-      link = (char*)realloc(link, link_len + 1);
+  if (prefetched) {
+    for (const PrefetchedEntry& entry : prefetched->entries) {
+      if (jcr->IsJobCanceled()) { break; }
+      rtn_stat = process_directory_entry(
+          jcr, ff_pkt, HandleFile, entry.name.c_str(), (int)entry.name.size(),
+          link, len, link_len, our_device, &entry, rtn_stat);
     }
-
-    memcpy(link + len, entry->d_name, name_length);
-    link[len + name_length] = '\0';
-
-    if (!FileIsExcluded(ff_pkt, link)) {
-      rtn_stat = FindOneFile(jcr, ff_pkt, HandleFile, link, our_device, false);
+  } else {
+    /* Allocate some extra room so an overflow of the d_name with more then
+     * name_max bytes doesn't kill us right away. We check in the loop if
+     * an overflow has not happened. */
+#ifdef USE_READDIR_R
+    entry = (struct dirent*)malloc(sizeof(struct dirent) + name_max + 100);
+    while (!jcr->IsJobCanceled()) {
+      if (Readdir_r(directory, entry, &result) != 0 || result == NULL) {
+        break;
+      }
+      rtn_stat = process_directory_entry(
+          jcr, ff_pkt, HandleFile, entry->d_name, (int)NAMELEN(entry), link,
+          len, link_len, our_device, nullptr, rtn_stat);
     }
-  }
-
-  closedir(directory);
-  free(link);
-  free(entry);
-
+    free(entry);
 #else
-
-  while (!jcr->IsJobCanceled()) {
-    int name_length;
-    result = readdir(directory);
-    if (result == NULL) { break; }
-
-    name_length = (int)NAMELEN(result);
-
-    /* Some filesystems violate against the rules and return filenames
-     * longer than _PC_NAME_MAX. Log the error and continue. */
-    if ((name_max + 1) <= ((int)sizeof(struct dirent) + name_length)) {
-      Jmsg2(jcr, M_ERROR, 0, T_("%s: File name too long [%d]\n"),
-            result->d_name, name_length);
-      continue;
-    }
-
-    // Skip `.', `..', and excluded file names.
-    if (result->d_name[0] == '\0'
-        || (result->d_name[0] == '.'
-            && (result->d_name[1] == '\0'
-                || (result->d_name[1] == '.' && result->d_name[2] == '\0')))) {
-      continue;
-    }
-
-    // Make sure there is enough room to store the whole name.
-    if (name_length + len >= link_len) {
-      link_len = len + name_length + 1;
-      link = (char*)realloc(link, link_len + 1);
-    }
-
-    memcpy(link + len, result->d_name, name_length);
-    link[len + name_length] = '\0';
-
-    if (!FileIsExcluded(ff_pkt, link)) {
-      rtn_stat = FindOneFile(jcr, ff_pkt, HandleFile, link, our_device, false);
-      if (ff_pkt->linked) { ff_pkt->linked->FileIndex = ff_pkt->FileIndex; }
+    while (!jcr->IsJobCanceled()) {
+      if ((result = readdir(directory)) == NULL) { break; }
+      rtn_stat = process_directory_entry(
+          jcr, ff_pkt, HandleFile, result->d_name, (int)NAMELEN(result), link,
+          len, link_len, our_device, nullptr, rtn_stat);
     }
+#endif
+    closedir(directory);
   }
-
-  closedir(directory);
   free(link);
-#endif
+
   /* Now that we have recursed through all the files in the
    * directory, we "save" the directory so that after all
    * the files are restored, this entry will serve to reset
@@ -886,6 +913,7 @@ static inline bool NeedsProcessing(JobControlRecord* jcr,
  *    p is the filename
  *    parent_device is the device we are currently on
  *    top_level is 1 when not recursing or 0 when descending into a directory.
+ *    prefetched is the already lstat()ed entry when read ahead.
  */
 int FindOneFile(JobControlRecord* jcr,
                 FindFilesPacket* ff_pkt,
@@ -894,17 +922,25 @@ int FindOneFile(JobControlRecord* jcr,
                                bool top_level),
                 char* fname,
                 dev_t parent_device,
-                bool top_level)
+                bool top_level,
+                const PrefetchedEntry* prefetched)
 {
   int rtn_stat;
   bool done = false;
+  int stat_errno = 0;
 
   ff_pkt->link = ff_pkt->fname = fname;
   ff_pkt->type = FT_UNSET;
-  if (lstat(fname, &ff_pkt->statp) != 0) {
+  if (prefetched) {
+    ff_pkt->statp = prefetched->statp;
+    stat_errno = prefetched->stat_errno;
+  } else if (lstat(fname, &ff_pkt->statp) != 0) {
+    stat_errno = errno;
+  }
+  if (stat_errno != 0) {
     // Cannot stat file
     ff_pkt->type = FT_NOSTAT;
-    ff_pkt->ff_errno = errno;
+    ff_pkt->ff_errno = stat_errno;
     return HandleFile(jcr, ff_pkt, top_level);
   }
 
@@ -1011,3 +1047,48 @@ void TermFindOne(FindFilesPacket* ff)
   delete ff->linkhash;
   ff->linkhash = nullptr;
 }
+
+DirectoryPrefetcher::Filter PrefetchFilter(FindFilesPacket* ff)
+{
+  /* The walk changes ff->flags and fileset->incexe as it goes, so the
+   * workers start from the state of the current Include{}. */
+  findFILESET* fileset = ff->fileset;
+  findIncludeExcludeItem* incexe = fileset ? fileset->incexe : nullptr;
+  std::string include_flags(ff->flags, sizeof(ff->flags));
+
+  return [ff, fileset, incexe, include_flags](const std::string& path,
+                                              const struct stat& statp,
+                                              dev_t parent_dev) {
+    if (FileIsExcluded(ff, path.c_str())) { return false; }
+
+    // What process_directory() checks, with AcceptFile() for OurCallback().
+    char flags[FOPTS_BYTES];
+    memcpy(flags, include_flags.data(), sizeof(flags));
+    findFOPTS* opts = nullptr;
+    if (incexe) {
+      if (!AcceptFileName(fileset, incexe, path.c_str(), true, flags, &opts)) {
+        return false;
+      }
+
+      POOLMEM* ignoredir_fname = nullptr;
+      bool ignored = ContainsIgnoredir(incexe, path.c_str(), ignoredir_fname);
+      if (ignoredir_fname) { FreePoolMemory(ignoredir_fname); }
+      if (ignored) { return false; }
+    }
+
+    if (BitIsSet(FO_NO_RECURSION, flags)) { return false; }
+
+    bool is_win32_mount_point = false;
+#if defined(HAVE_WIN32)
+    is_win32_mount_point = statp.st_rdev & FILE_ATTRIBUTE_VOLUME_MOUNT_POINT;
+#endif
+    if (parent_dev != statp.st_dev || is_win32_mount_point) {
+      if (!BitIsSet(FO_MULTIFS, flags)) { return false; }
+      if (opts && !AcceptFstypeOf(path.c_str(), opts->fstype)) {
+        return false;
+      }
+    }
+
+    return true;
+  };
+}
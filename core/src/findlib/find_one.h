@@ -21,6 +21,8 @@
 #ifndef BAREOS_FINDLIB_FIND_ONE_H_
 #define BAREOS_FINDLIB_FIND_ONE_H_
 
+struct PrefetchedEntry;
+
 int FindOneFile(JobControlRecord* jcr,
                 FindFilesPacket* ff,
                 int HandleFile(JobControlRecord* jcr,
@@ -28,7 +30,8 @@ int FindOneFile(JobControlRecord* jcr,
                                bool top_level),
                 char* p,
                 dev_t parent_device,
-                bool top_level);
+                bool top_level,
+                const PrefetchedEntry* prefetched = nullptr);
 void TermFindOne(FindFilesPacket* ff);
 bool HasFileChanged(JobControlRecord* jcr, FindFilesPacket* ff_pkt);
 bool CheckChanges(JobControlRecord* jcr, FindFilesPacket* ff_pkt);
@@ -341,6 +341,14 @@ void AddFnameToIncludeList(FindFilesPacket* ff, int prefixed, const char* fname)
               inc->algo = COMPRESS_FZ4H;
               inc->level = 1; /* Not used with libfzlib */
             }
+          } else if (*rp == 's') {
+            SetBit(FO_COMPRESS, inc->options);
+            inc->algo = COMPRESS_ZSTD;
+            inc->level = 0;
+            while (B_ISDIGIT(rp[1])) {
+              rp++;
+              inc->level = inc->level * 10 + (*rp - '0');
+            }
           }
           Dmsg2(200, "Compression alg=%d level=%d\n", inc->algo, inc->level);
           break;
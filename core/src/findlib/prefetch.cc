@@ -0,0 +1,302 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Parallel read ahead of directories for the file system walk.
+ */
+
+#include "include/bareos.h"
+#include "find.h"
+#include "findlib/prefetch.h"
+
+#include <algorithm>
+
+extern int32_t name_max; /* filename max length */
+
+namespace {
+// Number of entries that are lstat()ed by one worker in one go.
+constexpr std::size_t kStatBatchSize = 64;
+
+// More threads mostly add contention on the directory locks of the kernel.
+constexpr int kMaxWorkers = 16;
+
+bool IsDotOrDotDot(const char* name)
+{
+  return name[0] == '.'
+         && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+}  // namespace
+
+DirectoryPrefetcher::DirectoryPrefetcher(int depth, Filter descend)
+    : depth_(std::max(depth, 1)), descend_(std::move(descend))
+{
+  int num_workers = std::min(std::max(depth, 1), kMaxWorkers);
+  workers_.reserve(num_workers);
+  for (int i = 0; i < num_workers; ++i) {
+    workers_.emplace_back(&DirectoryPrefetcher::Work, this);
+  }
+}
+
+DirectoryPrefetcher::~DirectoryPrefetcher()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_cv_.notify_all();
+  for (auto& worker : workers_) { worker.join(); }
+}
+
+std::shared_ptr<DirectoryPrefetcher::Node> DirectoryPrefetcher::NewNode(
+    const std::string& path,
+    dev_t dev)
+{
+  auto node = std::make_shared<Node>();
+  node->path = path;
+  node->dev = dev;
+
+  // Same canonical name with a single trailing slash as in process_directory
+  std::size_t len = path.size();
+  while (len >= 1 && IsPathSeparator(path[len - 1])) { len--; }
+  node->prefix = path.substr(0, len) + '/';
+
+  return node;
+}
+
+std::unique_ptr<PrefetchedDirectory> DirectoryPrefetcher::Take(
+    const std::string& path,
+    dev_t dev)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  std::shared_ptr<Node> node;
+  if (auto it = nodes_.find(path); it != nodes_.end()) {
+    // A directory may be walked twice, e.g. when named twice in the fileset
+    if (!it->second->dropped && it->second->state != State::Taken) {
+      node = it->second;
+    }
+  }
+  if (!node) {
+    node = NewNode(path, dev);
+    nodes_[path] = node;
+  }
+
+  if (node->state == State::Queued) {
+    // Nobody started on it yet, so there is no point in waiting.
+    node->state = State::Reading;
+    active_++;
+    lock.unlock();
+    Read(node);
+    lock.lock();
+  }
+
+  ready_cv_.wait(lock, [&node] { return node->state == State::Ready; });
+  node->state = State::Taken;
+  active_--;
+  work_cv_.notify_all();
+
+  return std::move(node->listing);
+}
+
+void DirectoryPrefetcher::Drop(Node& node)
+{
+  if (node.state == State::Ready) {
+    node.listing.reset();
+    active_--;
+  }
+  node.dropped = true;
+}
+
+void DirectoryPrefetcher::Release(const std::string& path)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (auto it = nodes_.find(path); it != nodes_.end()) {
+    Drop(*it->second);
+    nodes_.erase(it);
+  }
+
+  /* All names below path share the canonical prefix, so they are found as
+   * one range of the ordered map. */
+  std::string prefix = NewNode(path, 0)->prefix;
+  auto it = nodes_.lower_bound(prefix);
+  while (it != nodes_.end()
+         && it->first.compare(0, prefix.size(), prefix) == 0) {
+    Drop(*it->second);
+    it = nodes_.erase(it);
+  }
+
+  work_cv_.notify_all();
+}
+
+void DirectoryPrefetcher::Work()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  while (true) {
+    work_cv_.wait(lock, [this] {
+      return stop_ || !stat_queue_.empty()
+             || (!read_queue_.empty() && active_ < depth_);
+    });
+    if (stop_) { return; }
+
+    // Finishing directories that were already started comes first.
+    if (!stat_queue_.empty()) {
+      StatBatch task = std::move(stat_queue_.front());
+      stat_queue_.pop_front();
+      lock.unlock();
+      if (!task.node->claimed[task.batch].exchange(true)) {
+        RunStatBatch(task.node, task.batch);
+      }
+      lock.lock();
+      continue;
+    }
+
+    std::shared_ptr<Node> node = std::move(read_queue_.front());
+    read_queue_.pop_front();
+    if (node->dropped || node->state != State::Queued) { continue; }
+
+    node->state = State::Reading;
+    active_++;
+    lock.unlock();
+    Read(node);
+    lock.lock();
+  }
+}
+
+void DirectoryPrefetcher::Read(const std::shared_ptr<Node>& node)
+{
+  auto listing = std::make_unique<PrefetchedDirectory>();
+
+  errno = 0;
+  DIR* directory = opendir(node->path.c_str());
+  if (!directory) {
+    listing->open_errno = errno ? errno : ENOENT;
+    node->listing = std::move(listing);
+    Finish(node);
+    return;
+  }
+
+#ifdef USE_READDIR_R
+  struct dirent* result;
+  struct dirent* entry
+      = (struct dirent*)malloc(sizeof(struct dirent) + name_max + 100);
+  while (!stop_ && !node->dropped) {
+    if (Readdir_r(directory, entry, &result) != 0 || result == NULL) { break; }
+    if (entry->d_name[0] == '\0' || IsDotOrDotDot(entry->d_name)) { continue; }
+    listing->entries.emplace_back().name.assign(entry->d_name, NAMELEN(entry));
+  }
+  free(entry);
+#else
+  struct dirent* result;
+  while (!stop_ && !node->dropped) {
+    if ((result = readdir(directory)) == NULL) { break; }
+    if (result->d_name[0] == '\0' || IsDotOrDotDot(result->d_name)) {
+      continue;
+    }
+    listing->entries.emplace_back().name.assign(result->d_name,
+                                                NAMELEN(result));
+  }
+#endif
+  closedir(directory);
+
+  std::size_t count = listing->entries.size();
+  node->listing = std::move(listing);
+  node->batches = std::max<std::size_t>(
+      (count + kStatBatchSize - 1) / kStatBatchSize, 1);
+  node->claimed = std::make_unique<std::atomic<bool>[]>(node->batches);
+  node->unfinished = node->batches;
+
+  if (node->batches > 1) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (std::size_t batch = 1; batch < node->batches; ++batch) {
+        stat_queue_.push_back(StatBatch{node, batch});
+      }
+    }
+    work_cv_.notify_all();
+  }
+
+  // Work on our own batches as well, the others just help out.
+  for (std::size_t batch = 0; batch < node->batches; ++batch) {
+    if (!node->claimed[batch].exchange(true)) { RunStatBatch(node, batch); }
+  }
+}
+
+void DirectoryPrefetcher::RunStatBatch(const std::shared_ptr<Node>& node,
+                                       std::size_t batch)
+{
+  auto& entries = node->listing->entries;
+  std::size_t begin = batch * kStatBatchSize;
+  std::size_t end = std::min(begin + kStatBatchSize, entries.size());
+
+  std::string fname = node->prefix;
+  for (std::size_t i = begin; i < end && !node->dropped && !stop_; ++i) {
+    fname.resize(node->prefix.size());
+    fname += entries[i].name;
+    if (lstat(fname.c_str(), &entries[i].statp) != 0) {
+      entries[i].stat_errno = errno ? errno : ENOENT;
+    }
+  }
+
+  // The last batch makes the directory available.
+  if (node->unfinished.fetch_sub(1) == 1) { Finish(node); }
+}
+
+void DirectoryPrefetcher::Finish(const std::shared_ptr<Node>& node)
+{
+  /* The subdirectories the walk will descend into, in reverse order.  The
+   * filter may have to look at the file system, so it runs unlocked. */
+  std::vector<std::pair<std::string, dev_t>> subdirs;
+  if (!node->dropped && node->listing->open_errno == 0) {
+    auto& entries = node->listing->entries;
+    for (auto it = entries.rbegin(); it != entries.rend() && !stop_; ++it) {
+      if (it->stat_errno != 0 || !S_ISDIR(it->statp.st_mode)) { continue; }
+
+      std::string path = node->prefix + it->name;
+      if (descend_ && !descend_(path, it->statp, node->dev)) { continue; }
+      subdirs.emplace_back(std::move(path), it->statp.st_dev);
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (node->dropped) {
+      node->listing.reset();
+      active_--;
+    } else {
+      node->state = State::Ready;
+
+      /* Queue the subdirectories in front of everything else in the order
+       * the walk will need them. */
+      for (auto& [path, dev] : subdirs) {
+        auto& child = nodes_[path];
+        if (child) { continue; }
+        child = NewNode(path, dev);
+        read_queue_.push_front(child);
+      }
+    }
+  }
+
+  ready_cv_.notify_all();
+  work_cv_.notify_all();
+}
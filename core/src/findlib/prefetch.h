@@ -0,0 +1,148 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Parallel read ahead of directories for the file system walk.
+ */
+#ifndef BAREOS_FINDLIB_PREFETCH_H_
+#define BAREOS_FINDLIB_PREFETCH_H_
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct FindFilesPacket;
+
+// A directory entry together with the result of its lstat().
+struct PrefetchedEntry {
+  std::string name;
+  struct stat statp {};
+  int stat_errno{0}; /**< Errno of lstat(), statp is only valid if 0 */
+};
+
+struct PrefetchedDirectory {
+  int open_errno{0}; /**< Errno of opendir(), entries are empty if set */
+  std::vector<PrefetchedEntry> entries;
+};
+
+/**
+ * Reads directories and lstat()s their entries on a pool of worker threads
+ * ahead of the walk done by FindOneFile().  The walk itself stays on the
+ * calling thread and asks for every directory in the same order as before,
+ * so the FindFiles callback sees exactly the same sequence of files; it just
+ * does not have to wait for the file system in between.
+ *
+ * At most depth directories are read ahead.  Directories that the walk will
+ * need next are read first: the subdirectories of a directory are queued in
+ * front of everything that was queued before them.  Big directories are split
+ * into batches of entries so idle workers can help with their lstat()s.
+ */
+class DirectoryPrefetcher {
+ public:
+  /* Decides whether the walk will descend into the subdirectory path, given
+   * its lstat() result and the device of its parent.  Only directories it
+   * accepts are read ahead.  It is called by the worker threads. */
+  using Filter = std::function<bool(const std::string& path,
+                                    const struct stat& statp,
+                                    dev_t parent_dev)>;
+
+  // Without a filter every subdirectory is read ahead.
+  explicit DirectoryPrefetcher(int depth, Filter descend = {});
+  ~DirectoryPrefetcher();
+
+  DirectoryPrefetcher(const DirectoryPrefetcher&) = delete;
+  DirectoryPrefetcher& operator=(const DirectoryPrefetcher&) = delete;
+
+  /* Returns the entries of the directory path located on dev.  If no worker
+   * got to it yet, the directory is read by the calling thread. */
+  std::unique_ptr<PrefetchedDirectory> Take(const std::string& path, dev_t dev);
+
+  /* The walk is done with path; everything read ahead below it is dropped.
+   * This also covers directories the walk decided not to descend into. */
+  void Release(const std::string& path);
+
+  std::size_t NumWorkers() const { return workers_.size(); }
+
+ private:
+  enum class State
+  {
+    Queued,
+    Reading,
+    Ready,
+    Taken
+  };
+
+  struct Node {
+    std::string path;
+    std::string prefix; /**< path with exactly one trailing slash */
+    dev_t dev{};
+    State state{State::Queued};
+    std::atomic<bool> dropped{false};
+    std::unique_ptr<PrefetchedDirectory> listing;
+    std::size_t batches{0};
+    std::unique_ptr<std::atomic<bool>[]> claimed;
+    std::atomic<std::size_t> unfinished{0};
+  };
+
+  struct StatBatch {
+    std::shared_ptr<Node> node;
+    std::size_t batch;
+  };
+
+  std::shared_ptr<Node> NewNode(const std::string& path, dev_t dev);
+  void Work();
+  void Read(const std::shared_ptr<Node>& node);
+  void RunStatBatch(const std::shared_ptr<Node>& node, std::size_t batch);
+  void Finish(const std::shared_ptr<Node>& node);
+  void Drop(Node& node);
+
+  const std::size_t depth_;
+  const Filter descend_;
+
+  std::mutex mutex_;
+  std::condition_variable work_cv_;  /**< Signals new work to the workers */
+  std::condition_variable ready_cv_; /**< Signals finished reads to Take() */
+  std::deque<std::shared_ptr<Node>> read_queue_;
+  std::deque<StatBatch> stat_queue_;
+  std::map<std::string, std::shared_ptr<Node>> nodes_;
+  std::size_t active_{0}; /**< Nodes that are Reading or Ready */
+  std::atomic<bool> stop_{false};
+  std::vector<std::thread> workers_;
+};
+
+/* The Filter for ff: applies the same checks as FindOneFile() does before it
+ * descends into a directory (old style excludes, Options{} of the current
+ * Include{}, Exclude{}, Exclude Dir Containing, recursion, file system
+ * changes and fstype). */
+DirectoryPrefetcher::Filter PrefetchFilter(FindFilesPacket* ff);
+
+#endif  // BAREOS_FINDLIB_PREFETCH_H_
@@ -35,6 +35,7 @@
 #define COMPRESS_FZFZ 0x465A465A
 #define COMPRESS_FZ4L 0x465A344C
 #define COMPRESS_FZ4H 0x465A3448
+#define COMPRESS_ZSTD 0x5A535444
 
 // Compression header version
 #define COMP_HEAD_VERSION 0x1
@@ -38,6 +38,9 @@ struct CompressionContext {
     void* pLZO{nullptr}; /**< LZO compression session data */
 #endif
     void* pZFAST{nullptr}; /**< FASTLZ compression session data */
+#ifdef HAVE_ZSTD
+    void* pZSTD{nullptr}; /**< ZSTD compression context */
+#endif
   } workset;
 };
 /* clang-format on */
@@ -165,6 +165,7 @@ class JobControlRecord {
   dlist<MessageQueueItem>* msg_queue{};             /**< Queued messages */
   pthread_mutex_t msg_queue_mutex = PTHREAD_MUTEX_INITIALIZER; /**< message queue mutex */
   bool dequeuing_msgs{};          /**< Set when dequeuing messages */
+  std::atomic<bool> queue_msgs{}; /**< Queue all job messages until cleared */
   alist<job_callback_item*> job_end_callbacks;        /**< callbacks called at Job end */
   POOLMEM* VolumeName{};          /**< Volume name desired -- pool_memory */
   POOLMEM* errmsg{};              /**< Edited error message */
@@ -0,0 +1,91 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Entries of the accurate file list sent from the director to the filed
+ */
+
+#include "lib/accurate_pack.h"
+
+#include <cstring>
+
+void AppendAccurateEntry(std::string& pack,
+                         const char* path,
+                         const char* fname,
+                         const char* lstat,
+                         const char* chksum,
+                         const char* delta_seq)
+{
+  pack.append(path);
+  pack.append(fname);
+  pack.push_back('\0');
+  pack.append(lstat);
+  pack.push_back('\0');
+  pack.append(chksum);
+  pack.push_back('\0');
+  pack.append(delta_seq);
+  pack.push_back('\0');
+}
+
+namespace {
+// The delta sequence is a short decimal number, an empty one is 0.
+bool ParseDeltaSeq(std::string_view str, uint16_t& delta_seq)
+{
+  uint32_t value = 0;
+  for (char c : str) {
+    if (c < '0' || c > '9') { return false; }
+    value = value * 10 + (c - '0');
+    if (value > UINT16_MAX) { return false; }
+  }
+  delta_seq = value;
+  return true;
+}
+}  // namespace
+
+bool ParseAccuratePack(const char* msg,
+                       std::size_t length,
+                       const std::function<void(const AccurateEntry&)>& add)
+{
+  const char* end = msg + length;
+  bool ok = true;
+
+  while (msg < end) {
+    std::string_view fields[4];
+
+    for (auto& field : fields) {
+      const char* term
+          = msg < end ? static_cast<const char*>(memchr(msg, '\0', end - msg))
+                      : nullptr;
+      if (!term) { return false; }
+      field = std::string_view(msg, term - msg);
+      msg = term + 1;
+    }
+
+    AccurateEntry entry{fields[0], fields[1], fields[2], 0};
+    if (fields[0].empty() || !ParseDeltaSeq(fields[3], entry.delta_seq)) {
+      ok = false;
+      continue;
+    }
+    add(entry);
+  }
+
+  return ok;
+}
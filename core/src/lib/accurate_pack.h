@@ -0,0 +1,60 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Entries of the accurate file list sent from the director to the filed
+ */
+
+#ifndef BAREOS_LIB_ACCURATE_PACK_H_
+#define BAREOS_LIB_ACCURATE_PACK_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+/*
+ * Every entry is
+ *   path + fname + \0 + lstat + \0 + checksum + \0 + delta_seq + \0
+ * A File daemon with FD_VERSION_55 gets a pack of entries per message,
+ * older ones get one entry per message without the last \0.
+ */
+struct AccurateEntry {
+  std::string_view fname;
+  std::string_view lstat;
+  std::string_view chksum;
+  uint16_t delta_seq{0};
+};
+
+void AppendAccurateEntry(std::string& pack,
+                         const char* path,
+                         const char* fname,
+                         const char* lstat,
+                         const char* chksum,
+                         const char* delta_seq);
+
+/* Calls add for every entry of a packed message.  Returns false if the
+ * message holds an incomplete or malformed entry, which is skipped. */
+bool ParseAccuratePack(const char* msg,
+                       std::size_t length,
+                       const std::function<void(const AccurateEntry&)>& add);
+
+#endif  // BAREOS_LIB_ACCURATE_PACK_H_
@@ -2,7 +2,7 @@
    BAREOS® - Backup Archiving REcovery Open Sourced
 
    Copyright (C) 2001-2011 Free Software Foundation Europe e.V.
-   Copyright (C) 2016-2023 Bareos GmbH & Co. KG
+   Copyright (C) 2016-2024 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -72,6 +72,9 @@ int BgetMsg(BareosSocket* sock)
           sock->fsend(OK_msg); /* send response */
         }
         return n; /* end of data */
+      case BNET_FRAME: /* the caller has to unpack the next message */
+        Dmsg0(messagelevel, "Got BNET_FRAME\n");
+        return n;
       case BNET_TERMINATE:
         Dmsg0(messagelevel, "Got BNET_TERMINATE\n");
         sock->SetTerminated();
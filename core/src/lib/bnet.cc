@@ -468,6 +468,7 @@ std::map<int, std::pair<std::string, std::string>> bnet_signal_to_text {
     {BNET_END_RTREE, {"BNET_END_RTREE", "End restore tree mode "}},
     {BNET_SUB_PROMPT, {"BNET_SUB_PROMPT", "Indicate we are at a subprompt "}},
     {BNET_TEXT_INPUT, {"BNET_TEXT_INPUT", "Get text input from user "}},
+    {BNET_FRAME, {"BNET_FRAME", "Next message holds several packets "}},
 };
 /* clang-format on */
 
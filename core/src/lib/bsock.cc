@@ -205,6 +205,94 @@ bool BareosSocket::signal(int signal)
   return send();
 }
 
+bool BareosSocket::SetFrameSize(uint32_t frame_size)
+{
+  bool ok = FlushFrame();
+
+  frame_size_ = std::min(frame_size, max_frame_size);
+  if (frame_size_ == 0) {
+    std::vector<char>().swap(frame_);
+  } else {
+    frame_.reserve(frame_size_ + framed_message_limit + sizeof(int32_t));
+  }
+
+  return ok;
+}
+
+// Adds a message to the frame, the frame is sent once it is full.
+bool BareosSocket::AddToFrame(const BnetBuffer* buffers,
+                              int count,
+                              int32_t length)
+{
+  int32_t hdr = htonl(length);
+
+  frame_.insert(frame_.end(), (const char*)&hdr,
+                (const char*)&hdr + sizeof(hdr));
+  for (int i = 0; i < count; ++i) {
+    frame_.insert(frame_.end(), buffers[i].data,
+                  buffers[i].data + buffers[i].size);
+  }
+  frame_count_++;
+
+  if (frame_.size() >= frame_size_) { return FlushFrame(); }
+  return true;
+}
+
+bool BareosSocket::FlushFrame()
+{
+  if (frame_count_ == 0) { return true; }
+
+  int32_t saved_length = message_length;
+  bool ok;
+
+  sending_frame_ = true;
+  if (frame_count_ == 1) {
+    // A single message is sent as it is
+    int32_t length = ntohl(*(int32_t*)frame_.data());
+    if (length < 0) {
+      ok = signal(length);
+    } else {
+      BnetBuffer buffer{frame_.data() + sizeof(int32_t), (std::size_t)length};
+      ok = SendBuffers(&buffer, 1);
+    }
+  } else {
+    BnetBuffer buffer{frame_.data(), frame_.size()};
+    ok = signal(BNET_FRAME) && SendBuffers(&buffer, 1);
+  }
+  sending_frame_ = false;
+  message_length = saved_length;
+
+  frame_.clear();
+  frame_count_ = 0;
+
+  return ok;
+}
+
+bool UnpackFrame(const char* frame,
+                 int32_t length,
+                 const std::function<bool(const char*, int32_t)>& handler)
+{
+  const char* end = frame + length;
+
+  while (frame < end) {
+    int32_t hdr;
+    if (end - frame < (ptrdiff_t)sizeof(hdr)) { return false; }
+    memcpy(&hdr, frame, sizeof(hdr));
+    frame += sizeof(hdr);
+
+    int32_t message_length = ntohl(hdr);
+    if (message_length < 0) {
+      if (!handler(nullptr, message_length)) { return false; }
+    } else {
+      if (end - frame < message_length) { return false; }
+      if (!handler(frame, message_length)) { return false; }
+      frame += message_length;
+    }
+  }
+
+  return true;
+}
+
 // Despool spooled attributes
 bool BareosSocket::despool(void UpdateAttrSpoolSize(ssize_t size),
                            ssize_t tsize)
@@ -326,6 +414,25 @@ bool BareosSocket::send(const char* msg_in, uint32_t nbytes)
   return send();
 }
 
+bool BareosSocket::SendBuffers(const BnetBuffer* buffers,
+                               int count,
+                               std::shared_ptr<const void>)
+{
+  if (errors || IsTerminated()) { return false; }
+
+  std::size_t total = 0;
+  for (int i = 0; i < count; ++i) { total += buffers[i].size; }
+
+  msg = CheckPoolMemorySize(msg, total);
+  message_length = 0;
+  for (int i = 0; i < count; ++i) {
+    memcpy(msg + message_length, buffers[i].data, buffers[i].size);
+    message_length += buffers[i].size;
+  }
+
+  return send();
+}
+
 void BareosSocket::SetKillable(bool killable)
 {
   if (jcr_) { jcr_->SetKillable(killable); }
@@ -50,9 +50,11 @@
 #include "include/version_numbers.h"
 
 #include <mutex>
+#include <memory>
 #include <functional>
 #include <cassert>
 #include <atomic>
+#include <vector>
 
 struct btimer_t; /* forward reference */
 class BareosSocket;
@@ -63,6 +65,19 @@ template <typename T> class dlist;
 btimer_t* StartBsockTimer(BareosSocket* bs, uint32_t wait);
 void StopBsockTimer(btimer_t* wid);
 
+/* Calls handler for each packet of a frame received after a BNET_FRAME
+ * signal: with the data of a message and its length, or with nullptr and
+ * a signal. Returns false if the frame is malformed or handler failed. */
+bool UnpackFrame(const char* frame,
+                 int32_t length,
+                 const std::function<bool(const char*, int32_t)>& handler);
+
+// One piece of a message sent with BareosSocket::SendBuffers()
+struct BnetBuffer {
+  const char* data;
+  std::size_t size;
+};
+
 class BareosSocket {
   /* Note, keep this public part before the private otherwise
    *  bat breaks on some systems such as RedHat. */
@@ -111,6 +126,12 @@ class BareosSocket {
   btime_t last_tick_;    /* Last tick used by bwlimit */
   bool tls_established_; /* is true when tls connection is established */
   std::unique_ptr<BnetDump> bnet_dump_;
+  uint32_t frame_size_{0};   /* Collect small messages into frames */
+  std::vector<char> frame_;  /* Packets of the messages collected */
+  uint32_t frame_count_{0};  /* Number of messages in frame_ */
+  bool sending_frame_{false};
+
+  bool AddToFrame(const BnetBuffer* buffers, int count, int32_t length);
 
   virtual void FinInit(JobControlRecord* jcr,
                        int sockfd,
@@ -189,6 +210,24 @@ class BareosSocket {
   bool fsend(const char*, ...);
   bool vfsend(const char* fmt, va_list ap);
   bool send(const char* msg_in, uint32_t nbytes);
+  /* Sends the concatenation of the buffers as one message.  Unlike send()
+   * this neither uses msg nor writes in front of the data.  The socket may
+   * keep a reference to keep_alive until the kernel is done with the data
+   * (see EnableZeroCopy()). */
+  virtual bool SendBuffers(const BnetBuffer* buffers,
+                           int count,
+                           std::shared_ptr<const void> keep_alive = nullptr);
+  // Returns false if the socket cannot send without copying the data.
+  virtual bool EnableZeroCopy() { return false; }
+  /* Messages shorter than framed_message_limit, signals included, are
+   * collected into frames of about frame_size bytes. A frame is sent as a
+   * BNET_FRAME signal followed by one message holding the packets of the
+   * collected messages, see UnpackFrame(). 0 sends what is collected and
+   * switches this off again. */
+  static constexpr uint32_t framed_message_limit = 16 * 1024;
+  static constexpr uint32_t max_frame_size = 512 * 1024;
+  bool SetFrameSize(uint32_t frame_size);
+  bool FlushFrame();
   void SetKillable(bool killable);
   bool signal(int signal);
   const char* bstrerror(); /* last error on socket */
@@ -321,7 +360,8 @@ enum
   BNET_START_RTREE = -25,  /* Start restore tree mode */
   BNET_END_RTREE = -26,    /* End restore tree mode */
   BNET_SUB_PROMPT = -27,   /* Indicate we are at a subprompt */
-  BNET_TEXT_INPUT = -28    /* Get text input from user */
+  BNET_TEXT_INPUT = -28,   /* Get text input from user */
+  BNET_FRAME = -29         /* Next message holds several packets */
 };
 
 #define BNET_SETBUF_READ 1  /* Arg for BnetSetBufferSize */
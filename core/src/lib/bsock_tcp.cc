@@ -43,6 +43,24 @@
 #  include "mstcpip.h"
 #endif
 
+#include <algorithm>
+#include <vector>
+
+#if !defined(HAVE_WIN32)
+#  include <netinet/in.h>
+#  include <poll.h>
+#  include <sys/socket.h>
+#  include <sys/uio.h>
+#endif
+
+#if defined(HAVE_LINUX_OS)
+#  include <linux/errqueue.h>
+#  if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) \
+      && defined(SO_EE_ORIGIN_ZEROCOPY)
+#    define USE_ZERO_COPY_SEND 1
+#  endif
+#endif
+
 #ifndef ENODATA /* not defined on BSD systems */
 #  define ENODATA EPIPE
 #endif
@@ -92,6 +110,10 @@ BareosSocket* BareosSocketTCP::clone()
   // if this is a socket we need to do the same thing here!
   if (spool_fd_ >= 0) { clone->spool_fd_ = dup(spool_fd_); }
 
+  // pending zero copy sends stay with the original
+  clone->zero_copy_ = false;
+  clone->zero_copy_pending_.clear();
+
   clone->cloned_ = true;
 
   return clone;
@@ -401,11 +423,29 @@ bool BareosSocketTCP::SetKeepalive(JobControlRecord* jcr,
 
 
 bool BareosSocketTCP::SendPacket(int32_t* hdr, int32_t pktsiz)
+{
+  BnetBuffer packet{(const char*)hdr, (std::size_t)pktsiz};
+
+  return SendPacket(&packet, 1, pktsiz, nullptr);
+}
+
+/*
+ * Send a packet made up of several buffers. If zero copy is enabled
+ * and the packet is large enough, keep_alive is held until the kernel
+ * reported that it is done with the data.
+ */
+bool BareosSocketTCP::SendPacket(const BnetBuffer* buffers,
+                                 int count,
+                                 int32_t pktsiz,
+                                 const std::shared_ptr<const void>& keep_alive)
 {
   Enter(400);
 
   int32_t rc;
   bool ok = true;
+  bool zero_copy = zero_copy_ && keep_alive && pktsiz >= min_zero_copy_size
+                   && !IsSpooling() && !tls_conn;
+  uint32_t first_zero_copy_id = zero_copy_next_id_;
 
   out_msg_no++; /* increment message number */
 
@@ -414,8 +454,14 @@ bool BareosSocketTCP::SendPacket(int32_t* hdr, int32_t pktsiz)
   ClearTimedOut();
 
   // Full I/O done in one write
-  rc = write_nbytes((char*)hdr, pktsiz);
+  rc = WriteBuffers(buffers, count, zero_copy);
   timer_start = 0; /* clear timer */
+
+  // Also when the send failed, the kernel may still read what was sent.
+  if (zero_copy_next_id_ != first_zero_copy_id) {
+    zero_copy_pending_.emplace_back(zero_copy_next_id_ - 1, keep_alive);
+  }
+
   if (rc != pktsiz) {
     ++errors;
     if (errno == 0) {
@@ -439,6 +485,13 @@ bool BareosSocketTCP::SendPacket(int32_t* hdr, int32_t pktsiz)
     ok = false;
   }
 
+  if (!zero_copy_pending_.empty()) {
+    ReapZeroCopyCompletions(0);
+    while (ok && zero_copy_pending_.size() > max_zero_copy_pending) {
+      if (!ReapZeroCopyCompletions(1000)) { break; }
+    }
+  }
+
   Leave(400);
 
   return ok;
@@ -484,6 +537,15 @@ bool BareosSocketTCP::send()
     return false;
   }
 
+  if (frame_size_ > 0 && !sending_frame_) {
+    if (o_msglen < static_cast<int32_t>(framed_message_limit)) {
+      BnetBuffer buffer{msg, static_cast<std::size_t>(std::max(o_msglen, 0))};
+      return AddToFrame(&buffer, o_msglen > 0 ? 1 : 0, o_msglen);
+    }
+    // Larger messages must not overtake the collected ones
+    if (!FlushFrame()) { return false; }
+  }
+
   LockMutex();
 
   // Compute total packet length
@@ -518,6 +580,178 @@ bool BareosSocketTCP::send()
   return ok;
 }
 
+/*
+ * Send the concatenation of the buffers as one message. The length
+ * header of each packet is sent from its own buffer, so nothing is copied
+ * and nothing in front of the data is overwritten.
+ *
+ * Returns: false on failure
+ *          true  on success
+ */
+bool BareosSocketTCP::SendBuffers(const BnetBuffer* buffers,
+                                  int count,
+                                  std::shared_ptr<const void> keep_alive)
+{
+  if (errors) {
+    if (!suppress_error_msgs_) {
+      Qmsg4(jcr_, M_ERROR, 0, T_("Socket has errors=%d on call to %s:%s:%d\n"),
+            errors.load(), who_, host_, port_);
+    }
+    return false;
+  }
+
+  if (IsTerminated()) {
+    if (!suppress_error_msgs_) {
+      Qmsg4(jcr_, M_ERROR, 0,
+            T_("Socket is terminated=%d on call to %s:%s:%d\n"), IsTerminated(),
+            who_, host_, port_);
+    }
+    return false;
+  }
+
+  std::size_t remaining = 0;
+  for (int i = 0; i < count; ++i) { remaining += buffers[i].size; }
+
+  if (frame_size_ > 0 && !sending_frame_) {
+    if (remaining < framed_message_limit) {
+      return AddToFrame(buffers, count, static_cast<int32_t>(remaining));
+    }
+    if (!FlushFrame()) { return false; }
+  }
+
+  LockMutex();
+
+  std::vector<BnetBuffer> packet;
+  int index = 0;
+  std::size_t offset = 0;
+  bool ok = true;
+  do {
+    // Split into Bareos packets just like send()
+    int32_t packet_msglen
+        = std::min(remaining, static_cast<std::size_t>(max_message_len));
+    int32_t hdr = htonl(packet_msglen);
+
+    packet.clear();
+    packet.push_back(BnetBuffer{(const char*)&hdr, header_length});
+    for (std::size_t left = packet_msglen; left > 0;) {
+      const BnetBuffer& buffer = buffers[index];
+      std::size_t size = std::min(buffer.size - offset, left);
+      if (size > 0) {
+        packet.push_back(BnetBuffer{buffer.data + offset, size});
+      }
+      left -= size;
+      offset += size;
+      if (offset == buffer.size) {
+        index++;
+        offset = 0;
+      }
+    }
+
+    ok = SendPacket(packet.data(), packet.size(), header_length + packet_msglen,
+                    keep_alive);
+    remaining -= packet_msglen;
+  } while (ok && remaining > 0);
+
+  UnlockMutex();
+
+  return ok;
+}
+
+/*
+ * Use MSG_ZEROCOPY for large packets sent with SendBuffers(). The kernel
+ * then reads the data directly from the given buffers, which therefore
+ * are kept alive until it reports completion.
+ */
+bool BareosSocketTCP::EnableZeroCopy()
+{
+#if defined(USE_ZERO_COPY_SEND)
+  // TLS encrypts into its own buffers anyway
+  if (tls_conn || fd_ < 0) { return false; }
+
+  int on = 1;
+  if (setsockopt(fd_, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) != 0) {
+    BErrNo be;
+    Dmsg1(100, "Cannot enable zero copy send: ERR=%s\n", be.bstrerror());
+    return false;
+  }
+  zero_copy_ = true;
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+/*
+ * Release the data of zero copy sends the kernel reported as done,
+ * waiting up to timeout_ms for a report.
+ *
+ * Returns: false if the socket cannot report anymore
+ *          true  otherwise
+ */
+bool BareosSocketTCP::ReapZeroCopyCompletions([[maybe_unused]] int timeout_ms)
+{
+#if defined(USE_ZERO_COPY_SEND)
+  if (timeout_ms > 0) {
+    // Reports are queued as errors of the socket
+    struct pollfd pfd = {fd_, 0, 0};
+    if (poll(&pfd, 1, timeout_ms) < 0 && errno != EINTR) { return false; }
+  }
+
+  while (!zero_copy_pending_.empty()) {
+    char control[128];
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_control = control;
+    mh.msg_controllen = sizeof(control);
+
+    if (recvmsg(fd_, &mh, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+
+    for (struct cmsghdr* cm = CMSG_FIRSTHDR(&mh); cm;
+         cm = CMSG_NXTHDR(&mh, cm)) {
+      if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+          && !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+        continue;
+      }
+      struct sock_extended_err err;
+      memcpy(&err, CMSG_DATA(cm), sizeof(err));
+      if (err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+        continue;
+      }
+
+      // TCP completes the sends in order, everything up to ee_data is done.
+      while (!zero_copy_pending_.empty()
+             && static_cast<int32_t>(zero_copy_pending_.front().first
+                                     - err.ee_data)
+                    <= 0) {
+        zero_copy_pending_.pop_front();
+      }
+    }
+  }
+#endif
+
+  return true;
+}
+
+/*
+ * The kernel may still read the data of zero copy sends after the
+ * socket is closed, so the data is kept until all sends are reported.
+ */
+void BareosSocketTCP::WaitForZeroCopyCompletions()
+{
+  // Data for a dead peer is dropped and reported as well
+  for (int tries = 0; !zero_copy_pending_.empty() && tries < 60; ++tries) {
+    if (!ReapZeroCopyCompletions(1000)) { break; }
+  }
+  if (!zero_copy_pending_.empty()) {
+    Dmsg1(100, "%d zero copy sends not reported as done\n",
+          (int)zero_copy_pending_.size());
+    zero_copy_pending_.clear();
+  }
+}
+
 /*
  * Receive a message from the other end. Each message consists of
  * two packets. The first is a header that contains the size
@@ -898,6 +1132,7 @@ void BareosSocketTCP::close()
     if (!cloned_) {
       if (IsTimedOut()) { shutdown(fd_, SHUT_RDWR); }
     }
+    WaitForZeroCopyCompletions();
     socketClose(fd_);
     fd_ = -1;
   }
@@ -930,6 +1165,7 @@ void BareosSocketTCP::destroy()
     src_addr = nullptr;
   }
   if (fd_ >= 0) { /* duplicated */
+    WaitForZeroCopyCompletions();
     socketClose(fd_);
     fd_ = -1;
   }
@@ -1065,6 +1301,131 @@ int32_t BareosSocketTCP::write_nbytes(char* ptr, int32_t nbytes)
   return nbytes - nleft;
 }
 
+/*
+ * Write the buffers to the network, with a single system call if possible.
+ * Spooling, TLS and network dumps write them one after the other.
+ */
+int32_t BareosSocketTCP::WriteBuffers(const BnetBuffer* buffers,
+                                      int count,
+                                      [[maybe_unused]] bool zero_copy)
+{
+  if (count == 1) {
+    return write_nbytes(const_cast<char*>(buffers[0].data), buffers[0].size);
+  }
+
+  int32_t nbytes = 0;
+  for (int i = 0; i < count; ++i) { nbytes += buffers[i].size; }
+
+#if !defined(HAVE_WIN32)
+  bool vectored = !IsSpooling() && !IsBnetDumpEnabled() && !tls_conn;
+#else
+  bool vectored = false;
+#endif
+
+  if (!vectored) {
+    if (IsBnetDumpEnabled() && !IsSpooling()) {
+      // The dump expects a complete packet
+      std::vector<char> packet;
+      packet.reserve(nbytes);
+      for (int i = 0; i < count; ++i) {
+        packet.insert(packet.end(), buffers[i].data,
+                      buffers[i].data + buffers[i].size);
+      }
+      return write_nbytes(packet.data(), nbytes);
+    }
+
+    int32_t written = 0;
+    for (int i = 0; i < count; ++i) {
+      int32_t rc
+          = write_nbytes(const_cast<char*>(buffers[i].data), buffers[i].size);
+      if (rc < 0) { return -1; }
+      written += rc;
+      if (rc != (int32_t)buffers[i].size) { break; }
+    }
+    return written;
+  }
+
+#if !defined(HAVE_WIN32)
+  std::vector<struct iovec> iov(count);
+  for (int i = 0; i < count; ++i) {
+    iov[i].iov_base = const_cast<char*>(buffers[i].data);
+    iov[i].iov_len = buffers[i].size;
+  }
+
+  int flags = 0;
+#  if defined(USE_ZERO_COPY_SEND)
+  if (zero_copy) { flags |= MSG_ZEROCOPY; }
+#  endif
+
+  std::size_t first = 0;
+  int32_t nleft = nbytes;
+  while (nleft > 0) {
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov[first];
+    mh.msg_iovlen = count - first;
+
+    int send_flags = flags;
+#  if defined(USE_ZERO_COPY_SEND)
+    /* The kernel reads zero copy data after sendmsg() returned, but the
+     * first buffer is the packet header on the stack of our caller. */
+    if ((flags & MSG_ZEROCOPY) && first == 0) {
+      mh.msg_iovlen = 1;
+      send_flags = MSG_MORE;
+    }
+#  endif
+
+    ssize_t nwritten;
+    do {
+      errno = 0;
+      nwritten = sendmsg(fd_, &mh, send_flags);
+      if (IsTimedOut() || IsTerminated()) { return -1; }
+    } while (nwritten == -1 && errno == EINTR);
+
+#  if defined(USE_ZERO_COPY_SEND)
+    if (send_flags & MSG_ZEROCOPY) {
+      if (nwritten == -1 && errno == ENOBUFS) {
+        // No memory left to track the data, so let the kernel copy it
+        flags &= ~MSG_ZEROCOPY;
+        continue;
+      }
+      // Every send that took data gets the next id
+      if (nwritten > 0) { zero_copy_next_id_++; }
+    }
+#  endif
+
+    /* If connection is non-blocking, we will get EAGAIN, so
+     * use select()/poll() to keep from consuming all
+     * the CPU and try again. */
+    if (nwritten == -1 && errno == EAGAIN) {
+      WaitForWritableFd(fd_, 1, false);
+      continue;
+    }
+
+    if (nwritten <= 0) { return -1; /* error */ }
+
+    nleft -= nwritten;
+    if (UseBwlimit()) { ControlBwlimit(nwritten); }
+
+    // Skip what was written
+    while (nwritten > 0) {
+      if ((std::size_t)nwritten >= iov[first].iov_len) {
+        nwritten -= iov[first].iov_len;
+        first++;
+      } else {
+        iov[first].iov_base = (char*)iov[first].iov_base + nwritten;
+        iov[first].iov_len -= nwritten;
+        nwritten = 0;
+      }
+    }
+  }
+
+  return nbytes - nleft;
+#else
+  return -1;
+#endif
+}
+
 bool BareosSocketTCP::ConnectionReceivedTerminateSignal()
 {
   int32_t signal;
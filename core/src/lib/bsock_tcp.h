@@ -24,6 +24,9 @@
 
 #include "lib/bsock.h"
 
+#include <deque>
+#include <utility>
+
 class BareosSocketTCP : public BareosSocket {
  public:
   /*
@@ -43,6 +46,19 @@ class BareosSocketTCP : public BareosSocket {
   static const int32_t max_packet_size = 1000000;
   static const int32_t max_message_len = max_packet_size - header_length;
 
+  /* Smaller packets are always copied, as pinning the pages costs more
+   * than copying them. */
+  static const int32_t min_zero_copy_size = 16 * 1024;
+  // Limit of packets waiting for a zero copy completion
+  static const std::size_t max_zero_copy_pending = 256;
+
+  bool zero_copy_{false};
+  uint32_t zero_copy_next_id_{0}; /* Id of the next zero copy send */
+  /* Data of zero copy sends the kernel may still read, with the id of the
+   * last send using it */
+  std::deque<std::pair<uint32_t, std::shared_ptr<const void>>>
+      zero_copy_pending_;
+
   /* methods -- in bsock_tcp.c */
   void FinInit(JobControlRecord* jcr,
                int sockfd,
@@ -63,6 +79,13 @@ class BareosSocketTCP : public BareosSocket {
                     int keepalive_start,
                     int keepalive_interval);
   bool SendPacket(int32_t* hdr, int32_t pktsiz);
+  bool SendPacket(const BnetBuffer* buffers,
+                  int count,
+                  int32_t pktsiz,
+                  const std::shared_ptr<const void>& keep_alive);
+  int32_t WriteBuffers(const BnetBuffer* buffers, int count, bool zero_copy);
+  bool ReapZeroCopyCompletions(int timeout_ms);
+  void WaitForZeroCopyCompletions();
   void DumpNetworkMessageToFile(const char* ptr, int nbytes);
 
  public:
@@ -82,6 +105,10 @@ class BareosSocketTCP : public BareosSocket {
                bool verbose) override;
   int32_t recv() override;
   bool send() override;
+  bool SendBuffers(const BnetBuffer* buffers,
+                   int count,
+                   std::shared_ptr<const void> keep_alive = nullptr) override;
+  bool EnableZeroCopy() override;
   bool fsend(const char*, ...);
   int32_t read_nbytes(char* ptr, int32_t nbytes) override;
   int32_t write_nbytes(char* ptr, int32_t nbytes) override;
@@ -46,6 +46,10 @@
 #  include <lzo/lzo1x.h>
 #endif
 
+#ifdef HAVE_ZSTD
+#  include <zstd.h>
+#endif
+
 #include "fastlz/fastlzlib.h"
 
 #ifndef HAVE_COMPRESS_BOUND
@@ -66,6 +70,8 @@ const char* cmprs_algo_to_text(uint32_t compression_algorithm)
       return "LZ4";
     case COMPRESS_FZ4H:
       return "LZ4HC";
+    case COMPRESS_ZSTD:
+      return "ZSTD";
     default:
       return "Unknown";
   }
@@ -123,11 +129,88 @@ std::size_t RequiredCompressionOutputBufferSize(uint32_t algo,
       return max_input_size + (max_input_size / 10 + 16 * 2)
              + sizeof(comp_stream_header);
       break;
+#ifdef HAVE_ZSTD
+    case COMPRESS_ZSTD:
+      return ZSTD_compressBound(max_input_size) + sizeof(comp_stream_header);
+#endif
   }
 
   return max_input_size + sizeof(comp_stream_header);
 }
 
+#ifdef HAVE_ZSTD
+static size_t ZstdSetParameters(ZSTD_CCtx* cctx, int level)
+{
+  if (level < 1) {
+    level = 1;
+  } else if (level > ZSTD_maxCLevel()) {
+    level = ZSTD_maxCLevel();
+  }
+
+  size_t status = ZSTD_CCtx_reset(cctx, ZSTD_reset_parameters);
+  if (!ZSTD_isError(status)) {
+    status = ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+  }
+
+  return status;
+}
+
+class zstd_compressor {
+  ZSTD_CCtx* cctx{nullptr};
+  int level{-1};
+  std::optional<PoolMem> error{};
+
+ public:
+  zstd_compressor()
+  {
+    cctx = ZSTD_createCCtx();
+    if (!cctx) { error.emplace("Failed to initialize zstd."); }
+  }
+
+  bool set_level(int t_level)
+  {
+    if (error) return false;
+    if (level == t_level) return true;
+
+    if (size_t status = ZstdSetParameters(cctx, t_level);
+        ZSTD_isError(status)) {
+      Mmsg(error.emplace(), "Failed to set zstd params: %s\n",
+           ZSTD_getErrorName(status));
+      return false;
+    }
+
+    level = t_level;
+    return true;
+  }
+
+  result<std::size_t> compress(char const* input,
+                               std::size_t size,
+                               char* output,
+                               std::size_t capacity)
+  {
+    if (error) return PoolMem{error->c_str()};
+
+    size_t compress_len = ZSTD_compress2(cctx, output, capacity, input, size);
+    if (ZSTD_isError(compress_len)) {
+      PoolMem errmsg;
+      Mmsg(errmsg, "Compression zstd error: %s\n",
+           ZSTD_getErrorName(compress_len));
+      return errmsg;
+    }
+
+    Dmsg2(400, "ZSTD compressed len=%d uncompressed len=%d\n", compress_len,
+          size);
+
+    return compress_len;
+  }
+
+  ~zstd_compressor()
+  {
+    if (cctx) { ZSTD_freeCCtx(cctx); }
+  }
+};
+#endif
+
 class z4_compressor {
   zfast_stream pZfastStream{};
   bool init_error{false};
@@ -317,6 +400,9 @@ struct compressors {
   std::unique_ptr<z4_compressor> lz_fast{nullptr};
   std::unique_ptr<z4_compressor> lz_default{nullptr};
   std::unique_ptr<z4_compressor> lz_best{nullptr};
+#ifdef HAVE_ZSTD
+  std::unique_ptr<zstd_compressor> zstd{nullptr};
+#endif
 };
 
 template <typename T> struct tls_manager {
@@ -388,6 +474,13 @@ result<std::size_t> ThreadlocalCompress(uint32_t algo,
             new z4_compressor{Z_BEST_COMPRESSION, COMPRESSOR_LZ4});
       return comps->lz_best->compress(input, size, output, capacity);
     } break;
+#ifdef HAVE_ZSTD
+    case COMPRESS_ZSTD: {
+      if (!comps->zstd) comps->zstd.reset(new zstd_compressor);
+      comps->zstd->set_level(level);
+      return comps->zstd->compress(input, size, output, capacity);
+    }
+#endif
   }
 
   PoolMem errmsg;
@@ -395,6 +488,272 @@ result<std::size_t> ThreadlocalCompress(uint32_t algo,
   return errmsg;
 }
 
+/* The decompression functions below write into an output buffer with
+ * data(), size() and resize(), which gets enlarged if the data does not fit.
+ * This is a std::vector for ThreadlocalDecompress() and the inflate buffer of
+ * the jcr for DecompressData(). */
+
+#ifdef HAVE_LIBZ
+template <typename Buffer>
+static result<std::size_t> DecompressZlib(const char* input,
+                                          std::size_t size,
+                                          Buffer& output)
+{
+  for (;;) {
+    uLong out_len = output.size();
+    int status = uncompress(reinterpret_cast<Bytef*>(output.data()), &out_len,
+                            reinterpret_cast<const Bytef*>(input), size);
+    if (status == Z_BUF_ERROR) {
+      // The buffer size is too small, try with a bigger one
+      output.resize(output.size() + (output.size() >> 1) + 1);
+      continue;
+    }
+    if (status != Z_OK) { return PoolMem{zlib_strerror(status)}; }
+    return static_cast<std::size_t>(out_len);
+  }
+}
+#endif
+
+#ifdef HAVE_LZO
+template <typename Buffer>
+static result<std::size_t> DecompressLzo(const char* input,
+                                         std::size_t size,
+                                         Buffer& output)
+{
+  for (;;) {
+    lzo_uint out_len = output.size();
+    int status = lzo1x_decompress_safe(
+        reinterpret_cast<const unsigned char*>(input), size,
+        reinterpret_cast<unsigned char*>(output.data()), &out_len, NULL);
+    if (status == LZO_E_OUTPUT_OVERRUN) {
+      // The buffer size is too small, try with a bigger one
+      output.resize(output.size() + (output.size() >> 1) + 1);
+      continue;
+    }
+    if (status != LZO_E_OK) {
+      PoolMem errmsg;
+      Mmsg(errmsg, "LZO error %d", status);
+      return errmsg;
+    }
+    return static_cast<std::size_t>(out_len);
+  }
+}
+#endif
+
+template <typename Buffer>
+static result<std::size_t> DecompressFastlz(uint32_t comp_magic,
+                                            const char* input,
+                                            std::size_t size,
+                                            Buffer& output)
+{
+  zfast_stream_compressor compressor = COMPRESSOR_FASTLZ;
+  switch (comp_magic) {
+    case COMPRESS_FZ4L:
+    case COMPRESS_FZ4H:
+      compressor = COMPRESSOR_LZ4;
+      break;
+  }
+
+  zfast_stream stream{};
+  stream.next_in = (Bytef*)input;
+  stream.avail_in = (uInt)size;
+  stream.next_out = (Bytef*)output.data();
+  stream.avail_out = (uInt)output.size();
+
+  int zstat = fastlzlibDecompressInit(&stream);
+  if (zstat == Z_OK) { zstat = fastlzlibSetCompressor(&stream, compressor); }
+
+  while (zstat == Z_OK || zstat == Z_BUF_ERROR) {
+    auto avail_in = stream.avail_in;
+    auto total_out = stream.total_out;
+    zstat = fastlzlibDecompress(&stream);
+
+    if (zstat == Z_STREAM_END) { break; }
+    if (zstat != Z_OK && zstat != Z_BUF_ERROR) { break; }
+
+    if (stream.avail_out == 0) {
+      // The buffer size is too small, continue with a bigger one
+      output.resize(output.size() + (output.size() >> 1) + 1);
+      stream.next_out = (Bytef*)output.data() + stream.total_out;
+      stream.avail_out = (uInt)(output.size() - stream.total_out);
+    } else if (stream.avail_in == 0) {
+      // all input was consumed
+      zstat = Z_STREAM_END;
+    } else if (stream.avail_in == avail_in && stream.total_out == total_out) {
+      // no progress was made
+      zstat = Z_DATA_ERROR;
+    }
+  }
+
+  std::size_t out_len = stream.total_out;
+  fastlzlibDecompressEnd(&stream);
+
+  if (zstat != Z_STREAM_END) { return PoolMem{zlib_strerror(zstat)}; }
+  return out_len;
+}
+
+#ifdef HAVE_ZSTD
+struct zstd_decompressor {
+  ZSTD_DCtx* dctx{ZSTD_createDCtx()};
+
+  ~zstd_decompressor()
+  {
+    if (dctx) { ZSTD_freeDCtx(dctx); }
+  }
+};
+
+// returns the size of the data contained in a zstd frame
+static result<std::size_t> ZstdFrameContentSize(const char* input,
+                                                std::size_t size)
+{
+  unsigned long long content_size = ZSTD_getFrameContentSize(input, size);
+  if (content_size == ZSTD_CONTENTSIZE_ERROR
+      || content_size == ZSTD_CONTENTSIZE_UNKNOWN) {
+    return PoolMem{"Zstd frame header error"};
+  }
+  return static_cast<std::size_t>(content_size);
+}
+
+// the output buffer needs to be at least as large as the frame content size
+static result<std::size_t> ZstdDecompress(const char* input,
+                                          std::size_t size,
+                                          char* output,
+                                          std::size_t capacity)
+{
+  static tls_manager<zstd_decompressor> manager;
+
+  auto* decomp = manager.thread_local_value();
+  if (!decomp->dctx) { return PoolMem{"Failed to initialize zstd."}; }
+
+  size_t out_len
+      = ZSTD_decompressDCtx(decomp->dctx, output, capacity, input, size);
+  if (ZSTD_isError(out_len)) { return PoolMem{ZSTD_getErrorName(out_len)}; }
+  return out_len;
+}
+
+/* A record never holds more data than a block of the storage daemon
+ * (MAX_BLOCK_LENGTH), so a frame claiming more is corrupted.  The content
+ * size is read from the frame header and must not be trusted when resizing
+ * the output. */
+static constexpr std::size_t kMaxZstdContentSize = 20000000;
+
+template <typename Buffer>
+static result<std::size_t> DecompressZstd(const char* input,
+                                          std::size_t size,
+                                          Buffer& output)
+{
+  auto content_size = ZstdFrameContentSize(input, size);
+  if (content_size.holds_error()) { return content_size; }
+  if (content_size.value_unchecked() > kMaxZstdContentSize) {
+    PoolMem errmsg;
+    Mmsg(errmsg, "Zstd frame content size too large. size=%llu",
+         static_cast<unsigned long long>(content_size.value_unchecked()));
+    return errmsg;
+  }
+  if (output.size() < content_size.value_unchecked()) {
+    output.resize(content_size.value_unchecked());
+  }
+  return ZstdDecompress(input, size, output.data(), output.size());
+}
+#endif
+
+template <typename Buffer>
+static result<std::size_t> DecompressRecord(int32_t stream,
+                                            const char* input,
+                                            std::size_t size,
+                                            Buffer& output)
+{
+  switch (stream) {
+    case STREAM_COMPRESSED_DATA:
+    case STREAM_SPARSE_COMPRESSED_DATA:
+    case STREAM_WIN32_COMPRESSED_DATA:
+    case STREAM_ENCRYPTED_FILE_COMPRESSED_DATA:
+    case STREAM_ENCRYPTED_WIN32_COMPRESSED_DATA: {
+      uint32_t comp_magic, comp_len;
+      uint16_t comp_level, comp_version;
+
+      if (size < sizeof(comp_stream_header)) {
+        PoolMem errmsg;
+        Mmsg(errmsg, "Compressed header size error. message_length=%llu",
+             static_cast<unsigned long long>(size));
+        return errmsg;
+      }
+
+      // Read compress header
+      unser_declare;
+      UnserBegin(input, sizeof(comp_stream_header));
+      unser_uint32(comp_magic);
+      unser_uint32(comp_len);
+      unser_uint16(comp_level);
+      unser_uint16(comp_version);
+      UnserEnd(input, sizeof(comp_stream_header));
+      Dmsg4(400,
+            "Compressed data stream found: magic=0x%x, len=%d, level=%d, "
+            "ver=0x%x\n",
+            comp_magic, comp_len, comp_level, comp_version);
+
+      // Version check
+      if (comp_version != COMP_HEAD_VERSION) {
+        PoolMem errmsg;
+        Mmsg(errmsg, "Compressed header version error. version=0x%x",
+             comp_version);
+        return errmsg;
+      }
+
+      // Size check
+      if (comp_len + sizeof(comp_stream_header) != size) {
+        PoolMem errmsg;
+        Mmsg(errmsg,
+             "Compressed header size error. comp_len=%d, message_length=%llu",
+             comp_len, static_cast<unsigned long long>(size));
+        return errmsg;
+      }
+
+      const char* cbuf = input + sizeof(comp_stream_header);
+      switch (comp_magic) {
+#ifdef HAVE_LIBZ
+        case COMPRESS_GZIP:
+          return DecompressZlib(cbuf, comp_len, output);
+#endif
+#ifdef HAVE_LZO
+        case COMPRESS_LZO1X:
+          return DecompressLzo(cbuf, comp_len, output);
+#endif
+        case COMPRESS_FZFZ:
+        case COMPRESS_FZ4L:
+        case COMPRESS_FZ4H:
+          return DecompressFastlz(comp_magic, cbuf, comp_len, output);
+#ifdef HAVE_ZSTD
+        case COMPRESS_ZSTD:
+          return DecompressZstd(cbuf, comp_len, output);
+#endif
+        default: {
+          PoolMem errmsg;
+          Mmsg(errmsg,
+               "Compression algorithm 0x%x found, but not supported!",
+               comp_magic);
+          return errmsg;
+        }
+      }
+    }
+    default:
+#ifdef HAVE_LIBZ
+      // old style GZIP stream without compression header
+      return DecompressZlib(input, size, output);
+#else
+      return PoolMem{"Compression algorithm GZIP found, but not supported!"};
+#endif
+  }
+}
+
+result<std::size_t> ThreadlocalDecompress(int32_t stream,
+                                          const char* input,
+                                          std::size_t size,
+                                          std::vector<char>& output)
+{
+  return DecompressRecord(stream, input, size, output);
+}
+
 bool SetupCompressionBuffers(JobControlRecord* jcr,
                              uint32_t compression_algorithm,
                              uint32_t* compress_buf_size)
@@ -524,6 +883,34 @@ bool SetupCompressionBuffers(JobControlRecord* jcr,
       }
       break;
     }
+#ifdef HAVE_ZSTD
+    case COMPRESS_ZSTD: {
+      ZSTD_CCtx* pZstdCtx;
+
+      /* ZSTD_compressBound() gives the worst case size of a single frame
+       * compressing x bytes, to which we add the size of a compression header.
+       *
+       * The ZSTD compression context is initialized here to minimize
+       * the "per file" load. The jcr member is only set, if the init
+       * was successful. */
+      wanted_compress_buf_size = ZSTD_compressBound(jcr->buf_size)
+                                 + (int)sizeof(comp_stream_header);
+      if (wanted_compress_buf_size > *compress_buf_size) {
+        *compress_buf_size = wanted_compress_buf_size;
+      }
+
+      // See if this compression algorithm is already setup.
+      if (jcr->compress.workset.pZSTD) { return true; }
+
+      if ((pZstdCtx = ZSTD_createCCtx())) {
+        jcr->compress.workset.pZSTD = pZstdCtx;
+      } else {
+        Jmsg(jcr, M_FATAL, 0, T_("Failed to initialize ZSTD compression\n"));
+        return false;
+      }
+      break;
+    }
+#endif
     default:
       UnknownCompressionAlgorithm(jcr, compression_algorithm);
       return false;
@@ -555,6 +942,31 @@ bool SetupDecompressionBuffers(JobControlRecord* jcr,
   return true;
 }
 
+bool SetCompressionLevel(JobControlRecord* jcr,
+                         uint32_t compression_algorithm,
+                         uint32_t level)
+{
+  switch (compression_algorithm) {
+#ifdef HAVE_ZSTD
+    case COMPRESS_ZSTD: {
+      size_t status
+          = ZstdSetParameters((ZSTD_CCtx*)jcr->compress.workset.pZSTD, level);
+      if (ZSTD_isError(status)) {
+        Jmsg(jcr, M_FATAL, 0, T_("Compression zstd parameter error: %s\n"),
+             ZSTD_getErrorName(status));
+        jcr->setJobStatusWithPriorityCheck(JS_ErrorTerminated);
+        return false;
+      }
+      break;
+    }
+#endif
+    default:
+      break;
+  }
+
+  return true;
+}
+
 #ifdef HAVE_LIBZ
 static bool compress_with_zlib(JobControlRecord* jcr,
                                char* rbuf,
@@ -668,6 +1080,36 @@ static bool compress_with_fastlz(JobControlRecord* jcr,
   return true;
 }
 
+#ifdef HAVE_ZSTD
+static bool compress_with_zstd(JobControlRecord* jcr,
+                               char* rbuf,
+                               uint32_t rsize,
+                               unsigned char* cbuf,
+                               uint32_t max_compress_len,
+                               uint32_t* compress_len)
+{
+  size_t len;
+
+  Dmsg3(400, "cbuf=0x%x rbuf=0x%x len=%u\n", cbuf, rbuf, rsize);
+
+  len = ZSTD_compress2((ZSTD_CCtx*)jcr->compress.workset.pZSTD, cbuf,
+                       max_compress_len, rbuf, rsize);
+  if (ZSTD_isError(len)) {
+    Jmsg(jcr, M_FATAL, 0, T_("Compression zstd error: %s\n"),
+         ZSTD_getErrorName(len));
+    jcr->setJobStatusWithPriorityCheck(JS_ErrorTerminated);
+    return false;
+  }
+
+  *compress_len = len;
+
+  Dmsg2(400, "ZSTD compressed len=%d uncompressed len=%d\n", *compress_len,
+        rsize);
+
+  return true;
+}
+#endif
+
 bool CompressData(JobControlRecord* jcr,
                   uint32_t compression_algorithm,
                   char* rbuf,
@@ -708,6 +1150,16 @@ bool CompressData(JobControlRecord* jcr,
         }
       }
       break;
+#ifdef HAVE_ZSTD
+    case COMPRESS_ZSTD:
+      if (jcr->compress.workset.pZSTD) {
+        if (!compress_with_zstd(jcr, rbuf, rsize, cbuf, max_compress_len,
+                                compress_len)) {
+          return false;
+        }
+      }
+      break;
+#endif
     default:
       break;
   }
@@ -715,356 +1167,67 @@ bool CompressData(JobControlRecord* jcr,
   return true;
 }
 
-#ifdef HAVE_LIBZ
-static bool decompress_with_zlib(JobControlRecord* jcr,
-                                 const char* last_fname,
-                                 char** data,
-                                 uint32_t* length,
-                                 bool sparse,
-                                 bool with_header,
-                                 bool want_data_stream)
-{
-  char ec1[50]; /* Buffer printing huge values */
-  uLong compress_len;
-  const unsigned char* cbuf;
-  char* wbuf;
-  int status, real_compress_len;
-
-  /* NOTE! We only use uLong and Byte because they are
-   * needed by the zlib routines, they should not otherwise
-   * be used in Bareos. */
-  if (sparse && want_data_stream) {
-    wbuf = jcr->compress.inflate_buffer + OFFSET_FADDR_SIZE;
-    compress_len = jcr->compress.inflate_buffer_size - OFFSET_FADDR_SIZE;
-  } else {
-    wbuf = jcr->compress.inflate_buffer;
-    compress_len = jcr->compress.inflate_buffer_size;
+namespace {
+// The inflate buffer of the jcr, behind the first offset bytes.
+class inflate_buffer {
+ public:
+  inflate_buffer(JobControlRecord* t_jcr, std::size_t t_offset)
+      : jcr{t_jcr}, offset{t_offset}
+  {
   }
 
-  // See if this is a compressed stream with the new compression header or an
-  // old one.
-  if (with_header) {
-    cbuf = (const unsigned char*)*data + sizeof(comp_stream_header);
-    real_compress_len = *length - sizeof(comp_stream_header);
-  } else {
-    cbuf = (const unsigned char*)*data;
-    real_compress_len = *length;
+  char* data() { return jcr->compress.inflate_buffer + offset; }
+  std::size_t size() const
+  {
+    return jcr->compress.inflate_buffer_size - offset;
   }
-
-  Dmsg2(400, "Comp_len=%d message_length=%d\n", compress_len, *length);
-
-  while ((status = uncompress((Byte*)wbuf, &compress_len, (const Byte*)cbuf,
-                              (uLong)real_compress_len))
-         == Z_BUF_ERROR) {
-    // The buffer size is too small, try with a bigger one
-    jcr->compress.inflate_buffer_size
-        = jcr->compress.inflate_buffer_size
-          + (jcr->compress.inflate_buffer_size >> 1);
+  void resize(std::size_t new_size)
+  {
+    jcr->compress.inflate_buffer_size = new_size + offset;
     jcr->compress.inflate_buffer = CheckPoolMemorySize(
         jcr->compress.inflate_buffer, jcr->compress.inflate_buffer_size);
-
-    if (sparse && want_data_stream) {
-      wbuf = jcr->compress.inflate_buffer + OFFSET_FADDR_SIZE;
-      compress_len = jcr->compress.inflate_buffer_size - OFFSET_FADDR_SIZE;
-    } else {
-      wbuf = jcr->compress.inflate_buffer;
-      compress_len = jcr->compress.inflate_buffer_size;
-    }
-    Dmsg2(400, "Comp_len=%d message_length=%d\n", compress_len, *length);
-  }
-
-  if (status != Z_OK) {
-    Qmsg(jcr, M_ERROR, 0, T_("Uncompression error on file %s. ERR=%s\n"),
-         last_fname, zlib_strerror(status));
-    return false;
   }
 
-  /* We return a decompressed data stream with the fileoffset encoded when this
-   * was a sparse stream. */
-  if (sparse && want_data_stream) {
-    memcpy(jcr->compress.inflate_buffer, *data, OFFSET_FADDR_SIZE);
-  }
-
-  *data = jcr->compress.inflate_buffer;
-  *length = compress_len;
-
-  Dmsg2(400, "Write uncompressed %d bytes, total before write=%s\n",
-        compress_len, edit_uint64(jcr->JobBytes, ec1));
+ private:
+  JobControlRecord* jcr;
+  std::size_t offset;
+};
+}  // namespace
 
-  return true;
-}
-#endif
-#ifdef HAVE_LZO
-static bool decompress_with_lzo(JobControlRecord* jcr,
-                                const char* last_fname,
-                                char** data,
-                                uint32_t* length,
-                                bool sparse,
-                                bool want_data_stream)
+bool DecompressData(JobControlRecord* jcr,
+                    const char* last_fname,
+                    int32_t stream,
+                    char** data,
+                    uint32_t* length,
+                    bool want_data_stream)
 {
   char ec1[50]; /* Buffer printing huge values */
-  lzo_uint compress_len;
-  const unsigned char* cbuf;
-  unsigned char* wbuf;
-  int status, real_compress_len;
-
-  if (sparse && want_data_stream) {
-    compress_len = jcr->compress.inflate_buffer_size - OFFSET_FADDR_SIZE;
-    cbuf = (const unsigned char*)*data + OFFSET_FADDR_SIZE
-           + sizeof(comp_stream_header);
-    wbuf = (unsigned char*)jcr->compress.inflate_buffer + OFFSET_FADDR_SIZE;
-  } else {
-    compress_len = jcr->compress.inflate_buffer_size;
-    cbuf = (const unsigned char*)*data + sizeof(comp_stream_header);
-    wbuf = (unsigned char*)jcr->compress.inflate_buffer;
-  }
-
-  real_compress_len = *length - sizeof(comp_stream_header);
-  Dmsg2(400, "Comp_len=%d message_length=%d\n", compress_len, *length);
-  while ((status = lzo1x_decompress_safe(cbuf, real_compress_len, wbuf,
-                                         &compress_len, NULL))
-         == LZO_E_OUTPUT_OVERRUN) {
-    // The buffer size is too small, try with a bigger one
-    jcr->compress.inflate_buffer_size
-        = jcr->compress.inflate_buffer_size
-          + (jcr->compress.inflate_buffer_size >> 1);
-    jcr->compress.inflate_buffer = CheckPoolMemorySize(
-        jcr->compress.inflate_buffer, jcr->compress.inflate_buffer_size);
-
-    if (sparse && want_data_stream) {
-      compress_len = jcr->compress.inflate_buffer_size - OFFSET_FADDR_SIZE;
-      wbuf = (unsigned char*)jcr->compress.inflate_buffer + OFFSET_FADDR_SIZE;
-    } else {
-      compress_len = jcr->compress.inflate_buffer_size;
-      wbuf = (unsigned char*)jcr->compress.inflate_buffer;
-    }
-    Dmsg2(400, "Comp_len=%d message_length=%d\n", compress_len, *length);
-  }
 
-  if (status != LZO_E_OK) {
-    Qmsg(jcr, M_ERROR, 0, T_("LZO uncompression error on file %s. ERR=%d\n"),
-         last_fname, status);
-    return false;
-  }
+  Dmsg1(400, "Stream found in DecompressData(): %d\n", stream);
 
   /* We return a decompressed data stream with the fileoffset encoded when this
    * was a sparse stream. */
-  if (sparse && want_data_stream) {
-    memcpy(jcr->compress.inflate_buffer, *data, OFFSET_FADDR_SIZE);
-  }
+  bool sparse = stream == STREAM_SPARSE_COMPRESSED_DATA
+                || stream == STREAM_SPARSE_GZIP_DATA;
+  std::size_t offset = (sparse && want_data_stream) ? OFFSET_FADDR_SIZE : 0;
 
-  *data = jcr->compress.inflate_buffer;
-  *length = compress_len;
-
-  Dmsg2(400, "Write uncompressed %d bytes, total before write=%s\n",
-        compress_len, edit_uint64(jcr->JobBytes, ec1));
-
-  return true;
-}
-#endif
-
-static bool decompress_with_fastlz(JobControlRecord* jcr,
-                                   const char* last_fname,
-                                   char** data,
-                                   uint32_t* length,
-                                   uint32_t comp_magic,
-                                   bool sparse,
-                                   bool want_data_stream)
-{
-  int zstat;
-  zfast_stream stream;
-  zfast_stream_compressor compressor = COMPRESSOR_FASTLZ;
-  char ec1[50]; /* Buffer printing huge values */
-
-  switch (comp_magic) {
-    case COMPRESS_FZ4L:
-    case COMPRESS_FZ4H:
-      compressor = COMPRESSOR_LZ4;
-      break;
-  }
-
-  /* NOTE! We only use uInt and Bytef because they are
-   * needed by the fastlz routines, they should not otherwise
-   * be used in Bareos. */
-  memset(&stream, 0, sizeof(stream));
-  stream.next_in = (Bytef*)*data + sizeof(comp_stream_header);
-  stream.avail_in = (uInt)*length - sizeof(comp_stream_header);
-  if (sparse && want_data_stream) {
-    stream.next_out = (Bytef*)jcr->compress.inflate_buffer + OFFSET_FADDR_SIZE;
-    stream.avail_out
-        = (uInt)jcr->compress.inflate_buffer_size - OFFSET_FADDR_SIZE;
-  } else {
-    stream.next_out = (Bytef*)jcr->compress.inflate_buffer;
-    stream.avail_out = (uInt)jcr->compress.inflate_buffer_size;
-  }
-
-  Dmsg2(400, "Comp_len=%d message_length=%d\n", stream.avail_in, *length);
-
-  if ((zstat = fastlzlibDecompressInit(&stream)) != Z_OK) { goto cleanup; }
-
-  if ((zstat = fastlzlibSetCompressor(&stream, compressor)) != Z_OK) {
-    goto cleanup;
-  }
-
-  while (1) {
-    zstat = fastlzlibDecompress(&stream);
-    switch (zstat) {
-      case Z_BUF_ERROR:
-        // The buffer size is too small, try with a bigger one
-        jcr->compress.inflate_buffer_size
-            = jcr->compress.inflate_buffer_size
-              + (jcr->compress.inflate_buffer_size >> 1);
-        jcr->compress.inflate_buffer = CheckPoolMemorySize(
-            jcr->compress.inflate_buffer, jcr->compress.inflate_buffer_size);
-        if (sparse && want_data_stream) {
-          stream.next_out
-              = (Bytef*)jcr->compress.inflate_buffer + OFFSET_FADDR_SIZE;
-          stream.avail_out
-              = (uInt)jcr->compress.inflate_buffer_size - OFFSET_FADDR_SIZE;
-        } else {
-          stream.next_out = (Bytef*)jcr->compress.inflate_buffer;
-          stream.avail_out = (uInt)jcr->compress.inflate_buffer_size;
-        }
-        continue;
-      case Z_OK:
-      case Z_STREAM_END:
-        break;
-      default:
-        goto cleanup;
-    }
-    break;
+  inflate_buffer output{jcr, offset};
+  result size = DecompressRecord(stream, *data, *length, output);
+  if (size.holds_error()) {
+    Qmsg(jcr, M_ERROR, 0, T_("Uncompression error on file %s. ERR=%s\n"),
+         last_fname, size.error_unchecked().c_str());
+    return false;
   }
 
-  /* We return a decompressed data stream with the fileoffset encoded when this
-   * was a sparse stream. */
-  if (sparse && want_data_stream) {
-    memcpy(jcr->compress.inflate_buffer, *data, OFFSET_FADDR_SIZE);
-  }
+  if (offset) { memcpy(jcr->compress.inflate_buffer, *data, offset); }
 
   *data = jcr->compress.inflate_buffer;
-  *length = stream.total_out;
+  *length = size.value_unchecked();
+
   Dmsg2(400, "Write uncompressed %d bytes, total before write=%s\n", *length,
         edit_uint64(jcr->JobBytes, ec1));
-  fastlzlibDecompressEnd(&stream);
 
   return true;
-
-cleanup:
-  Qmsg(jcr, M_ERROR, 0, T_("Uncompression error on file %s. ERR=%s\n"),
-       last_fname, zlib_strerror(zstat));
-  fastlzlibDecompressEnd(&stream);
-
-  return false;
-}
-
-bool DecompressData(JobControlRecord* jcr,
-                    const char* last_fname,
-                    int32_t stream,
-                    char** data,
-                    uint32_t* length,
-                    bool want_data_stream)
-{
-  Dmsg1(400, "Stream found in DecompressData(): %d\n", stream);
-  switch (stream) {
-    case STREAM_COMPRESSED_DATA:
-    case STREAM_SPARSE_COMPRESSED_DATA:
-    case STREAM_WIN32_COMPRESSED_DATA:
-    case STREAM_ENCRYPTED_FILE_COMPRESSED_DATA:
-    case STREAM_ENCRYPTED_WIN32_COMPRESSED_DATA: {
-      uint32_t comp_magic, comp_len;
-      uint16_t comp_level, comp_version;
-
-      // Read compress header
-      unser_declare;
-      UnserBegin(*data, sizeof(comp_stream_header));
-      unser_uint32(comp_magic);
-      unser_uint32(comp_len);
-      unser_uint16(comp_level);
-      unser_uint16(comp_version);
-      UnserEnd(*data, sizeof(comp_stream_header));
-      Dmsg4(400,
-            "Compressed data stream found: magic=0x%x, len=%d, level=%d, "
-            "ver=0x%x\n",
-            comp_magic, comp_len, comp_level, comp_version);
-
-      // Version check
-      if (comp_version != COMP_HEAD_VERSION) {
-        Qmsg(jcr, M_ERROR, 0,
-             T_("Compressed header version error. version=0x%x\n"),
-             comp_version);
-        return false;
-      }
-
-      // Size check
-      if (comp_len + sizeof(comp_stream_header) != *length) {
-        Qmsg(jcr, M_ERROR, 0,
-             T_("Compressed header size error. comp_len=%d, "
-                "message_length=%d\n"),
-             comp_len, *length);
-        return false;
-      }
-
-      /* Based on the compression used perform the actual decompression of the
-       * data. */
-      switch (comp_magic) {
-#ifdef HAVE_LIBZ
-        case COMPRESS_GZIP:
-          switch (stream) {
-            case STREAM_SPARSE_COMPRESSED_DATA:
-              return decompress_with_zlib(jcr, last_fname, data, length, true,
-                                          true, want_data_stream);
-            default:
-              return decompress_with_zlib(jcr, last_fname, data, length, false,
-                                          true, want_data_stream);
-          }
-#endif
-#ifdef HAVE_LZO
-        case COMPRESS_LZO1X:
-          switch (stream) {
-            case STREAM_SPARSE_COMPRESSED_DATA:
-              return decompress_with_lzo(jcr, last_fname, data, length, true,
-                                         want_data_stream);
-            default:
-              return decompress_with_lzo(jcr, last_fname, data, length, false,
-                                         want_data_stream);
-          }
-#endif
-        case COMPRESS_FZFZ:
-        case COMPRESS_FZ4L:
-        case COMPRESS_FZ4H:
-          switch (stream) {
-            case STREAM_SPARSE_COMPRESSED_DATA:
-              return decompress_with_fastlz(jcr, last_fname, data, length,
-                                            comp_magic, true, want_data_stream);
-            default:
-              return decompress_with_fastlz(jcr, last_fname, data, length,
-                                            comp_magic, false,
-                                            want_data_stream);
-          }
-        default:
-          Qmsg(jcr, M_ERROR, 0,
-               T_("Compression algorithm 0x%x found, but not supported!\n"),
-               comp_magic);
-          return false;
-      }
-      break;
-    }
-    default:
-#ifdef HAVE_LIBZ
-      switch (stream) {
-        case STREAM_SPARSE_GZIP_DATA:
-          return decompress_with_zlib(jcr, last_fname, data, length, true,
-                                      false, want_data_stream);
-        default:
-          return decompress_with_zlib(jcr, last_fname, data, length, false,
-                                      false, want_data_stream);
-      }
-#else
-      Qmsg(jcr, M_ERROR, 0,
-           T_("Compression algorithm GZIP found, but not supported!\n"));
-      return false;
-#endif
-  }
 }
 
 void CleanupCompression(JobControlRecord* jcr)
@@ -1100,4 +1263,11 @@ void CleanupCompression(JobControlRecord* jcr)
     free(jcr->compress.workset.pZFAST);
     jcr->compress.workset.pZFAST = NULL;
   }
+
+#ifdef HAVE_ZSTD
+  if (jcr->compress.workset.pZSTD) {
+    ZSTD_freeCCtx((ZSTD_CCtx*)jcr->compress.workset.pZSTD);
+    jcr->compress.workset.pZSTD = NULL;
+  }
+#endif
 }
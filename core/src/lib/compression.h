@@ -23,6 +23,8 @@
 
 #include "lib/util.h"
 
+#include <vector>
+
 const char* cmprs_algo_to_text(uint32_t compression_algorithm);
 
 bool SetupCompressionBuffers(JobControlRecord* jcr,
@@ -30,6 +32,11 @@ bool SetupCompressionBuffers(JobControlRecord* jcr,
                              uint32_t* compress_buf_size);
 bool SetupDecompressionBuffers(JobControlRecord* jcr,
                                uint32_t* decompress_buf_size);
+// set the level used by CompressData() for algorithms whose level is not
+// configured elsewhere, e.g. zstd.
+bool SetCompressionLevel(JobControlRecord* jcr,
+                         uint32_t compression_algorithm,
+                         uint32_t level);
 
 
 // return the number of bytes written to the output on success
@@ -41,6 +48,15 @@ result<std::size_t> ThreadlocalCompress(uint32_t algo,
                                         char* output,
                                         std::size_t capacity);
 
+// decompress the data of a record of the given (compressed) stream into
+// output, which gets enlarged if needed.  Does not use any job state, so it
+// can be used concurrently by multiple threads.
+// return the number of bytes written to the output on success
+result<std::size_t> ThreadlocalDecompress(int32_t stream,
+                                          const char* input,
+                                          std::size_t size,
+                                          std::vector<char>& output);
+
 std::size_t RequiredCompressionOutputBufferSize(uint32_t algo,
                                                 std::size_t max_input_size);
 
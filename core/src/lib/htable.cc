@@ -22,22 +22,24 @@
 /*
  * BAREOS hash table routines
  *
- * htable is a hash table of items (pointers). This code is
- * adapted and enhanced from code I wrote in 1982 for a
- * relocatable linker.  At that time, the hash table size
- * was fixed and a primary number, which essentially provides
- * the randomness. In this program, the hash table can grow when
- * it gets too full, so the table size here is a binary number. The
- * hashing is provided using an idea from Tcl where the initial
- * hash code is "randomized" using a simple calculation from
- * a random number generator that multiplies by a big number
- * (I multiply by a prime number, while Tcl did not)
- * then shifts the result down and does the binary division
- * by masking.  Increasing the size of the hash table is simple.
- * Just create a new larger table, walk the old table and
- * re-hash insert each entry into the new table.
+ * htable is a hash table of items (pointers).  It started out as a
+ * chained hash table written by Kern Sibbald in July MMIII, adapted from
+ * code he wrote in 1982 for a relocatable linker.
  *
- * Kern Sibbald, July MMIII
+ * Chasing the chain pointers of millions of items costs a cache miss per
+ * item, so the table now uses open addressing: the links of the items are
+ * kept in one array of slots and a parallel array holds one control byte
+ * per slot.  A control byte is either kEmpty or the lowest 7 bits of the
+ * (mixed) hash of the item.  The slots are probed a group at a time: all
+ * control bytes of a group are compared with the 7 hash bits with a few
+ * (SIMD) instructions, and only the items whose byte matches are looked
+ * at.  Groups are probed with triangular steps, which visits every group
+ * of the table because the number of groups is a power of two.
+ *
+ * Growing the table does not rehash everything at once.  A table twice
+ * the size is allocated and every insert moves a few entries of the old
+ * table over, while lookups look into both tables.  Items are never
+ * removed, so there are no tombstones.
  */
 
 #include <cinttypes>
@@ -46,54 +48,166 @@
 #include "include/bareos.h"
 #include "lib/htable.h"
 
+#if defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define HTABLE_USE_SSE2 1
+#endif
+
 static const int debuglevel = 500;
 
-// htable (Hash Table) class.
+namespace {
+constexpr uint8_t kEmpty = 0x80;
 
-/*
- * Create hash of key, stored in hash then
- * create and return the pseudo random bucket index
- */
-void htableImpl::HashIndex(char* key)
+// Maximum load is 7/8 of the capacity
+constexpr uint32_t kMaxLoadNum = 7;
+constexpr uint32_t kMaxLoadDen = 8;
+
+// Entries of the old table that are moved on every insert while growing
+constexpr uint32_t kMoveStep = 64;
+
+#if defined(HTABLE_USE_SSE2)
+constexpr uint32_t kGroupSize = 16;
+constexpr int kMaskShift = 0; /* bit i of a mask is slot i of the group */
+#else
+constexpr uint32_t kGroupSize = 8;
+constexpr int kMaskShift = 3; /* bit 8 * i + 7 of a mask is slot i */
+#endif
+
+inline int CountTrailingZeros(uint64_t x)
 {
-  hash = 0;
-  for (char* p = key; *p; p++) {
-    hash += ((hash << 5) | (hash >> (sizeof(hash) * 8 - 5))) + (uint32_t)*p;
+#if defined(__GNUC__)
+  return __builtin_ctzll(x);
+#else
+  int n = 0;
+  while (!(x & 1)) {
+    x >>= 1;
+    n++;
   }
-
-  // Multiply by large prime number, take top bits, mask for remainder.
-  index = ((hash * 1103515249) >> rshift) & mask;
-  Dmsg2(debuglevel, "Leave HashIndex hash=0x%llx index=%d\n", hash, index);
+  return n;
+#endif
 }
 
-void htableImpl::HashIndex(uint32_t key)
+// Set of slots in a group, iterated from the lowest slot up.
+class BitMask {
+ public:
+  explicit BitMask(uint64_t bits) : bits_(bits) {}
+  explicit operator bool() const { return bits_ != 0; }
+  uint32_t Lowest() const { return CountTrailingZeros(bits_) >> kMaskShift; }
+  void ClearLowest() { bits_ &= bits_ - 1; }
+
+ private:
+  uint64_t bits_;
+};
+
+class Group {
+ public:
+#if defined(HTABLE_USE_SSE2)
+  explicit Group(const uint8_t* ctrl)
+      : ctrl_(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl)))
+  {
+  }
+
+  BitMask Match(uint8_t h2) const
+  {
+    return BitMask(static_cast<uint32_t>(_mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_set1_epi8(static_cast<char>(h2)), ctrl_))));
+  }
+
+  // Only kEmpty has the top bit set
+  BitMask MatchEmpty() const
+  {
+    return BitMask(static_cast<uint32_t>(_mm_movemask_epi8(ctrl_)));
+  }
+
+ private:
+  __m128i ctrl_;
+#else
+  explicit Group(const uint8_t* ctrl)
+  {
+    ctrl_ = 0;
+    for (uint32_t i = 0; i < kGroupSize; ++i) {
+      ctrl_ |= static_cast<uint64_t>(ctrl[i]) << (8 * i);
+    }
+  }
+
+  /* Top bit of every byte equal to h2.  A byte above a match may be
+   * reported as well, which the caller sorts out by comparing the keys. */
+  BitMask Match(uint8_t h2) const
+  {
+    uint64_t x = ctrl_ ^ (kLsbs * h2);
+    return BitMask((x - kLsbs) & ~x & kMsbs);
+  }
+
+  BitMask MatchEmpty() const { return BitMask(ctrl_ & kMsbs); }
+
+ private:
+  static constexpr uint64_t kLsbs = 0x0101010101010101ULL;
+  static constexpr uint64_t kMsbs = 0x8080808080808080ULL;
+  uint64_t ctrl_;
+#endif
+};
+
+// Spread the bits of the hash, the hashes of small integers are the integers
+inline uint64_t Mix(uint64_t hash)
 {
-  hash = key;
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+inline uint8_t H2(uint64_t mixed) { return mixed & 0x7f; }
 
-  // Multiply by large prime number, take top bits, mask for remainder.
-  index = ((hash * 1103515249) >> rshift) & mask;
-  Dmsg2(debuglevel, "Leave HashIndex hash=0x%llx index=%d\n", hash, index);
+inline uint32_t NumGroups(uint32_t capacity) { return capacity / kGroupSize; }
+
+inline uint32_t FirstGroup(uint64_t mixed, uint32_t capacity)
+{
+  return (mixed >> 7) & (NumGroups(capacity) - 1);
 }
 
-void htableImpl::HashIndex(uint64_t key)
+inline bool TooFull(uint32_t items, uint32_t capacity)
 {
-  hash = key;
+  return static_cast<uint64_t>(items) * kMaxLoadDen
+         > static_cast<uint64_t>(capacity) * kMaxLoadNum;
+}
+}  // namespace
+
+// htable (Hash Table) class.
 
-  // Multiply by large prime number, take top bits, mask for remainder.
-  index = ((hash * 1103515249) >> rshift) & mask;
-  Dmsg2(debuglevel, "Leave HashIndex hash=0x%llx index=%d\n", hash, index);
+uint64_t htableImpl::Hash(char* key)
+{
+  uint64_t hash = 0;
+  for (char* p = key; *p; p++) {
+    hash += ((hash << 5) | (hash >> (sizeof(hash) * 8 - 5))) + (uint32_t)*p;
+  }
+  return hash;
 }
 
-void htableImpl::HashIndex(uint8_t* key, uint32_t keylen)
+uint64_t htableImpl::Hash(uint8_t* key, uint32_t keylen)
 {
-  hash = 0;
+  uint64_t hash = 0;
   for (uint8_t* p = key; keylen--; p++) {
     hash += ((hash << 5) | (hash >> (sizeof(hash) * 8 - 5))) + (uint32_t)*p;
   }
+  return hash;
+}
 
-  // Multiply by large prime number, take top bits, mask for remainder.
-  index = ((hash * 1103515249) >> rshift) & mask;
-  Dmsg2(debuglevel, "Leave HashIndex hash=0x%llx index=%d\n", hash, index);
+void htableImpl::AllocTable(Table& t, uint32_t capacity)
+{
+  t.capacity = capacity;
+  t.ctrl = (uint8_t*)malloc(capacity);
+  memset(t.ctrl, kEmpty, capacity);
+  t.slots = (hlink**)malloc(capacity * sizeof(hlink*));
+}
+
+void htableImpl::FreeTable(Table& t)
+{
+  free(t.ctrl);
+  free(t.slots);
+  t = Table{};
 }
 
 // tsize is the estimated number of entries in the hash table
@@ -105,338 +219,261 @@ htableImpl::htableImpl(size_t t_loffset, int tsize)
 
 void htableImpl::init(int tsize)
 {
-  memset(this, 0, sizeof(htableImpl));
+  destroy();
   if (tsize < 31) { tsize = 31; }
-  tsize >>= 2;
 
-  int pwr;
-  for (pwr = 0; tsize; pwr++) { tsize >>= 1; }
-  rshift = 30 - pwr;  /* Start using bits 28, 29, 30 */
-  buckets = 1 << pwr; /* Hash table size -- power of two */
+  uint32_t capacity = 2 * kGroupSize;
+  while (TooFull(tsize, capacity)) { capacity <<= 1; }
+  AllocTable(table, capacity);
 
-  mask = buckets - 1;      /* 3 bits => table size = 8 */
-  max_items = buckets * 4; /* Allow average nr_entries entries per chain */
-  table = (hlink**)malloc(buckets * sizeof(hlink*));
-  memset(table, 0, buckets * sizeof(hlink*));
+  moved = 0;
+  num_items = 0;
+  walk_index = 0;
 }
 
 uint32_t htableImpl::size() { return num_items; }
 
 /*
- * Take each hash link and walk down the chain of items
- *  that hash there counting them (i.e. the hits),
- *  then report that number.
- * Obiously, the more hits in a chain, the more time
- *  it takes to reference them. Empty chains are not so
- *  hot either -- as it means unused or wasted space.
+ * Count for every item how many groups have to be probed to find it.
+ * The more groups, the more time it takes to reference the item.
  */
 #define MAX_COUNT 20
 void htableImpl::stats()
 {
   int hits[MAX_COUNT];
   int max = 0;
-  int i, j;
-  hlink* p;
-  printf("\n\nNumItems=%d\nTotal buckets=%d\n", num_items, buckets);
-  printf("Hits/bucket: buckets\n");
+  int i;
+
+  FinishGrow();
+
+  printf("\n\nNumItems=%d\nTotal slots=%d\n", num_items, table.capacity);
+  printf("Groups probed: items\n");
   for (i = 0; i < MAX_COUNT; i++) { hits[i] = 0; }
-  for (i = 0; i < (int)buckets; i++) {
-    p = table[i];
-    j = 0;
-    while (p) {
-      p = (hlink*)(p->next);
-      j++;
+  for (uint32_t slot = 0; slot < table.capacity; slot++) {
+    if (table.ctrl[slot] == kEmpty) { continue; }
+
+    uint32_t want = slot / kGroupSize;
+    uint32_t group = FirstGroup(Mix(table.slots[slot]->hash), table.capacity);
+    int probes = 1;
+    for (uint32_t step = 1; group != want; step++) {
+      group = (group + step) & (NumGroups(table.capacity) - 1);
+      probes++;
     }
-    if (j > max) { max = j; }
-    if (j < MAX_COUNT) { hits[j]++; }
+    if (probes > max) { max = probes; }
+    if (probes < MAX_COUNT) { hits[probes]++; }
   }
-  for (i = 0; i < MAX_COUNT; i++) { printf("%2d:           %d\n", i, hits[i]); }
-  printf("buckets=%d num_items=%d max_items=%d\n", buckets, num_items,
-         max_items);
-  printf("max hits in a bucket = %d\n", max);
+  for (i = 1; i < MAX_COUNT; i++) { printf("%2d:           %d\n", i, hits[i]); }
+  printf("slots=%d num_items=%d group size=%d\n", table.capacity, num_items,
+         kGroupSize);
+  printf("max groups probed for an item = %d\n", max);
 }
 
-void htableImpl::grow_table()
+// Put hp into the first free slot of its probe sequence.
+void htableImpl::Place(Table& t, hlink* hp)
 {
-  htableImpl* big;
-  hlink* cur;
-  void* next_item;
-
-  Dmsg1(100, "Grow called old size = %d\n", buckets);
-
-  // Setup a bigger table.
-  big = (htableImpl*)malloc(sizeof(htableImpl));
-  big->hash = hash;
-  big->index = index;
-  big->loffset = loffset;
-  big->mask = mask << 1 | 1;
-  big->rshift = rshift - 1;
-  big->num_items = 0;
-  big->buckets = buckets * 2;
-  big->max_items = big->buckets * 4;
-
-  // Create a bigger hash table.
-  big->table = (hlink**)malloc(big->buckets * sizeof(hlink*));
-  memset(big->table, 0, big->buckets * sizeof(hlink*));
-  big->walkptr = NULL;
-  big->walk_index = 0;
-
-  // Insert all the items in the new hash table
-  Dmsg1(100, "Before copy num_items=%d\n", num_items);
-
-  /* We walk through the old smaller tree getting items,
-   * but since we are overwriting the colision links, we must
-   * explicitly save the item->next pointer and walk each
-   * colision chain ourselves. We do use next() for getting
-   * to the next bucket. */
-  for (void* item = first(); item;) {
-    cur = (hlink*)((char*)item + loffset);
-    next_item = cur->next; /* Save link overwritten by insert */
-    switch (cur->key_type) {
-      case KEY_TYPE_CHAR:
-        Dmsg1(100, "Grow insert: %s\n", cur->key.char_key);
-        big->insert(cur->key.char_key, item);
-        break;
-      case KEY_TYPE_UINT32:
-        Dmsg1(100, "Grow insert: %ld\n", cur->key.uint32_key);
-        big->insert(cur->key.uint32_key, item);
-        break;
-      case KEY_TYPE_UINT64:
-        Dmsg1(100, "Grow insert: %lld\n", cur->key.uint64_key);
-        big->insert(cur->key.uint64_key, item);
-        break;
-      case KEY_TYPE_BINARY:
-        big->insert(cur->key.binary_key, cur->key_len, item);
-        break;
-    }
-    if (next_item) {
-      item = (void*)((char*)next_item - loffset);
-    } else {
-      walkptr = NULL;
-      item = next();
+  uint64_t mixed = Mix(hp->hash);
+  uint32_t group_mask = NumGroups(t.capacity) - 1;
+  uint32_t group = FirstGroup(mixed, t.capacity);
+
+  for (uint32_t step = 1;; step++) {
+    uint32_t base = group * kGroupSize;
+    BitMask empty = Group(t.ctrl + base).MatchEmpty();
+    if (empty) {
+      uint32_t slot = base + empty.Lowest();
+      t.ctrl[slot] = H2(mixed);
+      t.slots[slot] = hp;
+      return;
     }
+    group = (group + step) & group_mask;
   }
+}
 
-  Dmsg1(100, "After copy new num_items=%d\n", big->num_items);
-  if (num_items != big->num_items) {
-    Dmsg0(000, "****** Big problems num_items mismatch ******\n");
+template <typename Equal>
+hlink* htableImpl::Find(const Table& t, uint64_t hash, Equal equal) const
+{
+  uint64_t mixed = Mix(hash);
+  uint8_t h2 = H2(mixed);
+  uint32_t group_mask = NumGroups(t.capacity) - 1;
+  uint32_t group = FirstGroup(mixed, t.capacity);
+
+  for (uint32_t step = 1;; step++) {
+    uint32_t base = group * kGroupSize;
+    Group g(t.ctrl + base);
+    for (BitMask match = g.Match(h2); match; match.ClearLowest()) {
+      hlink* hp = t.slots[base + match.Lowest()];
+      if (hp->hash == hash && equal(hp)) { return hp; }
+    }
+    // The item would have been put into the first empty slot
+    if (g.MatchEmpty()) { return nullptr; }
+    group = (group + step) & group_mask;
   }
+}
 
-  free(table);
-  memcpy(this, big, sizeof(htableImpl)); /* Move everything across */
-  free(big);
+template <typename Equal> void* htableImpl::Lookup(uint64_t hash, Equal equal)
+{
+  hlink* hp = Find(table, hash, equal);
+  if (!hp && old_table.ctrl) { hp = Find(old_table, hash, equal); }
+
+  if (hp) {
+    Dmsg1(debuglevel, "lookup return %p\n", ((char*)hp) - loffset);
+    return ((char*)hp) - loffset;
+  }
 
-  Dmsg0(100, "Exit grow.\n");
+  return NULL;
 }
 
-bool htableImpl::insert(char* key, void* item)
+/*
+ * Allocate a table twice the size.  The entries are moved over by the
+ * following inserts, see MoveSome().
+ */
+void htableImpl::grow_table()
 {
-  hlink* hp;
+  FinishGrow();
 
-  if (lookup(key)) { return false; /* Already exists */ }
+  Dmsg1(100, "Grow called old size = %d\n", table.capacity);
 
-  ASSERT(index < buckets);
-  Dmsg2(debuglevel, "Insert: hash=%p index=%d\n", hash, index);
-  hp = (hlink*)(((char*)item) + loffset);
+  old_table = table;
+  AllocTable(table, old_table.capacity * 2);
+  moved = 0;
+}
 
-  Dmsg4(debuglevel, "Insert hp=%p index=%d item=%p offset=%u\n", hp, index,
-        item, loffset);
+void htableImpl::MoveSome(uint32_t count)
+{
+  uint32_t end = std::min(moved + count, old_table.capacity);
+  for (; moved < end; moved++) {
+    if (old_table.ctrl[moved] != kEmpty) {
+      Place(table, old_table.slots[moved]);
+    }
+  }
 
-  hp->next = table[index];
-  hp->hash = hash;
-  hp->key_type = KEY_TYPE_CHAR;
-  hp->key.char_key = key;
-  hp->key_len = 0;
-  table[index] = hp;
+  if (moved == old_table.capacity) {
+    FreeTable(old_table);
+    Dmsg1(100, "Exit grow, new size = %d\n", table.capacity);
+  }
+}
+
+void htableImpl::FinishGrow()
+{
+  if (old_table.ctrl) { MoveSome(old_table.capacity); }
+}
 
-  Dmsg3(debuglevel, "Insert hp->next=%p hp->hash=0x%llx hp->key=%s\n", hp->next,
-        hp->hash, hp->key.char_key);
+bool htableImpl::Add(hlink* hp, void* item)
+{
+  Dmsg4(debuglevel, "Insert hp=%p item=%p offset=%u hash=0x%llx\n", hp, item,
+        loffset, hp->hash);
 
-  if (++num_items >= max_items) {
-    Dmsg2(debuglevel, "num_items=%d max_items=%d\n", num_items, max_items);
+  if (old_table.ctrl) {
+    MoveSome(kMoveStep);
+  } else if (TooFull(num_items + 1, table.capacity)) {
+    Dmsg1(debuglevel, "num_items=%d\n", num_items);
     grow_table();
   }
 
-  Dmsg3(debuglevel, "Leave insert index=%d num_items=%d key=%s\n", index,
-        num_items, key);
+  Place(table, hp);
+  num_items++;
+
+  Dmsg1(debuglevel, "Leave insert num_items=%d\n", num_items);
 
   return true;
 }
 
-bool htableImpl::insert(uint32_t key, void* item)
+bool htableImpl::insert(char* key, void* item)
 {
-  hlink* hp;
-
   if (lookup(key)) { return false; /* Already exists */ }
 
-  ASSERT(index < buckets);
-  Dmsg2(debuglevel, "Insert: hash=%p index=%d\n", hash, index);
-  hp = (hlink*)(((char*)item) + loffset);
+  hlink* hp = (hlink*)(((char*)item) + loffset);
+  hp->hash = Hash(key);
+  hp->key_type = KEY_TYPE_CHAR;
+  hp->key.char_key = key;
+  hp->key_len = 0;
+
+  return Add(hp, item);
+}
 
-  Dmsg4(debuglevel, "Insert hp=%p index=%d item=%p offset=%u\n", hp, index,
-        item, loffset);
+bool htableImpl::insert(uint32_t key, void* item)
+{
+  if (lookup(key)) { return false; /* Already exists */ }
 
-  hp->next = table[index];
-  hp->hash = hash;
+  hlink* hp = (hlink*)(((char*)item) + loffset);
+  hp->hash = key;
   hp->key_type = KEY_TYPE_UINT32;
   hp->key.uint32_key = key;
   hp->key_len = 0;
-  table[index] = hp;
-
-  Dmsg3(debuglevel, "Insert hp->next=%p hp->hash=0x%llx hp->key=%ld\n",
-        hp->next, hp->hash, hp->key.uint32_key);
-
-  if (++num_items >= max_items) {
-    Dmsg2(debuglevel, "num_items=%d max_items=%d\n", num_items, max_items);
-    grow_table();
-  }
 
-  Dmsg3(debuglevel, "Leave insert index=%d num_items=%d key=%ld\n", index,
-        num_items, key);
-
-  return true;
+  return Add(hp, item);
 }
 
 bool htableImpl::insert(uint64_t key, void* item)
 {
-  hlink* hp;
-
   if (lookup(key)) { return false; /* Already exists */ }
 
-  ASSERT(index < buckets);
-  Dmsg2(debuglevel, "Insert: hash=%p index=%d\n", hash, index);
-  hp = (hlink*)(((char*)item) + loffset);
-
-  Dmsg4(debuglevel, "Insert hp=%p index=%d item=%p offset=%u\n", hp, index,
-        item, loffset);
-
-  hp->next = table[index];
-  hp->hash = hash;
+  hlink* hp = (hlink*)(((char*)item) + loffset);
+  hp->hash = key;
   hp->key_type = KEY_TYPE_UINT64;
   hp->key.uint64_key = key;
   hp->key_len = 0;
-  table[index] = hp;
-
-  Dmsg3(debuglevel, "Insert hp->next=%p hp->hash=0x%llx hp->key=%lld\n",
-        hp->next, hp->hash, hp->key.uint64_key);
-
-  if (++num_items >= max_items) {
-    Dmsg2(debuglevel, "num_items=%d max_items=%d\n", num_items, max_items);
-    grow_table();
-  }
-
-  Dmsg3(debuglevel, "Leave insert index=%d num_items=%d key=%lld\n", index,
-        num_items, key);
 
-  return true;
+  return Add(hp, item);
 }
 
 bool htableImpl::insert(uint8_t* key, uint32_t key_len, void* item)
 {
-  hlink* hp;
-
   if (lookup(key, key_len)) { return false; /* Already exists */ }
 
-  ASSERT(index < buckets);
-  Dmsg2(debuglevel, "Insert: hash=%p index=%d\n", hash, index);
-  hp = (hlink*)(((char*)item) + loffset);
-
-  Dmsg4(debuglevel, "Insert hp=%p index=%d item=%p offset=%u\n", hp, index,
-        item, loffset);
-
-  hp->next = table[index];
-  hp->hash = hash;
+  hlink* hp = (hlink*)(((char*)item) + loffset);
+  hp->hash = Hash(key, key_len);
   hp->key_type = KEY_TYPE_BINARY;
   hp->key.binary_key = key;
   hp->key_len = key_len;
-  table[index] = hp;
-
-  Dmsg2(debuglevel, "Insert hp->next=%p hp->hash=0x%llx\n", hp->next, hp->hash);
-
-  if (++num_items >= max_items) {
-    Dmsg2(debuglevel, "num_items=%d max_items=%d\n", num_items, max_items);
-    grow_table();
-  }
 
-  Dmsg2(debuglevel, "Leave insert index=%d num_items=%d\n", index, num_items);
-
-  return true;
+  return Add(hp, item);
 }
 
 void* htableImpl::lookup(char* key)
 {
-  HashIndex(key);
-  for (hlink* hp = table[index]; hp; hp = (hlink*)hp->next) {
+  return Lookup(Hash(key), [key](hlink* hp) {
     ASSERT(hp->key_type == KEY_TYPE_CHAR);
-    if (hash == hp->hash && bstrcmp(key, hp->key.char_key)) {
-      Dmsg1(debuglevel, "lookup return %p\n", ((char*)hp) - loffset);
-      return ((char*)hp) - loffset;
-    }
-  }
-
-  return NULL;
+    return bstrcmp(key, hp->key.char_key);
+  });
 }
 
 void* htableImpl::lookup(uint32_t key)
 {
-  HashIndex(key);
-  for (hlink* hp = table[index]; hp; hp = (hlink*)hp->next) {
+  return Lookup(key, [key](hlink* hp) {
     ASSERT(hp->key_type == KEY_TYPE_UINT32);
-    if (hash == hp->hash && key == hp->key.uint32_key) {
-      Dmsg1(debuglevel, "lookup return %p\n", ((char*)hp) - loffset);
-      return ((char*)hp) - loffset;
-    }
-  }
-
-  return NULL;
+    return key == hp->key.uint32_key;
+  });
 }
 
 void* htableImpl::lookup(uint64_t key)
 {
-  HashIndex(key);
-  for (hlink* hp = table[index]; hp; hp = (hlink*)hp->next) {
+  return Lookup(key, [key](hlink* hp) {
     ASSERT(hp->key_type == KEY_TYPE_UINT64);
-    if (hash == hp->hash && key == hp->key.uint64_key) {
-      Dmsg1(debuglevel, "lookup return %p\n", ((char*)hp) - loffset);
-      return ((char*)hp) - loffset;
-    }
-  }
-
-  return NULL;
+    return key == hp->key.uint64_key;
+  });
 }
 
 void* htableImpl::lookup(uint8_t* key, uint32_t key_len)
 {
-  HashIndex(key, key_len);
-  for (hlink* hp = table[index]; hp; hp = (hlink*)hp->next) {
+  return Lookup(Hash(key, key_len), [key, key_len](hlink* hp) {
     ASSERT(hp->key_type == KEY_TYPE_BINARY);
-    if (hash == hp->hash && memcmp(key, hp->key.binary_key, hp->key_len) == 0) {
-      Dmsg1(debuglevel, "lookup return %p\n", ((char*)hp) - loffset);
-      return ((char*)hp) - loffset;
-    }
-  }
-
-  return NULL;
+    return key_len == hp->key_len
+           && memcmp(key, hp->key.binary_key, key_len) == 0;
+  });
 }
 
 void* htableImpl::next()
 {
-  Dmsg1(debuglevel, "Enter next: walkptr=%p\n", walkptr);
-  if (walkptr) { walkptr = (hlink*)(walkptr->next); }
-
-  while (!walkptr && walk_index < buckets) {
-    walkptr = table[walk_index++];
-    if (walkptr) {
-      Dmsg3(debuglevel, "new walkptr=%p next=%p inx=%d\n", walkptr,
-            walkptr->next, walk_index - 1);
+  Dmsg1(debuglevel, "Enter next: walk_index=%d\n", walk_index);
+
+  while (walk_index < table.capacity) {
+    uint32_t slot = walk_index++;
+    if (table.ctrl[slot] != kEmpty) {
+      Dmsg2(debuglevel, "next: rtn %p walk_index=%d\n",
+            ((char*)table.slots[slot]) - loffset, walk_index);
+      return ((char*)table.slots[slot]) - loffset;
     }
   }
-
-  if (walkptr) {
-    Dmsg2(debuglevel, "next: rtn %p walk_index=%d\n",
-          ((char*)walkptr) - loffset, walk_index);
-    return ((char*)walkptr) - loffset;
-  }
   Dmsg0(debuglevel, "next: return NULL\n");
 
   return NULL;
@@ -445,30 +482,18 @@ void* htableImpl::next()
 void* htableImpl::first()
 {
   Dmsg0(debuglevel, "Enter first\n");
-  walkptr = table[0]; /* get first bucket */
-  walk_index = 1;     /* Point to next index */
-
-  while (!walkptr && walk_index < buckets) {
-    walkptr = table[walk_index++]; /* go to next bucket */
-    if (walkptr) {
-      Dmsg3(debuglevel, "first new walkptr=%p next=%p inx=%d\n", walkptr,
-            walkptr->next, walk_index - 1);
-    }
-  }
 
-  if (walkptr) {
-    Dmsg1(debuglevel, "Leave first walkptr=%p\n", walkptr);
-    return ((char*)walkptr) - loffset;
-  }
-  Dmsg0(debuglevel, "Leave first walkptr=NULL\n");
+  // Walking two tables is not worth it
+  FinishGrow();
+  walk_index = 0;
 
-  return NULL;
+  return next();
 }
 
 /* Destroy the table and its contents */
 void htableImpl::destroy()
 {
-  free(table);
-  table = NULL;
+  FreeTable(table);
+  FreeTable(old_table);
   Dmsg0(100, "Done destroy.\n");
 }
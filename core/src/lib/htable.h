@@ -52,35 +52,52 @@ union hlink_key {
 };
 
 struct hlink {
-  void* next;          /* Next hash item */
   key_type_t key_type; /* Type of key used to hash */
   union hlink_key key; /* Key for this item */
   uint32_t key_len;    /* Length of key for this item */
   uint64_t hash;       /* Hash for this key */
 };
 
+/*
+ * Open addressing hash table of items.  Besides a slot with the link of
+ * the item, every entry has a control byte with 7 bits of the hash, so a
+ * whole group of entries is checked at once before any item is touched.
+ * When the table gets too full, a table twice the size is allocated and
+ * the entries are moved over a few at a time on every insert.
+ */
 class htableImpl {
-  hlink** table = nullptr;      /* Hash table */
-  size_t loffset = 0;           /* Link offset in item */
-  hlink* walkptr = nullptr;     /* Table walk pointer */
-  uint64_t hash = 0;            /* Temp storage */
-  uint32_t walk_index = 0;      /* Table walk index */
-  uint32_t num_items = 0;       /* Current number of items */
-  uint32_t max_items = 0;       /* Maximum items before growing */
-  uint32_t buckets = 0;         /* Size of hash table */
-  uint32_t index = 0;           /* Temp storage */
-  uint32_t mask = 0;            /* "Remainder" mask */
-  uint32_t rshift = 0;          /* Amount to shift down */
-  void HashIndex(char* key);    /* Produce hash key,index */
-  void HashIndex(uint32_t key); /* Produce hash key,index */
-  void HashIndex(uint64_t key); /* Produce hash key,index */
-  void HashIndex(uint8_t* key, uint32_t key_len); /* Produce hash key,index */
-  void grow_table();                              /* Grow the table */
+  struct Table {
+    uint8_t* ctrl = nullptr; /* Control bytes */
+    hlink** slots = nullptr; /* Links of the items */
+    uint32_t capacity = 0;   /* Number of slots, a power of two */
+  };
+
+  Table table;             /* Table new items are added to */
+  Table old_table;         /* Table that is moved into table while growing */
+  uint32_t moved = 0;      /* Slots of old_table already moved */
+  size_t loffset = 0;      /* Link offset in item */
+  uint32_t num_items = 0;  /* Current number of items */
+  uint32_t walk_index = 0; /* Table walk index */
+
+  static uint64_t Hash(char* key);
+  static uint64_t Hash(uint8_t* key, uint32_t key_len);
+  template <typename Equal>
+  hlink* Find(const Table& t, uint64_t hash, Equal equal) const;
+  template <typename Equal> void* Lookup(uint64_t hash, Equal equal);
+  bool Add(hlink* hp, void* item);
+  static void Place(Table& t, hlink* hp);
+  static void AllocTable(Table& t, uint32_t capacity);
+  static void FreeTable(Table& t);
+  void grow_table(); /* Start to grow the table */
+  void MoveSome(uint32_t count);
+  void FinishGrow();
 
  public:
   htableImpl() = default;
   htableImpl(size_t t_loffset, int tsize = 31);
   ~htableImpl() { destroy(); }
+  htableImpl(const htableImpl&) = delete;
+  htableImpl& operator=(const htableImpl&) = delete;
   void init(int tsize = 31);
   bool insert(char* key, void* item);
   bool insert(uint32_t key, void* item);
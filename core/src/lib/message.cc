@@ -1211,55 +1211,43 @@ void e_msg(const char* file,
   }
 }
 
-// Generate a Job message
-void Jmsg(JobControlRecord* jcr, int type, utime_t mtime, const char* fmt, ...)
+// Update the job for an error or warning message
+static void CountJobMessage(JobControlRecord* jcr, int type)
 {
-  va_list ap;
-  MessagesResource* msgs;
-  int len, maxlen;
-  uint32_t JobId = 0;
-  PoolMem buf(PM_EMSG), more(PM_EMSG);
-
-  Dmsg1(850, "Enter Jmsg type=%d\n", type);
-
-  /* Special case for the console, which has a dir_bsock and JobId == 0,
-   * in that case, we send the message directly back to the
-   * dir_bsock. */
-  if (jcr && jcr->JobId == 0 && jcr->dir_bsock) {
-    BareosSocket* dir = jcr->dir_bsock;
-
-    va_start(ap, fmt);
-    dir->message_length
-        = Bvsnprintf(dir->msg, SizeofPoolMemory(dir->msg), fmt, ap);
-    va_end(ap);
-    jcr->dir_bsock->send();
-
-    return;
-  }
-
-  // The watchdog thread can't use Jmsg directly, we always queued it
-  if (IsWatchdog()) {
-    while (1) {
-      maxlen = buf.MaxSize() - 1;
-      va_start(ap, fmt);
-      len = Bvsnprintf(buf.c_str(), maxlen, fmt, ap);
-      va_end(ap);
-
-      if (len < 0 || len >= (maxlen - 5)) {
-        buf.ReallocPm(maxlen + maxlen / 2);
-        continue;
-      }
-
+  switch (type) {
+    case M_FATAL:
+      jcr->setJobStatusWithPriorityCheck(JS_FatalError);
+      if (jcr->JobErrors == 0) { jcr->JobErrors = 1; }
+      break;
+    case M_ERROR:
+      jcr->JobErrors++;
+      break;
+    case M_WARNING:
+      jcr->JobWarnings++;
+      break;
+    default:
       break;
-    }
-    Qmsg(jcr, type, mtime, "%s", buf.c_str());
-
-    return;
   }
+}
 
-  msgs = NULL;
-  if (!jcr) { jcr = GetJcrFromThreadSpecificData(); }
+static void QueueMessage(JobControlRecord* jcr,
+                         int type,
+                         const char* msg,
+                         bool counted);
+
+/* Send a formatted Job message. If counted is set, CountJobMessage() was
+ * already called for it when it got queued. */
+static void SendJobMessage(JobControlRecord* jcr,
+                           int type,
+                           utime_t mtime,
+                           const char* msg,
+                           bool counted)
+{
+  MessagesResource* msgs;
+  uint32_t JobId = 0;
+  PoolMem buf(PM_EMSG);
 
+  msgs = NULL;
   if (jcr) {
     // Dequeue messages to keep the original order
     if (!jcr->dequeuing_msgs) { /* Avoid recursion */
@@ -1279,6 +1267,8 @@ void Jmsg(JobControlRecord* jcr, int type, utime_t mtime, const char* fmt, ...)
     return; /* no destination */
   }
 
+  if (jcr && !counted) { CountJobMessage(jcr, type); }
+
   switch (type) {
     case M_ABORT:
       Mmsg(buf, T_("%s ABORTING due to ERROR\n"), my_name);
@@ -1291,16 +1281,12 @@ void Jmsg(JobControlRecord* jcr, int type, utime_t mtime, const char* fmt, ...)
       break;
     case M_FATAL:
       Mmsg(buf, T_("%s JobId %u: Fatal error: "), my_name, JobId);
-      if (jcr) { jcr->setJobStatusWithPriorityCheck(JS_FatalError); }
-      if (jcr && jcr->JobErrors == 0) { jcr->JobErrors = 1; }
       break;
     case M_ERROR:
       Mmsg(buf, T_("%s JobId %u: Error: "), my_name, JobId);
-      if (jcr) { jcr->JobErrors++; }
       break;
     case M_WARNING:
       Mmsg(buf, T_("%s JobId %u: Warning: "), my_name, JobId);
-      if (jcr) { jcr->JobWarnings++; }
       break;
     case M_SECURITY:
       Mmsg(buf, T_("%s JobId %u: Security violation: "), my_name, JobId);
@@ -1310,6 +1296,46 @@ void Jmsg(JobControlRecord* jcr, int type, utime_t mtime, const char* fmt, ...)
       break;
   }
 
+  PmStrcat(buf, msg);
+  DispatchMessage(jcr, type, mtime, buf.c_str());
+
+  if (type == M_ABORT) {
+    printf("BAREOS aborting to obtain traceback.\n");
+    syslog(LOG_DAEMON | LOG_ERR, "BAREOS aborting to obtain traceback.\n");
+    abort();
+  } else if (type == M_ERROR_TERM) {
+    exit(BEXIT_FAILURE);
+  } else if (type == M_CONFIG_ERROR) {
+    exit(BEXIT_CONFIG_ERROR);
+  }
+}
+
+// Generate a Job message
+void Jmsg(JobControlRecord* jcr, int type, utime_t mtime, const char* fmt, ...)
+{
+  va_list ap;
+  int len, maxlen;
+  PoolMem more(PM_EMSG);
+
+  Dmsg1(850, "Enter Jmsg type=%d\n", type);
+
+  /* Special case for the console, which has a dir_bsock and JobId == 0,
+   * in that case, we send the message directly back to the
+   * dir_bsock. */
+  if (jcr && jcr->JobId == 0 && jcr->dir_bsock) {
+    BareosSocket* dir = jcr->dir_bsock;
+
+    va_start(ap, fmt);
+    dir->message_length
+        = Bvsnprintf(dir->msg, SizeofPoolMemory(dir->msg), fmt, ap);
+    va_end(ap);
+    jcr->dir_bsock->send();
+
+    return;
+  }
+
+  if (!jcr && !IsWatchdog()) { jcr = GetJcrFromThreadSpecificData(); }
+
   while (1) {
     maxlen = more.MaxSize() - 1;
     va_start(ap, fmt);
@@ -1324,18 +1350,22 @@ void Jmsg(JobControlRecord* jcr, int type, utime_t mtime, const char* fmt, ...)
     break;
   }
 
-  PmStrcat(buf, more.c_str());
-  DispatchMessage(jcr, type, mtime, buf.c_str());
+  // The watchdog thread can't use Jmsg directly, we always queued it.
+  if (IsWatchdog()) {
+    Qmsg(jcr, type, mtime, "%s", more.c_str());
+    return;
+  }
 
-  if (type == M_ABORT) {
-    printf("BAREOS aborting to obtain traceback.\n");
-    syslog(LOG_DAEMON | LOG_ERR, "BAREOS aborting to obtain traceback.\n");
-    abort();
-  } else if (type == M_ERROR_TERM) {
-    exit(BEXIT_FAILURE);
-  } else if (type == M_CONFIG_ERROR) {
-    exit(BEXIT_CONFIG_ERROR);
+  /* The same is done while a job wants its messages queued. A fatal error
+   * must stop the job right away though, so the job is updated now and only
+   * the message is sent later. */
+  if (jcr && jcr->queue_msgs && type != M_ABORT && type != M_ERROR_TERM) {
+    CountJobMessage(jcr, type);
+    QueueMessage(jcr, type, more.c_str(), true);
+    return;
   }
+
+  SendJobMessage(jcr, type, mtime, more.c_str(), false);
 }
 
 /*
@@ -1554,7 +1584,6 @@ void Qmsg(JobControlRecord* jcr, int type, utime_t, const char* fmt, ...)
   va_list ap;
   int len, maxlen;
   PoolMem buf(PM_EMSG);
-  MessageQueueItem* item;
 
   while (1) {
     maxlen = buf.MaxSize() - 1;
@@ -1570,11 +1599,22 @@ void Qmsg(JobControlRecord* jcr, int type, utime_t, const char* fmt, ...)
     break;
   }
 
+  QueueMessage(jcr, type, buf.c_str(), false);
+}
+
+static void QueueMessage(JobControlRecord* jcr,
+                         int type,
+                         const char* msg,
+                         bool counted)
+{
+  MessageQueueItem* item;
+
   item = (MessageQueueItem*)malloc(sizeof(MessageQueueItem));
   new (item) MessageQueueItem();
   item->type_ = type;
   item->mtime_ = time(NULL);
-  item->msg_ = strdup(buf.c_str());
+  item->msg_ = strdup(msg);
+  item->counted_ = counted;
 
   if (!jcr) { jcr = GetJcrFromThreadSpecificData(); }
 
@@ -1597,12 +1637,12 @@ void DequeueMessages(JobControlRecord* jcr)
 {
   MessageQueueItem* item;
 
-  if (!jcr->msg_queue) { return; }
+  if (!jcr->msg_queue || jcr->queue_msgs) { return; }
 
   lock_mutex(jcr->msg_queue_mutex);
   jcr->dequeuing_msgs = true;
   foreach_dlist (item, jcr->msg_queue) {
-    Jmsg(jcr, item->type_, item->mtime_, "%s", item->msg_);
+    SendJobMessage(jcr, item->type_, item->mtime_, item->msg_, item->counted_);
     free(item->msg_);
     item->msg_ = nullptr;
   }
@@ -36,6 +36,7 @@ class MessageQueueItem {
   int type_ = 0;
   utime_t mtime_ = {0};
   char* msg_{nullptr};
+  bool counted_ = false; /* JobStatus and JobErrors are already updated */
 };
 
 
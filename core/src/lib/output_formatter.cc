@@ -33,6 +33,7 @@
 #include "include/bareos.h"
 #define NEED_JANSSON_NAMESPACE
 #include "lib/output_formatter.h"
+#include "lib/berrno.h"
 
 const char* json_error_message_template
     = "{ "
@@ -81,6 +82,7 @@ OutputFormatter::~OutputFormatter()
   delete result_stack_json;
   json_object_clear(message_object_json);
   json_decref(message_object_json);
+  if (json_stream_spool) { fclose(json_stream_spool); }
 #endif
 }
 
@@ -177,8 +179,12 @@ void OutputFormatter::ObjectEnd(const char* name, const char* fmt)
   switch (api) {
 #if HAVE_JANSSON
     case API_MODE_JSON:
+      if (result_stack_json->size() > 1 && JsonStreamIsTop()) {
+        JsonStreamClose();
+      }
       result_stack_json->pop();
       Dmsg1(800, "result stack: %d\n", result_stack_json->size());
+      JsonStreamArray();
       break;
 #endif
     default:
@@ -255,8 +261,12 @@ void OutputFormatter::ArrayEnd(const char* name, const char* fmt)
   switch (api) {
 #if HAVE_JANSSON
     case API_MODE_JSON:
+      if (result_stack_json->size() > 1 && JsonStreamIsTop()) {
+        JsonStreamClose();
+      }
       result_stack_json->pop();
       Dmsg1(800, "result stack: %d\n", result_stack_json->size());
+      JsonStreamArray();
       break;
 #endif
     default:
@@ -822,6 +832,17 @@ void OutputFormatter::FinalizeResult([[maybe_unused]] bool result)
 }
 
 #if HAVE_JANSSON
+static void FreeJsonString(char* string)
+{
+#  if JANSSON_VERSION_HEX >= 0x020800
+  json_free_t my_free;
+  json_get_alloc_funcs(nullptr, &my_free);
+  my_free(string);
+#  else
+  free(string);
+#  endif
+}
+
 bool OutputFormatter::JsonArrayItemAdd(json_t* value)
 {
   json_t* json_array_current = NULL;
@@ -835,6 +856,7 @@ bool OutputFormatter::JsonArrayItemAdd(json_t* value)
   }
   if (json_is_array(json_array_current)) {
     json_array_append_new(json_array_current, value);
+    JsonStreamArray();
   } else {
     /* nameless objects only are indented to be added to arrays.
      * We do a workaround here, but this will only keep the last added
@@ -945,16 +967,21 @@ bool OutputFormatter::JsonSendErrorMessage(const char* message)
 
 void OutputFormatter::JsonFinalizeResult(bool result)
 {
-  json_t* msg_obj = json_object();
+  json_t* msg_obj = NULL;
   json_t* error_obj = NULL;
   json_t* data_obj = NULL;
-  json_t* meta_obj = NULL;
-  json_t* range_obj = NULL;
   PoolMem ErrorMsg;
   char* string;
 
+  if (!json_stream_levels.empty()) {
+    JsonStreamFinalize(!result || JsonHasErrorMessage());
+    JsonResetResult();
+    return;
+  }
+
   /* We mimic json-rpc result and error messages,
    * To make it easier to implement real json-rpc later on. */
+  msg_obj = json_object();
   json_object_set_new(msg_obj, "jsonrpc", json_string("2.0"));
   json_object_set_new(msg_obj, "id", json_null());
 
@@ -970,24 +997,7 @@ void OutputFormatter::JsonFinalizeResult(bool result)
   } else {
     json_object_set(msg_obj, "result", result_json);
     if (HasFilters()) {
-      meta_obj = json_object();
-      json_object_set_new(result_json, "meta", meta_obj);
-
-      range_obj = json_object();
-
-      for (of_filter_tuple* tuple : filters) {
-        if (tuple->type == OF_FILTER_LIMIT) {
-          json_object_set_new(range_obj, "limit",
-                              json_integer(tuple->u.limit_filter.limit));
-        }
-        if (tuple->type == OF_FILTER_OFFSET) {
-          json_object_set_new(range_obj, "offset",
-                              json_integer(tuple->u.offset_filter.offset));
-        }
-      }
-      json_object_set_new(range_obj, "filtered",
-                          json_integer(get_num_rows_filtered()));
-      json_object_set_new(meta_obj, "range", range_obj);
+      json_object_set_new(result_json, "meta", JsonMetaObject());
     }
   }
 
@@ -1018,15 +1028,40 @@ void OutputFormatter::JsonFinalizeResult(bool result)
       Dmsg0(100, ErrorMsg.c_str());
       JsonSendErrorMessage(ErrorMsg.c_str());
     }
-#  if JANSSON_VERSION_HEX >= 0x020800
-    json_free_t my_free;
-    json_get_alloc_funcs(nullptr, &my_free);
-    my_free(string);
-#  else
-    free(string);
-#  endif
+    FreeJsonString(string);
   }
 
+  JsonResetResult();
+
+  json_object_clear(msg_obj);
+  json_decref(msg_obj);
+  msg_obj = nullptr;
+}
+
+json_t* OutputFormatter::JsonMetaObject()
+{
+  json_t* meta_obj = json_object();
+  json_t* range_obj = json_object();
+
+  for (of_filter_tuple* tuple : filters) {
+    if (tuple->type == OF_FILTER_LIMIT) {
+      json_object_set_new(range_obj, "limit",
+                          json_integer(tuple->u.limit_filter.limit));
+    }
+    if (tuple->type == OF_FILTER_OFFSET) {
+      json_object_set_new(range_obj, "offset",
+                          json_integer(tuple->u.offset_filter.offset));
+    }
+  }
+  json_object_set_new(range_obj, "filtered",
+                      json_integer(get_num_rows_filtered()));
+  json_object_set_new(meta_obj, "range", range_obj);
+
+  return meta_obj;
+}
+
+void OutputFormatter::JsonResetResult()
+{
   /* cleanup and reinitialize */
   while (result_stack_json->pop()) {}
 
@@ -1040,9 +1075,385 @@ void OutputFormatter::JsonFinalizeResult(bool result)
   json_decref(message_object_json);
   message_object_json = nullptr;
   message_object_json = json_object();
+}
 
-  json_object_clear(msg_obj);
-  json_decref(msg_obj);
-  msg_obj = nullptr;
+/* Large results (e.g. "list files" of a big job, or the bvfs commands) used
+ * to be kept completely in memory until FinalizeResult().
+ * Instead, as soon as an array holds json_stream_threshold entries, the
+ * result up to this array and its entries are written to a temporary file
+ * and freed. From then on, only the containers on the result stack remain
+ * open; they are closed when ObjectEnd() or ArrayEnd() leaves them and
+ * finally by FinalizeResult().
+ * Only then it is known whether the command failed, so only then the
+ * json-rpc envelope is sent, with the spooled result either as "result" or
+ * inside of "error". The output is the same as when the message is dumped
+ * as a whole.
+ * As the members of an object are written in order, this only works when
+ * the array is the last member of all containers on the way. If it is not,
+ * the array is just kept in memory like before. */
+bool OutputFormatter::JsonStreamIsTop()
+{
+  return !json_stream_levels.empty()
+         && json_stream_levels.size()
+                == static_cast<size_t>(result_stack_json->size()) + 1;
+}
+
+void OutputFormatter::JsonStreamArray()
+{
+  json_t* current = (json_t*)result_stack_json->last();
+
+  if (json_stream_threshold == 0 || !json_is_array(current)
+      || json_array_size(current) < json_stream_threshold) {
+    return;
+  }
+  if (!JsonStreamIsTop() && !JsonStreamStart()) { return; }
+
+  JsonStreamMembers(json_stream_levels.size() - 1, nullptr);
+  JsonStreamClear(json_stream_levels.size() - 1);
+}
+
+static const char* JsonKeyOf(json_t* object, json_t* member)
+{
+  const char* key;
+  json_t* value;
+
+  json_object_foreach (object, key, value) {
+    if (value == member) { return key; }
+  }
+  return nullptr;
+}
+
+bool OutputFormatter::JsonStreamStart()
+{
+  size_t top = result_stack_json->size() - 1;
+  size_t first = json_stream_levels.empty() ? 0 : json_stream_levels.size() - 2;
+
+  for (size_t i = first; i < top; i++) {
+    json_t* parent = (json_t*)result_stack_json->get(i);
+    json_t* child = (json_t*)result_stack_json->get(i + 1);
+    json_t* last = nullptr;
+
+    if (json_is_array(parent) && json_array_size(parent) > 0) {
+      last = json_array_get(parent, json_array_size(parent) - 1);
+    } else if (json_is_object(parent)) {
+      const char* key;
+      json_t* value;
+      json_object_foreach (parent, key, value) { last = value; }
+    }
+    if (last != child) {
+      Dmsg0(800, "result can not be streamed, keeping it in memory.\n");
+      return false;
+    }
+  }
+
+  // The envelope is only written by JsonStreamFinalize().
+  if (json_stream_levels.empty()) {
+    json_stream_levels.push_back({nullptr, 0});
+    JsonStreamWrite("{", 1);
+    json_stream_levels.push_back({result_json, 0});
+  }
+
+  for (size_t i = json_stream_levels.size() - 2; i < top; i++) {
+    json_t* parent = (json_t*)result_stack_json->get(i);
+    json_t* child = (json_t*)result_stack_json->get(i + 1);
+    const char* key = nullptr;
+
+    // The child is detached from its parent and owned by its level.
+    json_incref(child);
+    JsonStreamMembers(i + 1, child);
+    if (json_is_object(parent)) { key = JsonKeyOf(parent, child); }
+    JsonStreamMember(i + 1, key, nullptr);
+    JsonStreamClear(i + 1);
+    JsonStreamWrite(json_is_array(child) ? "[" : "{", 1);
+    json_stream_levels.push_back({child, 0});
+  }
+  Dmsg1(800, "streaming result (stack size: %d)\n", result_stack_json->size());
+
+  return true;
+}
+
+// Send the rest of the innermost open container and close it.
+void OutputFormatter::JsonStreamClose()
+{
+  size_t level = json_stream_levels.size() - 1;
+  json_t* container = json_stream_levels[level].container;
+
+  JsonStreamMembers(level, nullptr);
+  if (json_stream_levels[level].written > 0) { JsonStreamIndent(level); }
+  JsonStreamWrite(json_is_array(container) ? "]" : "}", 1);
+  json_stream_levels.pop_back();
+
+  // result_json itself is released by JsonResetResult().
+  if (level > 1) { json_decref(container); }
+}
+
+void OutputFormatter::JsonStreamFinalize(bool failed)
+{
+  json_t* version = json_string("2.0");
+  json_t* code = json_integer(1);
+  json_t* message = json_string("failed");
+  std::string rest;
+
+  while (json_stream_levels.size() > 2) { JsonStreamClose(); }
+
+  if (!failed && HasFilters()) {
+    json_object_set_new(result_json, "meta", JsonMetaObject());
+  }
+  JsonStreamClose();
+  JsonStreamSpool();
+  // Without a temporary file, the whole result is still in the buffer.
+  rest.swap(json_stream_buffer);
+  json_stream_sending = true;
+
+  if (json_stream_spool_failed) {
+    JsonSendErrorMessage("Failed to write json message to temporary file.");
+  } else {
+    JsonStreamWrite("{", 1);
+    JsonStreamMember(0, "jsonrpc", version);
+    JsonStreamMember(0, "id", json_null());
+    if (failed) {
+      // Same as the buffered output: the result is part of the error data.
+      JsonStreamMember(0, "error", nullptr);
+      JsonStreamWrite("{", 1);
+      json_stream_levels.push_back({nullptr, 0});
+      JsonStreamMember(1, "code", code);
+      JsonStreamMember(1, "message", message);
+      JsonStreamMember(1, "data", nullptr);
+      JsonStreamWrite("{", 1);
+      json_stream_levels.push_back({nullptr, 0});
+      JsonStreamMember(2, "result", nullptr);
+      JsonStreamReplay(rest, 2);
+      JsonStreamMember(2, "messages", message_object_json);
+      for (size_t level = 2; level > 0; level--) {
+        JsonStreamIndent(level);
+        JsonStreamWrite("}", 1);
+      }
+    } else {
+      JsonStreamMember(0, "result", nullptr);
+      JsonStreamReplay(rest, 0);
+    }
+    JsonStreamIndent(0);
+    JsonStreamWrite("}", 1);
+    JsonStreamSend();
+  }
+
+  json_decref(version);
+  json_decref(code);
+  json_decref(message);
+  if (json_stream_spool) {
+    fclose(json_stream_spool);
+    json_stream_spool = nullptr;
+  }
+  json_stream_levels.clear();
+  json_stream_spool_failed = false;
+  json_stream_in_memory = false;
+  json_stream_sending = false;
+  json_stream_send_failed = false;
+}
+
+// Send all members of a container, except keep.
+void OutputFormatter::JsonStreamMembers(size_t level, json_t* keep)
+{
+  json_t* container = json_stream_levels[level].container;
+  const char* key;
+  json_t* value;
+  size_t index;
+
+  if (json_is_array(container)) {
+    json_array_foreach (container, index, value) {
+      if (value != keep) { JsonStreamMember(level, nullptr, value); }
+    }
+  } else {
+    json_object_foreach (container, key, value) {
+      if (value != keep) { JsonStreamMember(level, key, value); }
+    }
+  }
+}
+
+// Release the members of a container after they have been sent.
+void OutputFormatter::JsonStreamClear(size_t level)
+{
+  json_t* container = json_stream_levels[level].container;
+  json_t* replacement = NULL;
+  std::vector<json_t*> above;
+
+  if (!json_is_array(container)) {
+    json_object_clear(container);
+    return;
+  }
+
+  /* An array can not be emptied in place with all jansson versions, so it
+   * is replaced by a new one, on the result stack as well. */
+  replacement = json_array();
+  while (static_cast<size_t>(result_stack_json->size()) >= level) {
+    above.push_back((json_t*)result_stack_json->pop());
+  }
+  result_stack_json->push(replacement);
+  above.pop_back();
+  while (!above.empty()) {
+    result_stack_json->push(above.back());
+    above.pop_back();
+  }
+  json_stream_levels[level].container = replacement;
+  json_decref(container);
+}
+
+// Without a value, only the separator and the key are sent.
+void OutputFormatter::JsonStreamMember(size_t level,
+                                       const char* key,
+                                       json_t* value)
+{
+  if (json_stream_levels[level].written++ > 0) { JsonStreamWrite(",", 1); }
+  JsonStreamIndent(level + 1);
+  if (key) {
+    json_t* name = json_string(key);
+    JsonStreamValue(name, level + 1);
+    json_decref(name);
+    if (compact) {
+      JsonStreamWrite(":", 1);
+    } else {
+      JsonStreamWrite(": ", 2);
+    }
+  }
+  if (value) { JsonStreamValue(value, level + 1); }
+}
+
+void OutputFormatter::JsonStreamValue(json_t* value, size_t depth)
+{
+  char* string;
+  const char* start;
+  const char* end;
+
+  if (compact) {
+    string = json_dumps(value, UA_JSON_FLAGS_COMPACT | JSON_ENCODE_ANY);
+  } else {
+    string = json_dumps(value, UA_JSON_FLAGS_NORMAL | JSON_ENCODE_ANY);
+  }
+  if (string == NULL) {
+    Emsg0(M_ERROR, 0, "Failed to generate json string.\n");
+    return;
+  }
+
+  // json_dumps() indents relative to the value, not to the whole message.
+  start = string;
+  while ((end = strchr(start, '\n'))) {
+    JsonStreamWrite(start, end - start);
+    JsonStreamIndent(depth);
+    start = end + 1;
+  }
+  JsonStreamWrite(start, strlen(start));
+
+  FreeJsonString(string);
+}
+
+void OutputFormatter::JsonStreamIndent(size_t depth)
+{
+  if (compact) { return; }
+
+  std::string indent(2 * depth + 1, ' ');
+  indent[0] = '\n';
+  JsonStreamWrite(indent.c_str(), indent.size());
+}
+
+void OutputFormatter::JsonStreamWrite(const char* string, size_t length)
+{
+  json_stream_buffer.append(string, length);
+  if (json_stream_buffer.size() >= json_stream_send_size) {
+    if (json_stream_sending) {
+      JsonStreamSend();
+    } else {
+      JsonStreamSpool();
+    }
+  }
+}
+
+/* Move the buffer to the temporary file. If none can be created, the result
+ * is kept in the buffer, which is still smaller than the json tree. */
+void OutputFormatter::JsonStreamSpool()
+{
+  if (json_stream_buffer.empty() || json_stream_spool_failed
+      || json_stream_in_memory) {
+    return;
+  }
+
+  if (!json_stream_spool) {
+    json_stream_spool = tmpfile();
+    if (!json_stream_spool) {
+      BErrNo be;
+      Dmsg1(100, "Can not create temporary file for json message: %s\n",
+            be.bstrerror());
+      json_stream_in_memory = true;
+      return;
+    }
+  }
+  if (fwrite(json_stream_buffer.data(), 1, json_stream_buffer.size(),
+             json_stream_spool)
+      != json_stream_buffer.size()) {
+    BErrNo be;
+    Emsg1(M_ERROR, 0, "Failed to write json message to temporary file: %s\n",
+          be.bstrerror());
+    json_stream_spool_failed = true;
+  }
+  json_stream_buffer.clear();
+}
+
+/* Send the spooled result followed by rest. depth is the number of levels
+ * the result is nested deeper than when it was written. */
+void OutputFormatter::JsonStreamReplay(const std::string& rest, size_t depth)
+{
+  if (json_stream_spool) {
+    std::vector<char> chunk(json_stream_send_size);
+    size_t length;
+
+    rewind(json_stream_spool);
+    while ((length = fread(chunk.data(), 1, chunk.size(), json_stream_spool))
+           > 0) {
+      JsonStreamReplayChunk(chunk.data(), length, depth);
+    }
+    if (ferror(json_stream_spool)) {
+      BErrNo be;
+      // The beginning of the message is already sent, so just give up.
+      Emsg1(M_ERROR, 0, "Failed to read json message from temporary file: %s\n",
+            be.bstrerror());
+      json_stream_send_failed = true;
+    }
+  }
+  JsonStreamReplayChunk(rest.data(), rest.size(), depth);
+}
+
+void OutputFormatter::JsonStreamReplayChunk(const char* chunk,
+                                            size_t length,
+                                            size_t depth)
+{
+  const char* end = chunk + length;
+  const char* newline;
+
+  if (compact || depth == 0) {
+    JsonStreamWrite(chunk, length);
+    return;
+  }
+
+  std::string indent(2 * depth, ' ');
+  while ((newline
+          = static_cast<const char*>(memchr(chunk, '\n', end - chunk)))) {
+    JsonStreamWrite(chunk, newline - chunk + 1);
+    JsonStreamWrite(indent.c_str(), indent.size());
+    chunk = newline + 1;
+  }
+  JsonStreamWrite(chunk, end - chunk);
+}
+
+void OutputFormatter::JsonStreamSend()
+{
+  if (json_stream_buffer.empty()) { return; }
+
+  if (!json_stream_send_failed
+      && !send_func(send_ctx, "%s", json_stream_buffer.c_str())) {
+    // The beginning of the message is already sent, so just give up.
+    Dmsg1(100, "Failed to send json message (length=%lld).\n",
+          static_cast<long long>(json_stream_buffer.size()));
+    json_stream_send_failed = true;
+  }
+  json_stream_buffer.clear();
 }
 #endif
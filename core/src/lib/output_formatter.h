@@ -2,7 +2,7 @@
    BAREOS® - Backup Archiving REcovery Open Sourced
 
    Copyright (C) 2016-2016 Planets Communications B.V.
-   Copyright (C) 2015-2023 Bareos GmbH & Co. KG
+   Copyright (C) 2015-2024 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -53,6 +53,8 @@ typedef struct json_t json_t;
 #include "lib/alist.h"
 #include "lib/api_mode.h"
 #include <stdint.h>
+#include <string>
+#include <vector>
 
 class PoolMem;
 
@@ -130,6 +132,24 @@ class OutputFormatter {
   json_t* result_json = nullptr;
   alist<json_t*>* result_stack_json = nullptr;
   json_t* message_object_json = nullptr;
+
+  /* Containers of the result that are already partly sent, outermost first.
+   * The first entry stands for the json-rpc envelope, entry n for
+   * result_stack_json->get(n - 1). Except for result_json, each entry holds
+   * a reference to its container, which is no longer part of its parent. */
+  struct JsonStreamLevel {
+    json_t* container;
+    size_t written; /* number of members already sent */
+  };
+  std::vector<JsonStreamLevel> json_stream_levels;
+  std::string json_stream_buffer;
+  FILE* json_stream_spool = nullptr; /* the result written so far */
+  size_t json_stream_threshold = 1000;
+  bool json_stream_spool_failed = false;
+  bool json_stream_in_memory = false; /* no temporary file available */
+  bool json_stream_sending = false; /* set once the outcome is known */
+  bool json_stream_send_failed = false;
+  static const size_t json_stream_send_size = 64 * 1024;
 #endif
 
  private:
@@ -150,6 +170,25 @@ class OutputFormatter {
 
 #if HAVE_JANSSON
   bool JsonSendErrorMessage(const char* message);
+  json_t* JsonMetaObject();
+  void JsonResetResult();
+
+  // Streaming of large results, see JsonStreamArray().
+  bool JsonStreamIsTop();
+  void JsonStreamArray();
+  bool JsonStreamStart();
+  void JsonStreamClose();
+  void JsonStreamFinalize(bool failed);
+  void JsonStreamMembers(size_t level, json_t* keep);
+  void JsonStreamClear(size_t level);
+  void JsonStreamMember(size_t level, const char* key, json_t* value);
+  void JsonStreamValue(json_t* value, size_t depth);
+  void JsonStreamIndent(size_t depth);
+  void JsonStreamWrite(const char* string, size_t length);
+  void JsonStreamSpool();
+  void JsonStreamReplay(const std::string& rest, size_t depth);
+  void JsonStreamReplayChunk(const char* chunk, size_t length, size_t depth);
+  void JsonStreamSend();
 #endif
 
  public:
@@ -170,6 +209,16 @@ class OutputFormatter {
   void SetCompact(bool value) { compact = value; }
   bool GetCompact() { return compact; }
 
+#if HAVE_JANSSON
+  /* In json api mode, an array of the result holding this many entries is
+   * written to a temporary file right away, instead of keeping the whole
+   * result in memory until FinalizeResult(). 0 disables this. */
+  void SetJsonStreamThreshold(size_t entries)
+  {
+    json_stream_threshold = entries;
+  }
+#endif
+
   void Decoration(const char* fmt, ...);
 
   void ArrayStart(const char* name, const char* fmt = NULL);
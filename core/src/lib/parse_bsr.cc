@@ -941,6 +941,7 @@ static inline void RemoveBsr(storagedaemon::BootStrapRecord* bsr)
     free(bsr->fileregex_re);
   }
   if (bsr->attr) { FreeAttr(bsr->attr); }
+  if (bsr->index) { delete bsr->index; }
   if (bsr->next) { bsr->next->prev = bsr->prev; }
   if (bsr->prev) { bsr->prev->next = bsr->next; }
   free(bsr);
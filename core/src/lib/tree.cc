@@ -30,6 +30,13 @@
 #include "lib/util.h"
 #include "lib/fnmatch.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
 #define B_PAGE_SIZE 4096
 #define MAX_PAGES 2400
 #define MAX_BUF_SIZE (MAX_PAGES * B_PAGE_SIZE) /* approx 10MB */
@@ -40,6 +47,7 @@ static TREE_NODE* search_and_insert_tree_node(char* fname,
                                               TREE_ROOT* root,
                                               TREE_NODE* parent);
 template <typename T> static T* tree_alloc(TREE_ROOT* root, int size);
+static int NodeCompare(const TREE_NODE* tn1, const TREE_NODE* tn2);
 
 // NOTE !!!!! we turn off Debug messages for performance reasons.
 #undef Dmsg0
@@ -106,22 +114,230 @@ static TREE_NODE* new_tree_node(TREE_ROOT* root)
   return node;
 }
 
-// This routine can be called to release the previously allocated tree node.
-static void FreeTreeNode(TREE_ROOT* root)
+/*
+ * The children of a node are kept in an array allocated from the tree memory
+ * in power of two sizes.  Arrays of more than TREE_LINEAR_CHILDREN entries
+ * are followed by a hash index with twice as many slots, small directories
+ * are simply searched linearly.  An index slot holds the position of the
+ * child + 1 in its low bits and the high bits of the hash of the name in the
+ * bits not needed for that, so most mismatches are found without looking at
+ * the child itself.  An array that was outgrown is put on a free list for its
+ * size and handed out again for the next directory that needs one that size.
+ */
+#define TREE_LINEAR_CHILDREN 16
+
+static uint64_t HashName(const char* fname, std::size_t len)
 {
-  int asize = BALIGN(sizeof(TREE_NODE));
-  root->mem->rem += asize;
-  root->mem->mem = (char*)root->mem->mem - asize;
+  return std::hash<std::string_view>{}(std::string_view{fname, len});
 }
 
-void TreeRemoveNode(TREE_ROOT* root, TREE_NODE* node)
+static uint32_t* ChildIndex(TREE_NODE* node)
 {
-  int asize = BALIGN(sizeof(TREE_NODE));
-  node->parent->child.remove(node);
-  if (((char*)root->mem->mem - asize) == (char*)node) {
-    FreeTreeNode(root);
-  } else {
-    Dmsg0(0, "Can't release tree node\n");
+  if (node->child_capacity <= TREE_LINEAR_CHILDREN) { return nullptr; }
+  return reinterpret_cast<uint32_t*>(node->children + node->child_capacity);
+}
+
+static void ChildIndexAdd(TREE_NODE* node,
+                          uint32_t* index,
+                          uint32_t nr,
+                          uint64_t hash)
+{
+  uint32_t mask = node->child_capacity * 2 - 1;
+  uint32_t slot = hash & mask;
+
+  while (index[slot]) { slot = (slot + 1) & mask; }
+  index[slot] = (static_cast<uint32_t>(hash >> 32) & ~mask) | (nr + 1);
+}
+
+static void ChildIndexRebuild(TREE_NODE* node)
+{
+  uint32_t* index = ChildIndex(node);
+
+  if (!index) { return; }
+  memset(index, 0, node->child_capacity * 2 * sizeof(uint32_t));
+  for (uint32_t nr = 0; nr < node->child_count; nr++) {
+    TREE_NODE* child = node->children[nr];
+    ChildIndexAdd(node, index, nr, HashName(child->fname, child->fname_len));
+  }
+}
+
+static TREE_NODE* FindChild(TREE_NODE* node,
+                            const char* fname,
+                            int len,
+                            uint64_t hash)
+{
+  TREE_NODE* child;
+  uint32_t* index = ChildIndex(node);
+
+  if (!index) {
+    for (uint32_t nr = 0; nr < node->child_count; nr++) {
+      child = node->children[nr];
+      if (child->fname_len == len && bstrcmp(child->fname, fname)) {
+        return child;
+      }
+    }
+    return NULL;
+  }
+
+  uint32_t mask = node->child_capacity * 2 - 1;
+  uint32_t tag = static_cast<uint32_t>(hash >> 32) & ~mask;
+  for (uint32_t slot = hash & mask; index[slot]; slot = (slot + 1) & mask) {
+    if ((index[slot] & ~mask) != tag) { continue; }
+    child = node->children[(index[slot] & mask) - 1];
+    if (child->fname_len == len && bstrcmp(child->fname, fname)) {
+      return child;
+    }
+  }
+  return NULL;
+}
+
+static int ChildClass(uint32_t capacity)
+{
+  int size_class = 0;
+  while ((uint32_t{1} << size_class) < capacity) { size_class++; }
+  return size_class;
+}
+
+static TREE_NODE** AllocChildren(TREE_ROOT* root, uint32_t capacity)
+{
+  int size_class = ChildClass(capacity);
+  TREE_NODE** children = root->free_children[size_class];
+
+  if (children) {
+    root->free_children[size_class] = reinterpret_cast<TREE_NODE**>(*children);
+    return children;
+  }
+
+  std::size_t size = std::size_t{capacity} * sizeof(TREE_NODE*);
+  if (capacity > TREE_LINEAR_CHILDREN) {
+    size += std::size_t{capacity} * 2 * sizeof(uint32_t);
+  }
+  if (size <= MAX_BUF_SIZE / 8) {
+    return tree_alloc<TREE_NODE*>(root, static_cast<int>(size));
+  }
+
+  /* Large arrays get a buffer of their own which is put behind the one
+   * currently used, so the rest of that one is not lost. */
+  struct s_mem* mem
+      = (struct s_mem*)malloc(offsetof(struct s_mem, first) + size);
+  root->total_size += offsetof(struct s_mem, first) + size;
+  root->blocks++;
+  mem->next = root->mem->next;
+  root->mem->next = mem;
+  mem->mem = mem->first + size;
+  mem->rem = 0;
+  return reinterpret_cast<TREE_NODE**>(mem->first);
+}
+
+static void FreeChildren(TREE_ROOT* root,
+                         TREE_NODE** children,
+                         uint32_t capacity)
+{
+  if (!children) { return; }
+  int size_class = ChildClass(capacity);
+  *children = reinterpret_cast<TREE_NODE*>(root->free_children[size_class]);
+  root->free_children[size_class] = children;
+}
+
+static void TreeAddChild(TREE_ROOT* root,
+                         TREE_NODE* parent,
+                         TREE_NODE* node,
+                         uint64_t hash)
+{
+  if (parent->child_count == parent->child_capacity) {
+    uint32_t capacity
+        = parent->child_capacity ? parent->child_capacity * 2 : 4;
+    TREE_NODE** children = AllocChildren(root, capacity);
+    if (parent->child_count) {
+      memcpy(children, parent->children,
+             parent->child_count * sizeof(TREE_NODE*));
+    }
+    FreeChildren(root, parent->children, parent->child_capacity);
+    parent->children = children;
+    parent->child_capacity = capacity;
+    ChildIndexRebuild(parent);
+  }
+
+  /* Files often arrive in name order per directory, in that case the
+   * children never need to be sorted. */
+  if (parent->sorted && parent->child_count > 0
+      && NodeCompare(parent->children[parent->child_count - 1], node) > 0) {
+    parent->sorted = false;
+  }
+  parent->children[parent->child_count] = node;
+  if (uint32_t* index = ChildIndex(parent)) {
+    ChildIndexAdd(parent, index, parent->child_count, hash);
+  }
+  parent->child_count++;
+}
+
+/*
+ * Sort key holding the first sixteen bytes of the name, ordered the same way
+ * as NodeCompare() orders them, so most comparisons need not look at the node.
+ */
+struct ChildSortKey {
+  uint64_t key[2];
+  TREE_NODE* node;
+  uint64_t hash; /* for the index, so it is rebuilt without the node */
+};
+
+static ChildSortKey MakeSortKey(TREE_NODE* node)
+{
+  ChildSortKey sort_key{{0, 0}, node, 0};
+
+  for (int i = 0; i < 16; i++) {
+    uint8_t byte
+        = i < node->fname_len ? static_cast<uint8_t>(node->fname[i]) : 0;
+    if (i == 0 && std::is_signed_v<char>) { byte ^= 0x80; }
+    sort_key.key[i / 8] = (sort_key.key[i / 8] << 8) | byte;
+  }
+  return sort_key;
+}
+
+void TreeSortChildren(TREE_NODE* node)
+{
+  std::vector<ChildSortKey> keys;
+
+  keys.reserve(node->child_count);
+  for (uint32_t nr = 0; nr < node->child_count; nr++) {
+    keys.push_back(MakeSortKey(node->children[nr]));
+  }
+  uint32_t* index = ChildIndex(node);
+  if (index) {
+    for (ChildSortKey& sort_key : keys) {
+      sort_key.hash
+          = HashName(sort_key.node->fname, sort_key.node->fname_len);
+    }
+  }
+  std::sort(keys.begin(), keys.end(),
+            [](const ChildSortKey& a, const ChildSortKey& b) {
+              if (a.key[0] != b.key[0]) { return a.key[0] < b.key[0]; }
+              if (a.key[1] != b.key[1]) { return a.key[1] < b.key[1]; }
+              return NodeCompare(a.node, b.node) < 0;
+            });
+  if (index) {
+    memset(index, 0, node->child_capacity * 2 * sizeof(uint32_t));
+  }
+  for (uint32_t nr = 0; nr < node->child_count; nr++) {
+    node->children[nr] = keys[nr].node;
+    if (index) { ChildIndexAdd(node, index, nr, keys[nr].hash); }
+  }
+  node->sorted = true;
+}
+
+void TreeRemoveNode(TREE_ROOT*, TREE_NODE* node)
+{
+  TREE_NODE* parent = node->parent;
+
+  // Mostly the node was just inserted, so search from the end.
+  for (uint32_t nr = parent->child_count; nr-- > 0;) {
+    if (parent->children[nr] == node) {
+      memmove(parent->children + nr, parent->children + nr + 1,
+              (parent->child_count - nr - 1) * sizeof(TREE_NODE*));
+      parent->child_count--;
+      ChildIndexRebuild(parent);
+      break;
+    }
   }
 }
 
@@ -289,11 +505,8 @@ TREE_NODE* make_tree_path(char* path, TREE_ROOT* root)
   return node;
 }
 
-static int NodeCompare(void* item1, void* item2)
+static int NodeCompare(const TREE_NODE* tn1, const TREE_NODE* tn2)
 {
-  TREE_NODE* tn1 = (TREE_NODE*)item1;
-  TREE_NODE* tn2 = (TREE_NODE*)item2;
-
   if (tn1->fname[0] > tn2->fname[0]) {
     return 1;
   } else if (tn1->fname[0] < tn2->fname[0]) {
@@ -309,23 +522,24 @@ static TREE_NODE* search_and_insert_tree_node(char* fname,
                                               TREE_ROOT* root,
                                               TREE_NODE* parent)
 {
-  TREE_NODE *node, *found_node;
+  TREE_NODE* node;
+  int len = strlen(fname);
+  uint64_t hash = HashName(fname, len);
 
-  node = new_tree_node(root);
-  node->fname = fname;
-  found_node = (TREE_NODE*)parent->child.insert(node, NodeCompare);
-  if (found_node != node) { /* already in list */
-    FreeTreeNode(root);     /* free node allocated above */
-    found_node->inserted = false;
-    return found_node;
+  node = FindChild(parent, fname, len, hash);
+  if (node) { /* already in list */
+    node->inserted = false;
+    return node;
   }
 
-  // It was not found, but is now inserted
-  node->fname_len = strlen(fname);
+  // It was not found, so insert it now
+  node = new_tree_node(root);
+  node->fname_len = len;
   node->fname = tree_alloc<char>(root, node->fname_len + 1);
-  strcpy(node->fname, fname);
+  memcpy(node->fname, fname, len + 1);
   node->parent = parent;
   node->type = type;
+  TreeAddChild(root, parent, node, hash);
 
   // Maintain a linear chain of nodes
   if (!root->first) {
@@ -29,7 +29,6 @@
 #define BAREOS_LIB_TREE_H_
 
 #include "lib/htable.h"
-#include "lib/rblist.h"
 
 #include "include/config.h"
 
@@ -40,16 +39,18 @@ struct s_mem {
   char first[1];      /* first byte */
 };
 
-#define USE_DLIST
+#define TREE_CHILD_CLASSES 32 /* power of two size classes of child arrays */
 
-#define foreach_child(var, list) \
-  for ((var) = NULL;             \
-       (*((TREE_NODE**)&(var)) = (TREE_NODE*)(list->child.next(var)));)
+/* Iterate over the children of a node in name order, var is NULL afterwards */
+#define foreach_child(var, list)                                      \
+  for (uint32_t _child_nr = ((var) = NULL, 0);                        \
+       (*((TREE_NODE**)&(var)) = TreeChildAt((TREE_NODE*)(list),      \
+                                             _child_nr)) != NULL;     \
+       _child_nr++)
 
-#define TreeNodeHasChild(node) ((node)->child.size() > 0)
+#define TreeNodeHasChild(node) ((node)->child_count > 0)
 
-#define first_child(node) \
-        ((TREE_NODE *)(node->child.first())
+#define first_child(node) TreeChildAt((TREE_NODE*)(node), 0)
 
 struct delta_list {
   struct delta_list* next;
@@ -70,24 +71,28 @@ struct s_tree_node {
       , soft_link{false}
       , inserted{false}
       , loaded{false}
+      , sorted{true}
   {
   }
-  /* KEEP sibling as the first member to avoid having to
-   *  do initialization of child */
-  rblink sibling;
-  rblist child;
-  char* fname{};                /* file name */
-  int32_t FileIndex{};          /* file index */
-  uint32_t JobId{};             /* JobId */
-  int32_t delta_seq{};          /* current delta sequence */
-  uint16_t fname_len{};         /* filename length */
-  unsigned int type : 8;        /* node type */
-  unsigned int extract : 1;     /* extract item */
-  unsigned int extract_dir : 1; /* extract dir entry only */
-  unsigned int hard_link : 1;   /* set if have hard link */
-  unsigned int soft_link : 1;   /* set if is soft link */
-  unsigned int inserted : 1;    /* set when node newly inserted */
-  unsigned int loaded : 1;      /* set when the dir is in the tree */
+  /* The children are kept in an array allocated from the tree memory, they
+   * are appended while the tree is built and sorted by name when they are
+   * first iterated over. */
+  struct s_tree_node** children{}; /* child array */
+  char* fname{};                   /* file name */
+  int32_t FileIndex{};             /* file index */
+  uint32_t JobId{};                /* JobId */
+  int32_t delta_seq{};             /* current delta sequence */
+  uint32_t child_count{};          /* children in use */
+  uint32_t child_capacity{};       /* size of child array */
+  uint16_t fname_len{};            /* filename length */
+  unsigned int type : 8;           /* node type */
+  unsigned int extract : 1;        /* extract item */
+  unsigned int extract_dir : 1;    /* extract dir entry only */
+  unsigned int hard_link : 1;      /* set if have hard link */
+  unsigned int soft_link : 1;      /* set if is soft link */
+  unsigned int inserted : 1;       /* set when node newly inserted */
+  unsigned int loaded : 1;         /* set when the dir is in the tree */
+  unsigned int sorted : 1;          /* set when children are in name order */
   struct s_tree_node* parent{};
   struct s_tree_node* next{};      /* next hash of FileIndex */
   struct delta_list* delta_list{}; /* delta parts for this node */
@@ -111,26 +116,29 @@ struct s_tree_root {
       : type{false}
       , extract{false}
       , extract_dir{false}
-      , have_link{false}
+      , hard_link{false}
+      , soft_link{false}
       , inserted{false}
       , loaded{false}
+      , sorted{true}
   {
   }
-  /* KEEP sibling as the first member to avoid having to
-   *  do initialization of child */
-  rblink sibling{};
-  rblist child;
-  const char* fname{};          /* file name */
-  int32_t FileIndex{};          /* file index */
-  uint32_t JobId{};             /* JobId */
-  int32_t delta_seq{};          /* current delta sequence */
-  uint16_t fname_len{};         /* filename length */
-  unsigned int type : 8;        /* node type */
-  unsigned int extract : 1;     /* extract item */
-  unsigned int extract_dir : 1; /* extract dir entry only */
-  unsigned int have_link : 1;   /* set if have hard link */
-  unsigned int inserted : 1;    /* set when newly inserted */
-  unsigned int loaded : 1;      /* set when the dir is in the tree */
+  struct s_tree_node** children{}; /* child array */
+  const char* fname{};             /* file name */
+  int32_t FileIndex{};             /* file index */
+  uint32_t JobId{};                /* JobId */
+  int32_t delta_seq{};             /* current delta sequence */
+  uint32_t child_count{};          /* children in use */
+  uint32_t child_capacity{};       /* size of child array */
+  uint16_t fname_len{};            /* filename length */
+  unsigned int type : 8;           /* node type */
+  unsigned int extract : 1;        /* extract item */
+  unsigned int extract_dir : 1;    /* extract dir entry only */
+  unsigned int hard_link : 1;      /* set if have hard link */
+  unsigned int soft_link : 1;      /* set if is soft link */
+  unsigned int inserted : 1;       /* set when newly inserted */
+  unsigned int loaded : 1;         /* set when the dir is in the tree */
+  unsigned int sorted : 1;          /* set when children are in name order */
   struct s_tree_node* parent{};
   struct s_tree_node* next{};      /* next hash of FileIndex */
   struct delta_list* delta_list{}; /* delta parts for this node */
@@ -139,8 +147,10 @@ struct s_tree_root {
   struct s_tree_node* first{}; /* first entry in the tree */
   struct s_tree_node* last{};  /* last entry in tree */
   struct s_mem* mem{};         /* tree memory */
-  uint32_t total_size{};       /* total bytes allocated */
+  uint64_t total_size{};       /* total bytes allocated */
   uint32_t blocks{};           /* total mallocs */
+  /* released child arrays by size class, linked through their first slot */
+  struct s_tree_node** free_children[TREE_CHILD_CLASSES]{};
   int cached_path_len{};       /* length of cached path */
   char* cached_path{};         /* cached current path */
   TREE_NODE* cached_parent{};  /* cached parent for above path */
@@ -172,6 +182,15 @@ void TreeAddDeltaPart(TREE_ROOT* root,
 void FreeTree(TREE_ROOT* root);
 POOLMEM* tree_getpath(TREE_NODE* node);
 void TreeRemoveNode(TREE_ROOT* root, TREE_NODE* node);
+void TreeSortChildren(TREE_NODE* node);
+
+// Get the n-th child of a node in name order, NULL when there is none.
+inline TREE_NODE* TreeChildAt(TREE_NODE* node, uint32_t nr)
+{
+  if (nr >= node->child_count) { return NULL; }
+  if (!node->sorted) { TreeSortChildren(node); }
+  return node->children[nr];
+}
 
 /**
  * Use the following for traversing the whole tree. It will be
@@ -63,6 +63,7 @@ using namespace storagedaemon;
 #define COMPRESSOR_NAME_FZLZ (char*)"FASTLZ"
 #define COMPRESSOR_NAME_FZ4L (char*)"LZ4"
 #define COMPRESSOR_NAME_FZ4H (char*)"LZ4HC"
+#define COMPRESSOR_NAME_ZSTD (char*)"ZSTD"
 #define COMPRESSOR_NAME_UNSET (char*)"unknown"
 
 // Forward referenced functions
@@ -514,6 +515,15 @@ static bool SetupAutoDeflation(PluginContext* ctx, DeviceControlRecord* dcr)
       }
       break;
     }
+#if defined(HAVE_ZSTD)
+    case COMPRESS_ZSTD:
+      compressorname = COMPRESSOR_NAME_ZSTD;
+      if (!SetCompressionLevel(jcr, dcr->device_resource->autodeflate_algorithm,
+                               dcr->device_resource->autodeflate_level)) {
+        goto bail_out;
+      }
+      break;
+#endif
     default:
       break;
   }
@@ -185,6 +185,44 @@ class MessageHandler {
   // The thread created will try to access this class immediately after
   // being created!  As such everything else has to be initialized.
   std::thread receive_thread;
+  bool put(result_type&& result)
+  {
+    if (!input.emplace(std::move(result))) {
+      if (input.closed()) {
+        Dmsg1(20, "Tried to put message into closed queue.\n");
+      } else {
+        Dmsg1(20,
+              "Tried to put message into queue; but it did not succeed.\n");
+      }
+      return false;
+    }
+    return true;
+  }
+
+  // Queues the messages a frame of the File daemon is made of.
+  bool put_frame(const char* frame, int32_t length)
+  {
+    bool queued = true;
+    bool ok = UnpackFrame(
+        frame, length, [this, &queued](const char* data, int32_t size) {
+          if (!data) {
+            queued = put(signal_type{size});
+          } else {
+            PoolMem msg(PM_MESSAGE);
+            msg.check_size(size + 1);
+            memcpy(msg.c_str(), data, size);
+            msg.c_str()[size] = '\0';
+            queued = put(message_type{static_cast<std::size_t>(size),
+                                      std::move(msg)});
+          }
+          return queued;
+        });
+    if (!ok && queued) {
+      put(error_type{error_type::type::INTERNAL_ERROR, "malformed frame"});
+    }
+    return ok;
+  }
+
   void do_work()
   {
     POOLMEM* save = fd->msg;
@@ -195,6 +233,9 @@ class MessageHandler {
         fd->msg = msg.addr();
         result_type result;
         int n = BgetMsg(fd);
+        bool frame = n == BNET_SIGNAL && fd->message_length == BNET_FRAME;
+        // The packets of a frame follow as one message
+        if (frame) { n = BgetMsg(fd); }
         // fd->msg might have been relocated
         msg.addr() = fd->msg;
         if (n < 0) {
@@ -209,19 +250,15 @@ class MessageHandler {
                 = error_type{error_type::type::INTERNAL_ERROR, fd->bstrerror()};
             cont = false;
           }
-        } else {
+        } else if (!frame) {
           std::size_t length = n;
           result = message_type{length, std::move(msg)};
         }
         fd->msg = nullptr;
 
-        if (!input.emplace(std::move(result))) {
-          if (input.closed()) {
-            Dmsg1(20, "Tried to put message into closed queue.\n");
-          } else {
-            Dmsg1(20,
-                  "Tried to put message into queue; but it did not succeed.\n");
-          }
+        if (frame && n >= 0) {
+          if (!put_frame(msg.c_str(), n)) { cont = false; }
+        } else if (!put(std::move(result))) {
           cont = false;
         }
       } else if (res == fd->Error) {
@@ -633,6 +670,8 @@ bool SendAttrsToDir(JobControlRecord* jcr, DeviceRecord* rec)
 {
   if (!jcr->sd_impl->no_attributes) {
     BareosSocket* dir = jcr->dir_bsock;
+    // Data may be despooled in the background, see spool.cc
+    std::lock_guard lock(jcr->sd_impl->dir_mutex);
     if (AttributesAreSpooled(jcr)) { dir->SetSpooling(); }
     Dmsg0(850, "Send attributes to dir.\n");
     if (!jcr->sd_impl->dcr->DirUpdateFileAttributes(rec)) {
@@ -32,6 +32,7 @@
 
 #include "stored/stored.h"
 #include "stored/stored_globals.h"
+#include "stored/stored_jcr_impl.h"
 
 #include "include/jcr.h"
 #include "lib/crypto_cache.h"
@@ -176,6 +177,7 @@ bool StorageDaemonDeviceControlRecord::DirGetVolumeInfo(
 {
   bool ok;
   BareosSocket* dir = jcr->dir_bsock;
+  std::lock_guard lock(jcr->sd_impl->dir_mutex);
 
   lock_mutex(vol_info_mutex);
   setVolCatName(VolumeName);
@@ -205,6 +207,7 @@ bool StorageDaemonDeviceControlRecord::DirFindNextAppendableVolume()
 {
   bool retval = false;
   BareosSocket* dir = jcr->dir_bsock;
+  std::lock_guard lock(jcr->sd_impl->dir_mutex);
   PoolMem unwanted_volumes(PM_MESSAGE);
 
   Dmsg2(debuglevel, "DirFindNextAppendableVolume: reserved=%d Vol=%s\n",
@@ -279,6 +282,7 @@ bool StorageDaemonDeviceControlRecord::DirUpdateVolumeInfo(
     is_labeloperation label)
 {
   BareosSocket* dir = jcr->dir_bsock;
+  std::lock_guard lock(jcr->sd_impl->dir_mutex);
   VolumeCatalogInfo* vol = &dev->VolCatInfo;
   char ed1[50], ed2[50], ed3[50], ed4[50], ed5[50], ed6[50];
   int InChanger;
@@ -341,6 +345,7 @@ bail_out:
 bool StorageDaemonDeviceControlRecord::DirCreateJobmediaRecord(bool zero)
 {
   BareosSocket* dir = jcr->dir_bsock;
+  std::lock_guard lock(jcr->sd_impl->dir_mutex);
   char ed1[50];
 
   // If system job, do not update catalog
@@ -355,6 +360,11 @@ bool StorageDaemonDeviceControlRecord::DirCreateJobmediaRecord(bool zero)
   if (!WroteVol) { return true; /* nothing written to tape */ }
 
   WroteVol = false;
+  if (!zero && !dev->WaitForQueuedWrites()) {
+    Jmsg(jcr, M_FATAL, 0, T_("Error creating JobMedia record: %s\n"),
+         dev->errmsg);
+    return false;
+  }
   if (zero) {
     // Send dummy place holder to avoid purging
     dir->fsend(Create_job_media, jcr->Job, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -405,6 +415,7 @@ bool StorageDaemonDeviceControlRecord::DirUpdateFileAttributes(
     DeviceRecord* record)
 {
   BareosSocket* dir = jcr->dir_bsock;
+  std::lock_guard lock(jcr->sd_impl->dir_mutex);
   ser_declare;
 
 #ifdef NO_ATTRIBUTES_TEST
@@ -626,12 +637,14 @@ get_out:
 bool StorageDaemonDeviceControlRecord::DirAskToUpdateFileList()
 {
   BareosSocket* dir = jcr->dir_bsock;
+  std::lock_guard lock(jcr->sd_impl->dir_mutex);
   return dir->fsend(Update_filelist, jcr->Job);
 }
 
 bool StorageDaemonDeviceControlRecord::DirAskToUpdateJobRecord()
 {
   BareosSocket* dir = jcr->dir_bsock;
+  std::lock_guard lock(jcr->sd_impl->dir_mutex);
   return dir->fsend(Update_jobrecord, jcr->Job, jcr->JobFiles, jcr->JobBytes);
 }
 
@@ -651,6 +664,7 @@ bool DeleteNullJobmediaRecords(JobControlRecord* jcr)
 {
   Dmsg0(100, "Deleting null jobmedia records\n");
   BareosSocket* dir = jcr->dir_bsock;
+  std::lock_guard lock(jcr->sd_impl->dir_mutex);
   const char* delete_null_records
       = "CatReq Job=%s DeleteNullJobmediaRecords jobid=%u";
   dir->fsend(delete_null_records, jcr->Job, jcr->JobId);
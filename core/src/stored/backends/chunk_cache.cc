@@ -0,0 +1,386 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation, which is
+   listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Local on-disk cache of the chunks of chunked volumes.
+ *
+ * The cache index only lives in memory, on startup it is rebuilt from the
+ * files in the store directories ordered by their modification time.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "include/bareos.h"
+#include "stored/backends/chunk_cache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <vector>
+
+namespace storagedaemon {
+
+static const int debuglevel = 100;
+static const char kTmpSuffix[] = ".tmp";
+
+std::shared_ptr<ChunkCache> ChunkCache::ForDirectory(
+    const std::string& directory,
+    uint64_t max_bytes)
+{
+  static std::mutex caches_mutex;
+  static std::map<std::string, std::weak_ptr<ChunkCache>> caches;
+
+  std::lock_guard lock(caches_mutex);
+  if (auto cache = caches[directory].lock()) { return cache; }
+
+  if (mkdir(directory.c_str(), 0750) != 0 && errno != EEXIST) {
+    return nullptr;
+  }
+
+  std::shared_ptr<ChunkCache> cache(new ChunkCache(directory, max_bytes));
+  if (!cache->Scan()) { return nullptr; }
+  caches[directory] = cache;
+
+  return cache;
+}
+
+std::string ChunkCache::StoreName(const std::string& backing_store)
+{
+  // FNV-1a, the name has to be the same for every run
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (unsigned char c : backing_store) {
+    hash ^= c;
+    hash *= 0x100000001b3ULL;
+  }
+
+  char name[17];
+  snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+  return name;
+}
+
+std::string ChunkCache::PathOf(const Key& key) const
+{
+  char chunk[16];
+  snprintf(chunk, sizeof(chunk), "@%04u", std::get<2>(key));
+  return directory_ + "/" + std::get<0>(key) + "/" + std::get<1>(key) + chunk;
+}
+
+namespace {
+struct CachedFile {
+  std::string store;
+  std::string volname;
+  uint32_t chunk;
+  uint64_t size;
+  time_t mtime;
+};
+
+bool IsStoreName(const std::string& name)
+{
+  return name.size() == 16
+         && name.find_first_not_of("0123456789abcdef") == std::string::npos;
+}
+
+bool IsTmpFile(const std::string& name)
+{
+  return name.size() > sizeof(kTmpSuffix) - 1
+         && name.compare(name.size() - (sizeof(kTmpSuffix) - 1),
+                         std::string::npos, kTmpSuffix)
+                == 0;
+}
+
+// Splits <volume>@<chunk>
+bool ParseChunkName(const std::string& name,
+                    std::string& volname,
+                    uint32_t& chunk)
+{
+  auto at = name.rfind('@');
+  if (at == std::string::npos || at == 0 || at + 1 == name.size()
+      || name.find_first_not_of("0123456789", at + 1) != std::string::npos) {
+    return false;
+  }
+  volname = name.substr(0, at);
+  chunk = (uint32_t)strtoul(name.c_str() + at + 1, nullptr, 10);
+  return true;
+}
+
+void ScanStore(const std::string& dir,
+               const std::string& store,
+               std::vector<CachedFile>& found)
+{
+  DIR* dp = opendir(dir.c_str());
+  if (!dp) { return; }
+
+  while (struct dirent* de = readdir(dp)) {
+    std::string name = de->d_name;
+    std::string path = dir + "/" + name;
+    CachedFile file{store, {}, 0, 0, 0};
+    struct stat st;
+
+    if (lstat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) { continue; }
+
+    // Left behind by a Put() that did not finish.
+    if (IsTmpFile(name)) {
+      unlink(path.c_str());
+      continue;
+    }
+    if (!ParseChunkName(name, file.volname, file.chunk)) { continue; }
+
+    file.size = st.st_size;
+    file.mtime = st.st_mtime;
+    found.push_back(std::move(file));
+  }
+  closedir(dp);
+}
+}  // namespace
+
+// Pick up the chunks cached by an earlier run.
+bool ChunkCache::Scan()
+{
+  DIR* dp = opendir(directory_.c_str());
+  if (!dp) { return false; }
+
+  std::vector<CachedFile> found;
+
+  while (struct dirent* de = readdir(dp)) {
+    std::string name = de->d_name;
+    std::string path = directory_ + "/" + name;
+    std::string volname;
+    uint32_t chunk;
+    struct stat st;
+
+    if (lstat(path.c_str(), &st) != 0) { continue; }
+
+    if (S_ISDIR(st.st_mode) && IsStoreName(name)) {
+      ScanStore(path, name, found);
+    } else if (S_ISREG(st.st_mode)
+               && (IsTmpFile(name) || ParseChunkName(name, volname, chunk))) {
+      // Nothing tells which backing store such a chunk came from.
+      Dmsg1(debuglevel, "Removing stale %s from the chunk cache\n",
+            path.c_str());
+      unlink(path.c_str());
+    }
+  }
+  closedir(dp);
+
+  std::sort(found.begin(), found.end(),
+            [](const CachedFile& a, const CachedFile& b) {
+              return a.mtime > b.mtime;
+            });
+
+  std::lock_guard lock(mutex_);
+  for (auto& f : found) {
+    Key key{f.store, f.volname, f.chunk};
+    auto [it, inserted] = entries_.emplace(key, Entry{});
+    if (!inserted) { continue; }
+    it->second.size = f.size;
+    it->second.mtime = f.mtime;
+    it->second.lru = lru_.insert(lru_.end(), key);
+    bytes_ += f.size;
+  }
+  MakeRoom(0);
+
+  Dmsg3(debuglevel, "Chunk cache %s holds %llu chunks of %llu bytes\n",
+        directory_.c_str(), (unsigned long long)entries_.size(),
+        (unsigned long long)bytes_);
+
+  return true;
+}
+
+void ChunkCache::Drop(std::map<Key, Entry>::iterator it)
+{
+  bytes_ -= it->second.size;
+  lru_.erase(it->second.lru);
+  entries_.erase(it);
+}
+
+void ChunkCache::MakeRoom(uint64_t size)
+{
+  while (!lru_.empty() && bytes_ + size > max_bytes_) {
+    auto it = entries_.find(lru_.back());
+    std::string path = PathOf(it->first);
+
+    Dmsg1(debuglevel, "Removing %s from the chunk cache\n", path.c_str());
+    unlink(path.c_str());
+    Drop(it);
+  }
+}
+
+bool ChunkCache::Put(const std::string& store,
+                     const char* volname,
+                     uint32_t chunk,
+                     const char* data,
+                     uint32_t len)
+{
+  if (len > max_bytes_) { return false; }
+
+  Key key{store, volname, chunk};
+  std::string path = PathOf(key);
+  std::string tmp_path;
+  {
+    std::lock_guard lock(mutex_);
+    tmp_path = path + "." + std::to_string(tmp_counter_++) + kTmpSuffix;
+  }
+
+  // Write a new file and rename it, a concurrent Get() sees either version.
+  int flags = O_CREAT | O_TRUNC | O_WRONLY | O_BINARY;
+  int fd = open(tmp_path.c_str(), flags, 0640);
+  if (fd < 0 && errno == ENOENT) {
+    std::string store_dir = directory_ + "/" + store;
+    if (mkdir(store_dir.c_str(), 0750) == 0 || errno == EEXIST) {
+      fd = open(tmp_path.c_str(), flags, 0640);
+    }
+  }
+  if (fd < 0) { return false; }
+
+  uint32_t written = 0;
+  while (written < len) {
+    ssize_t status = write(fd, data + written, len - written);
+    if (status < 0 && errno == EINTR) { continue; }
+    if (status <= 0) { break; }
+    written += status;
+  }
+  // the rename keeps the modification time
+  struct stat st;
+  bool ok = written == len && fstat(fd, &st) == 0;
+  if (close(fd) != 0 || !ok) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+
+  std::lock_guard lock(mutex_);
+  auto it = entries_.find(key);
+  if (it != entries_.end()) { Drop(it); }
+  MakeRoom(len);
+
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    unlink(tmp_path.c_str());
+    unlink(path.c_str());
+    return false;
+  }
+
+  it = entries_.emplace(key, Entry{}).first;
+  it->second.size = len;
+  it->second.mtime = st.st_mtime;
+  it->second.lru = lru_.insert(lru_.begin(), key);
+  bytes_ += len;
+
+  return true;
+}
+
+bool ChunkCache::Get(const std::string& store,
+                     const char* volname,
+                     uint32_t chunk,
+                     char* buffer,
+                     uint32_t buf_size,
+                     uint32_t* len)
+{
+  Key key{store, volname, chunk};
+  uint64_t size;
+  time_t mtime;
+  {
+    std::lock_guard lock(mutex_);
+    auto it = entries_.find(key);
+    if (it == entries_.end() || it->second.size > buf_size) {
+      misses_++;
+      return false;
+    }
+    size = it->second.size;
+    mtime = it->second.mtime;
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+  }
+
+  // An unlink() by a concurrent eviction does not affect an open file.
+  std::string path = PathOf(key);
+  int fd = open(path.c_str(), O_RDONLY | O_BINARY);
+  uint64_t done = 0;
+  bool stale = false;
+  if (fd >= 0) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size != size
+        || st.st_mtime != mtime) {
+      stale = true;
+      size = 0;
+    }
+    while (done < size) {
+      ssize_t status = read(fd, buffer + done, size - done);
+      if (status < 0 && errno == EINTR) { continue; }
+      if (status <= 0) { break; }
+      done += status;
+    }
+    close(fd);
+  }
+
+  std::lock_guard lock(mutex_);
+  if (stale) {
+    // Unless a concurrent Put() already replaced the entry.
+    auto it = entries_.find(key);
+    if (it != entries_.end() && it->second.mtime == mtime) {
+      Dmsg1(debuglevel, "Dropping changed %s from the chunk cache\n",
+            path.c_str());
+      unlink(path.c_str());
+      Drop(it);
+    }
+    misses_++;
+    return false;
+  }
+  if (fd < 0 || done < size) {
+    Dmsg1(debuglevel, "Unable to read %s from the chunk cache\n", path.c_str());
+    misses_++;
+    return false;
+  }
+  hits_++;
+  *len = size;
+
+  return true;
+}
+
+void ChunkCache::Remove(const std::string& store, const char* volname)
+{
+  std::lock_guard lock(mutex_);
+  auto it = entries_.lower_bound(Key{store, volname, 0});
+  while (it != entries_.end() && std::get<0>(it->first) == store
+         && std::get<1>(it->first) == volname) {
+    unlink(PathOf(it->first).c_str());
+    Drop(it++);
+  }
+}
+
+uint64_t ChunkCache::Bytes()
+{
+  std::lock_guard lock(mutex_);
+  return bytes_;
+}
+
+uint64_t ChunkCache::Hits()
+{
+  std::lock_guard lock(mutex_);
+  return hits_;
+}
+
+uint64_t ChunkCache::Misses()
+{
+  std::lock_guard lock(mutex_);
+  return misses_;
+}
+
+} /* namespace storagedaemon */
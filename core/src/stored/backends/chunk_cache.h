@@ -0,0 +1,124 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation, which is
+   listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Local on-disk cache of the chunks of chunked volumes.
+ */
+
+#ifndef BAREOS_STORED_BACKENDS_CHUNK_CACHE_H_
+#define BAREOS_STORED_BACKENDS_CHUNK_CACHE_H_
+
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+namespace storagedaemon {
+
+/**
+ * Keeps copies of chunks in a local directory, one file per chunk named
+ * like the inflight files (<store>/<volume>@<chunk>).  The store is the
+ * StoreName() of the backing store, so devices sharing the directory but
+ * not the backing store never see each other's chunks.  When the cache
+ * grows beyond its size the least recently used chunks are removed.
+ *
+ * Chunks are added after they were flushed to or read from the backing
+ * store, so the cache never holds data the backing store does not have.
+ * A cached file whose size or modification time changed behind the back
+ * of the cache, e.g. by another process using the same directory, is
+ * dropped instead of being returned.
+ * All methods may be called from the io-threads.
+ */
+class ChunkCache {
+ public:
+  /* Returns the cache using directory, all devices configured with the same
+   * directory share one cache.  Returns nullptr and sets errno if the
+   * directory cannot be used. */
+  static std::shared_ptr<ChunkCache> ForDirectory(const std::string& directory,
+                                                  uint64_t max_bytes);
+
+  // The name of the subdirectory holding the chunks of a backing store
+  static std::string StoreName(const std::string& backing_store);
+
+  ChunkCache(const ChunkCache&) = delete;
+  ChunkCache& operator=(const ChunkCache&) = delete;
+
+  // Stores a copy of a chunk, replacing an older copy of it.
+  bool Put(const std::string& store,
+           const char* volname,
+           uint32_t chunk,
+           const char* data,
+           uint32_t len);
+
+  /* Copies a cached chunk into buffer and sets len.  Returns false if the
+   * chunk is not cached or does not fit into buf_size bytes. */
+  bool Get(const std::string& store,
+           const char* volname,
+           uint32_t chunk,
+           char* buffer,
+           uint32_t buf_size,
+           uint32_t* len);
+
+  // Drops all chunks of a volume, e.g. when it is truncated.
+  void Remove(const std::string& store, const char* volname);
+
+  uint64_t Bytes();
+  uint64_t MaxBytes() const { return max_bytes_; }
+  uint64_t Hits();
+  uint64_t Misses();
+
+ private:
+  using Key = std::tuple<std::string, std::string, uint32_t>;
+  struct Entry {
+    uint64_t size{0};
+    time_t mtime{0};
+    std::list<Key>::iterator lru;
+  };
+
+  ChunkCache(std::string directory, uint64_t max_bytes)
+      : directory_{std::move(directory)}, max_bytes_{max_bytes}
+  {
+  }
+  bool Scan();
+  std::string PathOf(const Key& key) const;
+  // Removes entries until there is room for size more bytes, needs mutex_
+  void MakeRoom(uint64_t size);
+  void Drop(std::map<Key, Entry>::iterator it);
+
+  const std::string directory_;
+  const uint64_t max_bytes_;
+
+  std::mutex mutex_;
+  std::map<Key, Entry> entries_;
+  std::list<Key> lru_;  // most recently used first
+  uint64_t bytes_{0};
+  uint64_t hits_{0};
+  uint64_t misses_{0};
+  uint64_t tmp_counter_{0};
+};
+
+} /* namespace storagedaemon */
+
+#endif  // BAREOS_STORED_BACKENDS_CHUNK_CACHE_H_
@@ -31,14 +31,18 @@
 
 #include "include/fcntl_def.h"
 #include "include/bareos.h"
+#include "lib/berrno.h"
 #include "lib/edit.h"
 #include "stored/device_status_information.h"
 
 #include "stored/stored.h"
 #include "chunked_device.h"
+#include "chunk_cache.h"
 
 #include "stored/stored_globals.h"
 
+#include <algorithm>
+
 namespace storagedaemon {
 
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -71,6 +75,11 @@ static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
  * ChunkedVolumeSize() - Get the current size of a volume.
  * LoadChunk() - Make sure we have the right chunk in memory.
  *
+ * When io-threads are used, a reader gets the next readahead_chunks_
+ * chunks read ahead by the io-threads. With a chunk cache directory
+ * configured, all chunks flushed to or read from the backing store are
+ * also kept in a local LRU cache which is tried before the backing store.
+ *
  * It also demands that the inheriting class implements the
  * following methods:
  *
@@ -209,11 +218,11 @@ bool ChunkedDevice::SetInflightChunk(chunk_io_request* request)
 {
   PoolMem inflight_file(PM_FNAME);
 
-  Mmsg(inflight_file, "%s/%s@%04d", me->working_directory, request->volname,
+  Mmsg(inflight_file, "%s/%s@%04u", me->working_directory, request->volname,
        request->chunk);
   PmStrcat(inflight_file, "%inflight");
 
-  Dmsg3(100, "Creating inflight file %s for volume %s, chunk %d\n",
+  Dmsg3(100, "Creating inflight file %s for volume %s, chunk %u\n",
         inflight_file.c_str(), request->volname, request->chunk);
 
   int inflight_fd
@@ -237,11 +246,11 @@ void ChunkedDevice::ClearInflightChunk(chunk_io_request* request)
   PoolMem inflight_file(PM_FNAME);
 
   if (request) {
-    Mmsg(inflight_file, "%s/%s@%04d", me->working_directory, request->volname,
+    Mmsg(inflight_file, "%s/%s@%04u", me->working_directory, request->volname,
          request->chunk);
     PmStrcat(inflight_file, "%inflight");
 
-    Dmsg3(100, "Removing inflight file %s for volume %s, chunk %d\n",
+    Dmsg3(100, "Removing inflight file %s for volume %s, chunk %u\n",
           inflight_file.c_str(), request->volname, request->chunk);
 
     if (stat(inflight_file.c_str(), &st) != 0) { return; }
@@ -260,7 +269,7 @@ bool ChunkedDevice::IsInflightChunk(chunk_io_request* request)
   struct stat st;
   PoolMem inflight_file(PM_FNAME);
 
-  Mmsg(inflight_file, "%s/%s@%04d", me->working_directory, request->volname,
+  Mmsg(inflight_file, "%s/%s@%04u", me->working_directory, request->volname,
        request->chunk);
   PmStrcat(inflight_file, "%inflight");
 
@@ -289,8 +298,11 @@ static int CompareChunkIoRequest(ocbuf_item* ocbuf1, ocbuf_item* ocbuf2)
 
   // Same volume name ?
   if (bstrcmp(chunk1->volname, chunk2->volname)) {
-    // Compare on chunk number.
+    // Compare on chunk number, reads and flushes of a chunk are distinct.
     if (chunk1->chunk == chunk2->chunk) {
+      if (chunk1->readahead != chunk2->readahead) {
+        return chunk1->readahead ? 1 : -1;
+      }
       return 0;
     } else {
       return (chunk1->chunk < chunk2->chunk) ? -1 : 1;
@@ -306,6 +318,15 @@ static void UpdateChunkIoRequest(void* item1, void* item2)
   chunk_io_request* chunk1 = (chunk_io_request*)item1;
   chunk_io_request* chunk2 = (chunk_io_request*)item2;
 
+  /* A chunk read ahead again before the earlier request was processed.
+   * Only the new buffer is still wanted by the reader, so read into that
+   * one and let the new request release the old buffer. */
+  if (chunk1->readahead) {
+    std::swap(chunk1->buffer, chunk2->buffer);
+    chunk2->release = true;
+    return;
+  }
+
   /* See if the new chunk_io_request has more bytes then
    * the chunk_io_request currently on the ordered circular
    * buffer. We can only have multiple chunk_io_requests for
@@ -327,7 +348,7 @@ bool ChunkedDevice::EnqueueChunk(chunk_io_request* request)
 {
   chunk_io_request *new_request, *enqueued_request;
 
-  Dmsg2(100, "Enqueueing chunk %d of volume %s\n", request->chunk,
+  Dmsg2(100, "Enqueueing chunk %u of volume %s\n", request->chunk,
         request->volname);
 
   if (!io_threads_started_) {
@@ -342,6 +363,7 @@ bool ChunkedDevice::EnqueueChunk(chunk_io_request* request)
   new_request->wbuflen = request->wbuflen;
   new_request->tries = 0;
   new_request->release = request->release;
+  new_request->readahead = request->readahead;
 
   Dmsg2(100, "Allocated chunk io request of %d bytes at %p\n",
         sizeof(chunk_io_request), new_request);
@@ -400,11 +422,16 @@ bool ChunkedDevice::DequeueChunk()
         &ts, DEFAULT_RECHECK_INTERVAL);
     if (!new_request) { return false; }
 
-    Dmsg3(100, "Flushing chunk %d of volume %s by thread %s\n",
+    if (new_request->readahead) {
+      ProcessReadahead(new_request);
+      goto bail_out;
+    }
+
+    Dmsg3(100, "Flushing chunk %u of volume %s by thread %s\n",
           new_request->chunk, new_request->volname,
           edit_pthread(pthread_self(), ed1, sizeof(ed1)));
 
-    if (!FlushRemoteChunk(new_request)) {
+    if (!FlushChunkRequest(new_request)) {
       chunk_io_request* enqueued_request;
 
       /* See if we have a maximum number of retries to upload chunks to the
@@ -415,7 +442,7 @@ bool ChunkedDevice::DequeueChunk()
       new_request->tries++;
       if (retries_ > 0 && new_request->tries >= retries_) {
         Mmsg4(errmsg,
-              T_("Unable to flush chunk %d of volume %s to backing store after "
+              T_("Unable to flush chunk %u of volume %s to backing store after "
                  "%d tries, setting device %s readonly\n"),
               new_request->chunk, new_request->volname, new_request->tries,
               print_name());
@@ -432,7 +459,7 @@ bool ChunkedDevice::DequeueChunk()
        * circular buffer we will not try dequeueing any new item either until a
        * new item is put onto the ordered circular buffer or after the retry
        * interval has expired. */
-      Dmsg2(100, "Enqueueing chunk %d of volume %s for retry of upload later\n",
+      Dmsg2(100, "Enqueueing chunk %u of volume %s for retry of upload later\n",
             new_request->chunk, new_request->volname);
 
       /* Enqueue the item onto the ordered circular buffer.
@@ -444,7 +471,7 @@ bool ChunkedDevice::DequeueChunk()
           true /* no_signal */);
       // See if the enqueue succeeded.
       if (!enqueued_request) {
-        Dmsg2(100, "Error: Chunk %d of volume %s not appended to queue\n",
+        Dmsg2(100, "Error: Chunk %u of volume %s not appended to queue\n",
               new_request->chunk, new_request->volname);
         return false;
       }
@@ -453,7 +480,7 @@ bool ChunkedDevice::DequeueChunk()
        * If it is different there was already a chunk io request for the
        * same chunk on the ordered circular buffer. */
       if (enqueued_request != new_request) {
-        Dmsg2(100, "Attempted to append chunk %d of volume %s twice\n",
+        Dmsg2(100, "Attempted to append chunk %u of volume %s twice\n",
               new_request->chunk, new_request->volname);
         FreeChunkIoRequest(new_request);
       }
@@ -469,6 +496,13 @@ bool ChunkedDevice::DequeueChunk()
     // Processed the chunk so clean it up now.
     FreeChunkIoRequest(new_request);
 
+    // Wake up anyone in WaitUntilChunksWritten().
+    {
+      std::lock_guard<std::mutex> lock(written_mutex_);
+      chunks_written_++;
+    }
+    chunk_written_.notify_all();
+
     return true;
   }
 }
@@ -493,13 +527,14 @@ bool ChunkedDevice::FlushChunk(bool release_chunk, bool move_to_next_chunk)
   request.buffer = current_chunk_->buffer;
   request.wbuflen = current_chunk_->buflen;
   request.release = release_chunk;
+  request.readahead = false;
 
   if (io_threads_) {
     retval = EnqueueChunk(&request);
   } else {
     // no multithreading
-    Dmsg1(100, "Try to flush chunk number: %d\n", request.chunk);
-    retval = FlushRemoteChunk(&request);
+    Dmsg1(100, "Try to flush chunk number: %u\n", request.chunk);
+    retval = FlushChunkRequest(&request);
   }
 
   // Clear the need flushing flag.
@@ -535,19 +570,212 @@ bool ChunkedDevice::ReadChunk()
   request.wbuflen = current_chunk_->chunk_size;
   request.rbuflen = &current_chunk_->buflen;
   request.release = false;
+  request.readahead = false;
 
   current_chunk_->end_offset
       = current_chunk_->start_offset + (current_chunk_->chunk_size - 1);
 
-  if (!ReadRemoteChunk(&request)) {
-    // If the chunk doesn't exist on the backing store it has a size of 0 bytes.
-    current_chunk_->buflen = 0;
-    return false;
+  if (!TakeReadahead(request.chunk)) {
+    /* Make sure no io-thread is still reading ahead, as that would change
+     * dev_errno under our feet. */
+    DropReadahead();
+
+    if (!ReadChunkRequest(&request)) {
+      /* If the chunk doesn't exist on the backing store it has a size of 0
+       * bytes. */
+      current_chunk_->buflen = 0;
+      return false;
+    }
+  }
+
+  ReadAhead(request.chunk);
+
+  return true;
+}
+
+// Flush a chunk to the backing store and keep a copy in the chunk cache.
+bool ChunkedDevice::FlushChunkRequest(chunk_io_request* request)
+{
+  if (!FlushRemoteChunk(request)) { return false; }
+
+  if (chunk_cache_) {
+    chunk_cache_->Put(chunk_cache_store_, request->volname, request->chunk,
+                      request->buffer, request->wbuflen);
   }
 
   return true;
 }
 
+// Read a chunk from the chunk cache or else from the backing store.
+bool ChunkedDevice::ReadChunkRequest(chunk_io_request* request)
+{
+  if (chunk_cache_
+      && chunk_cache_->Get(chunk_cache_store_, request->volname,
+                           request->chunk, request->buffer, request->wbuflen,
+                           request->rbuflen)) {
+    Dmsg2(100, "Read chunk %u of volume %s from the chunk cache\n",
+          request->chunk, request->volname);
+    return true;
+  }
+
+  if (!ReadRemoteChunk(request)) { return false; }
+
+  if (chunk_cache_) {
+    chunk_cache_->Put(chunk_cache_store_, request->volname, request->chunk,
+                      request->buffer, *request->rbuflen);
+  }
+
+  return true;
+}
+
+/*
+ * Let the io-threads read the chunks following chunk, forget about any
+ * chunk read ahead which the reader skipped or that is too far ahead.
+ */
+void ChunkedDevice::ReadAhead(uint32_t chunk)
+{
+  std::vector<std::pair<uint32_t, char*>> wanted;
+
+  if (!io_threads_ || !readahead_chunks_ || current_chunk_->writing) {
+    return;
+  }
+
+  {
+    std::lock_guard lock(readahead_mutex_);
+
+    readahead_volname_ = current_volname_;
+    for (auto it = readahead_.begin(); it != readahead_.end();) {
+      if (it->first > chunk && it->first <= chunk + readahead_chunks_) {
+        ++it;
+        continue;
+      }
+      if (!it->second.pending) { FreeChunkbuffer(it->second.buffer); }
+      it = readahead_.erase(it);
+    }
+
+    for (uint32_t next = chunk + 1;
+         next <= chunk + readahead_chunks_ && next < MAX_CHUNKS; next++) {
+      if (readahead_.find(next) != readahead_.end()) { continue; }
+      readahead_[next].buffer = allocate_chunkbuffer();
+      wanted.emplace_back(next, readahead_[next].buffer);
+    }
+  }
+
+  // Only this thread removes chunks, so they are still there.
+  for (auto [next, buffer] : wanted) {
+    chunk_io_request request;
+
+    request.volname = current_volname_;
+    request.chunk = next;
+    request.buffer = buffer;
+    request.wbuflen = current_chunk_->chunk_size;
+    request.release = true;
+    request.readahead = true;
+
+    Dmsg2(100, "Reading ahead chunk %u of volume %s\n", next,
+          current_volname_);
+
+    if (!EnqueueChunk(&request)) {
+      std::lock_guard lock(readahead_mutex_);
+      readahead_.erase(next);
+      FreeChunkbuffer(buffer);
+      break;
+    }
+  }
+}
+
+/*
+ * Use the chunk read ahead as the current chunk, waits for an io-thread
+ * still reading it. Returns false if the chunk was not read ahead or the
+ * read failed, the caller then reads it itself.
+ */
+bool ChunkedDevice::TakeReadahead(uint32_t chunk)
+{
+  std::unique_lock lock(readahead_mutex_);
+
+  if (readahead_volname_ != current_volname_) { return false; }
+
+  auto it = readahead_.find(chunk);
+  if (it == readahead_.end()) { return false; }
+
+  readahead_done_.wait(lock, [this, chunk] {
+    auto found = readahead_.find(chunk);
+    return found == readahead_.end() || !found->second.pending;
+  });
+
+  it = readahead_.find(chunk);
+  if (it == readahead_.end()) { return false; }
+
+  bool taken = !it->second.failed;
+  if (taken) {
+    std::swap(current_chunk_->buffer, it->second.buffer);
+    current_chunk_->buflen = it->second.buflen;
+    Dmsg2(100, "Using chunk %u of volume %s read ahead\n", chunk,
+          current_volname_);
+  }
+  if (it->second.buffer) { FreeChunkbuffer(it->second.buffer); }
+  readahead_.erase(it);
+
+  return taken;
+}
+
+// Forget all chunks read ahead and wait until no io-thread reads ahead.
+void ChunkedDevice::DropReadahead()
+{
+  std::unique_lock lock(readahead_mutex_);
+
+  for (auto& [chunk, ahead] : readahead_) {
+    if (!ahead.pending) { FreeChunkbuffer(ahead.buffer); }
+  }
+  readahead_.clear();
+
+  readahead_done_.wait(lock, [this] { return readahead_running_ == 0; });
+}
+
+// Read ahead a chunk on an io-thread, unless the reader no longer wants it.
+void ChunkedDevice::ProcessReadahead(chunk_io_request* request)
+{
+  uint32_t buflen = 0;
+  char ed1[50];
+
+  auto wanted = [this, request] {
+    auto it = readahead_.find(request->chunk);
+    return bstrcmp(readahead_volname_.c_str(), request->volname)
+                   && it != readahead_.end() && it->second.pending
+                   && it->second.buffer == request->buffer
+               ? it
+               : readahead_.end();
+  };
+
+  {
+    std::lock_guard lock(readahead_mutex_);
+    if (wanted() == readahead_.end()) { return; }
+    readahead_running_++;
+  }
+
+  Dmsg3(100, "Reading ahead chunk %u of volume %s by thread %s\n",
+        request->chunk, request->volname,
+        edit_pthread(pthread_self(), ed1, sizeof(ed1)));
+
+  request->rbuflen = &buflen;
+  bool ok = ReadChunkRequest(request);
+
+  {
+    std::lock_guard lock(readahead_mutex_);
+    readahead_running_--;
+
+    auto it = wanted();
+    if (it != readahead_.end()) {
+      it->second.pending = false;
+      it->second.failed = !ok;
+      it->second.buflen = buflen;
+      // The buffer now belongs to the reader.
+      request->release = false;
+    }
+  }
+  readahead_done_.notify_all();
+}
+
 /*
  * Setup a chunked volume for reading or writing.
  * return:
@@ -614,6 +842,25 @@ int ChunkedDevice::SetupChunk(const char*, int flags, int)
 
   current_volname_ = strdup(getVolCatName());
 
+  // Nothing read ahead of another volume or before the reopen is valid.
+  DropReadahead();
+
+  if (chunk_cache_dir_ && !chunk_cache_) {
+    uint64_t cache_size
+        = chunk_cache_size_ ? chunk_cache_size_ : DEFAULT_CHUNK_CACHE_SIZE;
+
+    chunk_cache_ = ChunkCache::ForDirectory(chunk_cache_dir_, cache_size);
+    chunk_cache_store_ = ChunkCache::StoreName(BackingStore());
+    if (!chunk_cache_) {
+      BErrNo be;
+
+      Mmsg2(errmsg, T_("Unable to use chunk cache directory %s: ERR=%s\n"),
+            chunk_cache_dir_, be.bstrerror());
+      Emsg0(M_WARNING, 0, errmsg);
+      chunk_cache_dir_ = NULL;
+    }
+  }
+
   /* in principle it is not required to load_chunk(),
    * but we need a secure way to determine,
    * if the chunk already exists. */
@@ -898,6 +1145,8 @@ int ChunkedDevice::CloseChunk()
     }
 
 
+    DropReadahead();
+
     // Invalidate chunk.
     current_chunk_->writing = false;
     current_chunk_->opened = false;
@@ -918,6 +1167,10 @@ bool ChunkedDevice::TruncateChunkedVolume(DeviceControlRecord* dcr)
   if (current_chunk_->opened) {
     if (!TruncateRemoteVolume(dcr)) { return false; }
 
+    if (chunk_cache_) {
+      chunk_cache_->Remove(chunk_cache_store_, current_volname_);
+    }
+
     // Reinitialize the initial chunk.
     current_chunk_->start_offset = 0;
     current_chunk_->end_offset = (current_chunk_->chunk_size - 1);
@@ -929,6 +1182,9 @@ bool ChunkedDevice::TruncateChunkedVolume(DeviceControlRecord* dcr)
     if (current_volname_) { free(current_volname_); }
 
     current_volname_ = strdup(getVolCatName());
+    if (chunk_cache_) {
+      chunk_cache_->Remove(chunk_cache_store_, current_volname_);
+    }
   }
 
   return true;
@@ -939,9 +1195,68 @@ static int CompareVolumeName(void* item1, void* item2)
   const char* volname = (const char*)item2;
   chunk_io_request* request = (chunk_io_request*)item1;
 
+  // Chunks read ahead say nothing about what is still to be written.
+  if (request->readahead) { return -1; }
+
   return strcmp(request->volname, volname);
 }
 
+/*
+ * Get the size of a volume made of the chunks 0 to n - 1 from a backend
+ * which can only look at one chunk at a time.  Instead of probing every
+ * chunk, n is found by probing chunk 1, 2, 4, 8, ... and then bisecting
+ * between the last chunk found and the first one missing, so only about
+ * 2 * log2(n) chunks are looked at.  All chunks but the last one have the
+ * size of the first one, as the offsets in a volume are computed the same
+ * way.
+ */
+ssize_t ChunkedDevice::VolumeSizeFromChunks(
+    const std::function<ChunkProbe(uint32_t chunk, uint64_t* size)>& probe)
+{
+  uint64_t first_size = 0;
+  uint64_t last_size = 0;
+  uint64_t size = 0;
+
+  switch (probe(0, &first_size)) {
+    case ChunkProbe::kFound:
+      break;
+    case ChunkProbe::kMissing:
+      return 0;
+    default:
+      return -1;
+  }
+
+  // Chunk found exists, chunk missing does not (or is beyond MAX_CHUNKS).
+  uint32_t found = 0;
+  uint32_t missing = 1;
+  last_size = first_size;
+  while (missing < MAX_CHUNKS) {
+    ChunkProbe status = probe(missing, &size);
+    if (status == ChunkProbe::kError) { return -1; }
+    if (status == ChunkProbe::kMissing) { break; }
+    found = missing;
+    last_size = size;
+    missing = std::min<uint64_t>(2 * (uint64_t)missing, MAX_CHUNKS);
+  }
+
+  while (missing - found > 1) {
+    uint32_t chunk = found + (missing - found) / 2;
+    switch (probe(chunk, &size)) {
+      case ChunkProbe::kFound:
+        found = chunk;
+        last_size = size;
+        break;
+      case ChunkProbe::kMissing:
+        missing = chunk;
+        break;
+      default:
+        return -1;
+    }
+  }
+
+  return (ssize_t)((uint64_t)found * first_size + last_size);
+}
+
 // Get the current size of a volume.
 ssize_t ChunkedDevice::ChunkedVolumeSize()
 {
@@ -1079,7 +1394,9 @@ bool ChunkedDevice::is_written()
 }
 
 
-// Busy waits until write buffer is empty.
+/* Waits until write buffer is empty, rechecking whenever an io-thread
+ * finished a request and at the latest every
+ * DEFAULT_RECHECK_INTERVAL_WRITE_BUFFER seconds. */
 bool ChunkedDevice::WaitUntilChunksWritten()
 {
   if (current_chunk_->need_flushing) {
@@ -1089,8 +1406,18 @@ bool ChunkedDevice::WaitUntilChunksWritten()
     }
   }
 
-  while (!is_written()) {
-    Bmicrosleep(DEFAULT_RECHECK_INTERVAL_WRITE_BUFFER, 0);
+  while (true) {
+    uint64_t written;
+    {
+      std::lock_guard<std::mutex> lock(written_mutex_);
+      written = chunks_written_;
+    }
+    if (is_written()) { break; }
+
+    std::unique_lock<std::mutex> lock(written_mutex_);
+    chunk_written_.wait_for(
+        lock, std::chrono::seconds(DEFAULT_RECHECK_INTERVAL_WRITE_BUFFER),
+        [this, written] { return chunks_written_ != written; });
   }
 
   return true;
@@ -1102,6 +1429,8 @@ static int CloneIoRequest(void* item1, void* item2)
   chunk_io_request* src = (chunk_io_request*)item1;
   chunk_io_request* dst = (chunk_io_request*)item2;
 
+  if (src->readahead) { return -1; }
+
   if (bstrcmp(src->volname, dst->volname) && src->chunk == dst->chunk) {
     memcpy(dst->buffer, src->buffer, src->wbuflen);
     *dst->rbuflen = src->wbuflen;
@@ -1219,8 +1548,13 @@ static int ListIoRequest(void* request, void* data)
   DeviceStatusInformation* dst = (DeviceStatusInformation*)data;
   PoolMem status(PM_MESSAGE);
 
-  status.bsprintf("   /%s/%04d - %ld (try=%d)\n", io_request->volname,
-                  io_request->chunk, io_request->wbuflen, io_request->tries);
+  if (io_request->readahead) {
+    status.bsprintf("   /%s/%04u - read-ahead\n", io_request->volname,
+                    io_request->chunk);
+  } else {
+    status.bsprintf("   /%s/%04u - %ld (try=%d)\n", io_request->volname,
+                    io_request->chunk, io_request->wbuflen, io_request->tries);
+  }
   dst->status_length = PmStrcat(dst->status, status.c_str());
 
   return 0;
@@ -1263,6 +1597,18 @@ bool ChunkedDevice::DeviceStatus(DeviceStatusInformation* dst)
         = PmStrcat(dst->status, T_("No pending IO flush requests.\n"));
   }
 
+  if (chunk_cache_) {
+    PoolMem cache(PM_MESSAGE);
+    char ed1[50], ed2[50], ed3[50], ed4[50];
+
+    cache.bsprintf(T_("Chunk cache: %s of %s bytes, hits=%s misses=%s\n"),
+                   edit_uint64_with_commas(chunk_cache_->Bytes(), ed1),
+                   edit_uint64_with_commas(chunk_cache_->MaxBytes(), ed2),
+                   edit_uint64_with_commas(chunk_cache_->Hits(), ed3),
+                   edit_uint64_with_commas(chunk_cache_->Misses(), ed4));
+    dst->status_length = PmStrcat(dst->status, cache.c_str());
+  }
+
   return (dst->status_length > 0);
 }
 
@@ -1288,6 +1634,7 @@ ChunkedDevice::~ChunkedDevice()
   }
 
   if (current_chunk_) {
+    DropReadahead();
     if (current_chunk_->buffer) { FreeChunkbuffer(current_chunk_->buffer); }
     free(current_chunk_);
     current_chunk_ = NULL;
@@ -2,7 +2,7 @@
    BAREOS® - Backup Archiving REcovery Open Sourced
 
    Copyright (C) 2015-2017 Planets Communications B.V.
-   Copyright (C) 2018-2021 Bareos GmbH & Co. KG
+   Copyright (C) 2018-2024 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -31,8 +31,18 @@
 template <typename T> class alist;
 
 #include "ordered_cbuf.h"
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
 namespace storagedaemon {
 
+class ChunkCache;
+
 // Let io-threads check for work every 300 seconds.
 #define DEFAULT_RECHECK_INTERVAL 300
 
@@ -51,10 +61,22 @@ namespace storagedaemon {
 
 /*
  * Maximum number of chunks per volume.
- * When you change this make sure you update the %04d format
- * used in the code to format the chunk numbers e.g. 0000-9999
+ * Chunk numbers are formatted with %04u, so the first 10000 chunks are
+ * named 0000-9999 as on volumes written by older versions and the
+ * names of later chunks just get more digits (10000-999999).
+ */
+#define MAX_CHUNKS 1000000
+
+/*
+ * Number of chunks older versions limited a volume to (0000-9999).
+ */
+#define LEGACY_MAX_CHUNKS 10000
+
+/*
+ * Default size of the local chunk cache when only its directory
+ * is configured as a device option.
  */
-#define MAX_CHUNKS 10000
+#define DEFAULT_CHUNK_CACHE_SIZE (1024 * 1024 * 1024)
 
 /*
  * Busy wait retry for inflight chunks.
@@ -75,14 +97,23 @@ struct thread_handle {
   pthread_t thread_id;   /* Actual threadid */
 };
 
+// What a backend found when it looked for a chunk.
+enum class ChunkProbe
+{
+  kFound,
+  kMissing,
+  kError
+};
+
 struct chunk_io_request {
   const char* volname; /* VolumeName */
-  uint16_t chunk;      /* Chunk number */
+  uint32_t chunk;      /* Chunk number */
   char* buffer;        /* Data */
   uint32_t wbuflen;    /* Size of the actual valid data in the chunk (Write) */
   uint32_t* rbuflen;   /* Size of the actual valid data in the chunk (Read) */
   uint8_t tries; /* Number of times the flush was tried to the backing store */
   bool release;  /* Should we release the data to which the buffer points ? */
+  bool readahead; /* Read the chunk for the reader instead of flushing it */
 };
 
 struct chunk_descriptor {
@@ -97,6 +128,14 @@ struct chunk_descriptor {
   bool opened;        /* An open call was done */
 };
 
+// A chunk read ahead by an io-thread.
+struct readahead_chunk {
+  char* buffer{};    /* Data, owned by the io request while pending */
+  uint32_t buflen{}; /* Size of the actual valid data in the chunk */
+  bool pending{true};
+  bool failed{};
+};
+
 
 class ChunkedDevice : public Device {
  private:
@@ -109,6 +148,20 @@ class ChunkedDevice : public Device {
   ordered_circbuf* cb_{};
   alist<thread_handle*>* thread_ids_{};
   chunk_descriptor* current_chunk_{};
+  std::shared_ptr<ChunkCache> chunk_cache_{};
+  std::string chunk_cache_store_{};
+
+  // Chunks read ahead of the reader, guarded by readahead_mutex_.
+  std::mutex readahead_mutex_;
+  std::condition_variable readahead_done_;
+  std::string readahead_volname_;
+  std::map<uint32_t, readahead_chunk> readahead_;
+  int readahead_running_{};
+
+  // Counts the requests the io-threads finished, guarded by written_mutex_.
+  std::mutex written_mutex_;
+  std::condition_variable chunk_written_;
+  uint64_t chunks_written_{};
 
   // Private Methods
   char* allocate_chunkbuffer();
@@ -119,6 +172,12 @@ class ChunkedDevice : public Device {
   bool EnqueueChunk(chunk_io_request* request);
   bool FlushChunk(bool release_chunk, bool move_to_next_chunk);
   bool ReadChunk();
+  bool FlushChunkRequest(chunk_io_request* request);
+  bool ReadChunkRequest(chunk_io_request* request);
+  void ReadAhead(uint32_t chunk);
+  bool TakeReadahead(uint32_t chunk);
+  void DropReadahead();
+  void ProcessReadahead(chunk_io_request* request);
   bool is_written();
 
  protected:
@@ -126,7 +185,10 @@ class ChunkedDevice : public Device {
   uint8_t io_threads_{};
   uint8_t io_slots_{};
   uint8_t retries_{};
+  uint8_t readahead_chunks_{};
   uint64_t chunk_size_{};
+  const char* chunk_cache_dir_{};
+  uint64_t chunk_cache_size_{};
   boffset_t offset_{};
   bool use_mmap_{};
 
@@ -141,6 +203,8 @@ class ChunkedDevice : public Device {
   int CloseChunk();
   bool TruncateChunkedVolume(DeviceControlRecord* dcr);
   ssize_t ChunkedVolumeSize();
+  ssize_t VolumeSizeFromChunks(
+      const std::function<ChunkProbe(uint32_t chunk, uint64_t* size)>& probe);
   bool LoadChunk();
   bool WaitUntilChunksWritten();
 
@@ -150,6 +214,8 @@ class ChunkedDevice : public Device {
   virtual bool ReadRemoteChunk(chunk_io_request* request) = 0;
   virtual ssize_t RemoteVolumeSize() = 0;
   virtual bool TruncateRemoteVolume(DeviceControlRecord* dcr) = 0;
+  // Identifies the backing store for the chunk cache
+  virtual std::string BackingStore() const { return archive_device_string; }
 
  public:
   // Public Methods
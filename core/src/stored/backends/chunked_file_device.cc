@@ -0,0 +1,494 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation, which is
+   listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Stacking is the following:
+ *
+ *   ChunkedFileDevice::
+ *         |
+ *         v
+ *   ChunkedDevice::
+ *         |
+ *         v
+ *       Device::
+ *
+ */
+/**
+ * @file
+ * Chunked device storing the chunks as files in a local directory.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "include/bareos.h"
+
+#include "stored/stored.h"
+#include "stored/sd_backends.h"
+#include "chunked_device.h"
+#include "chunked_file_device.h"
+#include "lib/berrno.h"
+#include "lib/edit.h"
+
+namespace storagedaemon {
+
+// Options that can be specified for this device type.
+enum device_option_type
+{
+  argument_none = 0,
+  argument_chunksize,
+  argument_iothreads,
+  argument_ioslots,
+  argument_retries,
+  argument_mmap,
+  argument_readahead,
+  argument_chunkcache,
+  argument_chunkcachesize,
+  argument_latency
+};
+
+struct device_option {
+  const char* name;
+  enum device_option_type type;
+  int compare_size;
+};
+
+static device_option device_options[]
+    = {{"chunksize=", argument_chunksize, 10},
+       {"iothreads=", argument_iothreads, 10},
+       {"ioslots=", argument_ioslots, 8},
+       {"retries=", argument_retries, 8},
+       {"mmap", argument_mmap, 4},
+       {"readahead=", argument_readahead, 10},
+       {"chunkcache=", argument_chunkcache, 11},
+       {"chunkcachesize=", argument_chunkcachesize, 15},
+       {"latency=", argument_latency, 8},
+       {NULL, argument_none, 0}};
+
+bool ChunkedFileDevice::ParseDeviceOptions()
+{
+  uint64_t value;
+  char *bp, *next_option;
+
+  options_parsed_ = true;
+  if (!dev_options) { return true; }
+
+  configstring_ = strdup(dev_options);
+
+  bp = configstring_;
+  while (bp) {
+    bool done = false;
+
+    next_option = strchr(bp, ',');
+    if (next_option) { *next_option++ = '\0'; }
+
+    for (int i = 0; !done && device_options[i].name; i++) {
+      // Try to find a matching device option.
+      if (bstrncasecmp(bp, device_options[i].name,
+                       device_options[i].compare_size)) {
+        const char* arg = bp + device_options[i].compare_size;
+
+        switch (device_options[i].type) {
+          case argument_chunksize:
+            size_to_uint64(arg, &value);
+            chunk_size_ = value;
+            break;
+          case argument_iothreads:
+            size_to_uint64(arg, &value);
+            io_threads_ = value & 0xFF;
+            break;
+          case argument_ioslots:
+            size_to_uint64(arg, &value);
+            io_slots_ = value & 0xFF;
+            break;
+          case argument_retries:
+            size_to_uint64(arg, &value);
+            retries_ = value & 0xFF;
+            break;
+          case argument_mmap:
+            use_mmap_ = true;
+            break;
+          case argument_readahead:
+            size_to_uint64(arg, &value);
+            readahead_chunks_ = value & 0xFF;
+            break;
+          case argument_chunkcache:
+            chunk_cache_dir_ = arg;
+            break;
+          case argument_chunkcachesize:
+            size_to_uint64(arg, &value);
+            chunk_cache_size_ = value;
+            break;
+          case argument_latency:
+            latency_ms_ = str_to_uint64(arg);
+            break;
+          default:
+            break;
+        }
+        done = true;
+      }
+    }
+
+    if (!done) {
+      Mmsg1(errmsg, T_("Unable to parse device option: %s\n"), bp);
+      return false;
+    }
+
+    bp = next_option;
+  }
+
+  return true;
+}
+
+std::string ChunkedFileDevice::VolumeDir(const char* volname) const
+{
+  return std::string{archive_device_string} + "/" + volname;
+}
+
+std::string ChunkedFileDevice::ChunkPath(const char* volname,
+                                         uint32_t chunk) const
+{
+  char name[16];
+
+  snprintf(name, sizeof(name), "/%04u", chunk);
+  return VolumeDir(volname) + name;
+}
+
+// Simulate the round trip to a remote backing store.
+void ChunkedFileDevice::InjectLatency() const
+{
+  if (latency_ms_) {
+    Bmicrosleep(latency_ms_ / 1000, (latency_ms_ % 1000) * 1000);
+  }
+}
+
+bool ChunkedFileDevice::CheckRemoteConnection()
+{
+  struct stat st;
+
+  if (stat(archive_device_string, &st) != 0 || !S_ISDIR(st.st_mode)) {
+    Dmsg1(100, "Chunk directory %s is not accessible\n",
+          archive_device_string);
+    return false;
+  }
+
+  return true;
+}
+
+// Write a chunk to a new file and rename it, so no partial chunk is seen.
+bool ChunkedFileDevice::FlushRemoteChunk(chunk_io_request* request)
+{
+  bool retval = false;
+  struct stat st;
+  std::string chunk_dir = VolumeDir(request->volname);
+  std::string chunk_name = ChunkPath(request->volname, request->chunk);
+  std::string tmp_name = chunk_name + ".tmp";
+  uint32_t written = 0;
+  int fd;
+
+  // Set that we are uploading the chunk.
+  if (!SetInflightChunk(request)) { return false; }
+
+  InjectLatency();
+
+  Dmsg1(100, "Flushing chunk %s\n", chunk_name.c_str());
+
+  /* Check on the backing store if the chunk already exists and if so
+   * keep it when it holds more data, see DropletDevice::FlushRemoteChunk(). */
+  if (stat(chunk_name.c_str(), &st) == 0
+      && st.st_size > (off_t)request->wbuflen) {
+    retval = true;
+    goto bail_out;
+  }
+
+  if (mkdir(chunk_dir.c_str(), 0750) != 0 && errno != EEXIST) {
+    BErrNo be;
+
+    dev_errno = errno;
+    Mmsg2(errmsg, T_("Failed to create directory %s: ERR=%s\n"),
+          chunk_dir.c_str(), be.bstrerror());
+    goto bail_out;
+  }
+
+  fd = ::open(tmp_name.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_BINARY,
+              0640);
+  if (fd < 0) {
+    BErrNo be;
+
+    dev_errno = errno;
+    Mmsg2(errmsg, T_("Failed to create %s: ERR=%s\n"), tmp_name.c_str(),
+          be.bstrerror());
+    goto bail_out;
+  }
+
+  while (written < request->wbuflen) {
+    ssize_t status
+        = ::write(fd, request->buffer + written, request->wbuflen - written);
+    if (status < 0 && errno == EINTR) { continue; }
+    if (status <= 0) { break; }
+    written += status;
+  }
+
+  if (written < request->wbuflen || fsync(fd) != 0) {
+    BErrNo be;
+
+    dev_errno = errno ? errno : EIO;
+    Mmsg2(errmsg, T_("Failed to flush %s: ERR=%s\n"), tmp_name.c_str(),
+          be.bstrerror());
+    ::close(fd);
+    unlink(tmp_name.c_str());
+    goto bail_out;
+  }
+
+  if (::close(fd) != 0
+      || rename(tmp_name.c_str(), chunk_name.c_str()) != 0) {
+    BErrNo be;
+
+    dev_errno = errno;
+    Mmsg2(errmsg, T_("Failed to flush %s: ERR=%s\n"), chunk_name.c_str(),
+          be.bstrerror());
+    unlink(tmp_name.c_str());
+    goto bail_out;
+  }
+
+  retval = true;
+
+bail_out:
+  // Clear that we are uploading the chunk.
+  ClearInflightChunk(request);
+
+  return retval;
+}
+
+bool ChunkedFileDevice::ReadRemoteChunk(chunk_io_request* request)
+{
+  bool retval = false;
+  struct stat st;
+  std::string chunk_name = ChunkPath(request->volname, request->chunk);
+  uint32_t done = 0;
+
+  InjectLatency();
+
+  Dmsg1(100, "Reading chunk %s\n", chunk_name.c_str());
+
+  int fd = ::open(chunk_name.c_str(), O_RDONLY | O_BINARY);
+  if (fd < 0) {
+    BErrNo be;
+
+    // A chunk that doesn't exist is the end of the volume.
+    dev_errno = (errno == ENOENT) ? EIO : errno;
+    Mmsg2(errmsg, T_("Failed to open %s: ERR=%s\n"), chunk_name.c_str(),
+          be.bstrerror());
+    Dmsg1(100, "%s", errmsg);
+    return false;
+  }
+
+  if (fstat(fd, &st) != 0) {
+    BErrNo be;
+
+    dev_errno = errno;
+    Mmsg2(errmsg, T_("Failed to stat %s: ERR=%s\n"), chunk_name.c_str(),
+          be.bstrerror());
+    goto bail_out;
+  }
+
+  if (st.st_size > (off_t)request->wbuflen) {
+    Mmsg3(errmsg,
+          T_("Failed to read %s (%ld) to big to fit in chunksize of %ld "
+             "bytes\n"),
+          chunk_name.c_str(), (long)st.st_size, (long)request->wbuflen);
+    Dmsg1(100, "%s", errmsg);
+    dev_errno = EINVAL;
+    goto bail_out;
+  }
+
+  while ((off_t)done < st.st_size) {
+    ssize_t status = ::read(fd, request->buffer + done, st.st_size - done);
+    if (status < 0 && errno == EINTR) { continue; }
+    if (status <= 0) { break; }
+    done += status;
+  }
+
+  if ((off_t)done < st.st_size) {
+    BErrNo be;
+
+    dev_errno = errno ? errno : EIO;
+    Mmsg2(errmsg, T_("Failed to read %s: ERR=%s\n"), chunk_name.c_str(),
+          be.bstrerror());
+    goto bail_out;
+  }
+
+  *request->rbuflen = done;
+  retval = true;
+
+bail_out:
+  ::close(fd);
+
+  return retval;
+}
+
+// A volume holds the chunks 0 to n - 1.
+ssize_t ChunkedFileDevice::RemoteVolumeSize()
+{
+  InjectLatency();
+
+  auto probe = [this](uint32_t chunk, uint64_t* size) {
+    struct stat st;
+    std::string path = ChunkPath(getVolCatName(), chunk);
+
+    if (stat(path.c_str(), &st) == 0) {
+      *size = st.st_size;
+      return ChunkProbe::kFound;
+    }
+    if (errno == ENOENT) { return ChunkProbe::kMissing; }
+
+    BErrNo be;
+    dev_errno = errno;
+    Mmsg2(errmsg, T_("Unable to stat chunk %s: ERR=%s\n"), path.c_str(),
+          be.bstrerror());
+    return ChunkProbe::kError;
+  };
+  ssize_t volumesize = VolumeSizeFromChunks(probe);
+
+  Dmsg2(100, "Size of volume %s: %lld\n", getVolCatName(),
+        (long long)volumesize);
+
+  return volumesize;
+}
+
+bool ChunkedFileDevice::TruncateRemoteVolume(DeviceControlRecord*)
+{
+  std::string chunk_dir = VolumeDir(getVolCatName());
+  DIR* dp;
+
+  InjectLatency();
+
+  Dmsg1(100, "truncate_remote_chunked_volume(%s) start.\n", getVolCatName());
+
+  if (!(dp = opendir(chunk_dir.c_str()))) {
+    if (errno == ENOENT) { return true; }
+
+    BErrNo be;
+    dev_errno = errno;
+    Mmsg2(errmsg, T_("Failed to open directory %s: ERR=%s\n"),
+          chunk_dir.c_str(), be.bstrerror());
+    return false;
+  }
+
+  bool retval = true;
+  while (struct dirent* de = readdir(dp)) {
+    if (de->d_name[0] == '.') { continue; }
+
+    std::string path = chunk_dir + "/" + de->d_name;
+    if (unlink(path.c_str()) != 0) {
+      BErrNo be;
+
+      dev_errno = errno;
+      Mmsg2(errmsg, T_("Operation failed on chunk %s: ERR=%s."), path.c_str(),
+            be.bstrerror());
+      retval = false;
+      break;
+    }
+  }
+  closedir(dp);
+
+  Dmsg1(100, "truncate_remote_chunked_volume(%s) finished.\n", getVolCatName());
+
+  return retval;
+}
+
+int ChunkedFileDevice::d_open(const char* pathname, int flags, int mode)
+{
+  if (!options_parsed_ && !ParseDeviceOptions()) {
+    Emsg0(M_FATAL, 0, errmsg);
+    return -1;
+  }
+
+  return SetupChunk(pathname, flags, mode);
+}
+
+ssize_t ChunkedFileDevice::d_read(int t_fd, void* buffer, size_t count)
+{
+  return ReadChunked(t_fd, buffer, count);
+}
+
+ssize_t ChunkedFileDevice::d_write(int t_fd, const void* buffer, size_t count)
+{
+  return WriteChunked(t_fd, buffer, count);
+}
+
+int ChunkedFileDevice::d_close(int) { return CloseChunk(); }
+
+int ChunkedFileDevice::d_ioctl(int, ioctl_req_t, char*) { return -1; }
+
+boffset_t ChunkedFileDevice::d_lseek(DeviceControlRecord*,
+                                     boffset_t offset,
+                                     int whence)
+{
+  switch (whence) {
+    case SEEK_SET:
+      offset_ = offset;
+      break;
+    case SEEK_CUR:
+      offset_ += offset;
+      break;
+    case SEEK_END: {
+      ssize_t volumesize;
+
+      volumesize = ChunkedVolumeSize();
+
+      Dmsg1(100, "Current volumesize: %lld\n", volumesize);
+
+      if (volumesize >= 0) {
+        offset_ = volumesize + offset;
+      } else {
+        return -1;
+      }
+      break;
+    }
+    default:
+      return -1;
+  }
+
+  if (!LoadChunk()) { return -1; }
+
+  return offset_;
+}
+
+bool ChunkedFileDevice::d_truncate(DeviceControlRecord* dcr)
+{
+  return TruncateChunkedVolume(dcr);
+}
+
+bool ChunkedFileDevice::d_flush(DeviceControlRecord*)
+{
+  return WaitUntilChunksWritten();
+}
+
+ChunkedFileDevice::~ChunkedFileDevice()
+{
+  if (configstring_) { free(configstring_); }
+}
+
+REGISTER_SD_BACKEND(chunked, ChunkedFileDevice)
+
+} /* namespace storagedaemon */
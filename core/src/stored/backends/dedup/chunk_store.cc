@@ -0,0 +1,463 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can modify it under the terms of
+   version three of the GNU Affero General Public License as published by the
+   Free Software Foundation, which is listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "chunk_store.h"
+
+#include <limits>
+#include <map>
+#include <mutex>
+
+#include <xxhash.h>
+
+extern "C" {
+#include <dirent.h>
+#include <sys/file.h>
+}
+
+namespace dedup {
+
+namespace {
+constexpr char store_magic[8] = {'B', 'A', 'R', 'C', 'H', 'N', 'K', '2'};
+
+constexpr std::uint64_t min_index_slots = std::uint64_t{1} << 16;
+
+/* compact() rewrites all chunks that are still in use, so it is only worth
+ * it if a good part of the data file can be dropped. */
+constexpr std::uint64_t min_unused_bytes = 64 * 1024 * 1024;
+constexpr std::uint64_t min_unused_ratio = 4; /* at least a quarter */
+
+// the hash table is kept at most half full
+std::uint64_t IndexSlotsFor(std::uint64_t entries)
+{
+  std::uint64_t slots = min_index_slots;
+  while (slots < 2 * (entries + 1)) { slots *= 2; }
+  return slots;
+}
+
+bool IsValidIndexSize(std::uint64_t slots, std::uint64_t entries)
+{
+  return slots >= min_index_slots && (slots & (slots - 1)) == 0
+         && slots >= 2 * entries;
+}
+
+bool InsertIntoIndex(fvec<index_slot>& index,
+                     std::uint64_t hash_low,
+                     std::uint64_t id)
+{
+  std::uint64_t mask = index.size() - 1;
+  std::uint64_t pos = hash_low & mask;
+  for (std::uint64_t i = 0; i < index.size(); ++i) {
+    if (index[pos].chunk == 0) {
+      index[pos] = index_slot{hash_low, id + 1};
+      return true;
+    }
+    pos = (pos + 1) & mask;
+  }
+  return false;
+}
+
+raii_fd CreateFile(const std::string& name, std::uint64_t size)
+{
+  raii_fd fd(name, O_RDWR | O_CREAT | O_TRUNC);
+  if (::ftruncate(fd.get(), size) < 0) {
+    throw error("ftruncate(" + name + ")");
+  }
+  return fd;
+}
+
+void SyncDirectory(const std::string& path)
+{
+  raii_fd dir(path, O_RDONLY | O_DIRECTORY);
+  if (::fsync(dir.get()) < 0) { throw error("fsync(" + path + ")"); }
+}
+}  // namespace
+
+std::shared_ptr<chunk_store> chunk_store::Open(const std::string& path)
+{
+  static std::mutex registry_mutex;
+  static std::map<std::string, std::weak_ptr<chunk_store>> registry;
+
+  std::unique_lock lock(registry_mutex);
+  auto& entry = registry[path];
+  if (auto store = entry.lock()) { return store; }
+
+  std::shared_ptr<chunk_store> store;
+  try {
+    store = std::make_shared<chunk_store>(path, false);
+  } catch (const std::system_error& e) {
+    /* Fall back to reading only, if we are not allowed to write or if
+     * another process is writing to the store. */
+    if (e.code() != std::errc::permission_denied
+        && e.code() != std::errc::read_only_file_system
+        && e.code() != std::errc::resource_unavailable_try_again) {
+      throw;
+    }
+    store = std::make_shared<chunk_store>(path, true);
+  }
+  entry = store;
+  return store;
+}
+
+chunk_store::chunk_store(const std::string& t_path, bool read_only)
+    : path{t_path}, writable{!read_only}
+{
+  if (writable && ::mkdir(path.c_str(), 0750) < 0 && errno != EEXIST) {
+    throw error("mkdir(" + path + ")");
+  }
+
+  int flags = read_only ? O_RDONLY : (O_RDWR | O_CREAT);
+  state_fd = raii_fd(path + "/state", flags);
+  if (writable && ::flock(state_fd.get(), LOCK_EX | LOCK_NB) < 0) {
+    throw error("flock(" + path + "/state)");
+  }
+
+  store_state state{};
+  if (ReadState(state_fd, state)) {
+    if (std::memcmp(state.magic, store_magic, sizeof(store_magic)) != 0) {
+      throw std::runtime_error(path + " is not a chunk store.");
+    }
+  } else if (writable) {
+    std::memcpy(state.magic, store_magic, sizeof(store_magic));
+    WriteState(state_fd, state);
+  } else {
+    throw std::runtime_error(path + " is not a chunk store.");
+  }
+
+  for (int attempt = 0;; ++attempt) {
+    try {
+      open_files(state);
+      break;
+    } catch (const std::system_error& e) {
+      // the writer may have compacted the store since we read the state
+      if (writable || attempt >= 2
+          || e.code() != std::errc::no_such_file_or_directory
+          || !ReadState(state_fd, state)) {
+        throw;
+      }
+    }
+  }
+
+  referenced_bytes = state.referenced_bytes;
+  unused_chunks = state.unused_chunks;
+  unused_bytes = state.unused_bytes;
+  reclaimed_chunks = state.reclaimed_chunks;
+
+  // leftovers of an interrupted compaction
+  if (writable) { remove_stale_files(); }
+}
+
+std::string chunk_store::file_name(const char* name, std::uint64_t gen) const
+{
+  return path + "/" + name + "." + std::to_string(gen);
+}
+
+void chunk_store::open_files(const store_state& state)
+{
+  generation = state.generation;
+  int flags = writable ? (O_RDWR | O_CREAT) : O_RDONLY;
+  chunks_fd = raii_fd(file_name("chunks", generation), flags);
+  data_fd = raii_fd(file_name("data", generation), flags);
+  chunks = fvec<chunk_entry>(!writable, chunks_fd.get(), state.chunk_count);
+  contents = fvec<char>(!writable, data_fd.get(), state.data_size);
+
+  // chunks are only looked up by content when writing
+  if (!writable) { return; }
+
+  index_fd = raii_fd(file_name("index", generation), flags);
+  struct stat s;
+  if (::fstat(index_fd.get(), &s) < 0) { throw error("fstat(index)"); }
+  std::uint64_t slots = s.st_size / sizeof(index_slot);
+  if (IsValidIndexSize(slots, state.index_entries)) {
+    index = fvec<index_slot>(false, index_fd.get(), slots);
+    index_entries = state.index_entries;
+  } else {
+    rebuild_index(IndexSlotsFor(chunks.size()));
+  }
+}
+
+void chunk_store::remove_stale_files() const
+{
+  DIR* dir = ::opendir(path.c_str());
+  if (!dir) { throw error("opendir(" + path + ")"); }
+
+  std::vector<std::string> stale;
+  while (struct dirent* entry = ::readdir(dir)) {
+    std::string name{entry->d_name};
+    for (const char* prefix : {"chunks.", "index.", "data."}) {
+      std::string current = std::string{prefix} + std::to_string(generation);
+      if (name.rfind(prefix, 0) == 0 && name != current) {
+        stale.push_back(path + "/" + name);
+      }
+    }
+  }
+  ::closedir(dir);
+
+  for (auto& name : stale) { ::unlink(name.c_str()); }
+}
+
+void chunk_store::rebuild_index(std::uint64_t slots)
+{
+  std::string name = file_name("index", generation);
+  raii_fd fd = CreateFile(name + ".tmp", slots * sizeof(index_slot));
+  fvec<index_slot> table(false, fd.get(), slots);
+
+  std::uint64_t entries = 0;
+  for (std::uint64_t id = 0; id < chunks.size(); ++id) {
+    const auto& chunk = chunks[id];
+    if (chunk.size == 0) { continue; }
+    if (!InsertIntoIndex(table, chunk.hash_low, id)) {
+      throw std::runtime_error(path + ": chunk index is too small.");
+    }
+    entries += 1;
+  }
+
+  table.flush();
+  if (::rename((name + ".tmp").c_str(), name.c_str()) < 0) {
+    throw error("rename(" + name + ")");
+  }
+
+  index = std::move(table);
+  index_fd = std::move(fd);
+  index_entries = entries;
+}
+
+std::uint64_t chunk_store::ref(const char* data, std::size_t size)
+{
+  if (!writable) {
+    errno = EROFS;
+    throw error("chunk store is read only");
+  }
+  if (size == 0 || size > std::numeric_limits<std::uint32_t>::max()) {
+    throw std::invalid_argument("bad chunk size");
+  }
+
+  XXH128_hash_t hash = XXH3_128bits(data, size);
+
+  std::unique_lock lock(mutex);
+  std::uint64_t mask = index.size() - 1;
+  std::uint64_t pos = hash.low64 & mask;
+  for (std::uint64_t i = 0; i < index.size() && index[pos].chunk != 0; ++i) {
+    const auto& slot = index[pos];
+    pos = (pos + 1) & mask;
+
+    /* Entries written after the last flush() may point to chunks that were
+     * lost in a crash, so all of this needs to be checked. */
+    std::uint64_t id = slot.chunk - 1;
+    if (slot.hash_low != hash.low64 || id >= chunks.size()) { continue; }
+    auto& chunk = chunks[id];
+    // never trust the hash alone; comparing is cheap compared to the io saved
+    if (chunk.hash_low == hash.low64 && chunk.hash_high == hash.high64
+        && chunk.size == size
+        && chunk.refcount < std::numeric_limits<std::uint32_t>::max()
+        && chunk.offset + size <= contents.size()
+        && std::memcmp(contents.data() + chunk.offset, data, size) == 0) {
+      if (chunk.refcount == 0) {
+        unused_chunks -= 1;
+        unused_bytes -= size;
+      }
+      chunk.refcount += 1;
+      referenced_bytes += size;
+      return id;
+    }
+  }
+
+  std::uint64_t id = chunks.size();
+  std::uint64_t offset = contents.size();
+  contents.append_range(data, size);
+  chunks.push_back(chunk_entry{hash.low64, hash.high64, offset,
+                               static_cast<std::uint32_t>(size), 1});
+  referenced_bytes += size;
+
+  if (2 * (index_entries + 1) > index.size()
+      || !InsertIntoIndex(index, hash.low64, id)) {
+    // the new table contains the new chunk as well
+    rebuild_index(IndexSlotsFor(chunks.size()));
+  } else {
+    index_entries += 1;
+  }
+  return id;
+}
+
+void chunk_store::unref(std::uint64_t id)
+{
+  std::unique_lock lock(mutex);
+  check_id(id);
+
+  auto& chunk = chunks[id];
+  if (chunk.refcount == 0) {
+    throw std::runtime_error("chunk " + std::to_string(id)
+                             + " is not referenced.");
+  }
+  chunk.refcount -= 1;
+  referenced_bytes -= chunk.size;
+  if (chunk.refcount == 0) {
+    unused_chunks += 1;
+    unused_bytes += chunk.size;
+  }
+}
+
+void chunk_store::read(std::uint64_t id, std::vector<char>& out) const
+{
+  std::shared_lock lock(mutex);
+  check_id(id);
+
+  const auto& chunk = chunks[id];
+  if (chunk.size == 0) {
+    throw std::runtime_error("chunk " + std::to_string(id)
+                             + " was reclaimed.");
+  }
+  if (chunk.offset + chunk.size > contents.size()) {
+    throw std::runtime_error(path + ": chunk " + std::to_string(id)
+                             + " lies outside of the data file.");
+  }
+  const char* begin = contents.data() + chunk.offset;
+  out.insert(out.end(), begin, begin + chunk.size);
+}
+
+void chunk_store::flush()
+{
+  if (!writable) { return; }
+
+  std::unique_lock lock(mutex);
+  contents.flush();
+  chunks.flush();
+  index.flush();
+  // the state must only be written once the data it describes is on disk
+  write_state();
+  SyncState(state_fd);
+}
+
+bool chunk_store::compaction_due() const
+{
+  if (!writable) { return false; }
+
+  std::shared_lock lock(mutex);
+  return unused_bytes >= min_unused_bytes
+         && unused_bytes * min_unused_ratio >= contents.size();
+}
+
+void chunk_store::compact()
+{
+  if (!writable) {
+    errno = EROFS;
+    throw error("chunk store is read only");
+  }
+
+  std::unique_lock lock(mutex);
+  std::uint64_t gen = generation + 1;
+
+  std::uint64_t live_chunks = 0;
+  for (const auto& chunk : chunks) {
+    if (chunk.refcount > 0) { live_chunks += 1; }
+  }
+
+  raii_fd new_chunks_fd = CreateFile(file_name("chunks", gen), 0);
+  raii_fd new_data_fd = CreateFile(file_name("data", gen), 0);
+  std::uint64_t slots = IndexSlotsFor(live_chunks);
+  raii_fd new_index_fd
+      = CreateFile(file_name("index", gen), slots * sizeof(index_slot));
+  fvec<chunk_entry> new_chunks(false, new_chunks_fd.get());
+  fvec<char> new_contents(false, new_data_fd.get());
+  fvec<index_slot> new_index(false, new_index_fd.get(), slots);
+
+  // ids are kept, so the chunks are copied in order
+  std::uint64_t new_referenced_bytes = 0;
+  std::uint64_t new_reclaimed_chunks = 0;
+  new_chunks.reserve(chunks.size());
+  for (std::uint64_t id = 0; id < chunks.size(); ++id) {
+    chunk_entry chunk = chunks[id];
+    if (chunk.refcount == 0) {
+      new_chunks.push_back(chunk_entry{0, 0, 0, 0, 0});
+      new_reclaimed_chunks += 1;
+      continue;
+    }
+    if (chunk.offset + chunk.size > contents.size()) {
+      throw std::runtime_error(path + ": chunk " + std::to_string(id)
+                               + " lies outside of the data file.");
+    }
+
+    std::uint64_t offset = new_contents.size();
+    new_contents.append_range(contents.data() + chunk.offset, chunk.size);
+    chunk.offset = offset;
+    new_chunks.push_back(chunk);
+    InsertIntoIndex(new_index, chunk.hash_low, id);
+    new_referenced_bytes += std::uint64_t{chunk.size} * chunk.refcount;
+  }
+
+  new_contents.flush();
+  new_chunks.flush();
+  new_index.flush();
+  SyncDirectory(path);
+
+  // switching the generation in the state file commits the compaction
+  generation = gen;
+  chunks = std::move(new_chunks);
+  contents = std::move(new_contents);
+  index = std::move(new_index);
+  chunks_fd = std::move(new_chunks_fd);
+  data_fd = std::move(new_data_fd);
+  index_fd = std::move(new_index_fd);
+  index_entries = live_chunks;
+  referenced_bytes = new_referenced_bytes;
+  unused_chunks = 0;
+  unused_bytes = 0;
+  reclaimed_chunks = new_reclaimed_chunks;
+  write_state();
+  SyncState(state_fd);
+
+  remove_stale_files();
+}
+
+store_stats chunk_store::stats() const
+{
+  std::shared_lock lock(mutex);
+  store_stats result;
+  result.chunks = chunks.size() - reclaimed_chunks;
+  result.unused_chunks = unused_chunks;
+  result.unused_bytes = unused_bytes;
+  result.stored_bytes = contents.size();
+  result.referenced_bytes = referenced_bytes;
+  return result;
+}
+
+void chunk_store::write_state()
+{
+  store_state state{};
+  std::memcpy(state.magic, store_magic, sizeof(store_magic));
+  state.generation = generation;
+  state.chunk_count = chunks.size();
+  state.data_size = contents.size();
+  state.index_entries = index_entries;
+  state.referenced_bytes = referenced_bytes;
+  state.unused_chunks = unused_chunks;
+  state.unused_bytes = unused_bytes;
+  state.reclaimed_chunks = reclaimed_chunks;
+  WriteState(state_fd, state);
+}
+
+void chunk_store::check_id(std::uint64_t id) const
+{
+  if (id >= chunks.size()) {
+    throw std::out_of_range("chunk " + std::to_string(id)
+                            + " does not exist.");
+  }
+}
+
+}  // namespace dedup
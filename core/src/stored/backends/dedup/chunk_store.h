@@ -0,0 +1,142 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can modify it under the terms of
+   version three of the GNU Affero General Public License as published by the
+   Free Software Foundation, which is listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#ifndef BAREOS_STORED_BACKENDS_DEDUP_CHUNK_STORE_H_
+#define BAREOS_STORED_BACKENDS_DEDUP_CHUNK_STORE_H_
+
+#include "fvec.h"
+#include "util.h"
+
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+namespace dedup {
+
+struct chunk_entry {
+  std::uint64_t hash_low;
+  std::uint64_t hash_high;
+  std::uint64_t offset; /* start of the chunk inside the data file */
+  std::uint32_t size;   /* 0 once the chunk was reclaimed */
+  std::uint32_t refcount; /* number of volume parts referencing this chunk */
+};
+
+/* Slot of the on-disk hash table mapping the lower half of the hash to the
+ * chunks with that hash; it uses linear probing. */
+struct index_slot {
+  std::uint64_t hash_low;
+  std::uint64_t chunk; /* id + 1, 0 if the slot is empty */
+};
+
+struct store_state {
+  char magic[8];
+  std::uint64_t generation; /* suffix of the chunks, index and data files */
+  std::uint64_t chunk_count;
+  std::uint64_t data_size;
+  std::uint64_t index_entries;
+  std::uint64_t referenced_bytes;
+  std::uint64_t unused_chunks;
+  std::uint64_t unused_bytes;
+  std::uint64_t reclaimed_chunks;
+};
+
+struct store_stats {
+  std::uint64_t chunks{0};
+  std::uint64_t unused_chunks{0};
+  std::uint64_t unused_bytes{0};
+  std::uint64_t stored_bytes{0};
+  std::uint64_t referenced_bytes{0};
+};
+
+/* The chunk store holds the deduplicated data of all volumes of one
+ * archive device: a list of all known chunks, a data file containing their
+ * contents and a hash table to find them by content.  Chunks are reference
+ * counted by the volumes using them.  Chunks whose count drops to zero get
+ * reused if the same data shows up again, until compact() drops them from
+ * the data file.
+ *
+ * Compacting writes a new generation of all three files and switches to it
+ * by updating the state file, so the store survives a crash at any point.
+ * Chunk ids never change; reclaimed chunks keep their (empty) entry.
+ *
+ * Changes are only made durable by flush().  After a crash, volumes may hold
+ * fewer references than the store counts, so chunks may leak, but a chunk
+ * is never reclaimed while a flushed volume still uses it.
+ *
+ * A store can be used by multiple devices at once; use Open() to get the
+ * shared instance. */
+class chunk_store {
+ public:
+  static std::shared_ptr<chunk_store> Open(const std::string& path);
+
+  chunk_store(const std::string& path, bool read_only);
+  chunk_store(const chunk_store&) = delete;
+  chunk_store& operator=(const chunk_store&) = delete;
+
+  bool read_only() const { return !writable; }
+
+  // stores the data if it is not already known and takes a reference to it
+  std::uint64_t ref(const char* data, std::size_t size);
+  void unref(std::uint64_t id);
+
+  // appends the chunk contents to out
+  void read(std::uint64_t id, std::vector<char>& out) const;
+
+  // makes all changes durable
+  void flush();
+
+  // true if enough of the data file is unused to make compact() worthwhile
+  bool compaction_due() const;
+  // drops the contents of all unused chunks from the data file
+  void compact();
+
+  store_stats stats() const;
+
+ private:
+  std::string path;
+  bool writable;
+  std::uint64_t generation{0};
+  raii_fd state_fd;
+  raii_fd chunks_fd;
+  raii_fd index_fd;
+  raii_fd data_fd;
+  fvec<chunk_entry> chunks;
+  fvec<index_slot> index;
+  fvec<char> contents;
+  std::uint64_t index_entries{0};
+  std::uint64_t referenced_bytes{0};
+  std::uint64_t unused_chunks{0};
+  std::uint64_t unused_bytes{0};
+  std::uint64_t reclaimed_chunks{0};
+  mutable std::shared_mutex mutex;
+
+  std::string file_name(const char* name, std::uint64_t gen) const;
+  void open_files(const store_state& state);
+  void remove_stale_files() const;
+  void rebuild_index(std::uint64_t slots);
+  void write_state();
+  void check_id(std::uint64_t id) const;
+};
+
+}  // namespace dedup
+
+#endif  // BAREOS_STORED_BACKENDS_DEDUP_CHUNK_STORE_H_
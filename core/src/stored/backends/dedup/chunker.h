@@ -0,0 +1,119 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can modify it under the terms of
+   version three of the GNU Affero General Public License as published by the
+   Free Software Foundation, which is listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#ifndef BAREOS_STORED_BACKENDS_DEDUP_CHUNKER_H_
+#define BAREOS_STORED_BACKENDS_DEDUP_CHUNKER_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+namespace dedup {
+
+namespace detail {
+constexpr std::array<std::uint64_t, 256> MakeGearTable()
+{
+  // splitmix64; the table must never change as it determines where
+  // chunks start, i.e. which data can be deduplicated against older volumes.
+  std::array<std::uint64_t, 256> table{};
+  std::uint64_t state = 0x6261726565736464ull;
+  for (auto& entry : table) {
+    state += 0x9e3779b97f4a7c15ull;
+    std::uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    entry = z ^ (z >> 31);
+  }
+  return table;
+}
+
+inline constexpr auto gear_table = MakeGearTable();
+
+constexpr unsigned Log2(std::size_t value)
+{
+  unsigned bits = 0;
+  while (value >>= 1) { bits += 1; }
+  return bits;
+}
+}  // namespace detail
+
+/* Content defined chunking with a gear rolling hash and normalized chunk
+ * sizes (FastCDC).  Boundaries only depend on the last few bytes before
+ * them, so inserting or removing data only changes the chunks around the
+ * modification. */
+class chunker {
+ public:
+  explicit chunker(std::size_t t_avg_size = 8 * 1024)
+      : min_size{t_avg_size / 4}
+      , avg_size{t_avg_size}
+      , max_size{t_avg_size * 8}
+      , mask_hard{Mask(detail::Log2(t_avg_size) + 1)}
+      , mask_easy{Mask(detail::Log2(t_avg_size) - 1)}
+  {
+    if (t_avg_size < 256 || t_avg_size > 1024 * 1024) {
+      throw std::invalid_argument("average chunk size out of range");
+    }
+  }
+
+  std::size_t min_chunk_size() const { return min_size; }
+  std::size_t avg_chunk_size() const { return avg_size; }
+  std::size_t max_chunk_size() const { return max_size; }
+
+  // returns the size of the chunk starting at data
+  std::size_t next_boundary(const char* data, std::size_t size) const
+  {
+    if (size <= min_size) { return size; }
+
+    std::size_t normal = size < avg_size ? size : avg_size;
+    std::size_t end = size < max_size ? size : max_size;
+    std::uint64_t hash = 0;
+    std::size_t i = min_size;
+
+    for (; i < normal; ++i) {
+      hash = (hash << 1)
+             + detail::gear_table[static_cast<unsigned char>(data[i])];
+      if ((hash & mask_hard) == 0) { return i + 1; }
+    }
+    for (; i < end; ++i) {
+      hash = (hash << 1)
+             + detail::gear_table[static_cast<unsigned char>(data[i])];
+      if ((hash & mask_easy) == 0) { return i + 1; }
+    }
+    return end;
+  }
+
+ private:
+  std::size_t min_size;
+  std::size_t avg_size;
+  std::size_t max_size;
+  std::uint64_t mask_hard;
+  std::uint64_t mask_easy;
+
+  // the highest bits depend on the most bytes, so we use those
+  static constexpr std::uint64_t Mask(unsigned bits)
+  {
+    return ~std::uint64_t{0} << (64 - bits);
+  }
+};
+
+}  // namespace dedup
+
+#endif  // BAREOS_STORED_BACKENDS_DEDUP_CHUNKER_H_
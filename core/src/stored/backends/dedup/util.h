@@ -0,0 +1,100 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can modify it under the terms of
+   version three of the GNU Affero General Public License as published by the
+   Free Software Foundation, which is listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#ifndef BAREOS_STORED_BACKENDS_DEDUP_UTIL_H_
+#define BAREOS_STORED_BACKENDS_DEDUP_UTIL_H_
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <utility>
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+namespace dedup {
+
+template <typename... Args> std::system_error error(Args&&... args)
+{
+  return std::system_error(errno, std::generic_category(),
+                           std::forward<Args>(args)...);
+}
+
+// owning file descriptor
+class raii_fd {
+ public:
+  raii_fd() = default;
+  raii_fd(const std::string& path, int flags, int mode = 0640)
+      : fd{::open(path.c_str(), flags, mode)}
+  {
+    if (fd < 0) { throw error("open(" + path + ")"); }
+  }
+
+  raii_fd(const raii_fd&) = delete;
+  raii_fd& operator=(const raii_fd&) = delete;
+  raii_fd(raii_fd&& other) { *this = std::move(other); }
+  raii_fd& operator=(raii_fd&& other)
+  {
+    std::swap(fd, other.fd);
+    return *this;
+  }
+
+  int get() const { return fd; }
+
+  ~raii_fd()
+  {
+    if (fd >= 0) { ::close(fd); }
+  }
+
+ private:
+  int fd{-1};
+};
+
+/* Small fixed size header files that store how much of the (overallocated)
+ * mmapped files is actually in use.  They are rewritten in place. */
+template <typename T> bool ReadState(const raii_fd& fd, T& state)
+{
+  auto res = ::pread(fd.get(), &state, sizeof(state), 0);
+  if (res < 0) { throw error("pread(state)"); }
+  return static_cast<std::size_t>(res) == sizeof(state);
+}
+
+template <typename T> void WriteState(const raii_fd& fd, const T& state)
+{
+  auto res = ::pwrite(fd.get(), &state, sizeof(state), 0);
+  if (res < 0) { throw error("pwrite(state)"); }
+  if (static_cast<std::size_t>(res) != sizeof(state)) {
+    errno = EIO;
+    throw error("pwrite(state)");
+  }
+}
+
+inline void SyncState(const raii_fd& fd)
+{
+  if (::fsync(fd.get()) < 0) { throw error("fsync(state)"); }
+}
+
+}  // namespace dedup
+
+#endif  // BAREOS_STORED_BACKENDS_DEDUP_UTIL_H_
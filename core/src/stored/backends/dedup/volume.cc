@@ -0,0 +1,285 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can modify it under the terms of
+   version three of the GNU Affero General Public License as published by the
+   Free Software Foundation, which is listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "volume.h"
+
+#include <algorithm>
+#include <limits>
+
+extern "C" {
+#include <arpa/inet.h>
+}
+
+namespace dedup {
+
+namespace {
+constexpr char volume_magic[8] = {'B', 'A', 'R', 'D', 'V', 'O', 'L', '1'};
+
+// see stored/block.h
+constexpr std::size_t block_header_size = 24;
+constexpr std::size_t record_header_size = 12;
+constexpr char block_id[4] = {'B', 'B', '0', '2'};
+
+/* Chunks smaller than this are kept inside the volume; the bookkeeping
+ * inside the chunk store would cost more than it could save. */
+constexpr std::size_t min_dedup_size = 256;
+
+std::uint32_t ReadNetworkInt(const char* data)
+{
+  std::uint32_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return ntohl(value);
+}
+}  // namespace
+
+volume::volume(const std::string& path, bool read_only) : writable{!read_only}
+{
+  if (writable && ::mkdir(path.c_str(), 0750) < 0 && errno != EEXIST) {
+    throw error("mkdir(" + path + ")");
+  }
+
+  int flags = read_only ? O_RDONLY : (O_RDWR | O_CREAT);
+  state_fd = raii_fd(path + "/state", flags);
+
+  volume_state state{};
+  if (ReadState(state_fd, state)) {
+    if (std::memcmp(state.magic, volume_magic, sizeof(volume_magic)) != 0) {
+      throw std::runtime_error(path + " is not a dedup volume.");
+    }
+  } else if (writable) {
+    std::memcpy(state.magic, volume_magic, sizeof(volume_magic));
+    WriteState(state_fd, state);
+  } else {
+    throw std::runtime_error(path + " is not a dedup volume.");
+  }
+
+  blocks_fd = raii_fd(path + "/blocks", flags);
+  parts_fd = raii_fd(path + "/parts", flags);
+  raw_fd = raii_fd(path + "/raw", flags);
+  blocks = fvec<block_entry>(read_only, blocks_fd.get(), state.block_count);
+  parts = fvec<part_entry>(read_only, parts_fd.get(), state.part_count);
+  raw = fvec<char>(read_only, raw_fd.get(), state.raw_size);
+
+  for (const auto& block : blocks) {
+    if (block.offset != volume_size
+        || block.part_begin + block.part_count > parts.size()) {
+      throw std::runtime_error(path + " has a corrupted block list.");
+    }
+    volume_size += block.size;
+  }
+}
+
+std::uint64_t volume::find_block(std::uint64_t offset) const
+{
+  auto it = std::upper_bound(
+      blocks.begin(), blocks.end(), offset,
+      [](std::uint64_t off, const block_entry& b) { return off < b.offset; });
+  if (it == blocks.begin()) { return block_count(); }
+  --it;
+  if (offset >= it->offset + it->size) { return block_count(); }
+  return it - blocks.begin();
+}
+
+void volume::add_raw(std::uint64_t part_begin,
+                     const char* data,
+                     std::size_t size)
+{
+  if (size == 0) { return; }
+
+  if (parts.size() > part_begin) {
+    auto& last = parts[parts.size() - 1];
+    if (last.type == part_type::Raw && last.location + last.size == raw.size()
+        && last.size + size <= std::numeric_limits<std::uint32_t>::max()) {
+      last.size += size;
+      raw.append_range(data, size);
+      return;
+    }
+  }
+
+  parts.push_back(
+      part_entry{raw.size(), static_cast<std::uint32_t>(size), part_type::Raw});
+  raw.append_range(data, size);
+}
+
+void volume::add_payload(chunk_store& store,
+                         const chunker& chunker,
+                         std::uint64_t part_begin,
+                         const char* data,
+                         std::size_t size)
+{
+  while (size > 0) {
+    std::size_t chunk_size = chunker.next_boundary(data, size);
+    if (chunk_size < min_dedup_size) {
+      add_raw(part_begin, data, chunk_size);
+    } else {
+      parts.push_back(part_entry{store.ref(data, chunk_size),
+                                 static_cast<std::uint32_t>(chunk_size),
+                                 part_type::Chunk});
+    }
+    data += chunk_size;
+    size -= chunk_size;
+  }
+}
+
+void volume::append_block(chunk_store& store,
+                          const chunker& chunker,
+                          const char* data,
+                          std::size_t size)
+{
+  if (!writable) {
+    errno = EROFS;
+    throw error("volume is read only");
+  }
+  if (size > std::numeric_limits<std::uint32_t>::max()) {
+    throw std::invalid_argument("block too big");
+  }
+
+  std::uint64_t part_begin = parts.size();
+
+  if (size >= block_header_size
+      && std::memcmp(data + 12, block_id, sizeof(block_id)) == 0) {
+    /* Only the record payloads are worth deduplicating; the headers contain
+     * the session and block numbers and would never match anything. */
+    std::size_t block_len = std::min<std::size_t>(ReadNetworkInt(data + 4),
+                                                  size);
+    std::size_t pos = std::min(block_header_size, block_len);
+    add_raw(part_begin, data, pos);
+    while (pos + record_header_size <= block_len) {
+      std::size_t data_len = ReadNetworkInt(data + pos + 8);
+      add_raw(part_begin, data + pos, record_header_size);
+      pos += record_header_size;
+
+      std::size_t payload = std::min(data_len, block_len - pos);
+      add_payload(store, chunker, part_begin, data + pos, payload);
+      pos += payload;
+    }
+    add_raw(part_begin, data + pos, size - pos);
+  } else {
+    add_payload(store, chunker, part_begin, data, size);
+  }
+
+  blocks.push_back(block_entry{volume_size, part_begin,
+                               static_cast<std::uint32_t>(size),
+                               static_cast<std::uint32_t>(parts.size()
+                                                          - part_begin)});
+  volume_size += size;
+}
+
+void volume::read_block(const chunk_store& store,
+                        std::uint64_t idx,
+                        std::vector<char>& out) const
+{
+  if (idx >= block_count()) {
+    throw std::out_of_range("block " + std::to_string(idx)
+                            + " does not exist.");
+  }
+
+  const auto& block = blocks[idx];
+  out.clear();
+  out.reserve(block.size);
+  for (std::uint64_t i = 0; i < block.part_count; ++i) {
+    const auto& part = parts[block.part_begin + i];
+    switch (part.type) {
+      case part_type::Raw: {
+        if (part.location + part.size > raw.size()) {
+          throw std::runtime_error("raw part lies outside of the volume.");
+        }
+        const char* begin = raw.data() + part.location;
+        out.insert(out.end(), begin, begin + part.size);
+      } break;
+      case part_type::Chunk: {
+        store.read(part.location, out);
+      } break;
+      default: {
+        throw std::runtime_error("unknown part type.");
+      }
+    }
+  }
+
+  if (out.size() != block.size) {
+    throw std::runtime_error("block " + std::to_string(idx)
+                             + " has the wrong size.");
+  }
+}
+
+void volume::truncate(chunk_store& store, std::uint64_t offset)
+{
+  if (!writable) {
+    errno = EROFS;
+    throw error("volume is read only");
+  }
+  if (offset == volume_size) { return; }
+
+  std::uint64_t idx = find_block(offset);
+  if (idx == block_count() || blocks[idx].offset != offset) {
+    throw std::invalid_argument("cannot truncate volume to "
+                                + std::to_string(offset)
+                                + " as it is not a block boundary.");
+  }
+
+  std::uint64_t part_begin = blocks[idx].part_begin;
+  std::uint64_t raw_size = raw.size();
+  bool found_raw = false;
+  std::vector<std::uint64_t> released;
+  for (std::uint64_t i = part_begin; i < parts.size(); ++i) {
+    const auto& part = parts[i];
+    if (part.type == part_type::Chunk) {
+      released.push_back(part.location);
+    } else if (!found_raw) {
+      // raw parts are appended in order, so the first one is the lowest
+      raw_size = part.location;
+      found_raw = true;
+    }
+  }
+
+  blocks.resize_uninitialized(idx);
+  parts.resize_uninitialized(part_begin);
+  raw.resize_uninitialized(raw_size);
+  volume_size = offset;
+
+  /* The volume must not use the chunks anymore, before they can be
+   * reclaimed: a crash should only ever leak chunks. */
+  store.flush();
+  flush();
+  for (auto id : released) { store.unref(id); }
+}
+
+void volume::flush()
+{
+  if (!writable) { return; }
+
+  blocks.flush();
+  parts.flush();
+  raw.flush();
+  write_state();
+  SyncState(state_fd);
+}
+
+void volume::write_state()
+{
+  volume_state state{};
+  std::memcpy(state.magic, volume_magic, sizeof(volume_magic));
+  state.block_count = blocks.size();
+  state.part_count = parts.size();
+  state.raw_size = raw.size();
+  WriteState(state_fd, state);
+}
+
+}  // namespace dedup
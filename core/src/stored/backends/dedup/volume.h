@@ -0,0 +1,119 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can modify it under the terms of
+   version three of the GNU Affero General Public License as published by the
+   Free Software Foundation, which is listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#ifndef BAREOS_STORED_BACKENDS_DEDUP_VOLUME_H_
+#define BAREOS_STORED_BACKENDS_DEDUP_VOLUME_H_
+
+#include "chunk_store.h"
+#include "chunker.h"
+#include "fvec.h"
+#include "util.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dedup {
+
+struct block_entry {
+  std::uint64_t offset;     /* start of the block inside the volume */
+  std::uint64_t part_begin; /* first part of the block */
+  std::uint32_t size;
+  std::uint32_t part_count;
+};
+
+enum class part_type : std::uint32_t
+{
+  Raw = 0,   /* location is an offset into the raw file */
+  Chunk = 1, /* location is the id of a chunk inside the chunk store */
+};
+
+struct part_entry {
+  std::uint64_t location;
+  std::uint32_t size;
+  part_type type;
+};
+
+struct volume_state {
+  char magic[8];
+  std::uint64_t block_count;
+  std::uint64_t part_count;
+  std::uint64_t raw_size;
+};
+
+/* A volume is a directory containing the list of its blocks.  Every block is
+ * split into parts: block and record headers are kept verbatim inside the
+ * volume (raw parts), while record payloads are cut into content defined
+ * chunks which are stored inside the chunk store.  Reading a block puts the
+ * parts back together, so the device returns exactly what was written. */
+class volume {
+ public:
+  volume(const std::string& path, bool read_only);
+  volume(const volume&) = delete;
+  volume& operator=(const volume&) = delete;
+
+  bool read_only() const { return !writable; }
+  std::uint64_t size() const { return volume_size; }
+  std::uint64_t block_count() const { return blocks.size(); }
+  std::uint64_t block_offset(std::uint64_t idx) const
+  {
+    return blocks[idx].offset;
+  }
+
+  // returns the block containing offset or block_count() if there is none
+  std::uint64_t find_block(std::uint64_t offset) const;
+
+  void append_block(chunk_store& store,
+                    const chunker& chunker,
+                    const char* data,
+                    std::size_t size);
+  // replaces the contents of out with the contents of the block
+  void read_block(const chunk_store& store,
+                  std::uint64_t idx,
+                  std::vector<char>& out) const;
+  // drops all blocks starting at offset, which needs to be a block boundary
+  void truncate(chunk_store& store, std::uint64_t offset);
+  /* makes the appended blocks durable; the store needs to be flushed first,
+   * as the volume may only use chunks that are on disk */
+  void flush();
+
+ private:
+  bool writable;
+  raii_fd state_fd;
+  raii_fd blocks_fd;
+  raii_fd parts_fd;
+  raii_fd raw_fd;
+  fvec<block_entry> blocks;
+  fvec<part_entry> parts;
+  fvec<char> raw;
+  std::uint64_t volume_size{0};
+
+  void add_raw(std::uint64_t part_begin, const char* data, std::size_t size);
+  void add_payload(chunk_store& store,
+                   const chunker& chunker,
+                   std::uint64_t part_begin,
+                   const char* data,
+                   std::size_t size);
+  void write_state();
+};
+
+}  // namespace dedup
+
+#endif  // BAREOS_STORED_BACKENDS_DEDUP_VOLUME_H_
@@ -0,0 +1,337 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can modify it under the terms of
+   version three of the GNU Affero General Public License as published by the
+   Free Software Foundation, which is listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Deduplicating device using content defined chunking.
+ */
+
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "stored/sd_backends.h"
+#include "stored/device_status_information.h"
+#include "stored/backends/dedup_device.h"
+#include "lib/edit.h"
+
+#include <algorithm>
+#include <system_error>
+
+namespace storagedaemon {
+
+// Options that can be specified for this device type.
+enum device_option_type
+{
+  argument_none = 0,
+  argument_store,
+  argument_chunksize
+};
+
+struct device_option {
+  const char* name;
+  enum device_option_type type;
+  int compare_size;
+};
+
+static device_option device_options[] = {{"store=", argument_store, 6},
+                                         {"chunksize=", argument_chunksize, 10},
+                                         {NULL, argument_none, 0}};
+
+bool dedup_device::ParseDeviceOptions()
+{
+  store_path_ = std::string{archive_device_string} + "/.dedup";
+
+  if (dev_options) {
+    std::string options{dev_options};
+    std::size_t begin = 0;
+    while (begin <= options.size()) {
+      std::size_t end = options.find(',', begin);
+      if (end == std::string::npos) { end = options.size(); }
+      std::string option = options.substr(begin, end - begin);
+      begin = end + 1;
+      if (option.empty()) { continue; }
+
+      bool done = false;
+      for (int i = 0; !done && device_options[i].name; i++) {
+        // Try to find a matching device option.
+        if (bstrncasecmp(option.c_str(), device_options[i].name,
+                         device_options[i].compare_size)) {
+          const char* value
+              = option.c_str() + device_options[i].compare_size;
+          switch (device_options[i].type) {
+            case argument_store:
+              store_path_ = value;
+              break;
+            case argument_chunksize: {
+              uint64_t size;
+              if (!size_to_uint64(value, &size)) {
+                Mmsg1(errmsg, T_("Unable to parse chunksize: %s\n"), value);
+                return false;
+              }
+              try {
+                chunker_ = dedup::chunker(size);
+              } catch (const std::invalid_argument&) {
+                Mmsg1(errmsg,
+                      T_("Chunksize %s is outside of the allowed range "
+                         "[256, 1M]\n"),
+                      value);
+                return false;
+              }
+            } break;
+            default:
+              break;
+          }
+          done = true;
+        }
+      }
+
+      if (!done) {
+        Mmsg1(errmsg, T_("Unable to parse device option: %s\n"),
+              option.c_str());
+        return false;
+      }
+    }
+  }
+
+  options_parsed_ = true;
+  return true;
+}
+
+void dedup_device::SetError(const std::exception& e)
+{
+  if (auto* se = dynamic_cast<const std::system_error*>(&e)) {
+    errno = se->code().value();
+  } else {
+    errno = EIO;
+  }
+  dev_errno = errno;
+  Mmsg2(errmsg, T_("Dedup device %s: %s\n"), prt_name, e.what());
+}
+
+int dedup_device::d_open(const char* pathname, int flags, int)
+{
+  if (!options_parsed_ && !ParseDeviceOptions()) {
+    Emsg0(M_FATAL, 0, errmsg);
+    errno = EINVAL;
+    return -1;
+  }
+
+  try {
+    if (!store_) { store_ = dedup::chunk_store::Open(store_path_); }
+
+    bool read_only = (flags & O_ACCMODE) == O_RDONLY;
+    if (!read_only && store_->read_only()) {
+      errno = EROFS;
+      throw dedup::error("chunk store " + store_path_
+                         + " is in use or not writable");
+    }
+    if (!(flags & O_CREAT) && ::access(pathname, F_OK) != 0) {
+      throw dedup::error(std::string{"open("} + pathname + ")");
+    }
+
+    volume_ = std::make_unique<dedup::volume>(pathname, read_only);
+    if (flags & O_TRUNC) { volume_->truncate(*store_, 0); }
+  } catch (const std::exception& e) {
+    volume_.reset();
+    SetError(e);
+    return -1;
+  }
+
+  position_ = 0;
+  buffered_block_ = no_block;
+  return 0;
+}
+
+ssize_t dedup_device::d_read(int, void* buffer, size_t count)
+{
+  if (!volume_) {
+    errno = EBADF;
+    return -1;
+  }
+
+  try {
+    if (position_ >= volume_->size()) { return 0; }
+
+    auto idx = volume_->find_block(position_);
+    if (idx != buffered_block_) {
+      buffered_block_ = no_block;
+      volume_->read_block(*store_, idx, block_buffer_);
+      buffered_block_ = idx;
+    }
+
+    std::size_t offset = position_ - volume_->block_offset(idx);
+    std::size_t size = std::min(count, block_buffer_.size() - offset);
+    std::memcpy(buffer, block_buffer_.data() + offset, size);
+    position_ += size;
+    return size;
+  } catch (const std::exception& e) {
+    SetError(e);
+    return -1;
+  }
+}
+
+ssize_t dedup_device::d_write(int, const void* buffer, size_t count)
+{
+  if (!volume_) {
+    errno = EBADF;
+    return -1;
+  }
+  if (count == 0) { return 0; }
+
+  try {
+    if (position_ < volume_->size()) {
+      // overwriting data is only possible by dropping everything after it
+      buffered_block_ = no_block;
+      volume_->truncate(*store_, position_);
+    } else if (position_ > volume_->size()) {
+      errno = EINVAL;
+      throw dedup::error("cannot write behind the end of the volume");
+    }
+
+    volume_->append_block(*store_, chunker_,
+                          static_cast<const char*>(buffer), count);
+    position_ += count;
+    return count;
+  } catch (const std::exception& e) {
+    SetError(e);
+    return -1;
+  }
+}
+
+int dedup_device::d_close(int)
+{
+  int status = 0;
+  if (volume_) {
+    try {
+      store_->flush();
+      volume_->flush();
+      if (store_->compaction_due()) {
+        Dmsg1(100, "Compacting chunk store %s\n", store_path_.c_str());
+        store_->compact();
+      }
+    } catch (const std::exception& e) {
+      SetError(e);
+      status = -1;
+    }
+    volume_.reset();
+  }
+  buffered_block_ = no_block;
+  block_buffer_.clear();
+  return status;
+}
+
+int dedup_device::d_ioctl(int, ioctl_req_t, char*) { return -1; }
+
+boffset_t dedup_device::d_lseek(DeviceControlRecord*,
+                                boffset_t offset,
+                                int whence)
+{
+  if (!volume_) {
+    errno = EBADF;
+    return -1;
+  }
+
+  boffset_t base;
+  switch (whence) {
+    case SEEK_SET:
+      base = 0;
+      break;
+    case SEEK_CUR:
+      base = position_;
+      break;
+    case SEEK_END:
+      base = volume_->size();
+      break;
+    default:
+      errno = EINVAL;
+      return -1;
+  }
+
+  if (offset < 0 && base < -offset) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  position_ = base + offset;
+  return position_;
+}
+
+bool dedup_device::d_truncate(DeviceControlRecord*)
+{
+  if (!volume_) {
+    Mmsg1(errmsg, T_("Unable to truncate device %s. Volume not open.\n"),
+          prt_name);
+    return false;
+  }
+
+  try {
+    buffered_block_ = no_block;
+    volume_->truncate(*store_, 0);
+    position_ = 0;
+  } catch (const std::exception& e) {
+    SetError(e);
+    Mmsg2(errmsg, T_("Unable to truncate device %s. ERR=%s\n"), prt_name,
+          e.what());
+    return false;
+  }
+
+  return true;
+}
+
+bool dedup_device::d_flush(DeviceControlRecord*)
+{
+  if (!volume_) { return true; }
+
+  try {
+    // the volume may only reference chunks that are already on disk
+    store_->flush();
+    volume_->flush();
+  } catch (const std::exception& e) {
+    SetError(e);
+    return false;
+  }
+
+  return true;
+}
+
+bool dedup_device::DeviceStatus(DeviceStatusInformation* dst)
+{
+  if (!store_) { return false; }
+
+  auto stats = store_->stats();
+  PoolMem status(PM_MESSAGE);
+  char ed1[50], ed2[50], ed3[50], ed4[50], ed5[50];
+
+  status.bsprintf(T_("Chunk store %s%s:\n"), store_path_.c_str(),
+                  store_->read_only() ? T_(" (read only)") : "");
+  dst->status_length = PmStrcpy(dst->status, status.c_str());
+  status.bsprintf(T_("   %s chunks (%s unused), %s bytes stored "
+                     "(%s unused), %s bytes referenced\n"),
+                  edit_uint64_with_commas(stats.chunks, ed1),
+                  edit_uint64_with_commas(stats.unused_chunks, ed2),
+                  edit_uint64_with_commas(stats.stored_bytes, ed3),
+                  edit_uint64_with_commas(stats.unused_bytes, ed4),
+                  edit_uint64_with_commas(stats.referenced_bytes, ed5));
+  dst->status_length = PmStrcat(dst->status, status.c_str());
+
+  return true;
+}
+
+REGISTER_SD_BACKEND(dedup, dedup_device);
+
+} /* namespace storagedaemon */
@@ -0,0 +1,78 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can modify it under the terms of
+   version three of the GNU Affero General Public License as published by the
+   Free Software Foundation, which is listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+// Deduplicating device using content defined chunking.
+
+#ifndef BAREOS_STORED_BACKENDS_DEDUP_DEVICE_H_
+#define BAREOS_STORED_BACKENDS_DEDUP_DEVICE_H_
+
+#include "stored/dev.h"
+#include "dedup/chunk_store.h"
+#include "dedup/chunker.h"
+#include "dedup/volume.h"
+
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace storagedaemon {
+
+/* Every volume is a directory below the archive device.  The deduplicated
+ * data is shared between all volumes of the device and lives inside a chunk
+ * store, by default in the directory ".dedup" of the archive device. */
+class dedup_device : public Device {
+ public:
+  dedup_device() = default;
+  ~dedup_device() { close(nullptr); }
+
+  // Interface from Device
+  SeekMode GetSeekMode() const override { return SeekMode::BYTES; }
+  bool DeviceStatus(DeviceStatusInformation* dst) override;
+  int d_close(int) override;
+  int d_open(const char* pathname, int flags, int mode) override;
+  int d_ioctl(int fd, ioctl_req_t request, char* mt = NULL) override;
+  boffset_t d_lseek(DeviceControlRecord* dcr,
+                    boffset_t offset,
+                    int whence) override;
+  ssize_t d_read(int fd, void* buffer, size_t count) override;
+  ssize_t d_write(int fd, const void* buffer, size_t count) override;
+  bool d_truncate(DeviceControlRecord* dcr) override;
+  bool d_flush(DeviceControlRecord* dcr) override;
+
+ private:
+  bool options_parsed_{false};
+  std::string store_path_{};
+  dedup::chunker chunker_{};
+  std::shared_ptr<dedup::chunk_store> store_{};
+  std::unique_ptr<dedup::volume> volume_{};
+  std::uint64_t position_{0};
+
+  // the last block read; the sd might read it in multiple steps
+  static constexpr std::uint64_t no_block = ~std::uint64_t{0};
+  std::uint64_t buffered_block_{no_block};
+  std::vector<char> block_buffer_{};
+
+  bool ParseDeviceOptions();
+  void SetError(const std::exception& e);
+};
+
+} /* namespace storagedaemon */
+
+#endif  // BAREOS_STORED_BACKENDS_DEDUP_DEVICE_H_
@@ -65,7 +65,10 @@ enum device_option_type
   argument_iothreads,
   argument_ioslots,
   argument_retries,
-  argument_mmap
+  argument_mmap,
+  argument_readahead,
+  argument_chunkcache,
+  argument_chunkcachesize
 };
 
 struct device_option {
@@ -85,6 +88,9 @@ static device_option device_options[]
        {"ioslots=", argument_ioslots, 8},
        {"retries=", argument_retries, 8},
        {"mmap", argument_mmap, 4},
+       {"readahead=", argument_readahead, 10},
+       {"chunkcache=", argument_chunkcache, 11},
+       {"chunkcachesize=", argument_chunkcachesize, 15},
        {NULL, argument_none, 0}};
 
 static int droplet_reference_count = 0;
@@ -159,20 +165,6 @@ static inline int DropletErrnoToSystemErrno(dpl_status_t status)
 }
 
 
-// Callback for getting the total size of a chunked volume.
-static dpl_status_t chunked_volume_size_callback(dpl_sysmd_t* sysmd,
-                                                 dpl_ctx_t*,
-                                                 const char*,
-                                                 void* data)
-{
-  dpl_status_t status = DPL_SUCCESS;
-  ssize_t* volumesize = (ssize_t*)data;
-
-  *volumesize = *volumesize + sysmd->size;
-
-  return status;
-}
-
 /*
  * Callback for truncating a chunked volume.
  *
@@ -220,11 +212,12 @@ bool DropletDevice::ForEachChunkInDirectoryRunCallback(
   PoolMem path(PM_NAME);
 
   bool found = true;
-  int i = 0;
+  uint32_t i = 0;
+  uint32_t gap = 0;
   int tries = 0;
 
   while ((i < max_chunks_) && (found) && (retval)) {
-    path.bsprintf("%s/%04d", dirname, i);
+    path.bsprintf("%s/%04u", dirname, i);
 
     auto sysmd = dpl_sysmd_dup(&sysmd_);
     status = dpl_getattr(ctx_,         /* context */
@@ -238,6 +231,7 @@ bool DropletDevice::ForEachChunkInDirectoryRunCallback(
         callback_status = callback(sysmd, ctx_, path.c_str(), data);
         if (callback_status == DPL_SUCCESS) {
           i++;
+          gap = 0;
         } else {
           Mmsg2(errmsg, T_("Operation failed on chunk %s: ERR=%s."),
                 path.c_str(), dpl_status_str(callback_status));
@@ -247,7 +241,9 @@ bool DropletDevice::ForEachChunkInDirectoryRunCallback(
         }
         break;
       case DPL_ENOENT:
-        if (ignore_gaps) {
+        /* Checking every possible chunk name would take ages, so give up
+         * after as many missing chunks as a volume used to have at most. */
+        if (ignore_gaps && ++gap < LEGACY_MAX_CHUNKS) {
           Dmsg1(1000, "chunk %s does not exist. Skipped.\n", path.c_str());
           i++;
         } else {
@@ -408,7 +404,7 @@ bool DropletDevice::FlushRemoteChunk(chunk_io_request* request)
   PoolMem chunk_dir(PM_FNAME), chunk_name(PM_FNAME);
 
   Mmsg(chunk_dir, "/%s", request->volname);
-  Mmsg(chunk_name, "%s/%04d", chunk_dir.c_str(), request->chunk);
+  Mmsg(chunk_name, "%s/%04u", chunk_dir.c_str(), request->chunk);
 
   // Set that we are uploading the chunk.
   if (!SetInflightChunk(request)) { return false; }
@@ -543,7 +539,7 @@ bool DropletDevice::ReadRemoteChunk(chunk_io_request* request)
   dpl_sysmd_t* sysmd = NULL;
   PoolMem chunk_name(PM_FNAME);
 
-  Mmsg(chunk_name, "/%s/%04d", request->volname, request->chunk);
+  Mmsg(chunk_name, "/%s/%04u", request->volname, request->chunk);
   Dmsg1(100, "Reading chunk %s\n", chunk_name.c_str());
 
   // See if chunk exists.
@@ -678,6 +674,12 @@ bool DropletDevice::TruncateRemoteVolume(DeviceControlRecord*)
   return true;
 }
 
+// The chunks are stored in the bucket of the profile.
+std::string DropletDevice::BackingStore() const
+{
+  std::string store = profile_ ? profile_ : "";
+  return store + "/" + (bucketname_ ? bucketname_ : "");
+}
 
 bool DropletDevice::d_flush(DeviceControlRecord*)
 {
@@ -784,6 +786,20 @@ bool DropletDevice::initialize()
               use_mmap_ = true;
               done = true;
               break;
+            case argument_readahead:
+              size_to_uint64(bp + device_options[i].compare_size, &value);
+              readahead_chunks_ = value & 0xFF;
+              done = true;
+              break;
+            case argument_chunkcache:
+              chunk_cache_dir_ = bp + device_options[i].compare_size;
+              done = true;
+              break;
+            case argument_chunkcachesize:
+              size_to_uint64(bp + device_options[i].compare_size, &value);
+              chunk_cache_size_ = value;
+              done = true;
+              break;
             default:
               break;
           }
@@ -926,35 +942,53 @@ int DropletDevice::d_close(int) { return CloseChunk(); }
 int DropletDevice::d_ioctl(int, ioctl_req_t, char*) { return -1; }
 
 /**
- * Open a directory on the backing store and find out size information for a
- * volume.
+ * Find out the size of a volume on the backing store.  Looking at every chunk
+ * would take one request per chunk, VolumeSizeFromChunks() only looks at a
+ * few of them.
  */
 ssize_t DropletDevice::RemoteVolumeSize()
 {
-  ssize_t volumesize = 0;
-  dpl_sysmd_t* sysmd = NULL;
   PoolMem chunk_dir(PM_FNAME);
 
   Mmsg(chunk_dir, "/%s", getVolCatName());
 
-  /* FIXME: With the current version of libdroplet a dpl_getattr() on a
-   * directory fails with DPL_ENOENT even when the directory does exist. All
-   * other operations succeed and as ForEachChunkInDirectoryRunCallback() does a
-   * dpl_chdir() anyway that will fail if the directory doesn't exist for now we
-   * should be mostly fine. */
-
   Dmsg1(100, "get RemoteVolumeSize(%s)\n", getVolCatName());
-  if (!ForEachChunkInDirectoryRunCallback(
-          chunk_dir.c_str(), chunked_volume_size_callback, &volumesize)) {
-    /* errno is already set in ForEachChunkInDirectoryRunCallback */
-    volumesize = -1;
-    goto bail_out;
-  }
-
-bail_out:
-  if (sysmd) { dpl_sysmd_free(sysmd); }
+  auto probe = [this, &chunk_dir](uint32_t chunk, uint64_t* size) {
+    PoolMem path(PM_NAME);
+
+    path.bsprintf("%s/%04u", chunk_dir.c_str(), chunk);
+    for (int tries = 1;; tries++) {
+      dpl_sysmd_t* sysmd = dpl_sysmd_dup(&sysmd_);
+      dpl_status_t status = dpl_getattr(ctx_,         /* context */
+                                        path.c_str(), /* locator */
+                                        nullptr,      /* metadata */
+                                        sysmd);       /* sysmd */
+      if (status == DPL_SUCCESS) { *size = sysmd->size; }
+      if (sysmd) { dpl_sysmd_free(sysmd); }
+
+      switch (status) {
+        case DPL_SUCCESS:
+          return ChunkProbe::kFound;
+        case DPL_ENOENT:
+          return ChunkProbe::kMissing;
+        default:
+          if (tries < NUMBER_OF_RETRIES) {
+            Dmsg3(100, "chunk %s failure: %s. Try again (%d).\n", path.c_str(),
+                  dpl_status_str(status), tries);
+            Bmicrosleep(INFLIGT_RETRY_TIME, 0);
+            continue;
+          }
+          Mmsg2(errmsg, T_("Operation failed on chunk %s: ERR=%s."),
+                path.c_str(), dpl_status_str(status));
+          dev_errno = DropletErrnoToSystemErrno(status);
+          return ChunkProbe::kError;
+      }
+    }
+  };
+  ssize_t volumesize = VolumeSizeFromChunks(probe);
 
-  Dmsg2(100, "Size of volume %s: %lld\n", chunk_dir.c_str(), volumesize);
+  Dmsg2(100, "Size of volume %s: %lld\n", chunk_dir.c_str(),
+        (long long)volumesize);
 
   return volumesize;
 }
@@ -50,8 +50,8 @@ typedef dpl_status_t (*t_dpl_walk_chunks_call_back)(dpl_sysmd_t* sysmd,
 
 class DropletDevice : public ChunkedDevice {
  private:
-  /* maximun number of chunks in a volume (0000 to 9999) */
-  const int max_chunks_ = 10000;
+  /* maximun number of chunks in a volume */
+  const uint32_t max_chunks_ = MAX_CHUNKS;
   char* configstring_{};
   const char* profile_{};
   const char* location_{};
@@ -70,6 +70,7 @@ class DropletDevice : public ChunkedDevice {
   bool ReadRemoteChunk(chunk_io_request* request) override;
   ssize_t RemoteVolumeSize() override;
   bool TruncateRemoteVolume(DeviceControlRecord* dcr) override;
+  std::string BackingStore() const override;
   bool ForEachChunkInDirectoryRunCallback(const char* dirname,
                                           t_dpl_walk_chunks_call_back callback,
                                           void* data,
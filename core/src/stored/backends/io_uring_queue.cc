@@ -0,0 +1,353 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation, which is
+   listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Queue of asynchronous writes using the Linux io_uring interface.
+ *
+ * The ring is driven by the raw system calls, so there is no dependency on
+ * liburing.  Only one thread uses a queue at a time and at most depth
+ * entries are ever submitted, so neither ring can overflow.
+ */
+
+#include <unistd.h>
+
+#include "include/bareos.h"
+#include "stored/backends/io_uring_queue.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if defined(HAVE_LINUX_IO_URING_H)
+#  include <linux/io_uring.h>
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#endif
+
+namespace storagedaemon {
+
+std::size_t IoUringQueue::BufferAlignment()
+{
+  long page_size = sysconf(_SC_PAGESIZE);
+  return page_size > 0 ? (std::size_t)page_size : 4096;
+}
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup)
+
+namespace {
+int io_uring_setup(unsigned entries, struct io_uring_params* params)
+{
+  return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+int io_uring_enter(int ring_fd,
+                   unsigned to_submit,
+                   unsigned min_complete,
+                   unsigned flags)
+{
+  return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+                      flags, nullptr, 0);
+}
+
+int io_uring_register(int ring_fd,
+                      unsigned opcode,
+                      const void* arg,
+                      unsigned nr_args)
+{
+  return (int)syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+unsigned* RingField(void* ring, std::uint32_t offset)
+{
+  return reinterpret_cast<unsigned*>(static_cast<char*>(ring) + offset);
+}
+}  // namespace
+
+std::unique_ptr<IoUringQueue> IoUringQueue::Create(unsigned depth,
+                                                   std::size_t buffer_size)
+{
+  std::unique_ptr<IoUringQueue> queue(new IoUringQueue);
+  if (!queue->Setup(depth, buffer_size)) {
+    int saved_errno = errno;
+    queue.reset();
+    errno = saved_errno;
+  }
+  return queue;
+}
+
+bool IoUringQueue::Setup(unsigned depth, std::size_t buffer_size)
+{
+  if (depth == 0 || buffer_size == 0) {
+    errno = EINVAL;
+    return false;
+  }
+
+  depth_ = depth;
+  const std::size_t alignment = BufferAlignment();
+  buffer_size_ = (buffer_size + alignment - 1) / alignment * alignment;
+
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_fd_ = io_uring_setup(depth_, &params);
+  if (ring_fd_ < 0) { return false; }
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_
+      = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  }
+
+  sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    sq_ring_ = nullptr;
+    return false;
+  }
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      cq_ring_ = nullptr;
+      return false;
+    }
+  }
+  sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (sqes_ == MAP_FAILED) {
+    sqes_ = nullptr;
+    return false;
+  }
+
+  sq_head_ = RingField(sq_ring_, params.sq_off.head);
+  sq_tail_ = RingField(sq_ring_, params.sq_off.tail);
+  sq_mask_ = RingField(sq_ring_, params.sq_off.ring_mask);
+  sq_array_ = RingField(sq_ring_, params.sq_off.array);
+  cq_head_ = RingField(cq_ring_, params.cq_off.head);
+  cq_tail_ = RingField(cq_ring_, params.cq_off.tail);
+  cq_mask_ = RingField(cq_ring_, params.cq_off.ring_mask);
+  cqes_ = static_cast<char*>(cq_ring_) + params.cq_off.cqes;
+
+  void* buffers = nullptr;
+  int status = posix_memalign(&buffers, alignment, depth_ * buffer_size_);
+  if (status != 0) {
+    errno = status;
+    return false;
+  }
+  buffers_ = static_cast<char*>(buffers);
+
+  iovecs_.resize(depth_);
+  slots_.resize(depth_);
+  for (unsigned i = 0; i < depth_; ++i) {
+    iovecs_[i].iov_base = buffers_ + i * buffer_size_;
+    iovecs_[i].iov_len = buffer_size_;
+  }
+
+  /* Registered buffers save the page pinning on every write, but count
+   * against RLIMIT_MEMLOCK.  Without them plain vectored writes are used. */
+  registered_ = io_uring_register(ring_fd_, IORING_REGISTER_BUFFERS,
+                                  iovecs_.data(), depth_)
+                == 0;
+
+  return true;
+}
+
+IoUringQueue::~IoUringQueue()
+{
+  if (in_flight_ > 0) { Drain(); }
+  if (sqes_) { munmap(sqes_, sqes_size_); }
+  if (cq_ring_ && cq_ring_ != sq_ring_) { munmap(cq_ring_, cq_ring_size_); }
+  if (sq_ring_) { munmap(sq_ring_, sq_ring_size_); }
+  if (ring_fd_ >= 0) { close(ring_fd_); }
+  free(buffers_);
+}
+
+bool IoUringQueue::Submit(unsigned slot)
+{
+  unsigned tail = *sq_tail_;
+  unsigned index = tail & *sq_mask_;
+  auto* sqe = static_cast<struct io_uring_sqe*>(sqes_) + index;
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->fd = slots_[slot].fd;
+  sqe->off = slots_[slot].offset;
+  sqe->user_data = slot;
+  if (registered_) {
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->addr = reinterpret_cast<std::uint64_t>(iovecs_[slot].iov_base);
+    sqe->len = slots_[slot].size;
+    sqe->buf_index = slot;
+  } else {
+    iovecs_[slot].iov_len = slots_[slot].size;
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->addr = reinterpret_cast<std::uint64_t>(&iovecs_[slot]);
+    sqe->len = 1;
+  }
+  sq_array_[index] = index;
+
+  // The entry has to be visible to the kernel before the new tail.
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+
+  int status;
+  do {
+    status = io_uring_enter(ring_fd_, 1, 0, 0);
+  } while (status < 0 && errno == EINTR);
+
+  if (status != 1) {
+    // Take the entry back, the kernel did not consume it.
+    if (__atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == tail) {
+      __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+    }
+    if (status >= 0) { errno = EIO; }
+    return false;
+  }
+
+  return true;
+}
+
+void IoUringQueue::Complete(unsigned slot, int result)
+{
+  Slot& s = slots_[slot];
+
+  if (result >= 0 && static_cast<std::size_t>(result) < s.size) {
+    // Short writes are rare, just write the rest synchronously.
+    const char* data = static_cast<const char*>(iovecs_[slot].iov_base);
+    std::size_t done = result;
+    while (done < s.size) {
+      ssize_t written
+          = pwrite(s.fd, data + done, s.size - done, s.offset + done);
+      if (written <= 0) {
+        result = written < 0 ? -errno : -EIO;
+        break;
+      }
+      done += written;
+    }
+  }
+
+  if (result < 0 && error_ == 0) { error_ = -result; }
+
+  s.busy = false;
+  in_flight_--;
+}
+
+bool IoUringQueue::WaitForCompletion()
+{
+  unsigned head = *cq_head_;
+  unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+
+  if (head == tail) {
+    int status;
+    do {
+      status = io_uring_enter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS);
+    } while (status < 0 && errno == EINTR);
+    if (status < 0) { return false; }
+    tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+  }
+
+  while (head != tail) {
+    auto* cqe = static_cast<struct io_uring_cqe*>(cqes_) + (head & *cq_mask_);
+    Complete(static_cast<unsigned>(cqe->user_data), cqe->res);
+    head++;
+  }
+  __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+
+  return true;
+}
+
+bool IoUringQueue::TakeError()
+{
+  if (error_ == 0) { return false; }
+  errno = error_;
+  error_ = 0;
+  return true;
+}
+
+bool IoUringQueue::Write(int fd,
+                         const void* data,
+                         std::size_t size,
+                         std::uint64_t offset)
+{
+  if (size > buffer_size_) {
+    errno = EINVAL;
+    return false;
+  }
+
+  while (in_flight_ == depth_) {
+    if (!WaitForCompletion()) { return false; }
+  }
+  if (TakeError()) { return false; }
+
+  unsigned slot = 0;
+  while (slots_[slot].busy) { slot++; }
+
+  memcpy(iovecs_[slot].iov_base, data, size);
+  slots_[slot].fd = fd;
+  slots_[slot].size = size;
+  slots_[slot].offset = offset;
+
+  if (!Submit(slot)) {
+    // Nothing is in flight for this slot, so write it directly.
+    ssize_t written = pwrite(fd, data, size, offset);
+    if (written != static_cast<ssize_t>(size)) {
+      if (written >= 0) { errno = EIO; }
+      return false;
+    }
+    return true;
+  }
+
+  slots_[slot].busy = true;
+  in_flight_++;
+
+  return true;
+}
+
+bool IoUringQueue::Drain()
+{
+  while (in_flight_ > 0) {
+    if (!WaitForCompletion()) { return false; }
+  }
+  return !TakeError();
+}
+
+#else
+
+std::unique_ptr<IoUringQueue> IoUringQueue::Create(unsigned, std::size_t)
+{
+  errno = ENOSYS;
+  return nullptr;
+}
+
+IoUringQueue::~IoUringQueue() = default;
+
+bool IoUringQueue::Write(int, const void*, std::size_t, std::uint64_t)
+{
+  errno = ENOSYS;
+  return false;
+}
+
+bool IoUringQueue::Drain() { return true; }
+
+#endif
+
+} /* namespace storagedaemon */
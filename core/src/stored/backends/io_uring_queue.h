@@ -0,0 +1,119 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation, which is
+   listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Queue of asynchronous writes using the Linux io_uring interface.
+ */
+
+#ifndef BAREOS_STORED_BACKENDS_IO_URING_QUEUE_H_
+#define BAREOS_STORED_BACKENDS_IO_URING_QUEUE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <sys/uio.h>
+
+namespace storagedaemon {
+
+/**
+ * Keeps up to depth writes in flight.  Every write is copied into one of
+ * depth buffers which are registered with the kernel if possible, so the
+ * caller can reuse its buffer right away.  The buffers are aligned to
+ * BufferAlignment(), so they can be used with O_DIRECT file descriptors.
+ *
+ * A failed write is reported by the next call to Write() or Drain().
+ */
+class IoUringQueue {
+ public:
+  /* The page size, which satisfies the memory alignment O_DIRECT needs on
+   * every file system.  The alignment of offsets and sizes depends on the
+   * file system and is up to the caller. */
+  static std::size_t BufferAlignment();
+
+  /* Returns nullptr and sets errno if io_uring is not usable, e.g. because
+   * the kernel is too old or the syscalls are filtered. */
+  static std::unique_ptr<IoUringQueue> Create(unsigned depth,
+                                              std::size_t buffer_size);
+  ~IoUringQueue();
+
+  IoUringQueue(const IoUringQueue&) = delete;
+  IoUringQueue& operator=(const IoUringQueue&) = delete;
+
+  std::size_t BufferSize() const { return buffer_size_; }
+  unsigned Depth() const { return depth_; }
+  bool UsesRegisteredBuffers() const { return registered_; }
+
+  /* Queues a write of size bytes (at most BufferSize()) at offset of fd.
+   * Waits for a free buffer if depth writes are in flight.  Returns false
+   * and sets errno if this or an earlier write failed. */
+  bool Write(int fd, const void* data, std::size_t size, std::uint64_t offset);
+
+  // Waits for all queued writes, returns false and sets errno on failure.
+  bool Drain();
+
+ private:
+  struct Slot {
+    int fd{-1};
+    std::size_t size{0};
+    std::uint64_t offset{0};
+    bool busy{false};
+  };
+
+  IoUringQueue() = default;
+  bool Setup(unsigned depth, std::size_t buffer_size);
+  bool Submit(unsigned slot);
+  bool WaitForCompletion();
+  void Complete(unsigned slot, int result);
+  bool TakeError();
+
+  unsigned depth_{0};
+  std::size_t buffer_size_{0};
+  bool registered_{false};
+  unsigned in_flight_{0};
+  int error_{0}; /**< Errno of the first failed write not yet reported */
+
+  char* buffers_{nullptr};
+  std::vector<struct iovec> iovecs_;
+  std::vector<Slot> slots_;
+
+  int ring_fd_{-1};
+  void* sq_ring_{nullptr};
+  std::size_t sq_ring_size_{0};
+  void* cq_ring_{nullptr};
+  std::size_t cq_ring_size_{0};
+  void* sqes_{nullptr};
+  std::size_t sqes_size_{0};
+
+  unsigned* sq_head_{nullptr};
+  unsigned* sq_tail_{nullptr};
+  unsigned* sq_mask_{nullptr};
+  unsigned* sq_array_{nullptr};
+  unsigned* cq_head_{nullptr};
+  unsigned* cq_tail_{nullptr};
+  unsigned* cq_mask_{nullptr};
+  void* cqes_{nullptr};
+};
+
+} /* namespace storagedaemon */
+
+#endif  // BAREOS_STORED_BACKENDS_IO_URING_QUEUE_H_
@@ -29,6 +29,8 @@
  * UNIX FILE API device abstraction.
  */
 
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "include/fcntl_def.h"
@@ -41,8 +43,31 @@
 #include "lib/berrno.h"
 #include "lib/util.h"
 
+#include <algorithm>
+
 namespace storagedaemon {
 
+// Options that can be specified for this device type.
+enum device_option_type
+{
+  argument_none = 0,
+  argument_io_uring,
+  argument_direct_io
+};
+
+struct device_option {
+  const char* name;
+  enum device_option_type type;
+  int compare_size;
+};
+
+static device_option device_options[] = {{"io_uring=", argument_io_uring, 9},
+                                         {"direct_io", argument_direct_io, 9},
+                                         {NULL, argument_none, 0}};
+
+// Upper limit for the number of queued writes per device.
+static const unsigned max_io_uring_depth = 64;
+
 // (Un)mount the device (For a FILE device)
 static bool do_mount(DeviceControlRecord* dcr, bool mount, int dotimeout)
 {
@@ -214,22 +239,270 @@ bool unix_file_device::ScanForVolumeImpl(DeviceControlRecord* dcr)
   return ScanDirectoryForVolume(dcr);
 }
 
+/**
+ * The device options of the file device are all optional, unknown options
+ * are only warned about as they used to be ignored altogether.
+ */
+void unix_file_device::ParseDeviceOptions()
+{
+  options_parsed_ = true;
+  if (!dev_options) { return; }
+
+  std::string options{dev_options};
+  std::size_t begin = 0;
+  while (begin <= options.size()) {
+    std::size_t end = options.find(',', begin);
+    if (end == std::string::npos) { end = options.size(); }
+    std::string option = options.substr(begin, end - begin);
+    begin = end + 1;
+    if (option.empty()) { continue; }
+
+    bool done = false;
+    for (int i = 0; !done && device_options[i].name; i++) {
+      // Try to find a matching device option.
+      if (bstrncasecmp(option.c_str(), device_options[i].name,
+                       device_options[i].compare_size)) {
+        const char* value = option.c_str() + device_options[i].compare_size;
+        switch (device_options[i].type) {
+          case argument_io_uring: {
+            char* end_ptr;
+            unsigned long depth = strtoul(value, &end_ptr, 10);
+            if (*value == '\0' || *end_ptr != '\0'
+                || depth > max_io_uring_depth) {
+              Emsg3(M_WARNING, 0,
+                    T_("Device %s: ignoring io_uring depth \"%s\", expected a "
+                       "number between 0 and %u.\n"),
+                    prt_name, value, max_io_uring_depth);
+            } else {
+              io_uring_depth_ = depth;
+            }
+          } break;
+          case argument_direct_io:
+            direct_io_ = true;
+            break;
+          default:
+            break;
+        }
+        done = true;
+      }
+    }
+
+    if (!done) {
+      Emsg2(M_WARNING, 0, T_("Device %s: ignoring unknown device option %s\n"),
+            prt_name, option.c_str());
+    }
+  }
+
+  if (direct_io_ && io_uring_depth_ == 0) {
+    Emsg1(M_WARNING, 0,
+          T_("Device %s: direct_io is only used together with io_uring.\n"),
+          prt_name);
+  }
+}
+
+// Creates the queue on first use and whenever the blocks got bigger.
+bool unix_file_device::SetupIoUring()
+{
+  std::size_t buffer_size
+      = std::max<std::size_t>(max_block_size, DEFAULT_BLOCK_SIZE);
+  if (io_uring_ && io_uring_->BufferSize() >= buffer_size) { return true; }
+
+  io_uring_.reset();
+  io_uring_ = IoUringQueue::Create(io_uring_depth_, buffer_size);
+  if (!io_uring_) {
+    BErrNo be;
+
+    Emsg2(M_WARNING, 0,
+          T_("Device %s: io_uring is not available, using blocking I/O. "
+             "ERR=%s\n"),
+          prt_name, be.bstrerror());
+    io_uring_depth_ = 0;
+    return false;
+  }
+
+  Dmsg3(100, "Device %s: io_uring with %u buffers of %zu bytes (%s)\n",
+        prt_name, io_uring_->Depth(), io_uring_->BufferSize(),
+        io_uring_->UsesRegisteredBuffers() ? "registered" : "not registered");
+  return true;
+}
+
+/* The alignment of file offsets and sizes for O_DIRECT writes.  It is never
+ * smaller than the page size: a page written through the page cache and
+ * through O_DIRECT at the same time may later be written back with stale
+ * contents over the direct write.  Without statx() we use the larger of the
+ * block size of the file system and the page size, which is always
+ * sufficient for the file system. */
+static std::size_t DirectIoAlignment(int t_fd)
+{
+  std::size_t alignment = IoUringQueue::BufferAlignment();
+
+#if defined(STATX_DIOALIGN)
+  struct statx stx;
+  if (statx(t_fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0
+      && (stx.stx_mask & STATX_DIOALIGN) && stx.stx_dio_offset_align > 0) {
+    return std::max(alignment, (std::size_t)stx.stx_dio_offset_align);
+  }
+#endif
+
+  struct stat st;
+  if (fstat(t_fd, &st) == 0 && st.st_blksize > 0) {
+    alignment = std::max(alignment, (std::size_t)st.st_blksize);
+  }
+
+  return alignment;
+}
+
+/* Writes that are aligned are done through a second file descriptor opened
+ * with O_DIRECT.  The kernel only keeps it coherent with the page cache used
+ * by the unaligned writes as long as both do not write the same page at the
+ * same time, so the queue is drained whenever the descriptor changes. */
+void unix_file_device::OpenDirect(const char* pathname, int flags)
+{
+#ifdef O_DIRECT
+  if (!direct_io_) { return; }
+
+  direct_fd_ = ::open(pathname, (flags & ~(O_CREAT | O_EXCL | O_TRUNC))
+                                    | O_DIRECT);
+  if (direct_fd_ < 0) {
+    BErrNo be;
+
+    Dmsg2(100, "Device %s: O_DIRECT not supported, ERR=%s\n", prt_name,
+          be.bstrerror());
+    return;
+  }
+
+  direct_alignment_ = DirectIoAlignment(direct_fd_);
+  Dmsg2(100, "Device %s: O_DIRECT alignment %zu\n", prt_name,
+        direct_alignment_);
+#else
+  (void)pathname;
+  (void)flags;
+#endif
+}
+
+/* Waits for all queued writes.  A failure is reported as EIO, as the data
+ * was already acknowledged and can no longer be written to another volume
+ * like after a (synchronous) ENOSPC. */
+bool unix_file_device::FlushWrites()
+{
+  std::lock_guard lock(queue_mutex_);
+  return DrainQueue();
+}
+
+// Same as FlushWrites(), with queue_mutex_ already held.
+bool unix_file_device::DrainQueue()
+{
+  queued_fd_ = -1;
+  if (!write_behind_ || io_uring_->Drain()) { return true; }
+
+  BErrNo be;
+  Mmsg2(errmsg, T_("Queued write to device %s failed. ERR=%s\n"), prt_name,
+        be.bstrerror());
+  Emsg0(M_ERROR, 0, errmsg);
+  dev_errno = errno = EIO;
+
+  return false;
+}
+
 int unix_file_device::d_open(const char* pathname, int flags, int mode)
 {
-  return ::open(pathname, flags, mode);
+  if (!options_parsed_) { ParseDeviceOptions(); }
+
+  std::lock_guard lock(queue_mutex_);
+  write_behind_ = false;
+  int t_fd = ::open(pathname, flags, mode);
+  if (t_fd < 0 || io_uring_depth_ == 0 || (flags & O_ACCMODE) == O_RDONLY) {
+    return t_fd;
+  }
+
+  if (SetupIoUring()) {
+    write_behind_ = true;
+    position_ = 0;
+    OpenDirect(pathname, flags);
+  }
+
+  return t_fd;
 }
 
 ssize_t unix_file_device::d_read(int t_fd, void* buffer, size_t count)
 {
-  return ::read(t_fd, buffer, count);
+  if (!write_behind_) { return ::read(t_fd, buffer, count); }
+
+  if (!FlushWrites()) { return -1; }
+  ssize_t status = ::pread(t_fd, buffer, count, position_);
+  if (status > 0) { position_ += status; }
+
+  return status;
+}
+
+ssize_t unix_file_device::d_pread(int t_fd,
+                                  void* buffer,
+                                  size_t count,
+                                  boffset_t offset)
+{
+  return ::pread(t_fd, buffer, count, offset);
 }
 
 ssize_t unix_file_device::d_write(int t_fd, const void* buffer, size_t count)
 {
-  return ::write(t_fd, buffer, count);
+  if (!write_behind_) { return ::write(t_fd, buffer, count); }
+
+  ssize_t status;
+  if (count > io_uring_->BufferSize()) {
+    // Does not fit into a queue buffer, so write it synchronously.
+    if (!FlushWrites()) { return -1; }
+    status = ::pwrite(t_fd, buffer, count, position_);
+  } else {
+    int target_fd = t_fd;
+    if (direct_fd_ >= 0 && position_ % direct_alignment_ == 0
+        && count % direct_alignment_ == 0) {
+      target_fd = direct_fd_;
+    }
+
+    std::lock_guard lock(queue_mutex_);
+    if (queued_fd_ >= 0 && queued_fd_ != target_fd && !DrainQueue()) {
+      return -1;
+    }
+    queued_fd_ = target_fd;
+    if (!io_uring_->Write(target_fd, buffer, count, position_)) {
+      BErrNo be;
+
+      Mmsg2(errmsg, T_("Queued write to device %s failed. ERR=%s\n"),
+            prt_name, be.bstrerror());
+      Emsg0(M_ERROR, 0, errmsg);
+      dev_errno = errno = EIO;
+      return -1;
+    }
+    status = count;
+  }
+
+  if (status > 0) { position_ += status; }
+
+  return status;
 }
 
-int unix_file_device::d_close(int t_fd) { return ::close(t_fd); }
+int unix_file_device::d_close(int t_fd)
+{
+  int status = 0;
+
+  std::lock_guard lock(queue_mutex_);
+  if (!DrainQueue()) { status = -1; }
+  write_behind_ = false;
+  if (direct_fd_ >= 0) {
+    ::close(direct_fd_);
+    direct_fd_ = -1;
+  }
+
+  if (status < 0) {
+    ::close(t_fd);
+    errno = EIO;
+    return -1;
+  }
+
+  return ::close(t_fd);
+}
+
+bool unix_file_device::d_flush(DeviceControlRecord*) { return FlushWrites(); }
 
 int unix_file_device::d_ioctl(int, ioctl_req_t, char*) { return -1; }
 
@@ -237,7 +510,41 @@ boffset_t unix_file_device::d_lseek(DeviceControlRecord*,
                                     boffset_t offset,
                                     int whence)
 {
-  return ::lseek(fd, offset, whence);
+  if (!write_behind_) { return ::lseek(fd, offset, whence); }
+
+  /* Queued writes use explicit offsets, so the position is our own.  The
+   * queue does not order its writes, so before the position changes all of
+   * them have to be done: a block rewritten at the same offset must not be
+   * overtaken by the queued older one. */
+  boffset_t base;
+  switch (whence) {
+    case SEEK_SET:
+      base = 0;
+      break;
+    case SEEK_CUR:
+      base = position_;
+      break;
+    case SEEK_END: {
+      struct stat st;
+
+      if (!FlushWrites()) { return -1; }
+      if (fstat(fd, &st) != 0) { return -1; }
+      base = st.st_size;
+    } break;
+    default:
+      errno = EINVAL;
+      return -1;
+  }
+
+  if (offset < 0 && base < -offset) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (base + offset != position_ && !FlushWrites()) { return -1; }
+
+  position_ = base + offset;
+  return position_;
 }
 
 bool unix_file_device::d_truncate(DeviceControlRecord* dcr)
@@ -245,6 +552,8 @@ bool unix_file_device::d_truncate(DeviceControlRecord* dcr)
   struct stat st;
   PoolMem archive_name(PM_FNAME);
 
+  if (!FlushWrites()) { return false; }
+
   // When secure erase is configured never truncate the file.
   if (!me->secure_erase_cmdline) {
     if (ftruncate(fd, 0) != 0) {
@@ -313,6 +622,17 @@ bool unix_file_device::d_truncate(DeviceControlRecord* dcr)
   // Reset proper owner
   (void)!chown(archive_name.c_str(), st.st_uid, st.st_gid);
 
+  // The queued writes need to go to the new file as well.
+  if (write_behind_) {
+    std::lock_guard lock(queue_mutex_);
+    position_ = 0;
+    if (direct_fd_ >= 0) {
+      ::close(direct_fd_);
+      direct_fd_ = -1;
+      OpenDirect(archive_name.c_str(), oflags);
+    }
+  }
+
 bail_out:
   return true;
 }
@@ -2,7 +2,7 @@
    BAREOS® - Backup Archiving REcovery Open Sourced
 
    Copyright (C) 2013-2013 Planets Communications B.V.
-   Copyright (C) 2013-2022 Bareos GmbH & Co. KG
+   Copyright (C) 2013-2024 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -29,6 +29,10 @@
 #define BAREOS_STORED_BACKENDS_UNIX_FILE_DEVICE_H_
 
 #include "stored/dev.h"
+#include "stored/backends/io_uring_queue.h"
+
+#include <memory>
+#include <mutex>
 
 namespace storagedaemon {
 
@@ -40,6 +44,7 @@ class unix_file_device : public Device {
   // Interface from Device
   SeekMode GetSeekMode() const override { return SeekMode::BYTES; }
   bool CanReadConcurrently() const override { return true; }
+  bool CanPrefetchBlocks() const override { return !write_behind_; }
   bool MountBackend(DeviceControlRecord* dcr, int timeout) override;
   bool UnmountBackend(DeviceControlRecord* dcr, int timeout) override;
   bool ScanForVolumeImpl(DeviceControlRecord* dcr) override;
@@ -50,8 +55,38 @@ class unix_file_device : public Device {
                     boffset_t offset,
                     int whence) override;
   ssize_t d_read(int fd, void* buffer, size_t count) override;
+  ssize_t d_pread(int fd,
+                  void* buffer,
+                  size_t count,
+                  boffset_t offset) override;
   ssize_t d_write(int fd, const void* buffer, size_t count) override;
   bool d_truncate(DeviceControlRecord* dcr) override;
+  bool d_flush(DeviceControlRecord* dcr) override;
+  bool WaitForQueuedWrites() override { return FlushWrites(); }
+
+ private:
+  bool options_parsed_{false};
+  unsigned io_uring_depth_{0}; /**< 0 means blocking I/O */
+  bool direct_io_{false};
+  std::unique_ptr<IoUringQueue> io_uring_{};
+
+  /* While a volume is open for writing with io_uring, writes are queued and
+   * the file offset is tracked here instead of in the kernel. */
+  bool write_behind_{false};
+  boffset_t position_{0};
+  int direct_fd_{-1}; /**< Same file opened with O_DIRECT */
+  std::size_t direct_alignment_{0}; /**< Offset and size for direct_fd_ */
+  int queued_fd_{-1}; /**< Descriptor of the writes in the queue */
+
+  /* Serializes the queue: WaitForQueuedWrites() is also called by jobs that
+   * do not hold the device lock. */
+  std::mutex queue_mutex_;
+
+  void ParseDeviceOptions();
+  bool SetupIoUring();
+  void OpenDirect(const char* pathname, int flags);
+  bool FlushWrites();
+  bool DrainQueue();
 };
 
 } /* namespace storagedaemon */
@@ -31,6 +31,7 @@
 
 #include "include/bareos.h"
 #include "stored/stored.h"
+#include "stored/block_prefetcher.h"
 #include "stored/crc32/crc32.h"
 #include "stored/dev.h"
 #include "stored/device.h"
@@ -990,7 +991,9 @@ reread:
       Bmicrosleep(10, 0); /* pause a bit if busy or lots of errors */
       dev->clrerror(-1);
     }
-    status = dev->read(block->buf, (size_t)block->buf_len);
+    if (!prefetcher || !prefetcher->Read(block, &status)) {
+      status = dev->read(block->buf, (size_t)block->buf_len);
+    }
 
   } while (status == -1 && (errno == EBUSY || errno == EINTR || errno == EIO)
            && retry++ < 3);
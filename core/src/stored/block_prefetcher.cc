@@ -0,0 +1,200 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation, which is
+   listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "include/bareos.h"
+#include "stored/stored.h"
+#include "stored/block_prefetcher.h"
+#include "stored/device_control_record.h"
+#include "lib/serial.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace storagedaemon {
+
+static const int debuglevel = 250;
+
+BlockPrefetcher::Prefetched::Prefetched(boffset_t t_offset, uint32_t buf_len)
+    : offset{t_offset}, buf{GetMemory(buf_len)}
+{
+}
+
+BlockPrefetcher::Prefetched& BlockPrefetcher::Prefetched::operator=(
+    Prefetched&& other) noexcept
+{
+  std::swap(offset, other.offset);
+  std::swap(len, other.len);
+  std::swap(buf, other.buf);
+  return *this;
+}
+
+BlockPrefetcher::Prefetched::~Prefetched()
+{
+  if (buf) { FreeMemory(buf); }
+}
+
+bool BlockPrefetcher::Read(DeviceBlock* block, ssize_t* status)
+{
+  Device* dev = dcr_->dev;
+
+  if (!dev->CanPrefetchBlocks()) {
+    Stop();
+    return false;
+  }
+
+  boffset_t pos = dev->d_lseek(dcr_, (boffset_t)0, SEEK_CUR);
+  if (pos < 0) {
+    Stop();
+    return false;
+  }
+
+  if (running_ && (fd_ != dev->fd || buf_len_ != block->buf_len)) { Stop(); }
+
+  std::optional<Prefetched> next;
+  if (running_) {
+    next = Take();
+    if (next && next->offset != pos) {
+      Dmsg1(debuglevel, "Device was repositioned, prefetch again at %lld\n",
+            (long long)pos);
+      next.reset();
+      Stop();
+    }
+  }
+  if (!running_) {
+    Start(dev->fd, pos, block->buf_len);
+    next = Take();
+  }
+
+  // End of volume or read error, the caller reads again and reports it.
+  if (!next || next->len <= 0) {
+    Stop();
+    return false;
+  }
+
+  if (dev->d_lseek(dcr_, pos + next->len, SEEK_SET) < 0) {
+    Stop();
+    return false;
+  }
+
+  std::swap(block->buf, next->buf);
+  dev->DevReadBytes += next->len;
+  *status = next->len;
+
+  return true;
+}
+
+void BlockPrefetcher::Start(int fd, boffset_t offset, uint32_t buf_len)
+{
+  // The output keeps as many blocks in its cache as there are in the queue.
+  uint32_t depth = std::clamp(kPrefetchBytes / 2 / std::max(buf_len, 1u), 2u,
+                              kMaxPrefetchBlocks);
+
+  Dmsg3(debuglevel, "Start prefetching %u blocks of %u bytes at %lld\n", depth,
+        buf_len, (long long)offset);
+
+  depth_ = depth;
+  window_ = std::min(kInitialWindow, depth);
+  in_flight_ = 0;
+  consumed_ = 0;
+  stopping_ = false;
+
+  auto [in, out] = channel::CreateBufferedChannel<Prefetched>(depth);
+  output_.emplace(std::move(out));
+  fd_ = fd;
+  buf_len_ = buf_len;
+  running_ = true;
+  prefetch_thread_ = std::thread(&BlockPrefetcher::Run, this, std::move(in),
+                                 fd, offset, buf_len);
+}
+
+std::optional<BlockPrefetcher::Prefetched> BlockPrefetcher::Take()
+{
+  std::optional<Prefetched> next = output_->get();
+  if (!next) { return next; }
+
+  {
+    std::lock_guard lock(mutex_);
+    in_flight_--;
+    if (++consumed_ >= window_ && window_ < depth_) {
+      window_ = std::min(window_ * 2, depth_);
+      consumed_ = 0;
+    }
+  }
+  window_changed_.notify_one();
+
+  return next;
+}
+
+void BlockPrefetcher::Stop()
+{
+  if (!running_) { return; }
+
+  {
+    std::lock_guard lock(mutex_);
+    stopping_ = true;
+  }
+  window_changed_.notify_one();
+  output_->close();
+  prefetch_thread_.join();
+  output_.reset();
+  running_ = false;
+}
+
+/* Runs on the prefetch thread, so it must only use the arguments, the
+ * window and Device::d_pread(). */
+void BlockPrefetcher::Run(channel::input<Prefetched> input,
+                          int fd,
+                          boffset_t offset,
+                          uint32_t buf_len)
+{
+  Device* dev = dcr_->dev;
+
+  for (;;) {
+    {
+      std::unique_lock lock(mutex_);
+      window_changed_.wait(
+          lock, [this] { return stopping_ || in_flight_ < window_; });
+      if (stopping_) { break; }
+      in_flight_++;
+    }
+
+    Prefetched block(offset, buf_len);
+    block.len = dev->d_pread(fd, block.buf, buf_len, offset);
+
+    /* The next block starts behind this one, we only know where if the
+     * header is readable.  Everything else is checked when the block is
+     * unserialized. */
+    uint32_t block_len = 0;
+    if (block.len >= BLKHDR1_LENGTH) {
+      ser_declare;
+      UnserBegin(block.buf + BLKHDR_CS_LENGTH, sizeof(block_len));
+      unser_uint32(block_len);
+    }
+    bool more = block_len >= BLKHDR1_LENGTH && (ssize_t)block_len <= block.len;
+
+    if (!input.emplace(std::move(block)) || !more) { break; }
+    offset += block_len;
+  }
+
+  input.close();
+}
+
+} /* namespace storagedaemon */
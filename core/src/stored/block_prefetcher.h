@@ -0,0 +1,118 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation, which is
+   listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Reads the blocks of a volume ahead on a second thread.
+ */
+
+#ifndef BAREOS_STORED_BLOCK_PREFETCHER_H_
+#define BAREOS_STORED_BLOCK_PREFETCHER_H_
+
+#include "lib/channel.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+namespace storagedaemon {
+
+class DeviceControlRecord;
+struct DeviceBlock;
+
+/**
+ * While ReadRecords() works through the records of one block, the next
+ * blocks are already read from the device into a bounded ring of buffers.
+ *
+ * The prefetch thread only does positional reads (Device::d_pread()),
+ * all device state is still updated by ReadBlockFromDev() on the reading
+ * thread.  Read() hands out a prefetched block only if it starts at the
+ * current position of the device, so after a reposition or a volume change
+ * the prefetcher simply starts over at the new position.
+ *
+ * As restores seek over the data not selected by the bootstrap, a new run
+ * only reads a few blocks ahead; the window doubles each time the reader
+ * consumed all of it, so long sequential runs still read far ahead.
+ */
+class BlockPrefetcher {
+ public:
+  static constexpr uint32_t kPrefetchBytes = 16 * 1024 * 1024;
+  static constexpr uint32_t kMaxPrefetchBlocks = 64;
+  static constexpr uint32_t kInitialWindow = 4;
+
+  explicit BlockPrefetcher(DeviceControlRecord* dcr) : dcr_{dcr} {}
+  ~BlockPrefetcher() { Stop(); }
+
+  BlockPrefetcher(const BlockPrefetcher&) = delete;
+  BlockPrefetcher& operator=(const BlockPrefetcher&) = delete;
+
+  /* Replaces the buffer of block with the prefetched block at the current
+   * position and moves the position behind it, like Device::read() would.
+   * Returns false if the caller has to read the block itself, e.g. at the
+   * end of the volume or on a read error. */
+  bool Read(DeviceBlock* block, ssize_t* status);
+
+  // Stops the prefetch thread, has to be called before the device is closed
+  void Stop();
+
+ private:
+  // A block read ahead; owns its pool memory buffer.
+  struct Prefetched {
+    Prefetched() = default;
+    Prefetched(boffset_t t_offset, uint32_t buf_len);
+    Prefetched(Prefetched&& other) noexcept { *this = std::move(other); }
+    Prefetched& operator=(Prefetched&& other) noexcept;
+    ~Prefetched();
+
+    boffset_t offset{0};
+    ssize_t len{-1};
+    POOLMEM* buf{nullptr};
+  };
+
+  void Start(int fd, boffset_t offset, uint32_t buf_len);
+  // Next block from the prefetch thread, widens the window as it goes
+  std::optional<Prefetched> Take();
+  void Run(channel::input<Prefetched> input,
+           int fd,
+           boffset_t offset,
+           uint32_t buf_len);
+
+  DeviceControlRecord* dcr_;
+  bool running_{false};
+  int fd_{-1};
+  uint32_t buf_len_{0};
+  std::optional<channel::output<Prefetched>> output_;
+  std::thread prefetch_thread_;
+
+  // Guard the read-ahead window shared with the prefetch thread
+  std::mutex mutex_;
+  std::condition_variable window_changed_;
+  uint32_t depth_{0};
+  uint32_t window_{0};
+  uint32_t in_flight_{0};
+  uint32_t consumed_{0};
+  bool stopping_{false};
+};
+
+} /* namespace storagedaemon */
+
+#endif  // BAREOS_STORED_BLOCK_PREFETCHER_H_
@@ -40,12 +40,14 @@
 #include "cats/cats.h"
 #include "cats/sql.h"
 #include "stored/acquire.h"
+#include "stored/bscan_checkpoint.h"
 #include "stored/butil.h"
 #include "stored/device_control_record.h"
 #include "stored/label.h"
 #include "stored/mount.h"
 #include "stored/read_record.h"
 #include "lib/attribs.h"
+#include "lib/berrno.h"
 #include "lib/cli.h"
 #include "lib/edit.h"
 #include "lib/parse_bsr.h"
@@ -53,9 +55,23 @@
 #include "include/jcr.h"
 #include "lib/bsock.h"
 #include "lib/parse_conf.h"
+#include "lib/scan.h"
 #include "lib/util.h"
 #include "lib/version.h"
 #include "lib/compression.h"
+#include "lib/channel.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 /* Dummy functions */
 namespace storagedaemon {
@@ -67,12 +83,7 @@ using namespace storagedaemon;
 /* Forward referenced functions */
 static void do_scan(void);
 static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec);
-static bool CreateFileAttributesRecord(BareosDb* db,
-                                       JobControlRecord* mjcr,
-                                       char* fname,
-                                       char* lname,
-                                       int type,
-                                       char* ap,
+static void CreateFileAttributesRecord(JobControlRecord* mjcr,
                                        DeviceRecord* rec);
 static bool CreateMediaRecord(BareosDb* db,
                               MediaDbRecord* mr,
@@ -93,10 +104,15 @@ static bool CreateJobmediaRecord(BareosDb* db, JobControlRecord* jcr);
 static JobControlRecord* create_jcr(JobDbRecord* jr,
                                     DeviceRecord* rec,
                                     uint32_t JobId);
-static bool UpdateDigestRecord(BareosDb* db,
-                               char* digest,
-                               DeviceRecord* rec,
-                               int type);
+static bool UpdateDigestRecord(char* digest, DeviceRecord* rec, int type);
+static void BscanFreeJcr(JobControlRecord* jcr);
+static void StartCatalogWriters();
+static void StopCatalogWriters();
+static void ReadCheckpointFile();
+static std::string RemoveScannedVolumes(const std::string& volumes);
+static void ResumeFromCheckpoint();
+static void CheckpointVolume(const char* volume);
+static void CheckpointJob(JobId_t JobId);
 
 /* Local variables */
 static Device* dev = nullptr;
@@ -113,7 +129,6 @@ static AttributesDbRecord ar;
 static FileDbRecord fr;
 static Session_Label label;
 static Session_Label elabel;
-static Attributes* attr;
 
 static time_t lasttime = 0;
 
@@ -130,6 +145,11 @@ static int num_pools = 0;
 static int num_media = 0;
 static int num_files = 0;
 static int num_restoreobjects = 0;
+static int catalog_threads = 4;
+static std::string checkpoint_file;
+static bool assume_yes = false;
+static BscanCheckpoint checkpoint;
+static std::unordered_set<JobId_t> created_jobs; /* for the checkpoint */
 
 int main(int argc, char* argv[])
 {
@@ -216,6 +236,24 @@ int main(int argc, char* argv[])
   bscan_app.add_flag("-s,--update-db", update_db,
                      "Synchronize or store in database.");
 
+  bscan_app
+      .add_option("-T,--threads", catalog_threads,
+                  "Number of threads storing File records in the database "
+                  "(0 stores them while reading).")
+      ->check(CLI::Range(0, 64))
+      ->type_name("<threads>")
+      ->capture_default_str();
+
+  bscan_app
+      .add_option("-C,--checkpoint", checkpoint_file,
+                  "Record the scanned volumes in <file>. When started again "
+                  "with the same <file>, they are skipped.")
+      ->type_name("<file>");
+
+  bscan_app.add_flag("-y,--yes", assume_yes,
+                     "Remove the File records stored after the checkpoint "
+                     "without asking.");
+
   std::string volumes;
   bscan_app
       .add_option("-V,--volumes", volumes,
@@ -287,6 +325,16 @@ int main(int argc, char* argv[])
           working_directory);
   }
 
+  if (!checkpoint_file.empty()) {
+    ReadCheckpointFile();
+    volumes = RemoveScannedVolumes(volumes);
+    if (volumes.empty()) {
+      Pmsg1(000, T_("All volumes of checkpoint %s were already scanned.\n"),
+            checkpoint_file.c_str());
+      exit(BEXIT_SUCCESS);
+    }
+  }
+
   DeviceControlRecord* dcr = new DeviceControlRecord;
   bjcr = SetupJcr("bscan", device_name.data(), bsr, director, dcr, volumes,
                   true);
@@ -323,6 +371,7 @@ int main(int argc, char* argv[])
           db_user.c_str());
   }
 
+  ResumeFromCheckpoint();
   do_scan();
   if (update_db) {
     printf(
@@ -381,6 +430,7 @@ static bool BscanMountNextReadVolume(DeviceControlRecord* dcr)
   }
 
   UpdateMediaRecord(db, &mr);
+  CheckpointVolume(my_dev->getVolCatName());
 
   /* Now let common read routine get up next tape. Note,
    * we call mount_next... with bscan's jcr because that is where we
@@ -400,8 +450,6 @@ static bool BscanMountNextReadVolume(DeviceControlRecord* dcr)
 
 static void do_scan()
 {
-  attr = new_attr(bjcr);
-
   AttributesDbRecord ar_emtpy;
   PoolDbRecord pr_empty;
   JobDbRecord jr_empty;
@@ -417,13 +465,9 @@ static void do_scan()
   fr = fr_empty;
 
   // Detach bscan's jcr as we are not a real Job on the tape
+  StartCatalogWriters();
   ReadRecords(bjcr->sd_impl->read_dcr, RecordCb, BscanMountNextReadVolume);
-
-  if (update_db) {
-    db->WriteBatchFileRecords(bjcr); /* used by bulk batch file insert */
-  }
-
-  FreeAttr(attr);
+  StopCatalogWriters();
 }
 
 /**
@@ -594,7 +638,9 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
           UnserSessionLabel(&label, rec);
           jr = JobDbRecord{};
           bstrncpy(jr.Job, label.Job, sizeof(jr.Job));
+          JobId_t existing_JobId = 0;
           if (db->GetJobRecord(my_bjcr, &jr)) {
+            existing_JobId = jr.JobId;
             // Job record already exists in DB
             update_db = false; /* don't change db in CreateJobRecord */
             if (g_verbose) {
@@ -618,6 +664,8 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
           mjcr = CreateJobRecord(db, &jr, &label, rec);
           dcr = mjcr->sd_impl->read_dcr;
           update_db = save_update_db;
+          // The File records belong to the Job record found in the catalog
+          if (existing_JobId) { mjcr->JobId = existing_JobId; }
 
           jr.PoolId = pr.PoolId;
           mjcr->start_time = jr.StartTime;
@@ -627,6 +675,8 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
           PmStrcpy(mjcr->client_name, label.ClientName);
           mjcr->sd_impl->fileset_name = GetPoolMemory(PM_FNAME);
           PmStrcpy(mjcr->sd_impl->fileset_name, label.FileSetName);
+          mjcr->sd_impl->fileset_md5 = GetPoolMemory(PM_FNAME);
+          PmStrcpy(mjcr->sd_impl->fileset_md5, label.FileSetMD5);
           bstrncpy(dcr->pool_type, label.PoolType, sizeof(dcr->pool_type));
           bstrncpy(dcr->pool_name, label.PoolName, sizeof(dcr->pool_name));
 
@@ -674,12 +724,6 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
         } else {
           UnserSessionLabel(&elabel, rec);
 
-          // Create FileSet record
-          bstrncpy(fsr.FileSet, label.FileSetName, sizeof(fsr.FileSet));
-          bstrncpy(fsr.MD5, label.FileSetMD5, sizeof(fsr.MD5));
-          CreateFilesetRecord(db, &fsr);
-          jr.FileSetId = fsr.FileSetId;
-
           mjcr = get_jcr_by_session(rec->VolSessionId, rec->VolSessionTime);
           if (!mjcr) {
             Pmsg2(000,
@@ -688,6 +732,14 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
             break;
           }
 
+          /* Create FileSet record, taken from the Job as other Jobs may
+           * have started since its SOS_LABEL */
+          bstrncpy(fsr.FileSet, mjcr->sd_impl->fileset_name,
+                   sizeof(fsr.FileSet));
+          bstrncpy(fsr.MD5, mjcr->sd_impl->fileset_md5, sizeof(fsr.MD5));
+          CreateFilesetRecord(db, &fsr);
+          jr.FileSetId = fsr.FileSetId;
+
           // Do the final update to the Job record
           UpdateJobRecord(db, &jr, &elabel, rec);
 
@@ -760,19 +812,6 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
   switch (rec->maskedStream) {
     case STREAM_UNIX_ATTRIBUTES:
     case STREAM_UNIX_ATTRIBUTES_EX:
-      if (!UnpackAttributesRecord(my_bjcr, rec->Stream, rec->data,
-                                  rec->data_len, attr)) {
-        Emsg0(M_ERROR_TERM, 0, T_("Cannot continue.\n"));
-      }
-
-      if (g_verbose > 1) {
-        DecodeStat(attr->attr, &attr->statp, sizeof(attr->statp),
-                   &attr->LinkFI);
-        BuildAttrOutputFnames(my_bjcr, attr);
-        PrintLsOutput(my_bjcr, attr);
-      }
-      fr.JobId = mjcr->JobId;
-      fr.FileId = 0;
       num_files++;
       if (g_verbose && (num_files & 0x7FFF) == 0) {
         char ed1[30], ed2[30], ed3[30], ed4[30];
@@ -782,8 +821,7 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
               edit_uint64_with_commas(rec->Block, ed3),
               edit_uint64_with_commas(mr.VolBytes, ed4));
       }
-      CreateFileAttributesRecord(db, mjcr, attr->fname, attr->lname, attr->type,
-                                 attr->attr, rec);
+      CreateFileAttributesRecord(mjcr, rec);
       FreeJcr(mjcr);
       break;
 
@@ -792,7 +830,7 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
                                &rop)) {
         Emsg0(M_ERROR_TERM, 0, T_("Cannot continue.\n"));
       }
-      rop.FileIndex = mjcr->FileId;
+      rop.FileIndex = rec->FileIndex;
       rop.JobId = mjcr->JobId;
       rop.FileType = FT_RESTORE_FIRST;
 
@@ -852,35 +890,35 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
       BinToBase64(digest, sizeof(digest), (char*)rec->data,
                   CRYPTO_DIGEST_MD5_SIZE, true);
       if (g_verbose > 1) { Pmsg1(000, T_("Got MD5 record: %s\n"), digest); }
-      UpdateDigestRecord(db, digest, rec, CRYPTO_DIGEST_MD5);
+      UpdateDigestRecord(digest, rec, CRYPTO_DIGEST_MD5);
       break;
 
     case STREAM_SHA1_DIGEST:
       BinToBase64(digest, sizeof(digest), (char*)rec->data,
                   CRYPTO_DIGEST_SHA1_SIZE, true);
       if (g_verbose > 1) { Pmsg1(000, T_("Got SHA1 record: %s\n"), digest); }
-      UpdateDigestRecord(db, digest, rec, CRYPTO_DIGEST_SHA1);
+      UpdateDigestRecord(digest, rec, CRYPTO_DIGEST_SHA1);
       break;
 
     case STREAM_SHA256_DIGEST:
       BinToBase64(digest, sizeof(digest), (char*)rec->data,
                   CRYPTO_DIGEST_SHA256_SIZE, true);
       if (g_verbose > 1) { Pmsg1(000, T_("Got SHA256 record: %s\n"), digest); }
-      UpdateDigestRecord(db, digest, rec, CRYPTO_DIGEST_SHA256);
+      UpdateDigestRecord(digest, rec, CRYPTO_DIGEST_SHA256);
       break;
 
     case STREAM_SHA512_DIGEST:
       BinToBase64(digest, sizeof(digest), (char*)rec->data,
                   CRYPTO_DIGEST_SHA512_SIZE, true);
       if (g_verbose > 1) { Pmsg1(000, T_("Got SHA512 record: %s\n"), digest); }
-      UpdateDigestRecord(db, digest, rec, CRYPTO_DIGEST_SHA512);
+      UpdateDigestRecord(digest, rec, CRYPTO_DIGEST_SHA512);
       break;
 
     case STREAM_XXH128_DIGEST:
       BinToBase64(digest, sizeof(digest), (char*)rec->data,
                   CRYPTO_DIGEST_XXH128_SIZE, true);
       if (g_verbose > 1) { Pmsg1(000, T_("Got XXH128 record: %s\n"), digest); }
-      UpdateDigestRecord(db, digest, rec, CRYPTO_DIGEST_XXH128);
+      UpdateDigestRecord(digest, rec, CRYPTO_DIGEST_XXH128);
       break;
 
     case STREAM_ENCRYPTED_SESSION_DATA:
@@ -968,6 +1006,314 @@ static bool RecordCb(DeviceControlRecord* dcr, DeviceRecord* rec)
   return true;
 }
 
+/*
+ * File attributes are decoded and stored in the catalog by writer threads,
+ * so reading the Volume does not wait for the database.  All records of a
+ * session go to the same writer, as a digest belongs to the attributes
+ * before it.  Each writer has a database connection of its own and stores
+ * the attributes with the batch insert.
+ */
+struct CatalogItem {
+  enum class Type
+  {
+    kAttributes,
+    kDigest,
+    kCommit
+  };
+
+  Type type{Type::kCommit};
+  JobId_t JobId{0};
+  DBId_t ClientId{0};
+  int32_t FileIndex{0};
+  int32_t Stream{0};
+  int DigestType{0};
+  std::string data;
+};
+
+class CatalogWriter {
+ public:
+  static constexpr std::size_t kQueueSize = 16 * 1024; /* Records */
+
+  /* Without a thread, the records are stored right away on the reading
+   * thread using bscan's own database connection. */
+  CatalogWriter(BareosDb* t_db, bool threaded);
+  ~CatalogWriter();
+  CatalogWriter(const CatalogWriter&) = delete;
+  CatalogWriter& operator=(const CatalogWriter&) = delete;
+
+  void Push(CatalogItem&& item);
+  void RequestCommit();
+  // Wait until all records pushed before RequestCommit() are stored.
+  void WaitCommitted();
+
+ private:
+  // Attributes waiting for their digest
+  struct PendingFile {
+    std::string fname;
+    std::string lname;
+    std::string attr;
+    std::string digest;
+    int type{0};
+    int DigestType{0};
+    int32_t FileIndex{0};
+    int32_t Stream{0};
+    DBId_t ClientId{0};
+  };
+
+  void Run(channel::output<CatalogItem> out);
+  void Store(CatalogItem& item);
+  void StoreFile(JobId_t JobId, PendingFile& file);
+  void StoreLateDigest(CatalogItem& item);
+  void Commit();
+
+  JobControlRecord* jcr_{nullptr};
+  BareosDb* db_{nullptr};
+  bool own_jcr_{false};
+  const bool update_db_{update_db}; /* update_db changes while reading */
+  Attributes* attr_{nullptr};
+  std::unordered_map<JobId_t, PendingFile> pending_;
+
+  channel::input<CatalogItem> in_{nullptr};
+  std::thread writer_;
+  std::mutex mutex_;
+  std::condition_variable committed_cv_;
+  uint64_t requested_{0}; /* Only changed by the reading thread */
+  uint64_t committed_{0};
+};
+
+CatalogWriter::CatalogWriter(BareosDb* t_db, bool threaded)
+{
+  if (!threaded) {
+    jcr_ = bjcr;
+    db_ = t_db;
+    attr_ = new_attr(jcr_);
+    return;
+  }
+
+  jcr_ = new_jcr(BscanFreeJcr);
+  jcr_->sd_impl = new StoredJcrImpl;
+  register_jcr(jcr_);
+  own_jcr_ = true;
+  if (!t_db->OpenBatchConnection(jcr_)) {
+    Emsg1(M_ERROR_TERM, 0, T_("Could not open database connection. ERR=%s\n"),
+          t_db->strerror());
+  }
+  db_ = jcr_->db_batch;
+  attr_ = new_attr(jcr_);
+
+  auto [in, out] = channel::CreateBufferedChannel<CatalogItem>(kQueueSize);
+  in_ = std::move(in);
+  writer_ = std::thread(&CatalogWriter::Run, this, std::move(out));
+}
+
+CatalogWriter::~CatalogWriter()
+{
+  if (writer_.joinable()) {
+    in_.close();
+    writer_.join();
+  } else {
+    Commit();
+  }
+
+  FreeAttr(attr_);
+  if (jcr_->db_batch) {
+    jcr_->db_batch->CloseDatabase(jcr_);
+    jcr_->db_batch = nullptr;
+  }
+  if (own_jcr_) { FreeJcr(jcr_); }
+}
+
+void CatalogWriter::Push(CatalogItem&& item)
+{
+  if (writer_.joinable()) {
+    in_.emplace(std::move(item));
+  } else {
+    Store(item);
+  }
+}
+
+void CatalogWriter::RequestCommit()
+{
+  requested_++;
+  Push(CatalogItem{});
+}
+
+void CatalogWriter::WaitCommitted()
+{
+  std::unique_lock l(mutex_);
+  committed_cv_.wait(l, [this] { return committed_ == requested_; });
+}
+
+void CatalogWriter::Run(channel::output<CatalogItem> out)
+{
+  while (std::optional item = out.get()) { Store(*item); }
+
+  Commit();
+  db_->ThreadCleanup();
+}
+
+void CatalogWriter::Store(CatalogItem& item)
+{
+  switch (item.type) {
+    case CatalogItem::Type::kAttributes: {
+      if (auto found = pending_.find(item.JobId); found != pending_.end()) {
+        StoreFile(found->first, found->second);
+        pending_.erase(found);
+      }
+
+      if (!UnpackAttributesRecord(jcr_, item.Stream, item.data.data(),
+                                  item.data.size(), attr_)) {
+        Emsg0(M_ERROR_TERM, 0, T_("Cannot continue.\n"));
+      }
+
+      if (g_verbose > 1) {
+        DecodeStat(attr_->attr, &attr_->statp, sizeof(attr_->statp),
+                   &attr_->LinkFI);
+        BuildAttrOutputFnames(jcr_, attr_);
+        PrintLsOutput(jcr_, attr_);
+      }
+
+      PendingFile& file = pending_[item.JobId];
+      file.fname = attr_->fname;
+      file.lname = attr_->lname;
+      file.attr = attr_->attr;
+      file.type = attr_->type;
+      file.FileIndex = item.FileIndex;
+      file.Stream = item.Stream;
+      file.ClientId = item.ClientId;
+      break;
+    }
+    case CatalogItem::Type::kDigest:
+      // The digest is the last record of a file
+      if (auto found = pending_.find(item.JobId);
+          found != pending_.end()
+          && found->second.FileIndex == item.FileIndex) {
+        found->second.digest = std::move(item.data);
+        found->second.DigestType = item.DigestType;
+        StoreFile(found->first, found->second);
+        pending_.erase(found);
+      } else {
+        StoreLateDigest(item);
+      }
+      break;
+    case CatalogItem::Type::kCommit: {
+      Commit();
+      std::unique_lock l(mutex_);
+      committed_++;
+      committed_cv_.notify_all();
+      break;
+    }
+  }
+}
+
+void CatalogWriter::StoreFile(JobId_t JobId, PendingFile& file)
+{
+  AttributesDbRecord t_ar;
+
+  t_ar.fname = file.fname.data();
+  t_ar.link = file.lname.data();
+  t_ar.attr = file.attr.data();
+  t_ar.ClientId = file.ClientId;
+  t_ar.JobId = JobId;
+  t_ar.Stream = file.Stream;
+  t_ar.FileType = file.type;
+  if (file.type == FT_DELETED) {
+    t_ar.FileIndex = 0;
+  } else {
+    t_ar.FileIndex = file.FileIndex;
+  }
+  if (!file.digest.empty()) {
+    t_ar.Digest = file.digest.data();
+    t_ar.DigestType = file.DigestType;
+  }
+
+  if (!update_db_) { return; }
+
+  // Uses the batch insert if available
+  bool created;
+  if (t_ar.FileType != FT_BASE) {
+    created = db_->CreateAttributesRecord(jcr_, &t_ar);
+  } else {
+    created = db_->CreateFileAttributesRecord(jcr_, &t_ar);
+  }
+  if (!created) {
+    Pmsg1(0, T_("Could not create File Attributes record. ERR=%s\n"),
+          db_->strerror());
+    return;
+  }
+
+  if (g_verbose > 1) {
+    Pmsg1(000, T_("Created File record: %s\n"), file.fname.c_str());
+  }
+}
+
+/* The File record was already stored by a Commit() at the end of the
+ * previous volume, possibly by an earlier run resumed from the checkpoint,
+ * so its digest is added afterwards. */
+void CatalogWriter::StoreLateDigest(CatalogItem& item)
+{
+  if (!update_db_ || item.FileIndex <= 0) { return; }
+
+  if (!db_->AddDigestToFileRecord(jcr_, item.JobId, item.FileIndex,
+                                  item.data.data(), item.DigestType)) {
+    Pmsg1(0, T_("Could not add MD5/SHA1 to File record. ERR=%s\n"),
+          db_->strerror());
+    return;
+  }
+
+  if (g_verbose > 1) { Pmsg0(000, T_("Updated MD5/SHA1 record\n")); }
+}
+
+/* Store the files still waiting for a digest and flush the batch insert.
+ * A digest arriving later, e.g. on the next volume, is added by
+ * StoreLateDigest(). */
+void CatalogWriter::Commit()
+{
+  for (auto& [JobId, file] : pending_) { StoreFile(JobId, file); }
+  pending_.clear();
+
+  if (jcr_->batch_started && !jcr_->db_batch->WriteBatchFileRecords(jcr_)) {
+    Pmsg1(0, T_("Could not create File records. ERR=%s\n"),
+          jcr_->db_batch->strerror());
+  }
+}
+
+static std::vector<std::unique_ptr<CatalogWriter>> catalog_writers;
+
+static void StartCatalogWriters()
+{
+  // Writers on other threads need connections of their own
+  bool threaded = catalog_threads > 0 && db->BatchInsertAvailable();
+  int count = threaded ? catalog_threads : 1;
+
+  for (int i = 0; i < count; i++) {
+    catalog_writers.emplace_back(std::make_unique<CatalogWriter>(db, threaded));
+  }
+  if (g_verbose) {
+    Pmsg1(000, T_("Using %d threads to store File records.\n"),
+          threaded ? count : 0);
+  }
+}
+
+static CatalogWriter& CatalogWriterOf(DeviceRecord* rec)
+{
+  return *catalog_writers[(rec->VolSessionId ^ rec->VolSessionTime)
+                          % catalog_writers.size()];
+}
+
+// Wait until all File records seen so far are in the catalog
+static void CommitCatalogWriters()
+{
+  for (auto& writer : catalog_writers) { writer->RequestCommit(); }
+  for (auto& writer : catalog_writers) { writer->WaitCommitted(); }
+}
+
+static void StopCatalogWriters()
+{
+  CommitCatalogWriters();
+  catalog_writers.clear();
+}
+
 /**
  * Free the Job Control Record if no one is still using it.
  *  Called from main FreeJcr() routine in src/lib/jcr.c so
@@ -993,6 +1339,16 @@ static void BscanFreeJcr(JobControlRecord* jcr)
 
   if (jcr->RestoreBootstrap) { free(jcr->RestoreBootstrap); }
 
+  if (jcr->sd_impl->fileset_name) {
+    FreePoolMemory(jcr->sd_impl->fileset_name);
+    jcr->sd_impl->fileset_name = nullptr;
+  }
+
+  if (jcr->sd_impl->fileset_md5) {
+    FreePoolMemory(jcr->sd_impl->fileset_md5);
+    jcr->sd_impl->fileset_md5 = nullptr;
+  }
+
   if (jcr->sd_impl->dcr) {
     FreeDeviceControlRecord(jcr->sd_impl->dcr);
     jcr->sd_impl->dcr = nullptr;
@@ -1012,45 +1368,25 @@ static void BscanFreeJcr(JobControlRecord* jcr)
 }
 
 /**
- * We got a File Attributes record on the tape.  Now, lookup the Job
- * record, and then create the attributes record.
+ * We got a File Attributes record on the tape.  Do the bookkeeping of the
+ * Job and hand the record to the catalog writer of its session.
  */
-static bool CreateFileAttributesRecord(BareosDb* t_db,
-                                       JobControlRecord* mjcr,
-                                       char* fname,
-                                       char* lname,
-                                       int type,
-                                       char* ap,
+static void CreateFileAttributesRecord(JobControlRecord* mjcr,
                                        DeviceRecord* rec)
 {
   DeviceControlRecord* dcr = mjcr->sd_impl->read_dcr;
-  ar.fname = fname;
-  ar.link = lname;
-  ar.ClientId = mjcr->ClientId;
-  ar.JobId = mjcr->JobId;
-  ar.Stream = rec->Stream;
-  if (type == FT_DELETED) {
-    ar.FileIndex = 0;
-  } else {
-    ar.FileIndex = rec->FileIndex;
-  }
-  ar.attr = ap;
   if (dcr->VolFirstIndex == 0) { dcr->VolFirstIndex = rec->FileIndex; }
   dcr->FileIndex = rec->FileIndex;
   mjcr->JobFiles++;
 
-  if (!update_db) { return true; }
-
-  if (!t_db->CreateFileAttributesRecord(bjcr, &ar)) {
-    Pmsg1(0, T_("Could not create File Attributes record. ERR=%s\n"),
-          t_db->strerror());
-    return false;
-  }
-  mjcr->FileId = ar.FileId;
-
-  if (g_verbose > 1) { Pmsg1(000, T_("Created File record: %s\n"), fname); }
-
-  return true;
+  CatalogItem item;
+  item.type = CatalogItem::Type::kAttributes;
+  item.JobId = mjcr->JobId;
+  item.ClientId = mjcr->ClientId;
+  item.FileIndex = rec->FileIndex;
+  item.Stream = rec->Stream;
+  item.data.assign(rec->data, rec->data_len);
+  CatalogWriterOf(rec).Push(std::move(item));
 }
 
 // For each Volume we see, we create a Medium record
@@ -1232,6 +1568,7 @@ static JobControlRecord* CreateJobRecord(BareosDb* t_db,
   Pmsg2(000, T_("Created new JobId=%u record for original JobId=%u\n"),
         t_jr->JobId, t_label->JobId);
   mjcr->JobId = t_jr->JobId; /* set new JobId */
+  CheckpointJob(mjcr->JobId);
 
   return mjcr;
 }
@@ -1379,11 +1716,8 @@ static bool CreateJobmediaRecord(BareosDb* t_db, JobControlRecord* mjcr)
   return true;
 }
 
-// Simulate the database call that updates the MD5/SHA1 record
-static bool UpdateDigestRecord(BareosDb* t_db,
-                               char* digest,
-                               DeviceRecord* rec,
-                               int type)
+// Attach the MD5/SHA1 digest to the File record of the last attributes
+static bool UpdateDigestRecord(char* digest, DeviceRecord* rec, int type)
 {
   JobControlRecord* mjcr;
 
@@ -1399,19 +1733,14 @@ static bool UpdateDigestRecord(BareosDb* t_db,
     return false;
   }
 
-  if (!update_db || mjcr->FileId == 0) {
-    FreeJcr(mjcr);
-    return true;
-  }
-
-  if (!t_db->AddDigestToFileRecord(bjcr, mjcr->FileId, digest, type)) {
-    Pmsg1(0, T_("Could not add MD5/SHA1 to File record. ERR=%s\n"),
-          t_db->strerror());
-    FreeJcr(mjcr);
-    return false;
-  }
-
-  if (g_verbose > 1) { Pmsg0(000, T_("Updated MD5/SHA1 record\n")); }
+  CatalogItem item;
+  item.type = CatalogItem::Type::kDigest;
+  item.JobId = mjcr->JobId;
+  // Restored from LastFileIndex of the checkpoint on resume
+  item.FileIndex = mjcr->sd_impl->read_dcr->FileIndex;
+  item.DigestType = type;
+  item.data = digest;
+  CatalogWriterOf(rec).Push(std::move(item));
   FreeJcr(mjcr);
 
   return true;
@@ -1443,3 +1772,156 @@ static JobControlRecord* create_jcr(JobDbRecord* t_jr,
 
   return jobjcr;
 }
+
+static void ReadCheckpointFile()
+{
+  PoolMem errmsg;
+  if (!ReadCheckpoint(checkpoint_file, checkpoint, errmsg)) {
+    Emsg1(M_ERROR_TERM, 0, "%s", errmsg.c_str());
+  }
+  for (const CheckpointSession& session : checkpoint.sessions) {
+    if (session.created) { created_jobs.insert(session.JobId); }
+  }
+}
+
+static std::string RemoveScannedVolumes(const std::string& volumes)
+{
+  const std::vector<std::string>& scanned_volumes = checkpoint.volumes;
+  if (scanned_volumes.empty()) { return volumes; }
+  if (bsr) {
+    Emsg0(M_ERROR_TERM, 0,
+          T_("A checkpoint can only be resumed with the volumes given by "
+             "-V.\n"));
+  }
+
+  std::string remaining;
+  std::istringstream names(volumes);
+  std::string name;
+  while (std::getline(names, name, '|')) {
+    if (std::find(scanned_volumes.begin(), scanned_volumes.end(), name)
+        != scanned_volumes.end()) {
+      Pmsg1(000, T_("Volume %s was already scanned.\n"), name.c_str());
+      continue;
+    }
+    if (!remaining.empty()) { remaining += '|'; }
+    remaining += name;
+  }
+
+  return remaining;
+}
+
+// Ask before the File records stored after the checkpoint are removed
+static bool ConfirmCheckpointCleanup(const std::vector<std::string>& queries)
+{
+  Pmsg1(000,
+        T_("Resuming checkpoint %s removes the File records stored after "
+           "it:\n"),
+        checkpoint_file.c_str());
+  for (const std::string& query : queries) {
+    Pmsg1(000, "  %s\n", query.c_str());
+  }
+  if (assume_yes) { return true; }
+
+  char answer[100];
+  printf(T_("Continue? (yes/no): "));
+  fflush(stdout);
+  if (fgets(answer, sizeof(answer), stdin) == nullptr) { return false; }
+  StripTrailingJunk(answer);
+  return Bstrcasecmp(answer, "yes") || Bstrcasecmp(answer, T_("yes"));
+}
+
+// Continue the Jobs open at the checkpoint as if their SOS_LABEL was read
+static void ResumeFromCheckpoint()
+{
+  if (update_db) {
+    for (const CheckpointSession& session : checkpoint.sessions) {
+      if (session.created) { continue; }
+      Pmsg2(000,
+            T_("JobId=%u was not created by bscan, its File records after "
+               "FileIndex=%d are not removed.\n"),
+            session.JobId, session.LastFileIndex);
+    }
+
+    std::vector<std::string> queries = CheckpointCleanupQueries(checkpoint);
+    if (!queries.empty() && !ConfirmCheckpointCleanup(queries)) {
+      Emsg1(M_ERROR_TERM, 0, T_("Checkpoint %s not resumed.\n"),
+            checkpoint_file.c_str());
+    }
+    for (const std::string& query : queries) {
+      if (!db->SqlQuery(query.c_str())) {
+        Emsg1(M_ERROR_TERM, 0, T_("Could not remove File records. ERR=%s\n"),
+              db->strerror());
+      }
+    }
+  }
+
+  for (CheckpointSession& session : checkpoint.sessions) {
+    JobDbRecord t_jr;
+    t_jr.JobId = session.JobId;
+    if (!db->GetJobRecord(bjcr, &t_jr)) {
+      Pmsg1(000, T_("Job record for JobId=%u not found.\n"), session.JobId);
+    }
+
+    DeviceRecord* rec = new_record(false);
+    rec->VolSessionId = session.VolSessionId;
+    rec->VolSessionTime = session.VolSessionTime;
+    JobControlRecord* mjcr = create_jcr(&t_jr, rec, session.JobId);
+    FreeRecord(rec);
+
+    mjcr->sd_impl->insert_jobmedia_records = session.insert_jobmedia_records;
+    mjcr->sd_impl->read_dcr->FileIndex = session.LastFileIndex;
+    mjcr->client_name = GetPoolMemory(PM_FNAME);
+    PmStrcpy(mjcr->client_name, session.ClientName.c_str());
+    mjcr->sd_impl->fileset_name = GetPoolMemory(PM_FNAME);
+    PmStrcpy(mjcr->sd_impl->fileset_name, session.FileSetName.c_str());
+    mjcr->sd_impl->fileset_md5 = GetPoolMemory(PM_FNAME);
+    PmStrcpy(mjcr->sd_impl->fileset_md5, session.FileSetMD5.c_str());
+
+    Pmsg2(000, T_("Resuming JobId=%u at FileIndex=%d.\n"), mjcr->JobId,
+          session.LastFileIndex + 1);
+  }
+}
+
+static void CheckpointVolume(const char* volume)
+{
+  if (checkpoint_file.empty()) { return; }
+
+  checkpoint.volumes.push_back(volume);
+  checkpoint.sessions.clear();
+  checkpoint.jobs.clear();
+  CommitCatalogWriters();
+
+  for (auto mdcr : dev->attached_dcrs) {
+    JobControlRecord* mjcr = mdcr->jcr;
+    if (!mjcr || mjcr->JobId == 0) { continue; }
+
+    CheckpointSession session;
+    session.VolSessionId = mjcr->VolSessionId;
+    session.VolSessionTime = mjcr->VolSessionTime;
+    session.JobId = mjcr->JobId;
+    session.LastFileIndex = mjcr->sd_impl->read_dcr->FileIndex;
+    session.insert_jobmedia_records = mjcr->sd_impl->insert_jobmedia_records;
+    session.created = created_jobs.count(mjcr->JobId) > 0;
+    session.FileSetMD5 = NPRTB(mjcr->sd_impl->fileset_md5);
+    session.FileSetName = NPRTB(mjcr->sd_impl->fileset_name);
+    session.ClientName = NPRTB(mjcr->client_name);
+    checkpoint.sessions.push_back(std::move(session));
+  }
+
+  PoolMem errmsg;
+  if (!WriteCheckpoint(checkpoint_file, checkpoint, errmsg)) {
+    Pmsg1(000, "%s", errmsg.c_str());
+  }
+}
+
+static void CheckpointJob(JobId_t JobId)
+{
+  if (checkpoint_file.empty()) { return; }
+
+  created_jobs.insert(JobId);
+  checkpoint.jobs.push_back(JobId);
+  PoolMem errmsg;
+  if (!AddJobToCheckpoint(checkpoint_file, JobId, errmsg)) {
+    Pmsg1(000, "%s", errmsg.c_str());
+  }
+}
@@ -0,0 +1,260 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Checkpoint file of bscan.
+ */
+
+#include "include/bareos.h"
+#include "stored/bscan_checkpoint.h"
+#include "lib/berrno.h"
+
+#include <charconv>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace storagedaemon {
+
+namespace {
+// The next word of fields as a number, nothing else is accepted
+template <typename T> bool ParseNumber(std::istringstream& fields, T& value)
+{
+  std::string word;
+  if (!(fields >> word)) { return false; }
+  const char* end = word.data() + word.size();
+  auto [ptr, ec] = std::from_chars(word.data(), end, value);
+  return ec == std::errc{} && ptr == end;
+}
+
+bool ParseFlag(std::istringstream& fields, bool& value)
+{
+  int flag = 0;
+  if (!ParseNumber(fields, flag) || (flag != 0 && flag != 1)) { return false; }
+  value = flag == 1;
+  return true;
+}
+
+bool AtEnd(std::istringstream& fields)
+{
+  fields >> std::ws;
+  return fields.eof();
+}
+
+// The rest of the line
+bool ParseName(std::istringstream& fields, std::string& name)
+{
+  fields >> std::ws;
+  std::getline(fields, name);
+  return !fields.bad();
+}
+
+bool ParseSession(std::istringstream& fields, CheckpointSession& session)
+{
+  return ParseNumber(fields, session.VolSessionId)
+         && ParseNumber(fields, session.VolSessionTime)
+         && ParseNumber(fields, session.JobId) && session.JobId != 0
+         && ParseNumber(fields, session.LastFileIndex)
+         && session.LastFileIndex >= 0
+         && ParseFlag(fields, session.insert_jobmedia_records)
+         && ParseFlag(fields, session.created) && AtEnd(fields);
+}
+
+bool SyncFile(FILE* fp)
+{
+  if (fflush(fp) != 0) { return false; }
+#if !defined(HAVE_WIN32)
+  if (fsync(fileno(fp)) != 0) { return false; }
+#endif
+  return true;
+}
+
+// Make the rename of a file in dir durable
+void SyncDirectory([[maybe_unused]] const std::string& file)
+{
+#if !defined(HAVE_WIN32)
+  std::string::size_type slash = file.rfind('/');
+  std::string dir = slash == std::string::npos ? "." : file.substr(0, slash);
+  if (dir.empty()) { dir = "/"; }
+  int fd = open(dir.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    fsync(fd);
+    close(fd);
+  }
+#endif
+}
+}  // namespace
+
+bool ReadCheckpoint(const std::string& file,
+                    BscanCheckpoint& checkpoint,
+                    PoolMem& errmsg)
+{
+  std::ifstream in(file);
+  if (!in) {
+    if (errno == ENOENT) { return true; }
+    BErrNo be;
+    Mmsg(errmsg, T_("Could not open checkpoint %s. ERR=%s\n"), file.c_str(),
+         be.bstrerror());
+    return false;
+  }
+
+  // the fileset and client line follow the session line
+  enum class Expect
+  {
+    kAny,
+    kFileset,
+    kClient
+  };
+  Expect expect = Expect::kAny;
+  std::string line;
+  int lineno = 0;
+
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string keyword;
+    bool ok = false;
+
+    lineno++;
+    fields >> keyword;
+    if (expect == Expect::kFileset) {
+      CheckpointSession& session = checkpoint.sessions.back();
+      ok = keyword == "fileset" && (fields >> session.FileSetMD5)
+           && ParseName(fields, session.FileSetName);
+      if (session.FileSetMD5 == "-") { session.FileSetMD5.clear(); }
+      expect = Expect::kClient;
+    } else if (expect == Expect::kClient) {
+      ok = keyword == "client"
+           && ParseName(fields, checkpoint.sessions.back().ClientName);
+      expect = Expect::kAny;
+    } else if (keyword == "volume") {
+      std::string volume;
+      ok = ParseName(fields, volume) && !volume.empty();
+      checkpoint.volumes.push_back(volume);
+    } else if (keyword == "session") {
+      CheckpointSession session;
+      ok = ParseSession(fields, session);
+      checkpoint.sessions.push_back(session);
+      expect = Expect::kFileset;
+    } else if (keyword == "job") {
+      JobId_t JobId = 0;
+      ok = ParseNumber(fields, JobId) && JobId != 0 && AtEnd(fields);
+      checkpoint.jobs.push_back(JobId);
+    }
+
+    if (!ok) {
+      Mmsg(errmsg, T_("Invalid line %d in checkpoint %s: %s\n"), lineno,
+           file.c_str(), line.c_str());
+      return false;
+    }
+  }
+
+  if (in.bad()) {
+    BErrNo be;
+    Mmsg(errmsg, T_("Could not read checkpoint %s. ERR=%s\n"), file.c_str(),
+         be.bstrerror());
+    return false;
+  }
+  if (expect != Expect::kAny) {
+    Mmsg(errmsg, T_("Checkpoint %s ends within a session.\n"), file.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool WriteCheckpoint(const std::string& file,
+                     const BscanCheckpoint& checkpoint,
+                     PoolMem& errmsg)
+{
+  std::string tmp_file = file + ".tmp";
+  FILE* fp = fopen(tmp_file.c_str(), "w");
+  if (!fp) {
+    BErrNo be;
+    Mmsg(errmsg, T_("Could not write checkpoint %s. ERR=%s\n"),
+         tmp_file.c_str(), be.bstrerror());
+    return false;
+  }
+
+  for (const std::string& volume : checkpoint.volumes) {
+    fprintf(fp, "volume %s\n", volume.c_str());
+  }
+  for (const CheckpointSession& session : checkpoint.sessions) {
+    fprintf(fp, "session %u %u %u %d %d %d\n", session.VolSessionId,
+            session.VolSessionTime, session.JobId, session.LastFileIndex,
+            session.insert_jobmedia_records, session.created);
+    fprintf(fp, "fileset %s %s\n",
+            session.FileSetMD5.empty() ? "-" : session.FileSetMD5.c_str(),
+            session.FileSetName.c_str());
+    fprintf(fp, "client %s\n", session.ClientName.c_str());
+  }
+  for (JobId_t JobId : checkpoint.jobs) { fprintf(fp, "job %u\n", JobId); }
+
+  bool ok = !ferror(fp) && SyncFile(fp);
+  if (fclose(fp) != 0) { ok = false; }
+  if (!ok || rename(tmp_file.c_str(), file.c_str()) != 0) {
+    BErrNo be;
+    Mmsg(errmsg, T_("Could not write checkpoint %s. ERR=%s\n"), file.c_str(),
+         be.bstrerror());
+    unlink(tmp_file.c_str());
+    return false;
+  }
+  SyncDirectory(file);
+
+  return true;
+}
+
+bool AddJobToCheckpoint(const std::string& file,
+                        JobId_t JobId,
+                        PoolMem& errmsg)
+{
+  FILE* fp = fopen(file.c_str(), "a");
+  bool ok = fp && fprintf(fp, "job %u\n", JobId) > 0 && SyncFile(fp);
+  if (fp && fclose(fp) != 0) { ok = false; }
+  if (!ok) {
+    BErrNo be;
+    Mmsg(errmsg, T_("Could not add JobId=%u to checkpoint %s. ERR=%s\n"),
+         JobId, file.c_str(), be.bstrerror());
+  }
+  return ok;
+}
+
+std::vector<std::string> CheckpointCleanupQueries(
+    const BscanCheckpoint& checkpoint)
+{
+  std::vector<std::string> queries;
+  PoolMem query;
+
+  for (JobId_t JobId : checkpoint.jobs) {
+    Mmsg(query, "DELETE FROM File WHERE JobId=%u", JobId);
+    queries.emplace_back(query.c_str());
+  }
+  for (const CheckpointSession& session : checkpoint.sessions) {
+    if (!session.created) { continue; }
+    Mmsg(query, "DELETE FROM File WHERE JobId=%u AND FileIndex>%d",
+         session.JobId, session.LastFileIndex);
+    queries.emplace_back(query.c_str());
+  }
+
+  return queries;
+}
+
+} /* namespace storagedaemon */
@@ -0,0 +1,89 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Checkpoint file of bscan.
+ */
+
+#ifndef BAREOS_STORED_BSCAN_CHECKPOINT_H_
+#define BAREOS_STORED_BSCAN_CHECKPOINT_H_
+
+#include <string>
+#include <vector>
+
+namespace storagedaemon {
+
+/* A session still open at the end of the last scanned volume.  created is
+ * set if bscan created the Job record, otherwise the File records are added
+ * to a Job that was already in the catalog.  The File record of
+ * LastFileIndex is stored, but its digest may still follow on the next
+ * volume and is then added to it. */
+struct CheckpointSession {
+  uint32_t VolSessionId{0};
+  uint32_t VolSessionTime{0};
+  JobId_t JobId{0};
+  int32_t LastFileIndex{0};
+  bool insert_jobmedia_records{false};
+  bool created{false};
+  std::string FileSetMD5{};
+  std::string FileSetName{};
+  std::string ClientName{};
+};
+
+/*
+ * The checkpoint file lists the volumes scanned completely and the sessions
+ * still open at the end of the last one.  It is rewritten after every volume,
+ * once all File records of it are in the catalog.  Jobs created after that
+ * are appended, so a resumed scan can remove the File records they got
+ * before bscan was interrupted.
+ */
+struct BscanCheckpoint {
+  std::vector<std::string> volumes{};
+  std::vector<CheckpointSession> sessions{};
+  std::vector<JobId_t> jobs{};
+};
+
+/* Read the checkpoint in file.  A missing file is an empty checkpoint, a
+ * file that cannot be parsed completely is an error. */
+bool ReadCheckpoint(const std::string& file,
+                    BscanCheckpoint& checkpoint,
+                    PoolMem& errmsg);
+
+/* Replace file by checkpoint.  The new content is synced to disk before it
+ * is renamed over the old one. */
+bool WriteCheckpoint(const std::string& file,
+                     const BscanCheckpoint& checkpoint,
+                     PoolMem& errmsg);
+
+// Append a Job created by bscan to file and sync it to disk
+bool AddJobToCheckpoint(const std::string& file,
+                        JobId_t JobId,
+                        PoolMem& errmsg);
+
+/* The queries removing the File records stored after checkpoint was
+ * written.  Only Jobs created by bscan are cleaned up, as the File records
+ * of other Jobs may have been in the catalog before. */
+std::vector<std::string> CheckpointCleanupQueries(
+    const BscanCheckpoint& checkpoint);
+
+} /* namespace storagedaemon */
+
+#endif  // BAREOS_STORED_BSCAN_CHECKPOINT_H_
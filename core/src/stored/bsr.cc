@@ -41,9 +41,12 @@
 #include "stored/bsr.h"
 #include "stored/device_control_record.h"
 #include "stored/stored_jcr_impl.h"
+#include "stored/match_bsr.h"
 #include "stored/stored.h"
 #include "include/jcr.h"
 
+#include <algorithm>
+
 namespace storagedaemon {
 
 const int dbglevel = 500;
@@ -753,6 +756,115 @@ uint64_t GetBsrStartAddr(BootStrapRecord* bsr, uint32_t* file, uint32_t* block)
   return bsr_addr;
 }
 
+/**
+ * Check if rec was written by the single session selected by the bsr, only
+ * then its FileIndex tells whether more wanted records can follow.
+ */
+static bool IsOnlySessionOfBsr(BootStrapRecord* bsr, DeviceRecord* rec)
+{
+  if (!bsr->sesstime || bsr->sesstime->next || !bsr->sessid
+      || bsr->sessid->next || bsr->sessid->sessid != bsr->sessid->sessid2) {
+    return false;
+  }
+  return bsr->sesstime->sesstime == rec->VolSessionTime
+         && bsr->sessid->sessid == rec->VolSessionId;
+}
+
+/**
+ * Collect the VolAddr ranges of all bsrs for the Volume on dev.
+ * If one of them has no VolAddr, we do not know where its records are
+ * and leave the index unusable.
+ */
+static void BuildBsrIndex(BootStrapRecord* root_bsr, Device* dev)
+{
+  if (!root_bsr->index) { root_bsr->index = new BsrIndex; }
+
+  BsrIndex* index = root_bsr->index;
+  index->VolumeName = dev->VolHdr.VolumeName;
+  index->intervals.clear();
+  index->first_pending = 0;
+  index->usable = false;
+  if (!root_bsr->use_positioning) { return; }
+
+  for (BootStrapRecord* bsr = root_bsr; bsr; bsr = bsr->next) {
+    if (!MatchVolume(bsr, bsr->volume, &dev->VolHdr, 1)) { continue; }
+    if (!bsr->voladdr) {
+      index->intervals.clear();
+      return;
+    }
+
+    int32_t last_findex = INT32_MAX;
+    if (bsr->FileIndex) {
+      last_findex = 0;
+      for (BsrFileIndex* fi = bsr->FileIndex; fi; fi = fi->next) {
+        last_findex = std::max(last_findex, fi->findex2);
+      }
+    }
+    for (BsrVolumeAddress* va = bsr->voladdr; va; va = va->next) {
+      index->intervals.push_back({va->saddr, va->eaddr, last_findex, bsr,
+                                  false});
+    }
+  }
+
+  std::sort(index->intervals.begin(), index->intervals.end(),
+            [](const BsrInterval& a, const BsrInterval& b) {
+              return a.saddr < b.saddr;
+            });
+  index->usable = !index->intervals.empty();
+  Dmsg2(dbglevel, "Bsr index of Volume %s has %d ranges\n",
+        index->VolumeName.c_str(), (int)index->intervals.size());
+}
+
+/**
+ * Called for a record no bsr wants, to find out where the next wanted
+ * record can be.  The ranges are walked in address order; ranges we have
+ * read past or whose records were all found are marked done, so each is
+ * looked at only a few times over the whole Volume.
+ */
+BsrSeek PlanBsrSeek(BootStrapRecord* root_bsr,
+                    Device* dev,
+                    DeviceRecord* rec,
+                    uint64_t* addr)
+{
+  if (!root_bsr) { return BsrSeek::kUnknown; }
+
+  if (!root_bsr->index
+      || root_bsr->index->VolumeName != dev->VolHdr.VolumeName) {
+    BuildBsrIndex(root_bsr, dev);
+  }
+
+  BsrIndex* index = root_bsr->index;
+  if (!index->usable) { return BsrSeek::kUnknown; }
+
+  uint64_t rec_addr = GetRecordAddress(rec);
+  BsrSeek result = BsrSeek::kVolumeDone;
+  for (size_t i = index->first_pending; i < index->intervals.size(); i++) {
+    BsrInterval& interval = index->intervals[i];
+
+    if (interval.done) { continue; }
+    if (interval.saddr > rec_addr) {
+      *addr = interval.saddr;
+      result = BsrSeek::kSeek;
+      break;
+    }
+    if (interval.eaddr < rec_addr || interval.bsr->done
+        || (rec->FileIndex > interval.last_findex
+            && IsOnlySessionOfBsr(interval.bsr, rec))) {
+      interval.done = true;
+      continue;
+    }
+    result = BsrSeek::kStay;
+    break;
+  }
+
+  while (index->first_pending < index->intervals.size()
+         && index->intervals[index->first_pending].done) {
+    index->first_pending++;
+  }
+
+  return result;
+}
+
 /* ****************************************************************
  * Routines for handling volumes
  */
@@ -35,6 +35,9 @@
 #endif
 #include "lib/attr.h"
 
+#include <string>
+#include <vector>
+
 namespace storagedaemon {
 
 /**
@@ -139,6 +142,32 @@ struct BsrStream {
   int32_t stream; /* stream desired */
 };
 
+struct BootStrapRecord;
+
+/**
+ * One VolAddr range of a bsr together with the last FileIndex wanted from
+ * it.  Once a record of the same session with a higher FileIndex was read,
+ * the rest of the range can be skipped.
+ */
+struct BsrInterval {
+  uint64_t saddr;       /* start address */
+  uint64_t eaddr;       /* end address */
+  int32_t last_findex;  /* last file index wanted in this range */
+  BootStrapRecord* bsr; /* bsr this range belongs to */
+  bool done;            /* set when nothing more is wanted from this range */
+};
+
+/**
+ * The VolAddr ranges of all bsrs for one Volume, sorted by start address.
+ * It is built by the SD when the Volume is read, see PlanBsrSeek().
+ */
+struct BsrIndex {
+  std::string VolumeName;
+  std::vector<BsrInterval> intervals;
+  size_t first_pending{0}; /* all intervals before are done */
+  bool usable{false};      /* all bsrs of the Volume have a VolAddr */
+};
+
 struct BootStrapRecord {
   /* NOTE!!! next must be the first item */
   BootStrapRecord* next;   /* pointer to next one */
@@ -168,6 +197,7 @@ struct BootStrapRecord {
   char* fileregex; /* set if restore is filtered on filename */
   regex_t* fileregex_re;
   Attributes* attr; /* scratch space for unpacking */
+  BsrIndex* index;  /* set on the root bsr, see PlanBsrSeek() */
 };
 
 
@@ -545,6 +545,16 @@ uint32_t crc32_16bytes_prefetch(const void* data, size_t length, uint32_t previo
 
 /// compute CRC32 using the fastest algorithm for large datasets on modern CPUs
 uint32_t crc32_fast(const void* data, size_t length, uint32_t previousCrc32)
+{
+  // Bareos: select the implementation once at runtime
+  static const auto implementation
+      = crc32_hardware_available() ? crc32_hardware : crc32_software;
+  return implementation(data, length, previousCrc32);
+}
+
+
+/// compute CRC32 using the fastest software algorithm
+uint32_t crc32_software(const void* data, size_t length, uint32_t previousCrc32)
 {
 #ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
   return crc32_16bytes (data, length, previousCrc32);
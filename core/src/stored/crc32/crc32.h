@@ -28,8 +28,17 @@
 #include <stddef.h>
 
 // crc32_fast selects the fastest algorithm depending on flags (CRC32_USE_LOOKUP_...)
+// Bareos: crc32_fast uses crc32_hardware if the cpu supports it
 /// compute CRC32 using the fastest algorithm for large datasets on modern CPUs
 uint32_t crc32_fast    (const void* data, size_t length, uint32_t previousCrc32 = 0);
+/// compute CRC32 using the fastest software algorithm (see crc32_fast above)
+uint32_t crc32_software(const void* data, size_t length, uint32_t previousCrc32 = 0);
+
+// Bareos: hardware accelerated variants, see crc32_hw.cc
+/// true if crc32_hardware can be used on this cpu
+bool     crc32_hardware_available();
+/// compute CRC32 using PCLMULQDQ (x86) or the CRC32 instructions (ARMv8)
+uint32_t crc32_hardware(const void* data, size_t length, uint32_t previousCrc32 = 0);
 
 /// compute CRC32 (bitwise algorithm)
 uint32_t crc32_bitwise (const void* data, size_t length, uint32_t previousCrc32 = 0);
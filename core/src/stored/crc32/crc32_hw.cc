@@ -0,0 +1,220 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can modify it under the terms of
+   version three of the GNU Affero General Public License as published by the
+   Free Software Foundation, which is listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Hardware accelerated CRC32 (zlib polynomial) with runtime cpu detection.
+ *
+ * Note that the SSE4.2 crc32 instruction cannot be used here, as it computes
+ * CRC32C (Castagnoli), which would change every block checksum.  On x86 the
+ * checksum is instead folded with carry-less multiplication as described in
+ * "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction"
+ * (Gopal et al., Intel 2009).  ARMv8 has instructions for both polynomials.
+ */
+
+#include "crc32.h"
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define CRC32_HAVE_PCLMUL 1
+#  include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__) \
+    && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#  define CRC32_HAVE_ARMV8 1
+#  include <arm_acle.h>
+#  if defined(__linux__)
+#    include <sys/auxv.h>
+#    include <asm/hwcap.h>
+#  endif
+#endif
+
+#if defined(CRC32_HAVE_PCLMUL)
+namespace {
+/* Folds len bytes into crc; len needs to be a multiple of 16 and at least
+ * 64.  crc is not inverted. */
+__attribute__((target("pclmul,sse4.1"))) uint32_t
+Crc32FoldPclmul(const unsigned char* buf, size_t len, uint32_t crc)
+{
+  // bit-reflected constants for the zlib polynomial
+  alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+  alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+  alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+  alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+  x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+  x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+  x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+  x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+  x0 = _mm_load_si128((const __m128i*)k1k2);
+  buf += 64;
+  len -= 64;
+
+  // fold four 128 bit lanes in parallel
+  while (len >= 64) {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+    y5 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+    y6 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+    y7 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+    y8 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+    buf += 64;
+    len -= 64;
+  }
+
+  // fold the four lanes into one
+  x0 = _mm_load_si128((const __m128i*)k3k4);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  // fold the remaining 16 byte blocks
+  while (len >= 16) {
+    x2 = _mm_loadu_si128((const __m128i*)buf);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    buf += 16;
+    len -= 16;
+  }
+
+  // fold 128 bits to 64 bits
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+  x1 = _mm_srli_si128(x1, 8);
+  x1 = _mm_xor_si128(x1, x2);
+
+  x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, x3);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // barrett reduction to 32 bits
+  x0 = _mm_load_si128((const __m128i*)poly);
+
+  x2 = _mm_and_si128(x1, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+  x2 = _mm_and_si128(x2, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+}  // namespace
+
+bool crc32_hardware_available()
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+}
+
+uint32_t crc32_hardware(const void* data, size_t length, uint32_t previousCrc32)
+{
+  const unsigned char* buf = static_cast<const unsigned char*>(data);
+
+  // the setup costs more than it saves for small buffers
+  if (length >= 64) {
+    size_t folded = length & ~size_t{15};
+    previousCrc32 = ~Crc32FoldPclmul(buf, folded, ~previousCrc32);
+    buf += folded;
+    length -= folded;
+  }
+
+  return crc32_software(buf, length, previousCrc32);
+}
+
+#elif defined(CRC32_HAVE_ARMV8)
+
+bool crc32_hardware_available()
+{
+#  if defined(__linux__)
+  return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#  elif defined(__APPLE__)
+  return true;  // all 64 bit apple cpus support the crc32 instructions
+#  else
+  return false;
+#  endif
+}
+
+__attribute__((target("+crc"))) uint32_t crc32_hardware(const void* data,
+                                                        size_t length,
+                                                        uint32_t previousCrc32)
+{
+  const unsigned char* buf = static_cast<const unsigned char*>(data);
+  uint32_t crc = ~previousCrc32;
+
+  while (length > 0 && (reinterpret_cast<uintptr_t>(buf) & 7) != 0) {
+    crc = __crc32b(crc, *buf++);
+    length -= 1;
+  }
+  while (length >= 8) {
+    uint64_t value;
+    std::memcpy(&value, buf, sizeof(value));
+    crc = __crc32d(crc, value);
+    buf += 8;
+    length -= 8;
+  }
+  while (length > 0) {
+    crc = __crc32b(crc, *buf++);
+    length -= 1;
+  }
+
+  return ~crc;
+}
+
+#else
+
+bool crc32_hardware_available() { return false; }
+
+uint32_t crc32_hardware(const void* data, size_t length, uint32_t previousCrc32)
+{
+  return crc32_software(data, length, previousCrc32);
+}
+
+#endif
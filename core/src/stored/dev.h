@@ -181,6 +181,7 @@ enum class SeekMode
 
 // incomplete list of device types for GuessMissingDeviceTypes()
 struct DeviceType {
+  static constexpr std::string_view B_CHUNKED_DEV = "chunked";
   static constexpr std::string_view B_DROPLET_DEV = "droplet";
   static constexpr std::string_view B_FIFO_DEV = "fifo";
   static constexpr std::string_view B_FILE_DEV = "file";
@@ -290,6 +291,7 @@ class Device {
   btime_t DevWriteTime{};
   uint64_t DevWriteBytes{};
   uint64_t DevReadBytes{};
+  uint64_t DevSkippedBytes{}; /**< Not read thanks to the bootstrap */
 
   /* Methods */
   btime_t GetTimerCount(); /**< Return the last timer interval (ms) */
@@ -455,6 +457,8 @@ public:
   virtual bool DeviceStatus(DeviceStatusInformation*) { return false; }
   virtual SeekMode GetSeekMode() const = 0;
   virtual bool CanReadConcurrently() const { return false; }
+  // Whether d_pread() may be used by a second thread, see block_prefetcher.h
+  virtual bool CanPrefetchBlocks() const { return false; }
 
   // Low level operations
   virtual int d_ioctl(int fd, ioctl_req_t request, char* mt_com = NULL) = 0;
@@ -467,6 +471,16 @@ public:
                             int whence) = 0;
   virtual bool d_truncate(DeviceControlRecord* dcr) = 0;
   virtual bool d_flush(DeviceControlRecord*) { return true; };
+  /* Waits until the blocks written so far are on the volume, for devices
+   * that queue their writes.  Done before the blocks are reported to the
+   * director in a JobMedia record; may be called without the device lock. */
+  virtual bool WaitForQueuedWrites() { return true; }
+  // Read at offset without moving the position of the device.
+  virtual ssize_t d_pread(int, void*, size_t, boffset_t)
+  {
+    errno = ENOSYS;
+    return -1;
+  }
 
     // Locking and blocking calls
   void rLock(bool locked = false);
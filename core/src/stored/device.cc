@@ -291,6 +291,28 @@ bail_out:
   return ok;
 }
 
+/**
+ * Reposition the device and account the bytes we did not have to read,
+ * this is only known on devices addressed by bytes.
+ */
+static void SkipToPosition(JobControlRecord* jcr,
+                           DeviceControlRecord* dcr,
+                           uint32_t file,
+                           uint32_t block)
+{
+  Device* dev = dcr->dev;
+  uint64_t from = dev->file_addr;
+
+  if (!dev->Reposition(dcr, file, block)) { return; }
+
+  if (dev->GetSeekMode() == SeekMode::BYTES && dev->file_addr > from) {
+    uint64_t skipped = dev->file_addr - from;
+
+    dev->DevSkippedBytes += skipped;
+    jcr->sd_impl->read_session.skipped_bytes += skipped;
+  }
+}
+
 // Position to the first file on this volume
 BootStrapRecord* PositionDeviceToFirstFile(JobControlRecord* jcr,
                                            DeviceControlRecord* dcr)
@@ -307,7 +329,7 @@ BootStrapRecord* PositionDeviceToFirstFile(JobControlRecord* jcr,
       Jmsg(jcr, M_INFO, 0,
            T_("Forward spacing Volume \"%s\" to file:block %u:%u.\n"),
            dev->VolHdr.VolumeName, file, block);
-      dev->Reposition(dcr, file, block);
+      SkipToPosition(jcr, dcr, file, block);
     }
   }
   return bsr;
@@ -326,6 +348,39 @@ bool TryDeviceRepositioning(JobControlRecord* jcr,
   BootStrapRecord* bsr;
   Device* dev = dcr->dev;
 
+  /* On devices addressed by bytes the VolAddr ranges of the bsr tell us
+   * where the next wanted record can be, so we seek over everything else. */
+  if (dev->GetSeekMode() == SeekMode::BYTES
+      && dev->HasCap(CAP_POSITIONBLOCKS)) {
+    uint64_t addr = 0;
+
+    switch (PlanBsrSeek(jcr->sd_impl->read_session.bsr, dev, rec, &addr)) {
+      case BsrSeek::kStay:
+        return false;
+      case BsrSeek::kSeek: {
+        uint64_t dev_addr = (((uint64_t)dev->file) << 32) | dev->block_num;
+
+        if (addr > dev_addr) {
+          Dmsg4(500, "Skip from (file:block) %u:%u to %u:%u\n", dev->file,
+                dev->block_num, (uint32_t)(addr >> 32), (uint32_t)addr);
+          SkipToPosition(jcr, dcr, (uint32_t)(addr >> 32), (uint32_t)addr);
+          rec->Block = 0;
+        }
+        return false;
+      }
+      case BsrSeek::kVolumeDone:
+        Dmsg0(500, "Nothing more wanted from this volume\n");
+        if (!dev->AtEot()) {
+          jcr->sd_impl->read_session.mount_next_volume = true;
+          dev->SetEot();
+        }
+        rec->Block = 0;
+        return true;
+      case BsrSeek::kUnknown:
+        break;
+    }
+  }
+
   bsr = find_next_bsr(jcr->sd_impl->read_session.bsr, dev);
   if (bsr == NULL && jcr->sd_impl->read_session.bsr->mount_next_volume) {
     Dmsg0(500, "Would mount next volume here\n");
@@ -352,7 +407,7 @@ bool TryDeviceRepositioning(JobControlRecord* jcr,
     if (dev_addr > bsr_addr) { return false; }
     Dmsg4(500, "Try_Reposition from (file:block) %u:%u to %u:%u\n", dev->file,
           dev->block_num, file, block);
-    dev->Reposition(dcr, file, block);
+    SkipToPosition(jcr, dcr, file, block);
     rec->Block = 0;
   }
   return false;
@@ -57,6 +57,8 @@ class Device;
 class DeviceResource;
 struct DeviceBlock;
 struct DeviceRecord;
+struct DataSpool;
+class BlockPrefetcher;
 
 /* clang-format off */
 
@@ -87,6 +89,8 @@ class DeviceControlRecord {
   pthread_t tid{};                 /**< Thread running this dcr */
   bool spool_data{};         /**< Set to spool data */
   int spool_fd{};            /**< Fd if spooling */
+  DataSpool* data_spool{};   /**< Spool segments, see spool.cc */
+  BlockPrefetcher* prefetcher{}; /**< Reads blocks ahead, see ReadRecords() */
   bool spooling{};           /**< Set when actually spooling */
   bool despooling{};         /**< Set when despooling */
   bool despool_wait{};       /**< Waiting for despooling */
@@ -90,6 +90,8 @@ DeviceResource::DeviceResource(const DeviceResource& other)
   volume_capacity = other.volume_capacity;
   max_spool_size = other.max_spool_size;
   max_job_spool_size = other.max_job_spool_size;
+  spool_direct_io = other.spool_direct_io;
+  spool_double_buffering = other.spool_double_buffering;
 
   if (other.mount_point) { mount_point = strdup(other.mount_point); }
   if (other.mount_command) { mount_command = strdup(other.mount_command); }
@@ -146,6 +148,8 @@ DeviceResource& DeviceResource::operator=(const DeviceResource& rhs)
   volume_capacity = rhs.volume_capacity;
   max_spool_size = rhs.max_spool_size;
   max_job_spool_size = rhs.max_job_spool_size;
+  spool_direct_io = rhs.spool_direct_io;
+  spool_double_buffering = rhs.spool_double_buffering;
 
   mount_point = rhs.mount_point;
   mount_command = rhs.mount_command;
@@ -81,6 +81,8 @@ class DeviceResource : public BareosResource {
   int64_t volume_capacity{0};        /**< Advisory capacity */
   int64_t max_spool_size{0};         /**< Max spool size for all jobs */
   int64_t max_job_spool_size{0};     /**< Max spool size for any single job */
+  bool spool_direct_io{false};        /**< Spool with O_DIRECT */
+  bool spool_double_buffering{false}; /**< Spool while despooling */
 
   char* mount_point;     /**< Mount point for require mount devices */
   char* mount_command;   /**< Mount command */
@@ -87,6 +87,7 @@ static char NOT_opened[] = "3902 Error session not opened\n";
 static char OK_end[] = "3000 OK end\n";
 static char OK_close[] = "3000 OK close Status = %d\n";
 static char OK_open[] = "3000 OK open ticket = %d\n";
+static char OK_open_frames[] = "3000 OK open ticket = %d frames\n";
 static char ERROR_append[] = "3903 Error append data\n";
 
 /* Responses sent to the Director */
@@ -297,8 +298,13 @@ static bool AppendOpenSession(JobControlRecord* jcr)
 
   jcr->sd_impl->session_opened = true;
 
-  /* Send "Ticket" to File Daemon */
-  fd->fsend(OK_open, jcr->VolSessionId);
+  /* Send "Ticket" to File Daemon, confirming that the data may come in
+   * frames of many small messages (see BareosSocket::SetFrameSize()). */
+  if (strstr(fd->msg, " frames")) {
+    fd->fsend(OK_open_frames, jcr->VolSessionId);
+  } else {
+    fd->fsend(OK_open, jcr->VolSessionId);
+  }
   Dmsg1(110, ">filed: %s", fd->msg);
 
   return true;
@@ -1,7 +1,7 @@
 /*
    BAREOS® - Backup Archiving REcovery Open Sourced
 
-   Copyright (C) 2018-2023 Bareos GmbH & Co. KG
+   Copyright (C) 2018-2024 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -35,6 +35,18 @@ uint64_t GetBsrStartAddr(BootStrapRecord* bsr,
                          uint32_t* file = NULL,
                          uint32_t* block = NULL);
 
+enum class BsrSeek
+{
+  kUnknown,    /* no VolAddr for every bsr of the Volume, cannot plan */
+  kStay,       /* the record is in a range that is still wanted */
+  kSeek,       /* nothing wanted before addr, seek there */
+  kVolumeDone, /* nothing more wanted from this Volume */
+};
+BsrSeek PlanBsrSeek(BootStrapRecord* root_bsr,
+                    Device* dev,
+                    DeviceRecord* rec,
+                    uint64_t* addr);
+
 } /* namespace storagedaemon */
 
 #endif  // BAREOS_STORED_MATCH_BSR_H_
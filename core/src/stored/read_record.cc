@@ -35,6 +35,7 @@
 
 #include "include/bareos.h"
 #include "stored/stored.h"
+#include "stored/block_prefetcher.h"
 #include "stored/butil.h"
 #include "stored/device.h"
 #include "stored/device_control_record.h"
@@ -43,6 +44,7 @@
 #include "stored/match_bsr.h"
 #include "stored/read_ctx.h"
 #include "include/jcr.h"
+#include "lib/edit.h"
 
 namespace storagedaemon {
 
@@ -206,6 +208,9 @@ bool ReadNextBlockFromDevice(DeviceControlRecord* dcr,
              T_("End of Volume at file %u on device %s, Volume \"%s\"\n"),
              dcr->dev->file, dcr->dev->print_name(), dcr->VolumeName);
 
+        // The volume gets closed, so stop reading it ahead.
+        if (dcr->prefetcher) { dcr->prefetcher->Stop(); }
+
         VolumeUnused(dcr); /* mark volume unused */
         if (!mount_cb(dcr)) {
           Jmsg(jcr, M_INFO, 0, T_("End of all volumes.\n"));
@@ -399,6 +404,11 @@ bool ReadRecords(DeviceControlRecord* dcr,
   PositionDeviceToFirstFile(jcr, dcr);
   jcr->sd_impl->read_session.mount_next_volume = false;
 
+  /* Read the next blocks while the records of the current one are
+   * processed by the callback. */
+  BlockPrefetcher prefetcher(dcr);
+  dcr->prefetcher = &prefetcher;
+
   while (ok && !done) {
     if (jcr->IsJobCanceled()) {
       ok = false;
@@ -484,6 +494,20 @@ bool ReadRecords(DeviceControlRecord* dcr,
   // Dmsg2(debuglevel, "Position=(file:block) %u:%u\n", dcr->dev->file,
   // dcr->dev->block_num);
 
+  dcr->prefetcher = nullptr;
+  prefetcher.Stop();
+
+  if (jcr->sd_impl->read_session.skipped_bytes > 0) {
+    char ed1[50];
+
+    Jmsg(jcr, M_INFO, 0,
+         T_("Skipped %s bytes of Volume data not selected by the "
+            "bootstrap.\n"),
+         edit_uint64_with_commas(jcr->sd_impl->read_session.skipped_bytes,
+                                 ed1));
+    jcr->sd_impl->read_session.skipped_bytes = 0;
+  }
+
   FreeReadContext(rctx);
   PrintBlockReadErrors(jcr, dcr->block);
 
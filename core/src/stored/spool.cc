@@ -40,18 +40,38 @@
 #include "lib/status_packet.h"
 #include "lib/util.h"
 #include "include/jcr.h"
+#include "lib/channel.h"
+#include "lib/thread_specific_data.h"
+
+#include <algorithm>
+#include <atomic>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace storagedaemon {
 
 /* Forward referenced subroutines */
 static void MakeUniqueDataSpoolFilename(DeviceControlRecord* dcr,
-                                        POOLMEM*& name);
+                                        POOLMEM*& name,
+                                        int segment);
 static bool OpenDataSpoolFile(DeviceControlRecord* dcr);
 static bool CloseDataSpoolFile(DeviceControlRecord* dcr, bool end_of_spool);
+static bool OpenSpoolSegment(DataSpool* spool, int segment);
+static void CloseSpoolSegment(DataSpool* spool, int segment);
+static void EmptySpoolSegment(DataSpool* spool, int segment);
 static bool DespoolData(DeviceControlRecord* dcr, bool commit);
-static int ReadBlockFromSpoolFile(DeviceControlRecord* dcr);
+static bool DespoolSegment(DeviceControlRecord* dcr,
+                           DataSpool* spool,
+                           int segment,
+                           bool commit);
+static bool StartBackgroundDespool(DeviceControlRecord* dcr);
+static bool WaitForBackgroundDespool(DeviceControlRecord* dcr);
 static bool OpenAttrSpoolFile(JobControlRecord* jcr, BareosSocket* bs);
 static bool CloseAttrSpoolFile(JobControlRecord* jcr, BareosSocket* bs);
+static bool WriteSpoolRecord(DeviceControlRecord* dcr);
+static bool WriteSpoolDirect(DeviceControlRecord* dcr);
 static bool WriteSpoolHeader(DeviceControlRecord* dcr);
 static bool WriteSpoolData(DeviceControlRecord* dcr);
 
@@ -77,11 +97,148 @@ struct spool_hdr {
   uint32_t len;       /* length of next buffer */
 };
 
-enum
+/* Records written with O_DIRECT are padded to this size */
+static constexpr uint32_t kSpoolAlignment = 4096;
+
+/* Amount of spooled data read ahead of the Volume writes */
+static constexpr uint32_t kSpoolReadAhead = 32 * 1024 * 1024;
+
+/**
+ * The data spool of a job consists of up to two segment files.  With
+ * double buffering one segment is despooled to the Volume by a background
+ * thread while the job keeps spooling into the other one.
+ */
+struct DataSpool {
+  DeviceControlRecord* dcr{};         /* dcr of the job */
+  int fd[2]{-1, -1};                  /* segment files */
+  int direct_fd[2]{-1, -1};           /* same files opened with O_DIRECT */
+  int64_t size[2]{};                  /* bytes spooled to each segment */
+  int current{};                      /* segment the job spools into */
+  bool direct_io{};                   /* use O_DIRECT if possible */
+  bool double_buffering{};            /* despool in the background */
+  char* io_buffer{};                  /* aligned buffer for O_DIRECT */
+  uint32_t io_buffer_size{};          /* size of io_buffer */
+  std::thread despooler;              /* background despool thread */
+  DeviceControlRecord* despool_dcr{}; /* dcr of the background despool */
+  std::atomic<bool> despool_done{};   /* background despool has finished */
+  std::atomic<bool> stop{};           /* abort the background despool */
+  bool despool_ok{true};              /* result of the background despool */
+};
+
+/* Length of a record in the current segment of the spool */
+static uint32_t SpoolRecordLength(DataSpool* spool, uint32_t len)
 {
-  RB_EOT = 1,
-  RB_ERROR,
-  RB_OK
+  if (spool->direct_fd[spool->current] < 0) { return len; }
+  return (len + kSpoolAlignment - 1) / kSpoolAlignment * kSpoolAlignment;
+}
+
+/**
+ * Reads the records of a spool segment in its own thread, so reading
+ * the spool disk overlaps with writing the Volume.
+ */
+class SpoolReader {
+ public:
+  struct Record {
+    spool_hdr hdr{};
+    std::vector<char> data;
+    std::string error; /* set if the segment could not be read */
+  };
+
+  SpoolReader(int fd, bool padded, bool drop_cache, uint32_t max_len)
+      : SpoolReader{fd, padded, drop_cache, max_len,
+                    channel::CreateBufferedChannel<Record>(
+                        std::max(kSpoolReadAhead / max_len, 2u))}
+  {
+  }
+
+  ~SpoolReader()
+  {
+    output.close();
+    read_thread.join();
+  }
+
+  // Returns the next record, nothing at the end of the segment
+  std::optional<Record> Next() { return output.get(); }
+
+ private:
+  SpoolReader(int t_fd,
+              bool t_padded,
+              bool t_drop_cache,
+              uint32_t t_max_len,
+              channel::channel_pair<Record> chan_pair)
+      : fd{t_fd}
+      , padded{t_padded}
+      , drop_cache{t_drop_cache}
+      , max_len{t_max_len}
+      , input{std::move(chan_pair.first)}
+      , output{std::move(chan_pair.second)}
+      , read_thread{&SpoolReader::Run, this}
+  {
+  }
+
+  int fd;
+  bool padded;
+  bool drop_cache;
+  uint32_t max_len;
+  channel::input<Record> input;
+  channel::output<Record> output;
+
+  // read_thread has to be defined last, it starts reading right away.
+  std::thread read_thread;
+
+  void Run()
+  {
+    boffset_t offset = 0;
+
+    for (;;) {
+      Record record;
+      PoolMem error(PM_MESSAGE);
+      bool failed = true;
+
+      ssize_t status = pread(fd, &record.hdr, sizeof(record.hdr), offset);
+      if (status == 0) { break; /* end of segment */ }
+      if (status == -1) {
+        BErrNo be;
+        Mmsg(error, T_("Spool header read error. ERR=%s\n"), be.bstrerror());
+      } else if (status != (ssize_t)sizeof(record.hdr)) {
+        Mmsg(error, T_("Spool header read error. Wanted %u bytes, got %d\n"),
+             (uint32_t)sizeof(record.hdr), (int)status);
+      } else if (record.hdr.len > max_len) {
+        Mmsg(error, T_("Spool block too big. Max %u bytes, got %u\n"), max_len,
+             record.hdr.len);
+      } else {
+        record.data.resize(record.hdr.len);
+        status = pread(fd, record.data.data(), record.hdr.len,
+                       offset + sizeof(record.hdr));
+        if (status != (ssize_t)record.hdr.len) {
+          Mmsg(error, T_("Spool data read error. Wanted %u bytes, got %d\n"),
+               record.hdr.len, (int)status);
+        } else {
+          failed = false;
+        }
+      }
+
+      if (failed) {
+        record.error = error.c_str();
+        input.emplace(std::move(record));
+        break;
+      }
+
+      uint32_t len = sizeof(record.hdr) + record.hdr.len;
+      if (padded) {
+        len = (len + kSpoolAlignment - 1) / kSpoolAlignment * kSpoolAlignment;
+      }
+      offset += len;
+
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_DONTNEED)
+      if (drop_cache) { posix_fadvise(fd, 0, offset, POSIX_FADV_DONTNEED); }
+#endif
+
+      if (!input.emplace(std::move(record))) { break; }
+    }
+
+    input.close();
+  }
 };
 
 void ListSpoolStats(StatusPacket* sp)
@@ -165,7 +322,8 @@ bool CommitDataSpool(DeviceControlRecord* dcr)
 }
 
 static void MakeUniqueDataSpoolFilename(DeviceControlRecord* dcr,
-                                        POOLMEM*& name)
+                                        POOLMEM*& name,
+                                        int segment)
 {
   const char* dir;
 
@@ -175,20 +333,46 @@ static void MakeUniqueDataSpoolFilename(DeviceControlRecord* dcr,
     dir = working_directory;
   }
 
-  Mmsg(name, "%s/%s.data.%u.%s.%s.spool", dir, my_name, dcr->jcr->JobId,
-       dcr->jcr->Job, dcr->device_resource->resource_name_);
+  if (segment == 0) {
+    Mmsg(name, "%s/%s.data.%u.%s.%s.spool", dir, my_name, dcr->jcr->JobId,
+         dcr->jcr->Job, dcr->device_resource->resource_name_);
+  } else {
+    Mmsg(name, "%s/%s.data.%u.%s.%s.%d.spool", dir, my_name, dcr->jcr->JobId,
+         dcr->jcr->Job, dcr->device_resource->resource_name_, segment);
+  }
 }
 
 static bool OpenDataSpoolFile(DeviceControlRecord* dcr)
 {
+  DataSpool* spool = new DataSpool;
+
+  spool->dcr = dcr;
+  spool->direct_io = dcr->device_resource->spool_direct_io;
+  /* Copy and migration jobs read volumes while spooling, their requests
+   * to the director cannot be interleaved with a background despool. */
+  spool->double_buffering = dcr->device_resource->spool_double_buffering
+                            && dcr->jcr->is_JobType(JT_BACKUP);
+  if (!OpenSpoolSegment(spool, 0)) {
+    delete spool;
+    return false;
+  }
+  dcr->data_spool = spool;
+  dcr->spool_fd = spool->fd[0];
+  dcr->jcr->sd_impl->spool_attributes = true;
+
+  return true;
+}
+
+static bool OpenSpoolSegment(DataSpool* spool, int segment)
+{
+  DeviceControlRecord* dcr = spool->dcr;
   int spool_fd;
   POOLMEM* name = GetPoolMemory(PM_MESSAGE);
 
-  MakeUniqueDataSpoolFilename(dcr, name);
+  MakeUniqueDataSpoolFilename(dcr, name, segment);
   if ((spool_fd = open(name, O_CREAT | O_TRUNC | O_RDWR | O_BINARY, 0640))
       >= 0) {
-    dcr->spool_fd = spool_fd;
-    dcr->jcr->sd_impl->spool_attributes = true;
+    spool->fd[segment] = spool_fd;
   } else {
     BErrNo be;
 
@@ -197,61 +381,146 @@ static bool OpenDataSpoolFile(DeviceControlRecord* dcr)
     FreePoolMemory(name);
     return false;
   }
+
+#ifdef O_DIRECT
+  /* The records are written through a second descriptor opened with
+   * O_DIRECT and read back through the first one. */
+  if (spool->direct_io) {
+    spool->direct_fd[segment] = open(name, O_WRONLY | O_BINARY | O_DIRECT);
+    if (spool->direct_fd[segment] < 0) {
+      BErrNo be;
+
+      Dmsg2(100, "Spool file %s: O_DIRECT not supported, ERR=%s\n", name,
+            be.bstrerror());
+    }
+  }
+#endif
+
   Dmsg1(100, "Created spool file: %s\n", name);
   FreePoolMemory(name);
 
   return true;
 }
 
-static bool CloseDataSpoolFile(DeviceControlRecord* dcr, bool end_of_spool)
+static void CloseSpoolSegment(DataSpool* spool, int segment)
 {
   POOLMEM* name = GetPoolMemory(PM_MESSAGE);
 
-  close(dcr->spool_fd);
-  dcr->spool_fd = -1;
-  dcr->spooling = false;
+  close(spool->fd[segment]);
+  spool->fd[segment] = -1;
+  if (spool->direct_fd[segment] >= 0) {
+    close(spool->direct_fd[segment]);
+    spool->direct_fd[segment] = -1;
+  }
 
-  MakeUniqueDataSpoolFilename(dcr, name);
-  SecureErase(dcr->jcr, name);
+  MakeUniqueDataSpoolFilename(spool->dcr, name, segment);
+  SecureErase(spool->dcr->jcr, name);
   Dmsg1(100, "Deleted spool file: %s\n", name);
   FreePoolMemory(name);
+}
 
+// Return spooled bytes of the job to the device and the statistics
+static void ReleaseSpoolSpace(DeviceControlRecord* dcr, int64_t size)
+{
   lock_mutex(mutex);
-  spool_stats.data_jobs--;
-  if (end_of_spool) { spool_stats.total_data_jobs++; }
-  if (spool_stats.data_size < dcr->job_spool_size) {
+  if (spool_stats.data_size < size) {
     spool_stats.data_size = 0;
   } else {
-    spool_stats.data_size -= dcr->job_spool_size;
+    spool_stats.data_size -= size;
   }
   unlock_mutex(mutex);
 
   lock_mutex(dcr->dev->spool_mutex);
-  dcr->dev->spool_size -= dcr->job_spool_size;
-  dcr->job_spool_size = 0;
+  dcr->dev->spool_size -= size;
+  dcr->job_spool_size -= size;
   unlock_mutex(dcr->dev->spool_mutex);
+}
+
+static bool CloseDataSpoolFile(DeviceControlRecord* dcr, bool end_of_spool)
+{
+  DataSpool* spool = dcr->data_spool;
+
+  spool->stop = true;
+  WaitForBackgroundDespool(dcr);
+  for (int segment = 0; segment < 2; segment++) {
+    if (spool->fd[segment] >= 0) { CloseSpoolSegment(spool, segment); }
+  }
+  free(spool->io_buffer);
+  delete spool;
+  dcr->data_spool = nullptr;
+  dcr->spool_fd = -1;
+  dcr->spooling = false;
+
+  lock_mutex(mutex);
+  spool_stats.data_jobs--;
+  if (end_of_spool) { spool_stats.total_data_jobs++; }
+  unlock_mutex(mutex);
+
+  ReleaseSpoolSpace(dcr, dcr->job_spool_size);
 
   return true;
 }
 
-static const char* spool_name = "*spool*";
+/* Truncates a despooled segment, or replaces it when using secure erase */
+static void EmptySpoolSegment(DataSpool* spool, int segment)
+{
+  if (me->secure_erase_cmdline) {
+    CloseSpoolSegment(spool, segment);
+    OpenSpoolSegment(spool, segment);
+  } else {
+    lseek(spool->fd[segment], 0, SEEK_SET); /* rewind */
+    if (ftruncate(spool->fd[segment], 0) != 0) {
+      BErrNo be;
+
+      Jmsg(spool->dcr->jcr, M_ERROR, 0,
+           T_("Ftruncate spool file failed: ERR=%s\n"), be.bstrerror());
+      // Note, try continuing despite ftruncate problem
+    }
+    if (spool->direct_fd[segment] >= 0) {
+      lseek(spool->direct_fd[segment], 0, SEEK_SET);
+    }
+  }
+
+  ReleaseSpoolSpace(spool->dcr, spool->size[segment]);
+  spool->size[segment] = 0;
+}
 
 /**
+ * Despool the current segment, after waiting for a background despool.
+ *
  * NB! This routine locks the device, but if committing will
  *     not unlock it. If not committing, it will be unlocked.
  */
 static bool DespoolData(DeviceControlRecord* dcr, bool commit)
 {
-  DeviceControlRecord* rdcr;
+  DataSpool* spool = dcr->data_spool;
+  bool ok;
+
+  if (!WaitForBackgroundDespool(dcr)) { return false; }
+  ok = DespoolSegment(dcr, spool, spool->current, commit);
+  dcr->spool_fd = spool->fd[spool->current];
+
+  return ok;
+}
+
+/**
+ * Write the blocks of a spool segment to the Volume using dcr, which is
+ * either the dcr of the job or the one of a background despool.
+ */
+static bool DespoolSegment(DeviceControlRecord* dcr,
+                           DataSpool* spool,
+                           int segment,
+                           bool commit)
+{
   bool ok = true;
   DeviceBlock* block;
   JobControlRecord* jcr = dcr->jcr;
-  int status;
+  int64_t despool_size = spool->size[segment];
   char ec1[50];
   BareosSocket* dir = jcr->dir_bsock;
 
   Dmsg0(100, "Despooling data\n");
-  if (jcr->sd_impl->dcr->job_spool_size == 0) {
+  if (despool_size == 0) {
     Jmsg(jcr, M_WARNING, 0,
          T_("Despooling zero bytes. Your disk is probably FULL!\n"));
   }
@@ -263,13 +532,12 @@ static bool DespoolData(DeviceControlRecord* dcr, bool commit)
     Jmsg(jcr, M_INFO, 0,
          T_("Committing spooled data to Volume \"%s\". Despooling %s bytes "
             "...\n"),
-         jcr->sd_impl->dcr->VolumeName,
-         edit_uint64_with_commas(jcr->sd_impl->dcr->job_spool_size, ec1));
+         dcr->VolumeName, edit_uint64_with_commas(despool_size, ec1));
     jcr->setJobStatusWithPriorityCheck(JS_DataCommitting);
   } else {
     Jmsg(jcr, M_INFO, 0,
          T_("Writing spooled data to Volume. Despooling %s bytes ...\n"),
-         edit_uint64_with_commas(jcr->sd_impl->dcr->job_spool_size, ec1));
+         edit_uint64_with_commas(despool_size, ec1));
     jcr->setJobStatusWithPriorityCheck(JS_DataDespooling);
   }
   jcr->sendJobStatus(JS_DataDespooling);
@@ -281,48 +549,46 @@ static bool DespoolData(DeviceControlRecord* dcr, bool commit)
   dcr->despool_wait = false;
   dcr->despooling = true;
 
-  /* This is really quite kludgy and should be fixed some time.
-   * We create a dev structure to read from the spool file
-   * in rdev and rdcr. */
-  auto rdev(std::make_unique<SpoolDevice>());
-  rdev->archive_device_string = GetMemory(strlen(spool_name) + 1);
-  bstrncpy(rdev->archive_device_string, spool_name,
-           SizeofPoolMemory(rdev->archive_device_string));
-  rdev->errmsg = GetPoolMemory(PM_EMSG);
-  rdev->errmsg[0] = 0;
-  rdev->max_block_size = dcr->dev->max_block_size;
-  rdev->min_block_size = dcr->dev->min_block_size;
-  rdev->device_resource = dcr->dev->device_resource;
-  rdcr = dcr->get_new_spooling_dcr();
-  SetupNewDcrDevice(jcr, rdcr, rdev.get(), NULL);
-  rdcr->spool_fd = dcr->spool_fd;
-  block = dcr->block;       /* save block */
-  dcr->block = rdcr->block; /* make read and write block the same */
-
-  Dmsg1(800, "read/write block size = %d\n", block->buf_len);
-  lseek(rdcr->spool_fd, 0, SEEK_SET); /* rewind */
-
-#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
-  posix_fadvise(rdcr->spool_fd, 0, 0, POSIX_FADV_WILLNEED);
-#endif
+  block = dcr->block;                /* save block */
+  dcr->block = new_block(dcr->dev); /* block to despool into */
+  Dmsg1(800, "read/write block size = %d\n", dcr->block->buf_len);
 
   /* Add run time, to get current wait time */
   int32_t despool_start = time(NULL) - jcr->run_time;
 
   SetNewFileParameters(dcr);
 
+  SpoolReader reader(spool->fd[segment], spool->direct_fd[segment] >= 0,
+                     spool->direct_io, dcr->block->buf_len);
   while (ok) {
-    if (jcr->IsJobCanceled()) {
+    if (jcr->IsJobCanceled() || spool->stop) {
       ok = false;
       break;
     }
-    status = ReadBlockFromSpoolFile(rdcr);
-    if (status == RB_EOT) {
+    std::optional<SpoolReader::Record> record = reader.Next();
+    if (!record) {
+      Dmsg0(100, "EOT on spool read.\n");
       break;
-    } else if (status == RB_ERROR) {
+    }
+    if (!record->error.empty()) {
+      Jmsg(jcr, M_FATAL, 0, "%s", record->error.c_str());
+      jcr->setJobStatus(JS_FatalError); /* override any Incomplete */
       ok = false;
       break;
     }
+
+    /* Setup write pointers */
+    DeviceBlock* wblock = dcr->block;
+    memcpy(wblock->buf, record->data.data(), record->hdr.len);
+    wblock->binbuf = record->hdr.len;
+    wblock->bufp = wblock->buf + wblock->binbuf;
+    wblock->FirstIndex = record->hdr.FirstIndex;
+    wblock->LastIndex = record->hdr.LastIndex;
+    wblock->VolSessionId = jcr->VolSessionId;
+    wblock->VolSessionTime = jcr->VolSessionTime;
+    Dmsg2(800, "Read block FI=%d LI=%d\n", wblock->FirstIndex,
+          wblock->LastIndex);
+
     ok = dcr->WriteBlockToDevice();
     if (!ok) {
       Jmsg2(jcr, M_FATAL, 0, T_("Fatal append error on device %s: ERR=%s\n"),
@@ -332,8 +598,8 @@ static bool DespoolData(DeviceControlRecord* dcr, bool commit)
       /* Force in case Incomplete set */
       jcr->setJobStatus(JS_FatalError);
     }
-    Dmsg3(800, "Write block ok=%d FI=%d LI=%d\n", ok, block->FirstIndex,
-          block->LastIndex);
+    Dmsg3(800, "Write block ok=%d FI=%d LI=%d\n", ok, record->hdr.FirstIndex,
+          record->hdr.LastIndex);
   }
 
   /* If this Job is incomplete, we need to backup the FileIndex
@@ -365,43 +631,13 @@ static bool DespoolData(DeviceControlRecord* dcr, bool commit)
           "Bytes/second\n"),
        despool_elapsed / 3600, despool_elapsed % 3600 / 60,
        despool_elapsed % 60,
-       edit_uint64_with_suffix(
-           jcr->sd_impl->dcr->job_spool_size / despool_elapsed, ec1));
+       edit_uint64_with_suffix(despool_size / despool_elapsed, ec1));
 
+  FreeBlock(dcr->block);
   dcr->block = block; /* reset block */
 
-  // See if we are using secure erase.
-  if (me->secure_erase_cmdline) {
-    CloseDataSpoolFile(dcr, false);
-    BeginDataSpool(dcr);
-  } else {
-    lseek(rdcr->spool_fd, 0, SEEK_SET); /* rewind */
-    if (ftruncate(rdcr->spool_fd, 0) != 0) {
-      BErrNo be;
+  EmptySpoolSegment(spool, segment);
 
-      Jmsg(jcr, M_ERROR, 0, T_("Ftruncate spool file failed: ERR=%s\n"),
-           be.bstrerror());
-      // Note, try continuing despite ftruncate problem
-    }
-
-    lock_mutex(mutex);
-    if (spool_stats.data_size < dcr->job_spool_size) {
-      spool_stats.data_size = 0;
-    } else {
-      spool_stats.data_size -= dcr->job_spool_size;
-    }
-    unlock_mutex(mutex);
-    lock_mutex(dcr->dev->spool_mutex);
-    dcr->dev->spool_size -= dcr->job_spool_size;
-    dcr->job_spool_size = 0; /* zap size in input dcr */
-    unlock_mutex(dcr->dev->spool_mutex);
-  }
-
-  /* null the jcr
-   * rdev will be freed by its smart pointer */
-  rdcr->jcr = NULL;
-  rdcr->SetDev(NULL);
-  FreeDeviceControlRecord(rdcr);
   dcr->spooling = true; /* turn on spooling again */
   dcr->despooling = false;
 
@@ -413,69 +649,110 @@ static bool DespoolData(DeviceControlRecord* dcr, bool commit)
   return ok;
 }
 
+/* Hand the position on the Volume from one dcr to another */
+static void CopyVolumeState(DeviceControlRecord* to,
+                            DeviceControlRecord* from)
+{
+  if (from->IsWriting()) { to->SetWillWrite(); }
+  to->NewVol = from->NewVol;
+  to->WroteVol = from->WroteVol;
+  to->NewFile = from->NewFile;
+  to->reserved_volume = from->reserved_volume;
+  to->any_volume = from->any_volume;
+  to->VolFirstIndex = from->VolFirstIndex;
+  to->VolLastIndex = from->VolLastIndex;
+  to->FileIndex = from->FileIndex;
+  to->EndFile = from->EndFile;
+  to->StartFile = from->StartFile;
+  to->StartBlock = from->StartBlock;
+  to->EndBlock = from->EndBlock;
+  to->VolMediaId = from->VolMediaId;
+  to->VolMinBlocksize = from->VolMinBlocksize;
+  to->VolMaxBlocksize = from->VolMaxBlocksize;
+  bstrncpy(to->VolumeName, from->VolumeName, sizeof(to->VolumeName));
+  bstrncpy(to->pool_name, from->pool_name, sizeof(to->pool_name));
+  bstrncpy(to->pool_type, from->pool_type, sizeof(to->pool_type));
+  bstrncpy(to->media_type, from->media_type, sizeof(to->media_type));
+  bstrncpy(to->dev_name, from->dev_name, sizeof(to->dev_name));
+  to->Copy = from->Copy;
+  to->Stripe = from->Stripe;
+  to->VolCatInfo = from->VolCatInfo;
+}
+
 /**
- * Read a block from the spool file
- *
- *  Returns RB_OK on success
- *          RB_EOT when file done
- *          RB_ERROR on error
+ * Hand the current segment to a background despool and continue spooling
+ * into the other segment.  The despool works on its own dcr.  Both threads
+ * ask the director under jcr->sd_impl->dir_mutex, and the job messages are
+ * queued until the despool is done, so only one thread at a time uses the
+ * director connection.
  */
-static int ReadBlockFromSpoolFile(DeviceControlRecord* dcr)
+static bool StartBackgroundDespool(DeviceControlRecord* dcr)
 {
-  uint32_t rlen;
-  ssize_t status;
-  spool_hdr hdr;
-  DeviceBlock* block = dcr->block;
-  JobControlRecord* jcr = dcr->jcr;
+  DataSpool* spool = dcr->data_spool;
+  int segment = spool->current;
+  int next = 1 - segment;
+  DeviceControlRecord* ddcr;
+
+  if (spool->fd[next] < 0 && !OpenSpoolSegment(spool, next)) { return false; }
+
+  ddcr = dcr->get_new_spooling_dcr();
+  SetupNewDcrDevice(dcr->jcr, ddcr, dcr->dev, NULL);
+  CopyVolumeState(ddcr, dcr);
+
+  spool->despool_dcr = ddcr;
+  spool->despool_ok = true;
+  spool->despool_done = false;
+  spool->current = next;
+  dcr->spool_fd = spool->fd[next];
+  dcr->jcr->queue_msgs = true;
+  spool->despooler = std::thread([spool, ddcr, segment] {
+    SetJcrInThreadSpecificData(ddcr->jcr);
+    spool->despool_ok = DespoolSegment(ddcr, spool, segment, false);
+    spool->despool_done = true;
+  });
 
-  rlen = sizeof(hdr);
-  status = read(dcr->spool_fd, (char*)&hdr, (size_t)rlen);
-  if (status == 0) {
-    Dmsg0(100, "EOT on spool read.\n");
-    return RB_EOT;
-  } else if (status != (ssize_t)rlen) {
-    if (status == -1) {
-      BErrNo be;
+  return true;
+}
 
-      Jmsg(dcr->jcr, M_FATAL, 0, T_("Spool header read error. ERR=%s\n"),
-           be.bstrerror());
-    } else {
-      Pmsg2(000, T_("Spool read error. Wanted %u bytes, got %d\n"), rlen,
-            status);
-      Jmsg2(jcr, M_FATAL, 0,
-            T_("Spool header read error. Wanted %u bytes, got %d\n"), rlen,
-            status);
-    }
-    jcr->setJobStatus(JS_FatalError); /* override any Incomplete */
-    return RB_ERROR;
-  }
-  rlen = hdr.len;
-  if (rlen > block->buf_len) {
-    Pmsg2(000, T_("Spool block too big. Max %u bytes, got %u\n"),
-          block->buf_len, rlen);
-    Jmsg2(jcr, M_FATAL, 0, T_("Spool block too big. Max %u bytes, got %u\n"),
-          block->buf_len, rlen);
-    jcr->setJobStatus(JS_FatalError); /* override any Incomplete */
-    return RB_ERROR;
-  }
-  status = read(dcr->spool_fd, (char*)block->buf, (size_t)rlen);
-  if (status != (ssize_t)rlen) {
-    Pmsg2(000, T_("Spool data read error. Wanted %u bytes, got %d\n"), rlen,
-          status);
-    Jmsg2(dcr->jcr, M_FATAL, 0,
-          T_("Spool data read error. Wanted %u bytes, got %d\n"), rlen, status);
-    jcr->setJobStatus(JS_FatalError); /* override any Incomplete */
-    return RB_ERROR;
-  }
-  /* Setup write pointers */
-  block->binbuf = rlen;
-  block->bufp = block->buf + block->binbuf;
-  block->FirstIndex = hdr.FirstIndex;
-  block->LastIndex = hdr.LastIndex;
-  block->VolSessionId = dcr->jcr->VolSessionId;
-  block->VolSessionTime = dcr->jcr->VolSessionTime;
-  Dmsg2(800, "Read block FI=%d LI=%d\n", block->FirstIndex, block->LastIndex);
-  return RB_OK;
+/* Wait for the background despool, the job continues where it stopped */
+static bool WaitForBackgroundDespool(DeviceControlRecord* dcr)
+{
+  DataSpool* spool = dcr->data_spool;
+
+  if (!spool->despooler.joinable()) { return true; }
+
+  Dmsg0(100, "Waiting for background despool\n");
+  spool->despooler.join();
+  spool->despool_done = false;
+  dcr->jcr->queue_msgs = false;
+  DequeueMessages(dcr->jcr);
+  CopyVolumeState(dcr, spool->despool_dcr);
+  FreeDeviceControlRecord(spool->despool_dcr);
+  spool->despool_dcr = nullptr;
+
+  return spool->despool_ok;
+}
+
+// Check the spool size limits, must be called with spool_mutex locked
+static bool SpoolLimitReached(DeviceControlRecord* dcr)
+{
+  return (dcr->max_job_spool_size > 0
+          && dcr->job_spool_size >= dcr->max_job_spool_size)
+         || (dcr->dev->max_spool_size > 0
+             && dcr->dev->spool_size >= dcr->dev->max_spool_size);
+}
+
+/* With double buffering a segment is despooled once it holds half of the
+ * spool size limit, so the other half can be filled meanwhile. */
+static bool SpoolSegmentFull(DeviceControlRecord* dcr)
+{
+  DataSpool* spool = dcr->data_spool;
+  int64_t limit = dcr->max_job_spool_size;
+  int64_t dev_limit = dcr->dev->max_spool_size;
+
+  if (dev_limit > 0 && (limit == 0 || dev_limit < limit)) { limit = dev_limit; }
+
+  return limit > 0 && spool->size[spool->current] >= limit / 2;
 }
 
 /**
@@ -487,8 +764,10 @@ static int ReadBlockFromSpoolFile(DeviceControlRecord* dcr)
 bool WriteBlockToSpoolFile(DeviceControlRecord* dcr)
 {
   uint32_t wlen, hlen; /* length to write */
+  uint32_t rlen;       /* length in the spool file */
   bool despool = false;
   DeviceBlock* block = dcr->block;
+  DataSpool* spool = dcr->data_spool;
 
   if (dcr->jcr->IsJobCanceled()) { return false; }
   ASSERT(block->binbuf == ((uint32_t)(block->bufp - block->buf)));
@@ -496,25 +775,46 @@ bool WriteBlockToSpoolFile(DeviceControlRecord* dcr)
     return true;
   }
 
+  if (spool->despool_done && !WaitForBackgroundDespool(dcr)) {
+    Pmsg0(000, T_("Bad return from despool in WriteBlock.\n"));
+    return false;
+  }
+
   hlen = sizeof(spool_hdr);
   wlen = block->binbuf;
+  rlen = SpoolRecordLength(spool, hlen + wlen);
   lock_mutex(dcr->dev->spool_mutex);
-  dcr->job_spool_size += hlen + wlen;
-  dcr->dev->spool_size += hlen + wlen;
-  if ((dcr->max_job_spool_size > 0
-       && dcr->job_spool_size >= dcr->max_job_spool_size)
-      || (dcr->dev->max_spool_size > 0
-          && dcr->dev->spool_size >= dcr->dev->max_spool_size)) {
-    despool = true;
-  }
+  dcr->job_spool_size += rlen;
+  dcr->dev->spool_size += rlen;
+  despool = SpoolLimitReached(dcr);
   unlock_mutex(dcr->dev->spool_mutex);
   lock_mutex(mutex);
-  spool_stats.data_size += hlen + wlen;
+  spool_stats.data_size += rlen;
   if (spool_stats.data_size > spool_stats.max_data_size) {
     spool_stats.max_data_size = spool_stats.data_size;
   }
   unlock_mutex(mutex);
-  if (despool) {
+
+  if (despool && spool->despooler.joinable()) {
+    // Wait until the background despool has freed its segment
+    if (!WaitForBackgroundDespool(dcr)) {
+      Pmsg0(000, T_("Bad return from despool in WriteBlock.\n"));
+      return false;
+    }
+    lock_mutex(dcr->dev->spool_mutex);
+    despool = SpoolLimitReached(dcr);
+    unlock_mutex(dcr->dev->spool_mutex);
+  }
+
+  if (spool->double_buffering && !spool->despooler.joinable()
+      && (despool || SpoolSegmentFull(dcr))) {
+    char ec1[30];
+    Jmsg(dcr->jcr, M_INFO, 0,
+         T_("Despooling %s bytes in the background, spooling data into "
+            "a second spool file ...\n"),
+         edit_uint64_with_commas(spool->size[spool->current], ec1));
+    if (!StartBackgroundDespool(dcr)) { return false; }
+  } else if (despool) {
     char ec1[30], ec2[30];
     if (dcr->max_job_spool_size > 0) {
       Jmsg(dcr->jcr, M_INFO, 0,
@@ -534,23 +834,101 @@ bool WriteBlockToSpoolFile(DeviceControlRecord* dcr)
       Pmsg0(000, T_("Bad return from despool in WriteBlock.\n"));
       return false;
     }
-    /* Despooling cleared these variables so reset them */
-    lock_mutex(dcr->dev->spool_mutex);
-    dcr->job_spool_size += hlen + wlen;
-    dcr->dev->spool_size += hlen + wlen;
-    unlock_mutex(dcr->dev->spool_mutex);
     Jmsg(dcr->jcr, M_INFO, 0, T_("Spooling data again ...\n"));
   }
 
-
-  if (!WriteSpoolHeader(dcr)) { return false; }
-  if (!WriteSpoolData(dcr)) { return false; }
+  if (!WriteSpoolRecord(dcr)) { return false; }
+  spool->size[spool->current] += rlen;
 
   Dmsg2(800, "Wrote block FI=%d LI=%d\n", block->FirstIndex, block->LastIndex);
   EmptyBlock(block);
   return true;
 }
 
+static bool WriteSpoolRecord(DeviceControlRecord* dcr)
+{
+  DataSpool* spool = dcr->data_spool;
+
+  if (spool->direct_fd[spool->current] >= 0) { return WriteSpoolDirect(dcr); }
+  return WriteSpoolHeader(dcr) && WriteSpoolData(dcr);
+}
+
+/* Write header and data as one record padded for O_DIRECT */
+static bool WriteSpoolDirect(DeviceControlRecord* dcr)
+{
+  spool_hdr hdr;
+  ssize_t status;
+  DataSpool* spool = dcr->data_spool;
+  DeviceBlock* block = dcr->block;
+  JobControlRecord* jcr = dcr->jcr;
+  uint32_t len = SpoolRecordLength(spool, sizeof(hdr) + block->binbuf);
+
+  if (len > spool->io_buffer_size) {
+    void* buffer = nullptr;
+
+    free(spool->io_buffer);
+    if (posix_memalign(&buffer, kSpoolAlignment, len) != 0) {
+      Emsg1(M_ABORT, 0, T_("Out of memory requesting %d bytes\n"), len);
+    }
+    spool->io_buffer = static_cast<char*>(buffer);
+    spool->io_buffer_size = len;
+  }
+
+  hdr.FirstIndex = block->FirstIndex;
+  hdr.LastIndex = block->LastIndex;
+  hdr.len = block->binbuf;
+  memcpy(spool->io_buffer, &hdr, sizeof(hdr));
+  memcpy(spool->io_buffer + sizeof(hdr), block->buf, block->binbuf);
+  memset(spool->io_buffer + sizeof(hdr) + block->binbuf, 0,
+         len - sizeof(hdr) - block->binbuf);
+
+  for (int retry = 0; retry <= 1; retry++) {
+    int fd = spool->direct_fd[spool->current];
+
+    status = write(fd, spool->io_buffer, len);
+    if (status == -1) {
+      BErrNo be;
+
+      Jmsg(jcr, M_FATAL, 0, T_("Error writing data to spool file. ERR=%s\n"),
+           be.bstrerror());
+      jcr->setJobStatus(JS_FatalError); /* override any Incomplete */
+    }
+    if (status != (ssize_t)len) {
+      // If we wrote something, truncate it, then despool
+      if (status > 0) {
+        boffset_t pos = lseek(fd, 0, SEEK_CUR);
+        if (ftruncate(fd, pos - status) != 0) {
+          BErrNo be;
+
+          Jmsg(jcr, M_ERROR, 0, T_("Ftruncate spool file failed: ERR=%s\n"),
+               be.bstrerror());
+          /* Note, try continuing despite ftruncate problem */
+        }
+      }
+
+      if (!DespoolData(dcr, false)) {
+        Jmsg(jcr, M_FATAL, 0, T_("Fatal despooling error.\n"));
+        jcr->setJobStatus(JS_FatalError); /* override any Incomplete */
+        return false;
+      }
+
+      // A segment recreated by secure erase may lack O_DIRECT support
+      if (spool->direct_fd[spool->current] < 0) {
+        return WriteSpoolHeader(dcr) && WriteSpoolData(dcr);
+      }
+
+      continue; /* try again */
+    }
+
+    return true;
+  }
+
+  Jmsg(jcr, M_FATAL, 0, T_("Retrying after data spooling error failed.\n"));
+  jcr->setJobStatus(JS_FatalError); /* override any Incomplete */
+
+  return false;
+}
+
 static bool WriteSpoolHeader(DeviceControlRecord* dcr)
 {
   spool_hdr hdr;
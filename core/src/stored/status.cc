@@ -312,6 +312,11 @@ static void ListDevices(JobControlRecord* jcr,
             edit_uint64_with_commas(dev->VolCatInfo.VolCatReads, b2),
             edit_uint64_with_commas(bpb, b3));
         sp->send(msg, len);
+        if (dev->DevSkippedBytes > 0) {
+          len = Mmsg(msg, T_("    Bytes Skipped=%s\n"),
+                     edit_uint64_with_commas(dev->DevSkippedBytes, b1));
+          sp->send(msg, len);
+        }
       }
 
       len = Mmsg(msg, T_("    Positioned at File=%s Block=%s\n"),
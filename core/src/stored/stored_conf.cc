@@ -196,6 +196,10 @@ static ResourceItem dev_items[] = {
   {"SpoolDirectory", CFG_TYPE_DIR, ITEM(res_dev, spool_directory), 0, 0, NULL, NULL, NULL},
   {"MaximumSpoolSize", CFG_TYPE_SIZE64, ITEM(res_dev, max_spool_size), 0, 0, NULL, NULL, NULL},
   {"MaximumJobSpoolSize", CFG_TYPE_SIZE64, ITEM(res_dev, max_job_spool_size), 0, 0, NULL, NULL, NULL},
+  {"SpoolDirectIo", CFG_TYPE_BOOL, ITEM(res_dev, spool_direct_io), 0, CFG_ITEM_DEFAULT, "false", NULL,
+      "Write the data spool files with O_DIRECT, bypassing the page cache of the Storage Daemon host."},
+  {"SpoolDoubleBuffering", CFG_TYPE_BOOL, ITEM(res_dev, spool_double_buffering), 0, CFG_ITEM_DEFAULT, "false", NULL,
+      "Keep spooling into a second spool file while the first one is despooled to the Volume."},
   {"DriveIndex", CFG_TYPE_PINT16, ITEM(res_dev, drive_index), 0, 0, NULL, NULL, NULL},
   {"MountPoint", CFG_TYPE_STRNAME, ITEM(res_dev, mount_point), 0, 0, NULL, NULL, NULL},
   {"MountCommand", CFG_TYPE_STRNAME, ITEM(res_dev, mount_command), 0, 0, NULL, NULL, NULL},
@@ -263,7 +267,8 @@ static s_io_kw io_directions[] = {
 static s_kw compression_algorithms[]
     = {{"gzip", COMPRESS_GZIP},   {"lzo", COMPRESS_LZO1X},
        {"lzfast", COMPRESS_FZFZ}, {"lz4", COMPRESS_FZ4L},
-       {"lz4hc", COMPRESS_FZ4H},  {NULL, 0}};
+       {"lz4hc", COMPRESS_FZ4H},  {"zstd", COMPRESS_ZSTD},
+       {NULL, 0}};
 
 static void StoreAuthenticationType(LEX* lc, ResourceItem* item, int index, int)
 {
@@ -483,13 +488,16 @@ static void ConfigBeforeCallback(ConfigurationParser& config)
   config.InitializeQualifiedResourceNameTypeConverter(map);
 }
 
-static void CheckDropletDevices(ConfigurationParser& config)
+// The chunked devices only keep one chunk of one volume in memory.
+static void CheckChunkedDevices(ConfigurationParser& config)
 {
   BareosResource* p = nullptr;
 
   while ((p = config.GetNextRes(R_DEVICE, p)) != nullptr) {
     DeviceResource* d = dynamic_cast<DeviceResource*>(p);
-    if (d && d->device_type == DeviceType::B_DROPLET_DEV) {
+    if (d
+        && (d->device_type == DeviceType::B_DROPLET_DEV
+            || d->device_type == DeviceType::B_CHUNKED_DEV)) {
       if (d->max_concurrent_jobs == 0) {
         /* 0 is the general default. However, for this device_type, only 1
          * works. So we set it to this value. */
@@ -583,7 +591,7 @@ static void ConfigReadyCallback(ConfigurationParser& config)
   MultiplyConfiguredDevices(config);
   GuessMissingDeviceTypes(config);
   CheckAndLoadDeviceBackends(config);
-  CheckDropletDevices(config);
+  CheckChunkedDevices(config);
 }
 
 ConfigurationParser* InitSdConfig(const char* t_configfile, int exit_code)
@@ -28,6 +28,8 @@
 #include "stored/stored_conf.h"
 #include "lib/thread_util.h"
 
+#include <mutex>
+
 #define SD_APPEND 1
 #define SD_READ 0
 
@@ -51,6 +53,7 @@ struct ReadSession {
   uint32_t read_EndFile{};
   uint32_t read_StartBlock{};
   uint32_t read_EndBlock{};
+  uint64_t skipped_bytes{}; /**< Seeked over instead of read */
 };
 
 struct DeviceWaitTimes {
@@ -100,6 +103,7 @@ struct StoredJcrImpl {
   bool PreferMountedVols{};       /**< Prefer mounted vols rather than new */
   bool insert_jobmedia_records{}; /**< Need to insert job media records */
   uint64_t RemainingQuota{};      /**< Available bytes to use as quota */
+  std::recursive_mutex dir_mutex; /**< Serializes the requests to the director, see spool.cc */
 
   storagedaemon::ReadSession read_session;
   storagedaemon::DeviceWaitTimes device_wait_times;
@@ -0,0 +1,151 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+
+#include <algorithm>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "include/jcr.h"
+#include "filed/filed.h"
+#include "filed/accurate.h"
+
+namespace filedaemon {
+
+namespace {
+struct Entry {
+  std::string fname;
+  std::string lstat;
+  std::string chksum;
+  int32_t delta_seq;
+};
+
+bool Add(BareosAccurateFilelist& list, Entry& entry)
+{
+  return list.AddFile(entry.fname.data(), entry.fname.size(),
+                      entry.lstat.data(), entry.lstat.size(),
+                      entry.chksum.empty() ? nullptr : entry.chksum.data(),
+                      entry.chksum.size(), entry.delta_seq);
+}
+
+std::vector<Entry> MakeEntries(std::size_t count)
+{
+  std::vector<Entry> entries;
+  for (std::size_t i = 0; i < count; ++i) {
+    std::string dir = "/srv/share" + std::to_string(i % 7) + "/dir"
+                      + std::to_string(i / 100) + "/";
+    entries.push_back({dir + "file" + std::to_string(i),
+                       "P0C BAGm IGk B Po Po A " + std::to_string(i),
+                       i % 3 ? "" : "chksum" + std::to_string(i),
+                       static_cast<int32_t>(i % 5) - 1});
+  }
+  return entries;
+}
+}  // namespace
+
+TEST(accurate_compact, lookup_in_any_order)
+{
+  JobControlRecord jcr;
+  auto entries = MakeEntries(5000);
+  std::shuffle(entries.begin(), entries.end(), std::mt19937{42});
+
+  BareosAccurateFilelistCompact list(&jcr, entries.size(), TEST_TEMP_DIR);
+  ASSERT_TRUE(list.init());
+  for (auto& entry : entries) { ASSERT_TRUE(Add(list, entry)); }
+  ASSERT_TRUE(list.EndLoad());
+
+  std::set<std::size_t> filenrs;
+  for (auto& entry : entries) {
+    accurate_payload* payload = list.lookup_payload(entry.fname.data());
+    ASSERT_NE(payload, nullptr) << entry.fname;
+    EXPECT_EQ(payload->lstat, entry.lstat);
+    EXPECT_EQ(payload->chksum, entry.chksum);
+    EXPECT_EQ(payload->delta_seq, entry.delta_seq);
+    EXPECT_LT(payload->filenr, entries.size());
+    filenrs.insert(payload->filenr);
+    list.MarkFileAsSeen(payload);
+  }
+  EXPECT_EQ(filenrs.size(), entries.size());
+
+  std::string missing = "/srv/share1/dir1/file";
+  EXPECT_EQ(list.lookup_payload(missing.data()), nullptr);
+  missing = "/srv/share1/dir10/file1001x";
+  EXPECT_EQ(list.lookup_payload(missing.data()), nullptr);
+  missing = "";
+  EXPECT_EQ(list.lookup_payload(missing.data()), nullptr);
+}
+
+TEST(accurate_compact, duplicates_keep_first)
+{
+  JobControlRecord jcr;
+  std::vector<Entry> entries = {
+      {"/b", "lstat b", "", 0},
+      {"/a", "lstat a", "sum a", 1},
+      {"/a", "lstat a again", "", 2},
+      {"/a/", "lstat a/", "", 3},
+  };
+
+  BareosAccurateFilelistCompact list(&jcr, entries.size(), TEST_TEMP_DIR);
+  ASSERT_TRUE(list.init());
+  for (auto& entry : entries) { ASSERT_TRUE(Add(list, entry)); }
+  ASSERT_TRUE(list.EndLoad());
+
+  std::string name = "/a";
+  accurate_payload* payload = list.lookup_payload(name.data());
+  ASSERT_NE(payload, nullptr);
+  EXPECT_STREQ(payload->lstat, "lstat a");
+  EXPECT_STREQ(payload->chksum, "sum a");
+  EXPECT_EQ(payload->filenr, 0u);
+
+  name = "/a/";
+  payload = list.lookup_payload(name.data());
+  ASSERT_NE(payload, nullptr);
+  EXPECT_EQ(payload->filenr, 1u);
+
+  name = "/b";
+  payload = list.lookup_payload(name.data());
+  ASSERT_NE(payload, nullptr);
+  EXPECT_EQ(payload->filenr, 2u);
+}
+
+TEST(accurate_compact, empty_list)
+{
+  JobControlRecord jcr;
+  BareosAccurateFilelistCompact list(&jcr, 0, TEST_TEMP_DIR);
+  ASSERT_TRUE(list.init());
+  ASSERT_TRUE(list.EndLoad());
+
+  std::string name = "/a";
+  EXPECT_EQ(list.lookup_payload(name.data()), nullptr);
+}
+
+TEST(accurate_compact, unusable_directory)
+{
+  JobControlRecord jcr;
+  BareosAccurateFilelistCompact list(&jcr, 10, "/nonexistent/directory");
+  EXPECT_FALSE(list.init());
+}
+
+}  // namespace filedaemon
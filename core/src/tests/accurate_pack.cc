@@ -0,0 +1,115 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include <string>
+#include <vector>
+
+#include "lib/accurate_pack.h"
+
+namespace {
+struct Entry {
+  std::string fname;
+  std::string lstat;
+  std::string chksum;
+  uint16_t delta_seq;
+
+  bool operator==(const Entry& other) const
+  {
+    return fname == other.fname && lstat == other.lstat
+           && chksum == other.chksum && delta_seq == other.delta_seq;
+  }
+};
+
+std::vector<Entry> Parse(const std::string& pack, bool* ok = nullptr)
+{
+  std::vector<Entry> entries;
+  bool parsed = ParseAccuratePack(
+      pack.data(), pack.size(), [&entries](const AccurateEntry& entry) {
+        entries.push_back({std::string(entry.fname), std::string(entry.lstat),
+                           std::string(entry.chksum), entry.delta_seq});
+      });
+  if (ok) { *ok = parsed; }
+  return entries;
+}
+}  // namespace
+
+TEST(accurate_pack, roundtrip)
+{
+  std::string pack;
+  AppendAccurateEntry(pack, "/etc/", "passwd", "P0C BAGm IGk B", "", "0");
+  AppendAccurateEntry(pack, "/srv/data/", "", "gB A", "1B2M2Y8AsgTpgAm", "3");
+  AppendAccurateEntry(pack, "/", "with space", "A", "xxh", "65535");
+
+  bool ok = false;
+  std::vector<Entry> entries = Parse(pack, &ok);
+  EXPECT_TRUE(ok);
+  std::vector<Entry> expected{{"/etc/passwd", "P0C BAGm IGk B", "", 0},
+                              {"/srv/data/", "gB A", "1B2M2Y8AsgTpgAm", 3},
+                              {"/with space", "A", "xxh", 65535}};
+  EXPECT_EQ(entries, expected);
+}
+
+TEST(accurate_pack, empty_message)
+{
+  bool ok = false;
+  EXPECT_TRUE(Parse("", &ok).empty());
+  EXPECT_TRUE(ok);
+}
+
+TEST(accurate_pack, incomplete_entry_is_skipped)
+{
+  std::string pack;
+  AppendAccurateEntry(pack, "/", "a", "A", "", "1");
+  std::string complete = pack;
+  AppendAccurateEntry(pack, "/", "b", "B", "", "2");
+
+  // every cut inside of the second entry only loses that entry
+  for (std::size_t size = complete.size() + 1; size < pack.size(); ++size) {
+    bool ok = true;
+    std::vector<Entry> entries = Parse(pack.substr(0, size), &ok);
+    EXPECT_FALSE(ok) << "size " << size;
+    ASSERT_EQ(entries.size(), 1u) << "size " << size;
+    EXPECT_EQ(entries[0].fname, "/a");
+  }
+}
+
+TEST(accurate_pack, malformed_entries_are_skipped)
+{
+  std::string pack;
+  AppendAccurateEntry(pack, "/", "a", "A", "", "1");
+  AppendAccurateEntry(pack, "/", "b", "B", "", "x");
+  AppendAccurateEntry(pack, "/", "c", "C", "", "65536");
+  AppendAccurateEntry(pack, "", "", "D", "", "1");
+  AppendAccurateEntry(pack, "/", "e", "E", "", "");
+
+  bool ok = true;
+  std::vector<Entry> entries = Parse(pack, &ok);
+  EXPECT_FALSE(ok);
+  std::vector<Entry> expected{{"/a", "A", "", 1}, {"/e", "E", "", 0}};
+  EXPECT_EQ(entries, expected);
+}
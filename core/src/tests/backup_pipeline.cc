@@ -0,0 +1,179 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include "filed/backup_pipeline.h"
+#include "lib/alist.h"
+#include "lib/serial.h"
+
+#include <optional>
+#include <vector>
+
+using namespace filedaemon;
+
+namespace {
+using message_future = std::future<result<shared_message>>;
+
+message_future Ready(result<shared_message> r)
+{
+  std::promise<result<shared_message>> promise;
+  promise.set_value(std::move(r));
+  return promise.get_future();
+}
+
+shared_message Message(const std::vector<char>& data)
+{
+  auto msg = std::make_shared<data_message>(data.size());
+  if (!data.empty()) {
+    std::memcpy(msg->data_ptr(), data.data(), data.size());
+  }
+  return msg;
+}
+
+struct session {
+  CRYPTO_SESSION* cs{nullptr};
+  alist<X509_KEYPAIR*> no_keys{1, false};
+
+  session() { cs = crypto_session_new(CRYPTO_CIPHER_AES_128_CBC, &no_keys); }
+  ~session() { CryptoSessionFree(cs); }
+};
+
+// Runs the messages through the encryption stage and returns its output.
+std::vector<result<shared_message>> Encrypt(
+    CIPHER_CONTEXT* cipher_ctx,
+    std::vector<result<shared_message>> messages)
+{
+  thread_pool pool;
+  // large enough that neither side blocks
+  const std::size_t capacity = messages.size() + 1;
+  auto [in, stage_out]
+      = channel::CreateBufferedChannel<message_future>(capacity);
+  auto [stage_in, out]
+      = channel::CreateBufferedChannel<message_future>(capacity);
+  std::future fin = MakeEncryptionThread(pool, cipher_ctx, std::move(stage_out),
+                                         std::move(stage_in));
+
+  std::vector<result<shared_message>> encrypted;
+  for (auto& msg : messages) {
+    if (!in.emplace(Ready(std::move(msg)))) { break; }
+  }
+  in.close();
+  while (std::optional f = out.get()) { encrypted.emplace_back(f->get()); }
+  fin.get();
+  return encrypted;
+}
+}  // namespace
+
+TEST(backup_pipeline, encryption_stage_roundtrip)
+{
+  session s;
+  ASSERT_NE(s.cs, nullptr);
+  uint32_t blocksize = 0;
+  CIPHER_CONTEXT* enc = crypto_cipher_new(s.cs, true, &blocksize);
+  ASSERT_NE(enc, nullptr);
+
+  std::vector<std::vector<char>> records;
+  std::vector<result<shared_message>> messages;
+  for (std::size_t size : {1, 15, 16, 17, 3, 1000, 65536, 7}) {
+    std::vector<char> data(size);
+    for (std::size_t i = 0; i < size; ++i) { data[i] = (char)(i * 7 + size); }
+    messages.emplace_back(Message(data));
+    records.push_back(std::move(data));
+  }
+
+  auto encrypted = Encrypt(enc, std::move(messages));
+
+  std::vector<char> stream;
+  for (auto& r : encrypted) {
+    ASSERT_FALSE(r.holds_error()) << r.error_unchecked().c_str();
+    auto& msg = r.value_unchecked();
+    // buffered input is never forwarded as an empty message
+    EXPECT_GT(msg->data_size(), 0u);
+    stream.insert(stream.end(), msg->data_ptr(),
+                  msg->data_ptr() + msg->data_size());
+  }
+  std::vector<char> tail(CRYPTO_CIPHER_MAX_BLOCK_SIZE);
+  uint32_t tail_len = 0;
+  ASSERT_TRUE(CryptoCipherFinalize(enc, (uint8_t*)tail.data(), &tail_len));
+  stream.insert(stream.end(), tail.begin(), tail.begin() + tail_len);
+  CryptoCipherFree(enc);
+
+  CIPHER_CONTEXT* dec = crypto_cipher_new(s.cs, false, &blocksize);
+  ASSERT_NE(dec, nullptr);
+  std::vector<char> plain(stream.size() + CRYPTO_CIPHER_MAX_BLOCK_SIZE);
+  uint32_t len = 0, final_len = 0;
+  ASSERT_TRUE(CryptoCipherUpdate(dec, (const uint8_t*)stream.data(),
+                                 stream.size(), (uint8_t*)plain.data(), &len));
+  ASSERT_TRUE(CryptoCipherFinalize(dec, (uint8_t*)plain.data() + len,
+                                   &final_len));
+  CryptoCipherFree(dec);
+  plain.resize(len + final_len);
+
+  // every record is prefixed with its length, as with EncryptData()
+  std::size_t pos = 0;
+  for (auto& record : records) {
+    ASSERT_LE(pos + sizeof(uint32_t), plain.size());
+    uint32_t record_len;
+    unser_declare;
+    UnserBegin(plain.data() + pos, sizeof(uint32_t));
+    unser_uint32(record_len);
+    UnserEnd(plain.data() + pos, sizeof(uint32_t));
+    pos += sizeof(uint32_t);
+    ASSERT_EQ(record_len, record.size());
+    ASSERT_LE(pos + record_len, plain.size());
+    EXPECT_EQ(std::vector<char>(plain.begin() + pos,
+                                plain.begin() + pos + record_len),
+              record);
+    pos += record_len;
+  }
+  EXPECT_EQ(pos, plain.size());
+}
+
+TEST(backup_pipeline, encryption_stage_stops_on_error)
+{
+  session s;
+  ASSERT_NE(s.cs, nullptr);
+  uint32_t blocksize = 0;
+  CIPHER_CONTEXT* enc = crypto_cipher_new(s.cs, true, &blocksize);
+  ASSERT_NE(enc, nullptr);
+
+  std::vector<result<shared_message>> messages;
+  messages.emplace_back(Message(std::vector<char>(100, 'a')));
+  messages.emplace_back(PoolMem{"read error"});
+  for (int i = 0; i < 10; ++i) {
+    messages.emplace_back(Message(std::vector<char>(100, 'b')));
+  }
+
+  auto encrypted = Encrypt(enc, std::move(messages));
+  CryptoCipherFree(enc);
+
+  // the error is passed on and nothing is encrypted after it
+  ASSERT_EQ(encrypted.size(), 2u);
+  EXPECT_FALSE(encrypted[0].holds_error());
+  ASSERT_TRUE(encrypted[1].holds_error());
+  EXPECT_STREQ(encrypted[1].error_unchecked().c_str(), "read error");
+}
@@ -0,0 +1,164 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation, which is
+   listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+#include "include/fcntl_def.h"
+
+#define STORAGE_DAEMON 1
+#include "include/jcr.h"
+#include "lib/parse_conf.h"
+#include "lib/serial.h"
+#include "stored/block_prefetcher.h"
+#include "stored/butil.h"
+#include "stored/device_control_record.h"
+#include "stored/sd_device_control_record.h"
+#include "stored/stored_jcr_impl.h"
+#include "stored/stored.h"
+#include "stored/stored_globals.h"
+#include "stored/sd_backends.h"
+
+#define CONFIG_SUBDIR "block_prefetcher"
+#include "sd_backend_tests.h"
+
+using namespace storagedaemon;
+
+namespace {
+// Blocks only need a valid length in the header to be prefetched.
+std::vector<char> MakeBlock(std::uint32_t size, std::uint32_t seed)
+{
+  std::mt19937 gen(seed);
+  std::vector<char> block(size);
+  for (auto& c : block) { c = static_cast<char>(gen()); }
+
+  ser_declare;
+  SerBegin(block.data() + BLKHDR_CS_LENGTH, sizeof(size));
+  ser_uint32(size);
+  return block;
+}
+
+struct prefetch_test {
+  JobControlRecord* jcr{nullptr};
+  Device* dev{nullptr};
+  StorageDaemonDeviceControlRecord dcr;
+  DeviceBlock* block{nullptr};
+  std::vector<std::vector<char>> blocks;
+  std::vector<boffset_t> offsets;
+
+  prefetch_test()
+  {
+    jcr = SetupDummyJcr("sd_backend_test", nullptr, nullptr);
+    DeviceResource* device_resource
+        = (DeviceResource*)my_config->GetResWithName(R_DEVICE, "file");
+    std::string archive = device_resource->archive_device_string;
+    std::filesystem::create_directories(archive);
+    std::string volume
+        = archive + "/"
+          + ::testing::UnitTest::GetInstance()->current_test_info()->name();
+
+    std::ofstream file(volume, std::ios::binary | std::ios::trunc);
+    boffset_t offset = 0;
+    for (std::uint32_t i = 0; i < 50; ++i) {
+      blocks.push_back(MakeBlock(BLKHDR2_LENGTH + 997 * i, i));
+      offsets.push_back(offset);
+      file.write(blocks.back().data(), blocks.back().size());
+      offset += blocks.back().size();
+    }
+    file.close();
+
+    dev = FactoryCreateDevice(jcr, device_resource);
+    dev->fd = dev->d_open(volume.c_str(), O_RDONLY | O_BINARY, 0640);
+    dcr.SetDev(dev);
+    block = new_block(dev);
+  }
+
+  ~prefetch_test()
+  {
+    FreeBlock(block);
+    if (dev->fd >= 0) { dev->d_close(dev->fd); }
+    dev->fd = -1;
+    delete dev;
+    FreeJcr(jcr);
+  }
+
+  // What ReadBlockFromDev() does with the result of a read
+  void ExpectBlock(BlockPrefetcher& prefetcher, std::size_t index)
+  {
+    ssize_t status = 0;
+    ASSERT_TRUE(prefetcher.Read(block, &status));
+    auto& expected = blocks[index];
+    ASSERT_GE(status, (ssize_t)expected.size());
+    EXPECT_EQ(std::memcmp(block->buf, expected.data(), expected.size()), 0);
+
+    boffset_t end = offsets[index] + expected.size();
+    EXPECT_EQ(dev->d_lseek(&dcr, 0, SEEK_CUR), offsets[index] + status);
+    dev->d_lseek(&dcr, end, SEEK_SET);
+  }
+};
+}  // namespace
+
+TEST_F(sd, block_prefetcher_reads_sequentially)
+{
+  prefetch_test test;
+  ASSERT_GE(test.dev->fd, 0) << test.dev->errmsg;
+  ASSERT_TRUE(test.dev->CanPrefetchBlocks());
+
+  BlockPrefetcher prefetcher(&test.dcr);
+  for (std::size_t i = 0; i < test.blocks.size(); ++i) {
+    test.ExpectBlock(prefetcher, i);
+  }
+
+  // at the end the caller reads (and sees the end of the volume) itself
+  ssize_t status = 0;
+  boffset_t end = test.dev->d_lseek(&test.dcr, 0, SEEK_CUR);
+  EXPECT_FALSE(prefetcher.Read(test.block, &status));
+  EXPECT_EQ(test.dev->d_lseek(&test.dcr, 0, SEEK_CUR), end);
+}
+
+TEST_F(sd, block_prefetcher_follows_repositioning)
+{
+  prefetch_test test;
+  ASSERT_GE(test.dev->fd, 0) << test.dev->errmsg;
+
+  BlockPrefetcher prefetcher(&test.dcr);
+  test.ExpectBlock(prefetcher, 0);
+  test.ExpectBlock(prefetcher, 1);
+
+  // forward, as done for a bootstrap record
+  test.dev->d_lseek(&test.dcr, test.offsets[30], SEEK_SET);
+  test.ExpectBlock(prefetcher, 30);
+  test.ExpectBlock(prefetcher, 31);
+
+  // backward
+  test.dev->d_lseek(&test.dcr, test.offsets[5], SEEK_SET);
+  test.ExpectBlock(prefetcher, 5);
+
+  // stopped, e.g. for a volume change
+  prefetcher.Stop();
+  test.ExpectBlock(prefetcher, 6);
+  test.ExpectBlock(prefetcher, 7);
+}
@@ -0,0 +1,196 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include "stored/bscan_checkpoint.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace storagedaemon;
+
+namespace {
+std::string TestFile()
+{
+  std::string file = std::string{TEST_TEMP_DIR} + "/"
+                     + ::testing::UnitTest::GetInstance()
+                           ->current_test_info()
+                           ->name();
+  unlink(file.c_str());
+  return file;
+}
+
+void WriteFile(const std::string& file, const std::string& content)
+{
+  std::ofstream out(file, std::ios::trunc);
+  out << content;
+}
+
+CheckpointSession Session(JobId_t JobId, int32_t LastFileIndex, bool created)
+{
+  CheckpointSession session;
+  session.VolSessionId = JobId + 100;
+  session.VolSessionTime = 1700000000;
+  session.JobId = JobId;
+  session.LastFileIndex = LastFileIndex;
+  session.insert_jobmedia_records = true;
+  session.created = created;
+  session.FileSetMD5 = "kGhn+Dsb7ZWS2xRXMb/7xD";
+  session.FileSetName = "SelfTest with spaces";
+  session.ClientName = "bareos-fd";
+  return session;
+}
+}  // namespace
+
+TEST(bscan_checkpoint, missing_file_is_empty)
+{
+  std::string file = TestFile();
+  BscanCheckpoint checkpoint;
+  PoolMem errmsg;
+
+  ASSERT_TRUE(ReadCheckpoint(file, checkpoint, errmsg)) << errmsg.c_str();
+  EXPECT_TRUE(checkpoint.volumes.empty());
+  EXPECT_TRUE(checkpoint.sessions.empty());
+  EXPECT_TRUE(checkpoint.jobs.empty());
+}
+
+TEST(bscan_checkpoint, round_trip)
+{
+  std::string file = TestFile();
+  BscanCheckpoint written;
+  written.volumes = {"Full-0001", "Volume with spaces"};
+  written.sessions.push_back(Session(3, 1234, true));
+  written.sessions.push_back(Session(4, 0, false));
+  written.sessions.back().FileSetMD5.clear();
+  written.sessions.back().ClientName.clear();
+  written.jobs = {7};
+  PoolMem errmsg;
+
+  ASSERT_TRUE(WriteCheckpoint(file, written, errmsg)) << errmsg.c_str();
+  ASSERT_TRUE(AddJobToCheckpoint(file, 8, errmsg)) << errmsg.c_str();
+  // the temporary file is renamed
+  EXPECT_NE(access((file + ".tmp").c_str(), F_OK), 0);
+
+  BscanCheckpoint read;
+  ASSERT_TRUE(ReadCheckpoint(file, read, errmsg)) << errmsg.c_str();
+  EXPECT_EQ(read.volumes, written.volumes);
+  EXPECT_EQ(read.jobs, (std::vector<JobId_t>{7, 8}));
+  ASSERT_EQ(read.sessions.size(), written.sessions.size());
+  for (std::size_t i = 0; i < read.sessions.size(); ++i) {
+    const CheckpointSession& r = read.sessions[i];
+    const CheckpointSession& w = written.sessions[i];
+    EXPECT_EQ(r.VolSessionId, w.VolSessionId);
+    EXPECT_EQ(r.VolSessionTime, w.VolSessionTime);
+    EXPECT_EQ(r.JobId, w.JobId);
+    EXPECT_EQ(r.LastFileIndex, w.LastFileIndex);
+    EXPECT_EQ(r.insert_jobmedia_records, w.insert_jobmedia_records);
+    EXPECT_EQ(r.created, w.created);
+    EXPECT_EQ(r.FileSetMD5, w.FileSetMD5);
+    EXPECT_EQ(r.FileSetName, w.FileSetName);
+    EXPECT_EQ(r.ClientName, w.ClientName);
+  }
+}
+
+TEST(bscan_checkpoint, rejects_invalid_files)
+{
+  const char* valid_session
+      = "session 1 2 3 4 1 1\nfileset - FileSet\nclient bareos-fd\n";
+  std::vector<std::string> invalid{
+      "unknown 1\n",
+      "volume\n",
+      "job 0\n",
+      "job -1\n",
+      "job 3 4\n",
+      "job x\n",
+      "session 1 2 0 4 1 1\nfileset - FileSet\nclient bareos-fd\n",
+      "session 1 2 3 -4 1 1\nfileset - FileSet\nclient bareos-fd\n",
+      "session 1 2 3 4 2 1\nfileset - FileSet\nclient bareos-fd\n",
+      "session 1 2 3 4 1\nfileset - FileSet\nclient bareos-fd\n",
+      "session 1 2 3 4 1 1 5\nfileset - FileSet\nclient bareos-fd\n",
+      "session 1 2 3 4 1 1\nclient bareos-fd\nfileset - FileSet\n",
+      "session 1 2 3 4 1 1\nfileset - FileSet\n",
+      "fileset - FileSet\n",
+      "client bareos-fd\n",
+  };
+  std::string file = TestFile();
+
+  WriteFile(file, std::string{"volume Full-0001\n"} + valid_session);
+  BscanCheckpoint checkpoint;
+  PoolMem errmsg;
+  ASSERT_TRUE(ReadCheckpoint(file, checkpoint, errmsg)) << errmsg.c_str();
+
+  for (const std::string& content : invalid) {
+    WriteFile(file, content);
+    BscanCheckpoint rejected;
+    EXPECT_FALSE(ReadCheckpoint(file, rejected, errmsg)) << content;
+  }
+}
+
+TEST(bscan_checkpoint, resume_removes_only_records_of_created_jobs)
+{
+  BscanCheckpoint checkpoint;
+  checkpoint.sessions.push_back(Session(3, 1234, true));
+  // the File records of a Job found in the catalog are left alone
+  checkpoint.sessions.push_back(Session(4, 10, false));
+  checkpoint.jobs = {7, 8};
+
+  EXPECT_EQ(CheckpointCleanupQueries(checkpoint),
+            (std::vector<std::string>{
+                "DELETE FROM File WHERE JobId=7",
+                "DELETE FROM File WHERE JobId=8",
+                "DELETE FROM File WHERE JobId=3 AND FileIndex>1234",
+            }));
+
+  EXPECT_TRUE(CheckpointCleanupQueries(BscanCheckpoint{}).empty());
+}
+
+TEST(bscan_checkpoint, resume_after_interrupted_scan)
+{
+  std::string file = TestFile();
+  PoolMem errmsg;
+
+  // bscan created JobId 3, was checkpointed after the first volume and then
+  // created JobId 5 before it was interrupted
+  ASSERT_TRUE(AddJobToCheckpoint(file, 3, errmsg)) << errmsg.c_str();
+  BscanCheckpoint first;
+  first.volumes = {"Full-0001"};
+  first.sessions.push_back(Session(3, 99, true));
+  ASSERT_TRUE(WriteCheckpoint(file, first, errmsg)) << errmsg.c_str();
+  ASSERT_TRUE(AddJobToCheckpoint(file, 5, errmsg)) << errmsg.c_str();
+
+  BscanCheckpoint resumed;
+  ASSERT_TRUE(ReadCheckpoint(file, resumed, errmsg)) << errmsg.c_str();
+  EXPECT_EQ(resumed.volumes, first.volumes);
+  ASSERT_EQ(resumed.sessions.size(), 1u);
+  EXPECT_EQ(resumed.sessions[0].LastFileIndex, 99);
+  EXPECT_EQ(CheckpointCleanupQueries(resumed),
+            (std::vector<std::string>{
+                "DELETE FROM File WHERE JobId=5",
+                "DELETE FROM File WHERE JobId=3 AND FileIndex>99",
+            }));
+}
@@ -0,0 +1,174 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation, which is
+   listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+
+#include <fstream>
+
+#define STORAGE_DAEMON 1
+#include "include/jcr.h"
+#include "lib/parse_conf.h"
+#include "stored/stored.h"
+#include "stored/bsr.h"
+#include "stored/butil.h"
+#include "stored/match_bsr.h"
+#include "stored/stored_jcr_impl.h"
+#include "stored/stored_globals.h"
+#include "stored/sd_backends.h"
+#include "lib/parse_bsr.h"
+
+#define CONFIG_SUBDIR "bsr_seek"
+#include "sd_backend_tests.h"
+
+using namespace storagedaemon;
+
+namespace {
+// Two jobs on Vol1 with a third job in between that is not restored.
+const char* kBootstrap
+    = "Volume=Vol1\n"
+      "VolSessionId=1\n"
+      "VolSessionTime=100\n"
+      "VolAddr=1000-2000\n"
+      "FileIndex=1-5\n"
+      "Count=5\n"
+      "Volume=Vol1\n"
+      "VolSessionId=3\n"
+      "VolSessionTime=100\n"
+      "VolAddr=8000-9000\n"
+      "FileIndex=2-3\n"
+      "Count=2\n"
+      "Volume=Vol2\n"
+      "VolSessionId=3\n"
+      "VolSessionTime=100\n"
+      "VolAddr=100-200\n"
+      "FileIndex=4-4\n"
+      "Count=1\n";
+
+struct seek_test {
+  JobControlRecord* jcr{nullptr};
+  Device* dev{nullptr};
+  BootStrapRecord* bsr{nullptr};
+  DeviceRecord* rec{nullptr};
+
+  seek_test(const char* bootstrap)
+  {
+    jcr = SetupDummyJcr("bsr_seek_test", nullptr, nullptr);
+    DeviceResource* device_resource
+        = (DeviceResource*)my_config->GetResWithName(R_DEVICE, "file");
+    dev = FactoryCreateDevice(jcr, device_resource);
+
+    std::string fname = std::string(device_resource->archive_device_string)
+                        + ".bsr";
+    std::ofstream(fname) << bootstrap;
+    bsr = libbareos::parse_bsr(jcr, fname.data());
+    rec = new_record();
+  }
+
+  ~seek_test()
+  {
+    FreeRecord(rec);
+    if (bsr) { libbareos::FreeBsr(bsr); }
+    delete dev;
+    FreeJcr(jcr);
+  }
+
+  void Mount(const char* volume)
+  {
+    bstrncpy(dev->VolHdr.VolumeName, volume, sizeof(dev->VolHdr.VolumeName));
+  }
+
+  BsrSeek Plan(uint32_t sessid, int32_t findex, uint64_t addr, uint64_t* to)
+  {
+    rec->VolSessionId = sessid;
+    rec->VolSessionTime = 100;
+    rec->FileIndex = findex;
+    rec->File = addr >> 32;
+    rec->Block = (uint32_t)addr;
+    return PlanBsrSeek(bsr, dev, rec, to);
+  }
+};
+}  // namespace
+
+TEST_F(sd, bsr_seek_skips_between_ranges)
+{
+  seek_test test(kBootstrap);
+  ASSERT_NE(test.bsr, nullptr);
+  test.Mount("Vol1");
+
+  uint64_t to = 0;
+  EXPECT_EQ(test.Plan(1, 1, 500, &to), BsrSeek::kSeek);
+  EXPECT_EQ(to, 1000u);
+
+  // inside the range of a job, records of other jobs are read
+  EXPECT_EQ(test.Plan(2, 1, 1500, &to), BsrSeek::kStay);
+
+  // behind the range, continue with the next one
+  EXPECT_EQ(test.Plan(2, 7, 2500, &to), BsrSeek::kSeek);
+  EXPECT_EQ(to, 8000u);
+
+  EXPECT_EQ(test.Plan(3, 2, 8500, &to), BsrSeek::kStay);
+  EXPECT_EQ(test.Plan(3, 9, 9500, &to), BsrSeek::kVolumeDone);
+}
+
+TEST_F(sd, bsr_seek_stops_after_last_file)
+{
+  seek_test test(kBootstrap);
+  ASSERT_NE(test.bsr, nullptr);
+  test.Mount("Vol1");
+
+  uint64_t to = 0;
+  // all files of session 1 were seen, no need to read to the end of its range
+  EXPECT_EQ(test.Plan(1, 6, 1200, &to), BsrSeek::kSeek);
+  EXPECT_EQ(to, 8000u);
+
+  // and the range is not looked at again
+  EXPECT_EQ(test.Plan(2, 1, 1300, &to), BsrSeek::kSeek);
+  EXPECT_EQ(to, 8000u);
+}
+
+TEST_F(sd, bsr_seek_rebuilds_index_on_volume_change)
+{
+  seek_test test(kBootstrap);
+  ASSERT_NE(test.bsr, nullptr);
+  test.Mount("Vol1");
+
+  uint64_t to = 0;
+  EXPECT_EQ(test.Plan(3, 9, 9500, &to), BsrSeek::kVolumeDone);
+
+  test.Mount("Vol2");
+  EXPECT_EQ(test.Plan(3, 1, 50, &to), BsrSeek::kSeek);
+  EXPECT_EQ(to, 100u);
+}
+
+TEST_F(sd, bsr_seek_needs_volume_addresses)
+{
+  seek_test test(
+      "Volume=Vol1\n"
+      "VolSessionId=1\n"
+      "VolSessionTime=100\n"
+      "FileIndex=1-5\n");
+  ASSERT_NE(test.bsr, nullptr);
+  test.Mount("Vol1");
+
+  uint64_t to = 0;
+  EXPECT_EQ(test.Plan(1, 1, 500, &to), BsrSeek::kUnknown);
+}
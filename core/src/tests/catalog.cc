@@ -34,7 +34,9 @@
 #include "lib/util.h"
 #include "dird/jcr_util.h"
 
+#include <chrono>
 #include <string>
+#include <thread>
 #include <vector>
 
 using directordaemon::InitDirConfig;
@@ -163,3 +165,103 @@ TEST_F(CatalogTest, database)
 
   EXPECT_EQ(time_converted, StrToUtime("2019-11-27 15:04:49"));
 }
+
+static BareosDb* GetBatchConnection(JobControlRecord* jcr)
+{
+  auto* catalog = jcr->dir_impl->res.catalog;
+  return DbSqlGetPooledConnection(
+      jcr, catalog->db_driver, catalog->db_name, catalog->db_user,
+      catalog->db_password.value, catalog->db_address, catalog->db_port,
+      catalog->db_socket, true, catalog->disable_batch_insert,
+      catalog->try_reconnect, catalog->exit_on_fatal, true);
+}
+
+TEST_F(CatalogTest, connection_pool)
+{
+  auto* catalog = jcr->dir_impl->res.catalog;
+  ASSERT_TRUE(db_sql_pool_initialize(
+      catalog->db_driver, catalog->db_name, catalog->db_user,
+      catalog->db_password.value, catalog->db_address, catalog->db_port,
+      catalog->db_socket, catalog->disable_batch_insert,
+      catalog->try_reconnect, catalog->exit_on_fatal, 0, 2, 1, 30, 0));
+
+  BareosDb* first = GetBatchConnection(jcr);
+  ASSERT_NE(first, nullptr);
+  DbSqlClosePooledConnection(jcr, first);
+
+  BareosDb* again = GetBatchConnection(jcr);
+  EXPECT_EQ(again, first) << "an idle connection should be reused";
+  BareosDb* second = GetBatchConnection(jcr);
+  ASSERT_NE(second, nullptr);
+  EXPECT_NE(second, first);
+  BareosDb* overflow = GetBatchConnection(jcr);
+  ASSERT_NE(overflow, nullptr);
+  EXPECT_TRUE(overflow->SqlQuery("SELECT 1"));
+
+  auto stats = DbSqlPoolStatistics();
+  ASSERT_EQ(stats.size(), 1u);
+  EXPECT_EQ(stats[0].connections, 2);
+  EXPECT_EQ(stats[0].in_use, 2);
+  EXPECT_EQ(stats[0].opened, 2u);
+  EXPECT_EQ(stats[0].reused, 1u);
+  EXPECT_EQ(stats[0].overflows, 1u);
+
+  DbSqlClosePooledConnection(jcr, overflow);
+  DbSqlClosePooledConnection(jcr, second);
+  DbSqlClosePooledConnection(jcr, again);
+
+  stats = DbSqlPoolStatistics();
+  ASSERT_EQ(stats.size(), 1u);
+  EXPECT_EQ(stats[0].connections, 2);
+  EXPECT_EQ(stats[0].in_use, 0);
+}
+
+TEST_F(CatalogTest, connection_pool_resets_reused_connections)
+{
+  auto* catalog = jcr->dir_impl->res.catalog;
+  ASSERT_TRUE(db_sql_pool_initialize(
+      catalog->db_driver, catalog->db_name, catalog->db_user,
+      catalog->db_password.value, catalog->db_address, catalog->db_port,
+      catalog->db_socket, catalog->disable_batch_insert,
+      catalog->try_reconnect, catalog->exit_on_fatal, 0, 1, 1, 30, 0));
+
+  BareosDb* first = GetBatchConnection(jcr);
+  ASSERT_NE(first, nullptr);
+  first->SetFetchSize(17);
+  ASSERT_TRUE(first->SqlQuery("CREATE TEMPORARY TABLE pool_leftover (i INT)"));
+  DbSqlClosePooledConnection(jcr, first);
+
+  BareosDb* again = GetBatchConnection(jcr);
+  ASSERT_EQ(again, first);
+  EXPECT_EQ(again->GetFetchSize(), BareosDb::kDefaultFetchSize);
+  EXPECT_TRUE(again->SqlQuery("CREATE TEMPORARY TABLE pool_leftover (i INT)"))
+      << "temporary tables of the previous user should be gone";
+  DbSqlClosePooledConnection(jcr, again);
+}
+
+TEST_F(CatalogTest, connection_pool_reaps_idle_connections)
+{
+  auto* catalog = jcr->dir_impl->res.catalog;
+  ASSERT_TRUE(db_sql_pool_initialize(
+      catalog->db_driver, catalog->db_name, catalog->db_user,
+      catalog->db_password.value, catalog->db_address, catalog->db_port,
+      catalog->db_socket, catalog->disable_batch_insert,
+      catalog->try_reconnect, catalog->exit_on_fatal, 0, 2, 1, 1, 0));
+
+  BareosDb* mdb = GetBatchConnection(jcr);
+  ASSERT_NE(mdb, nullptr);
+  DbSqlClosePooledConnection(jcr, mdb);
+
+  auto stats = DbSqlPoolStatistics();
+  ASSERT_EQ(stats.size(), 1u);
+  EXPECT_EQ(stats[0].connections, 1);
+
+  // without anybody asking for a connection
+  for (int i = 0; i < 50 && stats[0].connections > 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    stats = DbSqlPoolStatistics();
+    ASSERT_EQ(stats.size(), 1u);
+  }
+  EXPECT_EQ(stats[0].connections, 0);
+  EXPECT_EQ(stats[0].closed, 1u);
+}
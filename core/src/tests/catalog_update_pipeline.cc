@@ -0,0 +1,151 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "include/jcr.h"
+#include "dird/catalog_update_pipeline.h"
+
+using namespace directordaemon;
+using namespace std::chrono_literals;
+
+namespace {
+struct recorder {
+  std::mutex mutex;
+  std::vector<std::string> stored;
+
+  CatalogUpdatePipeline::StoreFunction Store()
+  {
+    return [this](char* msg, int32_t length) {
+      std::lock_guard l(mutex);
+      stored.emplace_back(msg, length);
+    };
+  }
+
+  std::vector<std::string> Stored()
+  {
+    std::lock_guard l(mutex);
+    return stored;
+  }
+};
+
+std::vector<std::string> Messages(std::size_t count)
+{
+  std::vector<std::string> messages;
+  for (std::size_t i = 0; i < count; ++i) {
+    messages.push_back("attr " + std::to_string(i));
+  }
+  return messages;
+}
+}  // namespace
+
+TEST(catalog_update_pipeline, stores_in_order)
+{
+  JobControlRecord jcr;
+  recorder rec;
+  // more than one batch
+  auto messages = Messages(3 * CatalogUpdatePipeline::kBatchSize + 7);
+
+  CatalogUpdatePipeline pipeline(&jcr, rec.Store());
+  for (auto& msg : messages) { pipeline.Push(msg.data(), msg.size()); }
+  pipeline.Flush();
+
+  EXPECT_EQ(rec.Stored(), messages);
+}
+
+TEST(catalog_update_pipeline, flush_waits_for_earlier_messages)
+{
+  JobControlRecord jcr;
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  std::atomic<int> stored{0};
+
+  CatalogUpdatePipeline pipeline(&jcr, [&](char*, int32_t) {
+    released.wait();
+    stored++;
+  });
+  auto messages = Messages(10);
+  for (auto& msg : messages) { pipeline.Push(msg.data(), msg.size()); }
+
+  std::future flushed
+      = std::async(std::launch::async, [&pipeline] { pipeline.Flush(); });
+  EXPECT_EQ(flushed.wait_for(100ms), std::future_status::timeout);
+  EXPECT_EQ(stored, 0);
+
+  release.set_value();
+  flushed.get();
+  // everything pushed before the flush is stored once it returns
+  EXPECT_EQ(stored, 10);
+}
+
+TEST(catalog_update_pipeline, canceled_job_drops_messages)
+{
+  JobControlRecord jcr;
+  recorder rec;
+  std::promise<void> entered, release;
+  std::shared_future<void> released = release.get_future().share();
+
+  CatalogUpdatePipeline pipeline(&jcr, [&](char* msg, int32_t length) {
+    if (rec.Stored().empty()) { entered.set_value(); }
+    released.wait();
+    rec.Store()(msg, length);
+  });
+  auto messages = Messages(100);
+  for (auto& msg : messages) { pipeline.Push(msg.data(), msg.size()); }
+
+  // the writer is blocked in the first message
+  entered.get_future().wait();
+  jcr.setJobStatus(JS_Canceled);
+  release.set_value();
+
+  // a flush after the cancel still returns and nothing after it is stored
+  pipeline.Flush();
+  EXPECT_EQ(rec.Stored().size(), 1u);
+  pipeline.Push("late", 4);
+  pipeline.Flush();
+  EXPECT_EQ(rec.Stored().size(), 1u);
+}
+
+TEST(catalog_update_pipeline, finish_stores_remaining)
+{
+  JobControlRecord jcr;
+  recorder rec;
+  auto messages = Messages(500);
+
+  {
+    CatalogUpdatePipeline pipeline(&jcr, rec.Store());
+    for (auto& msg : messages) { pipeline.Push(msg.data(), msg.size()); }
+  }
+
+  EXPECT_EQ(rec.Stored(), messages);
+}
@@ -0,0 +1,217 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation, which is
+   listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "stored/backends/chunk_cache.h"
+#include "testing_common.h"
+
+using namespace storagedaemon;
+
+namespace {
+const std::string kStore = ChunkCache::StoreName("/var/lib/bareos/chunks");
+
+// A fresh cache directory per test.
+std::string CacheDir()
+{
+  std::string dir
+      = std::string("chunk_cache_test/")
+        + ::testing::UnitTest::GetInstance()->current_test_info()->name();
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories("chunk_cache_test");
+  return dir;
+}
+
+bool Cached(ChunkCache& cache,
+            const char* volname,
+            uint32_t chunk,
+            const std::vector<char>& expected)
+{
+  std::vector<char> buffer(expected.size());
+  uint32_t len = 0;
+  if (!cache.Get(kStore, volname, chunk, buffer.data(), buffer.size(), &len)) {
+    return false;
+  }
+  return len == expected.size() && buffer == expected;
+}
+}  // namespace
+
+TEST(chunk_cache, put_and_get)
+{
+  auto cache = ChunkCache::ForDirectory(CacheDir(), 1024 * 1024);
+  ASSERT_NE(cache, nullptr);
+
+  auto data = RandomData(4096, 1);
+  EXPECT_FALSE(Cached(*cache, "Full-0001", 0, data));
+  ASSERT_TRUE(cache->Put(kStore, "Full-0001", 0, data.data(), data.size()));
+  EXPECT_TRUE(Cached(*cache, "Full-0001", 0, data));
+  EXPECT_FALSE(Cached(*cache, "Full-0001", 1, data));
+  EXPECT_FALSE(Cached(*cache, "Full-0002", 0, data));
+  EXPECT_EQ(cache->Bytes(), 4096u);
+  EXPECT_EQ(cache->Hits(), 1u);
+  EXPECT_EQ(cache->Misses(), 3u);
+
+  // a chunk which got more data replaces the older copy
+  auto more = RandomData(8192, 2);
+  ASSERT_TRUE(cache->Put(kStore, "Full-0001", 0, more.data(), more.size()));
+  EXPECT_TRUE(Cached(*cache, "Full-0001", 0, more));
+  EXPECT_EQ(cache->Bytes(), 8192u);
+
+  // does not fit into the buffer
+  std::vector<char> small(100);
+  uint32_t len = 0;
+  EXPECT_FALSE(
+      cache->Get(kStore, "Full-0001", 0, small.data(), small.size(), &len));
+}
+
+TEST(chunk_cache, shared_by_directory)
+{
+  std::string dir = CacheDir();
+  auto cache = ChunkCache::ForDirectory(dir, 1024 * 1024);
+  auto other = ChunkCache::ForDirectory(dir, 1024 * 1024);
+  ASSERT_NE(cache, nullptr);
+  EXPECT_EQ(cache, other);
+}
+
+TEST(chunk_cache, evicts_least_recently_used)
+{
+  auto cache = ChunkCache::ForDirectory(CacheDir(), 3 * 1000);
+  ASSERT_NE(cache, nullptr);
+
+  std::vector<std::vector<char>> chunks;
+  for (uint32_t i = 0; i < 4; ++i) { chunks.push_back(RandomData(1000, i)); }
+
+  for (uint32_t i = 0; i < 3; ++i) {
+    ASSERT_TRUE(cache->Put(kStore, "Full-0001", i, chunks[i].data(), 1000));
+  }
+  // chunk 0 is used again, so chunk 1 is the oldest
+  EXPECT_TRUE(Cached(*cache, "Full-0001", 0, chunks[0]));
+
+  ASSERT_TRUE(cache->Put(kStore, "Full-0001", 3, chunks[3].data(), 1000));
+  EXPECT_EQ(cache->Bytes(), 3000u);
+  EXPECT_TRUE(Cached(*cache, "Full-0001", 0, chunks[0]));
+  EXPECT_FALSE(Cached(*cache, "Full-0001", 1, chunks[1]));
+  EXPECT_TRUE(Cached(*cache, "Full-0001", 2, chunks[2]));
+  EXPECT_TRUE(Cached(*cache, "Full-0001", 3, chunks[3]));
+
+  // larger than the whole cache
+  auto huge = RandomData(4000, 5);
+  EXPECT_FALSE(cache->Put(kStore, "Full-0001", 4, huge.data(), huge.size()));
+  EXPECT_EQ(cache->Bytes(), 3000u);
+}
+
+TEST(chunk_cache, remove_volume)
+{
+  auto cache = ChunkCache::ForDirectory(CacheDir(), 1024 * 1024);
+  ASSERT_NE(cache, nullptr);
+
+  auto data = RandomData(1000, 1);
+  for (uint32_t i = 0; i < 3; ++i) {
+    ASSERT_TRUE(cache->Put(kStore, "Full-0001", i, data.data(), data.size()));
+    ASSERT_TRUE(cache->Put(kStore, "Full-0002", i, data.data(), data.size()));
+  }
+
+  cache->Remove(kStore, "Full-0001");
+  EXPECT_EQ(cache->Bytes(), 3000u);
+  for (uint32_t i = 0; i < 3; ++i) {
+    EXPECT_FALSE(Cached(*cache, "Full-0001", i, data));
+    EXPECT_TRUE(Cached(*cache, "Full-0002", i, data));
+  }
+}
+
+TEST(chunk_cache, picks_up_earlier_chunks)
+{
+  std::string dir = CacheDir();
+  auto data = RandomData(1000, 1);
+  {
+    auto cache = ChunkCache::ForDirectory(dir, 1024 * 1024);
+    ASSERT_NE(cache, nullptr);
+    ASSERT_TRUE(cache->Put(kStore, "Full-0001", 7, data.data(), data.size()));
+    ASSERT_TRUE(cache->Put(kStore, "Full@0002", 12, data.data(), data.size()));
+  }
+
+  // an interrupted Put(), unrelated files and a chunk of an older cache
+  // which did not record the backing store
+  std::ofstream(dir + "/" + kStore + "/Full-0001@0008.3.tmp") << "partial";
+  std::ofstream(dir + "/README") << "not a chunk";
+  std::ofstream(dir + "/Full-0003@0001") << "unknown store";
+
+  auto cache = ChunkCache::ForDirectory(dir, 1024 * 1024);
+  ASSERT_NE(cache, nullptr);
+  EXPECT_EQ(cache->Bytes(), 2000u);
+  EXPECT_TRUE(Cached(*cache, "Full-0001", 7, data));
+  EXPECT_TRUE(Cached(*cache, "Full@0002", 12, data));
+  EXPECT_FALSE(
+      std::filesystem::exists(dir + "/" + kStore + "/Full-0001@0008.3.tmp"));
+  EXPECT_FALSE(std::filesystem::exists(dir + "/Full-0003@0001"));
+  EXPECT_TRUE(std::filesystem::exists(dir + "/README"));
+}
+
+TEST(chunk_cache, keeps_backing_stores_apart)
+{
+  auto cache = ChunkCache::ForDirectory(CacheDir(), 1024 * 1024);
+  ASSERT_NE(cache, nullptr);
+  std::string other = ChunkCache::StoreName("profile/bucket");
+  ASSERT_NE(other, kStore);
+  EXPECT_EQ(other, ChunkCache::StoreName("profile/bucket"));
+
+  auto data = RandomData(1000, 1);
+  auto other_data = RandomData(1000, 2);
+  ASSERT_TRUE(cache->Put(kStore, "Full-0001", 0, data.data(), data.size()));
+  ASSERT_TRUE(cache->Put(other, "Full-0001", 0, other_data.data(),
+                         other_data.size()));
+  EXPECT_TRUE(Cached(*cache, "Full-0001", 0, data));
+  EXPECT_EQ(cache->Bytes(), 2000u);
+
+  cache->Remove(other, "Full-0001");
+  EXPECT_TRUE(Cached(*cache, "Full-0001", 0, data));
+  EXPECT_EQ(cache->Bytes(), 1000u);
+}
+
+TEST(chunk_cache, drops_changed_files)
+{
+  std::string dir = CacheDir();
+  auto cache = ChunkCache::ForDirectory(dir, 1024 * 1024);
+  ASSERT_NE(cache, nullptr);
+
+  auto data = RandomData(1000, 1);
+  ASSERT_TRUE(cache->Put(kStore, "Full-0001", 0, data.data(), data.size()));
+  ASSERT_TRUE(cache->Put(kStore, "Full-0001", 1, data.data(), data.size()));
+
+  // e.g. rewritten by another process using the same directory
+  std::string path = dir + "/" + kStore + "/Full-0001@0000";
+  std::ofstream(path, std::ios::app) << "more";
+  EXPECT_FALSE(Cached(*cache, "Full-0001", 0, data));
+  EXPECT_FALSE(std::filesystem::exists(path));
+  EXPECT_EQ(cache->Bytes(), 1000u);
+
+  std::filesystem::last_write_time(
+      dir + "/" + kStore + "/Full-0001@0001",
+      std::filesystem::file_time_type::clock::now() - std::chrono::hours(1));
+  EXPECT_FALSE(Cached(*cache, "Full-0001", 1, data));
+  EXPECT_EQ(cache->Bytes(), 0u);
+}
@@ -0,0 +1,268 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation, which is
+   listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+
+#include <filesystem>
+#include <fstream>
+
+#include "include/fcntl_def.h"
+
+#define STORAGE_DAEMON 1
+#include "include/jcr.h"
+#include "lib/parse_conf.h"
+#include "stored/butil.h"
+#include "stored/device_control_record.h"
+#include "stored/stored_jcr_impl.h"
+#include "stored/stored.h"
+#include "stored/stored_globals.h"
+#include "stored/sd_backends.h"
+
+#define CONFIG_SUBDIR "chunked_backend"
+#include "sd_backend_tests.h"
+
+using namespace storagedaemon;
+
+namespace {
+constexpr std::size_t kChunkSize = 10 * 1024 * 1024;
+
+std::vector<std::vector<char>> TestData(std::size_t write_size,
+                                        std::size_t count)
+{
+  std::vector<std::vector<char>> test_data;
+  for (std::size_t i = 0; i < count; ++i) {
+    test_data.emplace_back(write_size, static_cast<char>('0' + i % 64));
+  }
+  return test_data;
+}
+
+struct chunked_test {
+  JobControlRecord* jcr{nullptr};
+  Device* dev{nullptr};
+  std::string volname
+      = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+  std::string volume_dir;
+
+  // keep_volume reuses the volume an earlier device wrote
+  explicit chunked_test(const char* dev_name, bool keep_volume = false)
+  {
+    jcr = SetupDummyJcr("sd_backend_test", nullptr, nullptr);
+    DeviceResource* device_resource
+        = (DeviceResource*)my_config->GetResWithName(R_DEVICE, dev_name);
+    std::filesystem::create_directories(device_resource->archive_device_string);
+    volume_dir
+        = std::string{device_resource->archive_device_string} + "/" + volname;
+    if (!keep_volume) { std::filesystem::remove_all(volume_dir); }
+
+    dev = FactoryCreateDevice(jcr, device_resource);
+    dev->setVolCatName(volname.c_str());
+  }
+
+  ~chunked_test()
+  {
+    delete dev;
+    FreeJcr(jcr);
+  }
+
+  void Write(const std::vector<std::vector<char>>& test_data)
+  {
+    int fd = dev->d_open(volname.c_str(), O_CREAT | O_RDWR | O_BINARY, 0640);
+    ASSERT_GE(fd, 0) << dev->errmsg;
+    ASSERT_TRUE(dev->d_truncate(nullptr));
+    for (auto& buf : test_data) {
+      ASSERT_EQ(dev->d_write(fd, buf.data(), buf.size()), (ssize_t)buf.size());
+    }
+    ASSERT_TRUE(dev->d_flush(nullptr));
+    ASSERT_EQ(dev->d_close(fd), 0);
+  }
+
+  void Reread(const std::vector<std::vector<char>>& test_data)
+  {
+    int fd = dev->d_open(volname.c_str(), O_RDONLY | O_BINARY, 0640);
+    ASSERT_GE(fd, 0) << dev->errmsg;
+    for (auto& buf : test_data) {
+      std::vector<char> tmp(buf.size());
+      ASSERT_EQ(dev->d_read(fd, tmp.data(), tmp.size()), (ssize_t)tmp.size());
+      ASSERT_EQ(buf, tmp);
+    }
+    // end of the volume
+    char c;
+    EXPECT_EQ(dev->d_read(fd, &c, 1), 0);
+    ASSERT_EQ(dev->d_close(fd), 0);
+  }
+
+  std::size_t Chunks() const
+  {
+    std::size_t chunks = 0;
+    for (auto& entry : std::filesystem::directory_iterator(volume_dir)) {
+      std::string name = entry.path().filename().string();
+      if (name.find_first_not_of("0123456789") == std::string::npos) {
+        chunks++;
+      }
+    }
+    return chunks;
+  }
+};
+}  // namespace
+
+TEST_F(sd, chunked_write_reread)
+{
+  chunked_test test("chunked");
+  auto test_data = TestData(1024 * 1024 + 1, 25);
+
+  test.Write(test_data);
+  EXPECT_EQ(test.Chunks(), 3u);
+  EXPECT_EQ(std::filesystem::file_size(test.volume_dir + "/0000"), kChunkSize);
+  test.Reread(test_data);
+}
+
+TEST_F(sd, chunked_volume_size_and_truncate)
+{
+  chunked_test test("chunked");
+  auto test_data = TestData(3 * 1024 * 1024, 5);
+
+  test.Write(test_data);
+
+  int fd = test.dev->d_open(test.volname.c_str(), O_RDWR | O_BINARY, 0640);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(test.dev->d_lseek(nullptr, 0, SEEK_END), 15 * 1024 * 1024);
+
+  // appending continues in the last, partially filled chunk
+  std::vector<char> more(6 * 1024 * 1024, 'x');
+  ASSERT_EQ(test.dev->d_write(fd, more.data(), more.size()),
+            (ssize_t)more.size());
+  ASSERT_TRUE(test.dev->d_flush(nullptr));
+  EXPECT_EQ(test.dev->d_lseek(nullptr, 0, SEEK_END), 21 * 1024 * 1024);
+  EXPECT_EQ(test.Chunks(), 3u);
+
+  ASSERT_TRUE(test.dev->d_truncate(nullptr));
+  EXPECT_EQ(test.Chunks(), 0u);
+  test.dev->d_close(fd);
+}
+
+TEST_F(sd, chunked_volume_beyond_10000_chunks)
+{
+  chunked_test test("chunked");
+  constexpr std::size_t kLegacyChunks = 10000;
+  constexpr std::size_t kHalf = 512 * 1024;
+
+  /* A volume filled up to the former limit of 0000-9999, as sparse files.
+   * The last chunk is not completely filled. */
+  std::filesystem::create_directories(test.volume_dir);
+  for (std::size_t chunk = 0; chunk < kLegacyChunks; ++chunk) {
+    char name[16];
+    snprintf(name, sizeof(name), "/%04zu", chunk);
+    std::string path = test.volume_dir + name;
+    std::ofstream(path).close();
+    std::filesystem::resize_file(
+        path, chunk + 1 < kLegacyChunks ? kChunkSize : kChunkSize - kHalf);
+  }
+  const boffset_t legacy_size = kLegacyChunks * kChunkSize - kHalf;
+
+  int fd = test.dev->d_open(test.volname.c_str(), O_RDWR | O_BINARY, 0640);
+  ASSERT_GE(fd, 0) << test.dev->errmsg;
+  ASSERT_EQ(test.dev->d_lseek(nullptr, 0, SEEK_END), legacy_size);
+
+  std::vector<char> more(2 * kHalf, 'x');
+  ASSERT_EQ(test.dev->d_write(fd, more.data(), more.size()),
+            (ssize_t)more.size());
+  ASSERT_TRUE(test.dev->d_flush(nullptr));
+  EXPECT_EQ(test.Chunks(), kLegacyChunks + 1);
+  EXPECT_EQ(std::filesystem::file_size(test.volume_dir + "/9999"), kChunkSize);
+  EXPECT_EQ(std::filesystem::file_size(test.volume_dir + "/10000"), kHalf);
+  EXPECT_EQ(test.dev->d_lseek(nullptr, 0, SEEK_END),
+            legacy_size + (boffset_t)more.size());
+
+  ASSERT_EQ(test.dev->d_lseek(nullptr, legacy_size, SEEK_SET), legacy_size);
+  std::vector<char> tmp(more.size());
+  ASSERT_EQ(test.dev->d_read(fd, tmp.data(), tmp.size()), (ssize_t)tmp.size());
+  EXPECT_EQ(tmp, more);
+
+  ASSERT_TRUE(test.dev->d_truncate(nullptr));
+  EXPECT_EQ(test.Chunks(), 0u);
+  test.dev->d_close(fd);
+}
+
+TEST_F(sd, chunked_volume_size_of_any_number_of_chunks)
+{
+  chunked_test test("chunked");
+  constexpr std::size_t kHalf = 512 * 1024;
+
+  std::filesystem::create_directories(test.volume_dir);
+  int fd = test.dev->d_open(test.volname.c_str(),
+                            O_CREAT | O_RDWR | O_BINARY, 0640);
+  ASSERT_GE(fd, 0) << test.dev->errmsg;
+  EXPECT_EQ(test.dev->d_lseek(nullptr, 0, SEEK_END), 0);
+
+  /* Add one sparse chunk after the other, the last one is never completely
+   * filled.  The volume size is found without looking at every chunk, so
+   * check every number of chunks around the powers of two. */
+  for (std::size_t chunks = 1; chunks <= 1100; ++chunks) {
+    char name[16];
+    if (chunks > 1) {
+      snprintf(name, sizeof(name), "/%04zu", chunks - 2);
+      std::filesystem::resize_file(test.volume_dir + name, kChunkSize);
+    }
+    snprintf(name, sizeof(name), "/%04zu", chunks - 1);
+    std::string path = test.volume_dir + name;
+    std::ofstream(path).close();
+    std::filesystem::resize_file(path, kHalf);
+
+    ASSERT_EQ(test.dev->d_lseek(nullptr, 0, SEEK_END),
+              (boffset_t)((chunks - 1) * kChunkSize + kHalf))
+        << chunks << " chunks";
+  }
+
+  ASSERT_TRUE(test.dev->d_truncate(nullptr));
+  EXPECT_EQ(test.dev->d_lseek(nullptr, 0, SEEK_END), 0);
+  test.dev->d_close(fd);
+}
+
+TEST_F(sd, chunked_threaded_write_reread)
+{
+  chunked_test test("chunked-threaded");
+  auto test_data = TestData(1024 * 1024 - 1, 60);
+
+  test.Write(test_data);
+  EXPECT_EQ(test.Chunks(), 6u);
+  test.Reread(test_data);
+
+  // the chunks read ahead have to match the ones read synchronously
+  chunked_test other("chunked", true);
+  other.Reread(test_data);
+}
+
+TEST_F(sd, chunked_threaded_reads_from_cache)
+{
+  chunked_test test("chunked-threaded");
+  auto test_data = TestData(1024 * 1024, 20);
+
+  test.Write(test_data);
+  EXPECT_EQ(test.Chunks(), 2u);
+
+  // the chunks just written are still in the cache, so these are not read
+  for (auto& entry : std::filesystem::directory_iterator(test.volume_dir)) {
+    std::filesystem::resize_file(entry.path(), 0);
+  }
+
+  test.Reread(test_data);
+}
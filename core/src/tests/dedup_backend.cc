@@ -0,0 +1,421 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation, which is
+   listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <string_view>
+
+extern "C" {
+#include <arpa/inet.h>
+}
+
+#include "include/fcntl_def.h"
+#include "include/streams.h"
+
+#define STORAGE_DAEMON 1
+#include "include/jcr.h"
+#include "lib/parse_conf.h"
+#include "stored/butil.h"
+#include "stored/device_control_record.h"
+#include "stored/stored_jcr_impl.h"
+#include "stored/stored.h"
+#include "stored/stored_globals.h"
+#include "stored/sd_backends.h"
+#include "stored/backends/dedup/chunk_store.h"
+#include "stored/backends/dedup/chunker.h"
+
+#define CONFIG_SUBDIR "dedup_backend"
+#include "sd_backend_tests.h"
+#include "testing_common.h"
+
+using namespace storagedaemon;
+
+namespace {
+void PutInt(std::vector<char>& buf, std::size_t offset, std::uint32_t value)
+{
+  value = htonl(value);
+  std::memcpy(buf.data() + offset, &value, sizeof(value));
+}
+
+// builds a block in the same layout the sd uses (see stored/block.h)
+std::vector<char> MakeBlock(std::uint32_t block_number,
+                            const std::vector<std::vector<char>>& payloads)
+{
+  std::vector<char> block(BLKHDR2_LENGTH);
+  std::uint32_t file_index = 1;
+  for (auto& payload : payloads) {
+    std::size_t pos = block.size();
+    block.resize(pos + RECHDR2_LENGTH);
+    PutInt(block, pos, file_index++);
+    PutInt(block, pos + 4, STREAM_FILE_DATA);
+    PutInt(block, pos + 8, payload.size());
+    block.insert(block.end(), payload.begin(), payload.end());
+  }
+  PutInt(block, 0, 0);
+  PutInt(block, 4, block.size());
+  PutInt(block, 8, block_number);
+  std::memcpy(block.data() + 12, BLKHDR2_ID, BLKHDR_ID_LENGTH);
+  PutInt(block, 16, block_number);
+  PutInt(block, 20, block_number * 7);
+  return block;
+}
+
+struct dedup_device_test {
+  JobControlRecord* jcr{nullptr};
+  DeviceResource* device_resource{nullptr};
+  Device* dev{nullptr};
+  std::string archive;
+
+  // every test has a device of the same name
+  dedup_device_test()
+  {
+    jcr = SetupDummyJcr("sd_backend_test", nullptr, nullptr);
+    device_resource = (DeviceResource*)my_config->GetResWithName(
+        R_DEVICE,
+        ::testing::UnitTest::GetInstance()->current_test_info()->name());
+    if (!device_resource) { return; }
+
+    archive = device_resource->archive_device_string;
+    std::filesystem::remove_all(archive);
+    std::filesystem::create_directories(archive);
+    dev = FactoryCreateDevice(jcr, device_resource);
+  }
+
+  ~dedup_device_test()
+  {
+    delete dev;
+    FreeJcr(jcr);
+  }
+
+  // releases the chunk store of the device
+  void delete_device()
+  {
+    delete dev;
+    dev = nullptr;
+  }
+
+  // a new device has to read the chunk store from disk again
+  void recreate_device()
+  {
+    delete_device();
+    dev = FactoryCreateDevice(jcr, device_resource);
+  }
+
+  int open(int flags, std::string volname = {})
+  {
+    if (volname.empty()) {
+      volname
+          = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+    }
+    dev->setVolCatName(volname.c_str());
+    return dev->d_open((archive + "/" + volname).c_str(), flags, 0640);
+  }
+
+  void write(const std::vector<std::vector<char>>& blocks,
+             const std::string& volname = {})
+  {
+    int fd = open(O_CREAT | O_RDWR | O_BINARY, volname);
+    ASSERT_GE(fd, 0) << dev->errmsg;
+    for (auto& block : blocks) {
+      ASSERT_EQ(dev->d_write(fd, block.data(), block.size()),
+                (ssize_t)block.size())
+          << dev->errmsg;
+    }
+    ASSERT_EQ(dev->d_close(fd), 0) << dev->errmsg;
+  }
+
+  void reread(const std::vector<std::vector<char>>& blocks,
+              const std::string& volname = {})
+  {
+    int fd = open(O_RDONLY | O_BINARY, volname);
+    ASSERT_GE(fd, 0) << dev->errmsg;
+    std::vector<char> buffer(1024 * 1024);
+    for (auto& block : blocks) {
+      ASSERT_EQ(dev->d_read(fd, buffer.data(), buffer.size()),
+                (ssize_t)block.size())
+          << dev->errmsg;
+      ASSERT_EQ(std::memcmp(buffer.data(), block.data(), block.size()), 0);
+    }
+    EXPECT_EQ(dev->d_read(fd, buffer.data(), buffer.size()), 0);
+    EXPECT_EQ(dev->d_close(fd), 0);
+  }
+
+  dedup::store_state store_state()
+  {
+    dedup::store_state state{};
+    std::ifstream file(archive + "/.dedup/state", std::ios::binary);
+    file.read(reinterpret_cast<char*>(&state), sizeof(state));
+    return state;
+  }
+
+  std::uint64_t references()
+  {
+    auto state = store_state();
+    std::vector<dedup::chunk_entry> entries(state.chunk_count);
+    std::ifstream file(
+        archive + "/.dedup/chunks." + std::to_string(state.generation),
+        std::ios::binary);
+    file.read(reinterpret_cast<char*>(entries.data()),
+              entries.size() * sizeof(dedup::chunk_entry));
+    std::uint64_t refs = 0;
+    for (auto& entry : entries) { refs += entry.refcount; }
+    return refs;
+  }
+};
+}  // namespace
+
+TEST_F(sd, dedup_write_reread)
+{
+  dedup_device_test test;
+  ASSERT_TRUE(test.dev);
+
+  std::vector<std::vector<char>> payloads;
+  for (std::uint32_t i = 0; i < 8; ++i) {
+    payloads.push_back(RandomData(32 * 1024, i));
+  }
+
+  // the second half contains the same data as the first half
+  std::vector<std::vector<char>> blocks;
+  std::size_t payload_size = 0;
+  for (std::uint32_t i = 0; i < 8; ++i) {
+    auto& p1 = payloads[(2 * i) % payloads.size()];
+    auto& p2 = payloads[(2 * i + 1) % payloads.size()];
+    blocks.push_back(MakeBlock(i, {p1, p2}));
+    payload_size += p1.size() + p2.size();
+  }
+
+  test.write(blocks);
+
+  auto state = test.store_state();
+  EXPECT_GT(state.chunk_count, 0u);
+  EXPECT_LT(state.data_size, payload_size * 6 / 10);
+
+  int fd = test.open(O_RDONLY | O_BINARY);
+  ASSERT_GE(fd, 0) << test.dev->errmsg;
+
+  std::vector<char> buffer(1024 * 1024);
+  std::size_t volume_size = 0;
+  for (auto& block : blocks) {
+    // every read returns at most one block, just like reading from tape
+    ASSERT_EQ(test.dev->d_read(fd, buffer.data(), buffer.size()),
+              (ssize_t)block.size());
+    ASSERT_EQ(std::memcmp(buffer.data(), block.data(), block.size()), 0);
+    volume_size += block.size();
+  }
+  EXPECT_EQ(test.dev->d_read(fd, buffer.data(), buffer.size()), 0);
+  EXPECT_EQ(test.dev->d_lseek(nullptr, 0, SEEK_END), (boffset_t)volume_size);
+
+  // partial reads inside of a block
+  boffset_t offset = blocks[0].size() + 100;
+  ASSERT_EQ(test.dev->d_lseek(nullptr, offset, SEEK_SET), offset);
+  ASSERT_EQ(test.dev->d_read(fd, buffer.data(), 1000), 1000);
+  EXPECT_EQ(std::memcmp(buffer.data(), blocks[1].data() + 100, 1000), 0);
+  ASSERT_EQ(test.dev->d_read(fd, buffer.data(), 1000), 1000);
+  EXPECT_EQ(std::memcmp(buffer.data(), blocks[1].data() + 1100, 1000), 0);
+
+  // volumes are not writable when opened read only
+  EXPECT_LT(test.dev->d_write(fd, blocks[0].data(), blocks[0].size()), 0);
+
+  EXPECT_EQ(test.dev->d_close(fd), 0);
+}
+
+TEST_F(sd, dedup_truncate_releases_chunks)
+{
+  dedup_device_test test;
+  ASSERT_TRUE(test.dev);
+
+  std::vector<std::vector<char>> blocks;
+  for (std::uint32_t i = 0; i < 4; ++i) {
+    blocks.push_back(MakeBlock(i, {RandomData(64 * 1024, 100 + i)}));
+  }
+
+  test.write(blocks);
+  auto written = test.store_state();
+  EXPECT_GT(test.references(), 0u);
+
+  int fd = test.open(O_RDWR | O_BINARY);
+  ASSERT_GE(fd, 0) << test.dev->errmsg;
+  ASSERT_TRUE(test.dev->d_truncate(nullptr)) << test.dev->errmsg;
+  EXPECT_EQ(test.dev->d_lseek(nullptr, 0, SEEK_END), 0);
+  ASSERT_EQ(test.dev->d_close(fd), 0);
+  EXPECT_EQ(test.references(), 0u);
+
+  // released chunks are reused once the same data is written again
+  test.write(blocks);
+  auto rewritten = test.store_state();
+  EXPECT_EQ(rewritten.chunk_count, written.chunk_count);
+  EXPECT_EQ(rewritten.data_size, written.data_size);
+  EXPECT_GT(test.references(), 0u);
+}
+
+TEST_F(sd, dedup_overwrite)
+{
+  dedup_device_test test;
+  ASSERT_TRUE(test.dev);
+
+  std::vector<std::vector<char>> blocks;
+  for (std::uint32_t i = 0; i < 3; ++i) {
+    blocks.push_back(MakeBlock(i, {RandomData(16 * 1024, 200 + i)}));
+  }
+  test.write(blocks);
+
+  auto replacement = MakeBlock(1, {RandomData(20 * 1024, 300)});
+  int fd = test.open(O_RDWR | O_BINARY);
+  ASSERT_GE(fd, 0) << test.dev->errmsg;
+  boffset_t offset = blocks[0].size();
+  ASSERT_EQ(test.dev->d_lseek(nullptr, offset, SEEK_SET), offset);
+  ASSERT_EQ(test.dev->d_write(fd, replacement.data(), replacement.size()),
+            (ssize_t)replacement.size());
+  EXPECT_EQ(test.dev->d_lseek(nullptr, 0, SEEK_END),
+            (boffset_t)(blocks[0].size() + replacement.size()));
+
+  std::vector<char> buffer(1024 * 1024);
+  ASSERT_EQ(test.dev->d_lseek(nullptr, 0, SEEK_SET), 0);
+  ASSERT_EQ(test.dev->d_read(fd, buffer.data(), buffer.size()),
+            (ssize_t)blocks[0].size());
+  EXPECT_EQ(std::memcmp(buffer.data(), blocks[0].data(), blocks[0].size()), 0);
+  ASSERT_EQ(test.dev->d_read(fd, buffer.data(), buffer.size()),
+            (ssize_t)replacement.size());
+  EXPECT_EQ(
+      std::memcmp(buffer.data(), replacement.data(), replacement.size()), 0);
+  EXPECT_EQ(test.dev->d_close(fd), 0);
+}
+
+TEST_F(sd, dedup_compaction_reclaims_chunks)
+{
+  dedup_device_test test;
+  ASSERT_TRUE(test.dev);
+
+  std::vector<std::vector<char>> kept, dropped;
+  for (std::uint32_t i = 0; i < 4; ++i) {
+    kept.push_back(MakeBlock(i, {RandomData(64 * 1024, 400 + i)}));
+    dropped.push_back(MakeBlock(i, {RandomData(64 * 1024, 500 + i)}));
+  }
+  test.write(kept, "kept");
+  test.write(dropped, "dropped");
+  auto written = test.store_state();
+
+  int fd = test.open(O_RDWR | O_BINARY, "dropped");
+  ASSERT_GE(fd, 0) << test.dev->errmsg;
+  ASSERT_TRUE(test.dev->d_truncate(nullptr)) << test.dev->errmsg;
+  ASSERT_EQ(test.dev->d_close(fd), 0);
+
+  auto released = test.store_state();
+  EXPECT_GT(released.unused_chunks, 0u);
+  EXPECT_GT(released.unused_bytes, written.data_size / 3);
+  // the store is small, so it is not compacted on its own
+  EXPECT_EQ(released.data_size, written.data_size);
+
+  // only one writer may use the store
+  test.delete_device();
+  dedup::chunk_store(test.archive + "/.dedup", false).compact();
+  test.recreate_device();
+  ASSERT_TRUE(test.dev);
+
+  auto compacted = test.store_state();
+  EXPECT_EQ(compacted.generation, written.generation + 1);
+  EXPECT_EQ(compacted.chunk_count, written.chunk_count);
+  EXPECT_EQ(compacted.unused_chunks, 0u);
+  EXPECT_EQ(compacted.unused_bytes, 0u);
+  EXPECT_EQ(compacted.reclaimed_chunks, released.unused_chunks);
+  EXPECT_EQ(compacted.data_size, written.data_size - released.unused_bytes);
+  EXPECT_FALSE(std::filesystem::exists(
+      test.archive + "/.dedup/data." + std::to_string(written.generation)));
+
+  // the remaining volume can still be read
+  test.reread(kept, "kept");
+
+  // reclaimed chunks are not found anymore, so the data is stored again
+  test.write(dropped, "dropped");
+  auto rewritten = test.store_state();
+  EXPECT_GT(rewritten.chunk_count, compacted.chunk_count);
+  EXPECT_EQ(rewritten.data_size, written.data_size);
+  test.reread(dropped, "dropped");
+}
+
+TEST_F(sd, dedup_index_survives_reopen)
+{
+  dedup_device_test test;
+  ASSERT_TRUE(test.dev);
+
+  std::vector<std::vector<char>> blocks;
+  for (std::uint32_t i = 0; i < 4; ++i) {
+    blocks.push_back(MakeBlock(i, {RandomData(32 * 1024, 600 + i)}));
+  }
+  test.write(blocks, "first");
+  auto written = test.store_state();
+  EXPECT_GT(written.index_entries, 0u);
+
+  // the chunks are found in the index on disk
+  test.recreate_device();
+  ASSERT_TRUE(test.dev);
+  test.write(blocks, "second");
+  auto rewritten = test.store_state();
+  EXPECT_EQ(rewritten.chunk_count, written.chunk_count);
+  EXPECT_EQ(rewritten.data_size, written.data_size);
+  EXPECT_EQ(rewritten.referenced_bytes, 2 * written.referenced_bytes);
+
+  // a missing index is rebuilt from the chunk list
+  test.recreate_device();
+  ASSERT_TRUE(test.dev);
+  std::filesystem::remove(test.archive + "/.dedup/index."
+                          + std::to_string(written.generation));
+  test.write(blocks, "third");
+  EXPECT_EQ(test.store_state().data_size, written.data_size);
+  test.reread(blocks, "third");
+}
+
+TEST(dedup_chunker, boundaries_resynchronize)
+{
+  dedup::chunker chunker(4 * 1024);
+  auto data = RandomData(1024 * 1024, 42);
+
+  auto chunks = [&chunker](const std::vector<char>& buf) {
+    std::set<std::string_view> result;
+    std::size_t pos = 0;
+    while (pos < buf.size()) {
+      std::size_t size = chunker.next_boundary(buf.data() + pos,
+                                               buf.size() - pos);
+      EXPECT_LE(size, chunker.max_chunk_size());
+      if (pos + size < buf.size()) {
+        EXPECT_GE(size, chunker.min_chunk_size());
+      }
+      result.emplace(buf.data() + pos, size);
+      pos += size;
+    }
+    return result;
+  };
+
+  auto modified = data;
+  modified.insert(modified.begin() + 1000, 100, 'x');
+
+  auto original_chunks = chunks(data);
+  auto modified_chunks = chunks(modified);
+  std::size_t common = 0;
+  for (auto& chunk : modified_chunks) {
+    if (original_chunks.count(chunk)) { common += 1; }
+  }
+  EXPECT_GT(common, original_chunks.size() * 9 / 10);
+}
@@ -2,7 +2,7 @@
    BAREOS® - Backup Archiving REcovery Open Sourced
 
    Copyright (C) 2003-2011 Free Software Foundation Europe e.V.
-   Copyright (C) 2014-2022 Bareos GmbH & Co. KG
+   Copyright (C) 2014-2024 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -36,6 +36,9 @@
 
 #include "lib/htable.h"
 
+#include <algorithm>
+#include <vector>
+
 struct HTABLEJCR {
 #ifndef TEST_NON_CHAR
   char* key;
@@ -93,3 +96,70 @@ TEST(htable, htable)
 struct RbListJobControlRecord {
   char* buf;
 };
+
+struct HTABLEU64 {
+  uint64_t key;
+  hlink link;
+};
+
+TEST(htable, lookup_while_growing)
+{
+  using U64Table = htable<uint64_t, HTABLEU64>;
+  // start small, so the table grows several times
+  U64Table table(31);
+  constexpr uint64_t kItems = 100000;
+
+  for (uint64_t i = 0; i < kItems; i++) {
+    auto* item = (HTABLEU64*)table.hash_malloc(sizeof(HTABLEU64));
+    item->key = i * 4096; /* keys that only differ in high bits */
+    EXPECT_TRUE(table.insert(item->key, item));
+    EXPECT_FALSE(table.insert(item->key, item));
+
+    // everything inserted so far is found, whether moved already or not
+    if (i % 997 == 0) {
+      for (uint64_t j = 0; j <= i; j += 13) {
+        HTABLEU64* found = table.lookup(j * 4096);
+        ASSERT_NE(found, nullptr) << j;
+        EXPECT_EQ(found->key, j * 4096);
+      }
+    }
+  }
+  EXPECT_EQ(table.size(), kItems);
+  EXPECT_EQ(table.lookup(4095), nullptr);
+  EXPECT_EQ(table.lookup(kItems * 4096), nullptr);
+
+  std::vector<bool> seen(kItems);
+  HTABLEU64* item;
+  foreach_htable (item, &table) {
+    ASSERT_EQ(item->key % 4096, 0u);
+    EXPECT_FALSE(seen[item->key / 4096]);
+    seen[item->key / 4096] = true;
+  }
+  EXPECT_EQ(std::count(seen.begin(), seen.end(), true), (long)kItems);
+}
+
+struct HTABLEBIN {
+  uint8_t key[8];
+  hlink link;
+};
+
+TEST(htable, binary_keys)
+{
+  using BinTable = htable<htable_binary_key, HTABLEBIN>;
+  BinTable table(31);
+
+  for (int i = 0; i < 1000; i++) {
+    auto* item = (HTABLEBIN*)table.hash_malloc(sizeof(HTABLEBIN));
+    memcpy(item->key, &i, sizeof(i));
+    memcpy(item->key + sizeof(i), &i, sizeof(i));
+    EXPECT_TRUE(table.insert({item->key, sizeof(item->key)}, item));
+  }
+
+  int i = 500;
+  uint8_t key[8];
+  memcpy(key, &i, sizeof(i));
+  memcpy(key + sizeof(i), &i, sizeof(i));
+  EXPECT_NE(table.lookup({key, sizeof(key)}), nullptr);
+  // a prefix of a key is a different key
+  EXPECT_EQ(table.lookup({key, sizeof(i)}), nullptr);
+}
@@ -0,0 +1,248 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation, which is
+   listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+
+#include <filesystem>
+
+#include "include/fcntl_def.h"
+
+#define STORAGE_DAEMON 1
+#include "include/jcr.h"
+#include "lib/parse_conf.h"
+#include "stored/butil.h"
+#include "stored/device_control_record.h"
+#include "stored/stored_jcr_impl.h"
+#include "stored/stored.h"
+#include "stored/stored_globals.h"
+#include "stored/sd_backends.h"
+#include "stored/backends/io_uring_queue.h"
+
+#define CONFIG_SUBDIR "io_uring_file_device"
+#include "sd_backend_tests.h"
+#include "testing_common.h"
+
+using namespace storagedaemon;
+
+namespace {
+const char* TestName()
+{
+  return ::testing::UnitTest::GetInstance()->current_test_info()->name();
+}
+
+// Every test has its own device, named after the test.
+DeviceResource* TestDevice()
+{
+  return (DeviceResource*)my_config->GetResWithName(R_DEVICE, TestName());
+}
+
+std::string VolumePath(DeviceResource* device_resource)
+{
+  std::string dir = device_resource->archive_device_string;
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  return dir + "/" + TestName();
+}
+
+std::vector<char> ReadFile(const std::string& path)
+{
+  std::vector<char> content(std::filesystem::file_size(path));
+  int fd = open(path.c_str(), O_RDONLY);
+  EXPECT_GE(fd, 0);
+  EXPECT_EQ(pread(fd, content.data(), content.size(), 0),
+            (ssize_t)content.size());
+  close(fd);
+  return content;
+}
+
+struct io_uring_device {
+  JobControlRecord* jcr{nullptr};
+  Device* dev{nullptr};
+  std::string volume;
+
+  io_uring_device()
+  {
+    jcr = SetupDummyJcr("sd_backend_test", nullptr, nullptr);
+    DeviceResource* device_resource = TestDevice();
+    EXPECT_TRUE(device_resource);
+    if (!jcr || !device_resource) { return; }
+    dev = FactoryCreateDevice(jcr, device_resource);
+    volume = VolumePath(device_resource);
+  }
+
+  ~io_uring_device()
+  {
+    delete dev;
+    if (jcr) { FreeJcr(jcr); }
+  }
+
+  bool Open()
+  {
+    dev->fd = dev->d_open(volume.c_str(), O_CREAT | O_RDWR | O_BINARY, 0640);
+    return dev->fd >= 0;
+  }
+
+  bool Close()
+  {
+    int status = dev->d_close(dev->fd);
+    dev->fd = -1;
+    return status == 0;
+  }
+};
+}  // namespace
+
+TEST_F(sd, io_uring_queue_writes_everything)
+{
+  auto queue = IoUringQueue::Create(4, 8192);
+  if (!queue) { GTEST_SKIP() << "io_uring is not available"; }
+  // rounded up to whole pages
+  EXPECT_GE(queue->BufferSize(), 8192u);
+  EXPECT_EQ(queue->BufferSize() % IoUringQueue::BufferAlignment(), 0u);
+
+  DeviceResource* device_resource = TestDevice();
+  ASSERT_TRUE(device_resource);
+  std::string path = VolumePath(device_resource);
+  int fd = open(path.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0640);
+  ASSERT_GE(fd, 0);
+
+  // more writes than buffers, with odd sizes and out of order
+  std::vector<char> data = RandomData(64 * 1000, 1);
+  for (std::size_t i = 0; i < 64; i += 2) {
+    ASSERT_TRUE(queue->Write(fd, data.data() + (i + 1) * 1000, 1000,
+                             (i + 1) * 1000));
+    ASSERT_TRUE(queue->Write(fd, data.data() + i * 1000, 1000, i * 1000));
+  }
+  ASSERT_TRUE(queue->Drain());
+
+  std::vector<char> read_back(data.size());
+  ASSERT_EQ(pread(fd, read_back.data(), read_back.size(), 0),
+            (ssize_t)data.size());
+  EXPECT_EQ(read_back, data);
+
+  // too big for one buffer
+  std::vector<char> too_big(queue->BufferSize() + 1);
+  EXPECT_FALSE(queue->Write(fd, too_big.data(), too_big.size(), 0));
+  EXPECT_EQ(errno, EINVAL);
+  close(fd);
+
+  // a failed write is reported by the next call
+  fd = open(path.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  ASSERT_TRUE(queue->Write(fd, data.data(), 1000, 0));
+  EXPECT_FALSE(queue->Drain());
+  EXPECT_EQ(errno, EBADF);
+  EXPECT_TRUE(queue->Drain());
+  close(fd);
+}
+
+TEST_F(sd, io_uring_file_device_write_reread)
+{
+  io_uring_device test;
+  ASSERT_TRUE(test.dev);
+  Device* dev = test.dev;
+
+  // aligned blocks go through O_DIRECT, the others do not
+  std::vector<std::vector<char>> blocks;
+  for (std::uint32_t i = 0; i < 16; ++i) {
+    std::size_t size = (i % 3 == 0) ? 4096 * (i + 1) : 1000 * i + 17;
+    blocks.push_back(RandomData(size, i));
+  }
+  // larger than the io_uring buffers
+  blocks.push_back(RandomData(1024 * 1024, 99));
+
+  ASSERT_TRUE(test.Open()) << dev->errmsg;
+  boffset_t volume_size = 0;
+  for (auto& block : blocks) {
+    ASSERT_EQ(dev->d_write(dev->fd, block.data(), block.size()),
+              (ssize_t)block.size())
+        << dev->errmsg;
+    volume_size += block.size();
+    EXPECT_EQ(dev->d_lseek(nullptr, 0, SEEK_CUR), volume_size);
+  }
+  EXPECT_EQ(dev->d_lseek(nullptr, 0, SEEK_END), volume_size);
+
+  // reading back while writes may still be in flight
+  ASSERT_EQ(dev->d_lseek(nullptr, 0, SEEK_SET), 0);
+  for (auto& block : blocks) {
+    std::vector<char> buffer(block.size());
+    ASSERT_EQ(dev->d_read(dev->fd, buffer.data(), buffer.size()),
+              (ssize_t)buffer.size());
+    EXPECT_EQ(buffer, block);
+  }
+  EXPECT_TRUE(test.Close()) << dev->errmsg;
+
+  EXPECT_EQ(std::filesystem::file_size(test.volume),
+            (std::uintmax_t)volume_size);
+}
+
+TEST_F(sd, io_uring_file_device_rewrite_after_seek)
+{
+  io_uring_device test;
+  ASSERT_TRUE(test.dev);
+  Device* dev = test.dev;
+
+  constexpr std::size_t kBlock = 64 * 1024;
+  constexpr int kBlocks = 8;
+  ASSERT_TRUE(test.Open()) << dev->errmsg;
+
+  /* Every block is rewritten right after it was queued, like a label or the
+   * last block of a volume is.  The rewrite has to win. */
+  std::vector<char> expected;
+  for (int i = 0; i < kBlocks; ++i) {
+    auto first = RandomData(kBlock, i);
+    auto second = RandomData(kBlock, 100 + i);
+    boffset_t offset = (boffset_t)i * kBlock;
+    ASSERT_EQ(dev->d_write(dev->fd, first.data(), kBlock), (ssize_t)kBlock)
+        << dev->errmsg;
+    ASSERT_EQ(dev->d_lseek(nullptr, offset, SEEK_SET), offset);
+    ASSERT_EQ(dev->d_write(dev->fd, second.data(), kBlock), (ssize_t)kBlock)
+        << dev->errmsg;
+    expected.insert(expected.end(), second.begin(), second.end());
+  }
+  EXPECT_TRUE(test.Close()) << dev->errmsg;
+
+  EXPECT_EQ(ReadFile(test.volume), expected);
+}
+
+TEST_F(sd, io_uring_file_device_wait_for_queued_writes)
+{
+  io_uring_device test;
+  ASSERT_TRUE(test.dev);
+  Device* dev = test.dev;
+
+  ASSERT_TRUE(test.Open()) << dev->errmsg;
+  std::vector<char> data;
+  for (std::uint32_t i = 0; i < 32; ++i) {
+    auto block = RandomData(4096 * (i % 4 + 1), i);
+    ASSERT_EQ(dev->d_write(dev->fd, block.data(), block.size()),
+              (ssize_t)block.size())
+        << dev->errmsg;
+    data.insert(data.end(), block.begin(), block.end());
+  }
+
+  /* What is reported in a JobMedia record has to be on the volume, so
+   * somebody else reading the file sees all of it. */
+  ASSERT_TRUE(dev->WaitForQueuedWrites()) << dev->errmsg;
+  EXPECT_EQ(ReadFile(test.volume), data);
+
+  EXPECT_TRUE(test.Close()) << dev->errmsg;
+}
@@ -26,6 +26,7 @@
 #  include "include/bareos.h"
 #endif
 
+#include "include/jcr.h"
 #include "include/version_numbers.h"
 #define BAREOS_TEST_LIB
 #include "lib/bnet.h"
@@ -335,3 +336,24 @@ TEST(StringManipulation, DelimitedString_PrintsCorrectMultipleCharacters)
 
   EXPECT_STREQ(result.c_str(), "'A','B','C','D','E','F'");
 }
+
+TEST(Messages, QueuedFatalErrorFailsTheJobRightAway)
+{
+  JobControlRecord jcr;
+  jcr.JobId = 1;
+  jcr.setJobStatus(JS_Running);
+  jcr.queue_msgs = true;
+
+  Jmsg(&jcr, M_ERROR, 0, "queued error\n");
+  Jmsg(&jcr, M_FATAL, 0, "queued fatal error\n");
+  EXPECT_EQ(jcr.msg_queue->size(), 2);
+  EXPECT_EQ(jcr.JobErrors, 1);
+  EXPECT_TRUE(jcr.IsJobCanceled());
+
+  // sending the queued messages does not count them again
+  jcr.queue_msgs = false;
+  DequeueMessages(&jcr);
+  EXPECT_EQ(jcr.msg_queue->size(), 0);
+  EXPECT_EQ(jcr.JobErrors, 1);
+  EXPECT_EQ(jcr.getJobStatus(), JS_FatalError);
+}
@@ -0,0 +1,294 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include <string>
+#include <vector>
+#include "cats/postgresql_binary_copy.h"
+#include "lib/edit.h"
+
+static std::string Bytes(const PgBinaryCopyBuffer& buffer)
+{
+  return std::string(buffer.data(), buffer.size());
+}
+
+TEST(postgresql_binary_copy, header_and_trailer)
+{
+  PgBinaryCopyBuffer buffer;
+  buffer.Start();
+  buffer.Finish();
+
+  EXPECT_EQ(Bytes(buffer), std::string("PGCOPY\n\377\r\n\0"
+                                       "\0\0\0\0"
+                                       "\0\0\0\0"
+                                       "\377\377",
+                                       21));
+}
+
+TEST(postgresql_binary_copy, integers)
+{
+  PgBinaryCopyBuffer buffer;
+  buffer.StartRow(2);
+  EXPECT_TRUE(buffer.AddInt32(0x01020304));
+  EXPECT_TRUE(buffer.AddInt16(-2));
+
+  EXPECT_EQ(Bytes(buffer), std::string("\0\2"
+                                       "\0\0\0\4\1\2\3\4"
+                                       "\0\0\0\2\377\376",
+                                       16));
+}
+
+TEST(postgresql_binary_copy, text_is_not_escaped)
+{
+  PgBinaryCopyBuffer buffer;
+  buffer.AddText("a\tb\\c\n", 6);
+  buffer.AddText("", 0);
+
+  EXPECT_EQ(Bytes(buffer), std::string("\0\0\0\6a\tb\\c\n"
+                                       "\0\0\0\0",
+                                       14));
+}
+
+TEST(postgresql_binary_copy, numeric)
+{
+  PgBinaryCopyBuffer zero;
+  zero.AddNumeric(0);
+  EXPECT_EQ(Bytes(zero), std::string("\0\0\0\10"
+                                     "\0\0\0\0\0\0\0\0",
+                                     12));
+
+  // 123456789 is 1 2345 6789 in base 10000.
+  PgBinaryCopyBuffer digits;
+  digits.AddNumeric(123456789);
+  EXPECT_EQ(Bytes(digits), std::string("\0\0\0\16"
+                                       "\0\3\0\2\0\0\0\0"
+                                       "\0\1\x09\x29\x1a\x85",
+                                       18));
+
+  // Trailing zero digits are left out: 20000 0000 is 2 with weight 2.
+  PgBinaryCopyBuffer trailing;
+  trailing.AddNumeric(200000000);
+  EXPECT_EQ(Bytes(trailing), std::string("\0\0\0\12"
+                                         "\0\1\0\2\0\0\0\0"
+                                         "\0\2",
+                                         14));
+
+  // 18446744073709551615 is 1844 6744 0737 0955 1615 in base 10000.
+  PgBinaryCopyBuffer largest;
+  largest.AddNumeric(UINT64_MAX);
+  EXPECT_EQ(Bytes(largest), std::string("\0\0\0\22"
+                                        "\0\5\0\4\0\0\0\0"
+                                        "\x07\x34\x1a\x58\x02\xe1\x03\xbb"
+                                        "\x06\x4f",
+                                        22));
+}
+
+TEST(postgresql_binary_copy, flush_size)
+{
+  PgBinaryCopyBuffer buffer;
+  std::string name(1024, 'x');
+
+  while (!buffer.NeedsFlush()) { buffer.AddText(name.data(), name.size()); }
+  EXPECT_GE(buffer.size(), PgBinaryCopyBuffer::kFlushSize);
+
+  buffer.clear();
+  EXPECT_TRUE(buffer.empty());
+}
+
+TEST(postgresql_binary_copy, text_escape)
+{
+  const char name[] = "a\tb\\c'd\ne";
+  char escaped[2 * sizeof(name) + 1];
+
+  PgCopyEscape(escaped, name, strlen(name));
+  EXPECT_STREQ(escaped, "a\\tb\\\\c\\'d\\ne");
+}
+
+TEST(postgresql_binary_copy, integers_out_of_range)
+{
+  PgBinaryCopyBuffer buffer;
+  EXPECT_FALSE(buffer.AddInt16(INT16_MAX + 1));
+  EXPECT_FALSE(buffer.AddInt16(INT16_MIN - 1));
+  EXPECT_FALSE(buffer.AddInt32(int64_t{INT32_MAX} + 1));
+  EXPECT_FALSE(buffer.AddInt32(UINT32_MAX));
+  EXPECT_TRUE(buffer.empty());
+
+  EXPECT_TRUE(buffer.AddInt16(INT16_MAX));
+  EXPECT_TRUE(buffer.AddInt32(INT32_MAX));
+}
+
+namespace {
+// The row as the text format of COPY sent it before the binary format.
+std::string TextRow(const PgBatchFileRow& row)
+{
+  std::string path(row.Path), name(row.Name);
+  std::vector<char> esc_path(2 * path.size() + 1);
+  std::vector<char> esc_name(2 * name.size() + 1);
+  PgCopyEscape(esc_path.data(), path.c_str(), path.size());
+  PgCopyEscape(esc_name.data(), name.c_str(), name.size());
+
+  char ed1[50], ed2[50], ed3[50];
+  PoolMem line;
+  Mmsg(line, "%u\t%s\t%s\t%s\t%s\t%s\t%u\t%s\t%s\n", row.FileIndex,
+       edit_int64(row.JobId, ed1), esc_path.data(), esc_name.data(),
+       std::string(row.LStat).c_str(), std::string(row.Md5).c_str(),
+       row.DeltaSeq, edit_uint64(row.Fhinfo, ed2),
+       edit_uint64(row.Fhnode, ed3));
+  return line.c_str();
+}
+
+// Decodes a binary row of the batch table into the text format.
+class BinaryRowReader {
+ public:
+  explicit BinaryRowReader(const std::string& data) : data_(data) {}
+
+  std::string TextRow()
+  {
+    EXPECT_EQ(Get(2), 9u);
+    // the fields have to be read one after the other
+    std::vector<std::string> fields;
+    fields.push_back(Int());
+    fields.push_back(Int());
+    fields.push_back(Text());
+    fields.push_back(Text());
+    fields.push_back(Text(false));
+    fields.push_back(Text(false));
+    fields.push_back(Int());
+    fields.push_back(Numeric());
+    fields.push_back(Numeric());
+    EXPECT_EQ(pos_, data_.size());
+
+    std::string line;
+    for (auto& field : fields) {
+      if (!line.empty()) { line += '\t'; }
+      line += field;
+    }
+    return line + '\n';
+  }
+
+ private:
+  uint64_t Get(int bytes)
+  {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+      value = (value << 8) | static_cast<unsigned char>(data_.at(pos_++));
+    }
+    return value;
+  }
+
+  std::string Int()
+  {
+    uint64_t len = Get(4);
+    uint64_t value = Get(len);
+    int64_t sign_bit = int64_t{1} << (8 * len - 1);
+    int64_t number = static_cast<int64_t>(value);
+    if (number & sign_bit) { number -= 2 * sign_bit; }
+    return std::to_string(number);
+  }
+
+  std::string Text(bool escape = true)
+  {
+    uint64_t len = Get(4);
+    std::string text = data_.substr(pos_, len);
+    pos_ += len;
+    if (!escape) { return text; }
+    std::vector<char> escaped(2 * text.size() + 1);
+    PgCopyEscape(escaped.data(), text.c_str(), text.size());
+    return escaped.data();
+  }
+
+  std::string Numeric()
+  {
+    Get(4);
+    uint64_t ndigits = Get(2);
+    uint64_t weight = Get(2);
+    EXPECT_EQ(Get(2), 0u); /* positive */
+    EXPECT_EQ(Get(2), 0u); /* scale */
+    uint64_t value = 0;
+    for (uint64_t i = 0; i <= weight; i++) {
+      value = value * 10000 + (i < ndigits ? Get(2) : 0);
+    }
+    return std::to_string(value);
+  }
+
+  const std::string& data_;
+  std::size_t pos_ = 0;
+};
+}  // namespace
+
+TEST(postgresql_binary_copy, batch_row_matches_text_format)
+{
+  std::vector<PgBatchFileRow> rows(3);
+  rows[0].FileIndex = 1;
+  rows[0].JobId = 42;
+  rows[0].Path = "/tmp/";
+  rows[0].Name = "file";
+  rows[0].LStat = "P0C BAAE Ajg B A A A";
+  rows[0].Md5 = "0";
+
+  rows[1].FileIndex = INT32_MAX;
+  rows[1].JobId = INT32_MAX;
+  rows[1].Path = "/with\ttab\\and'quote/";
+  rows[1].Name = "new\nline";
+  rows[1].LStat = "gB A";
+  rows[1].Md5 = "1B2M2Y8AsgTpgAmY7PhCfg";
+  rows[1].DeltaSeq = INT16_MAX;
+  rows[1].Fhinfo = UINT64_MAX;
+  rows[1].Fhnode = 200000000;
+
+  rows[2].Path = "/";
+  rows[2].DeltaSeq = 7;
+  rows[2].Fhinfo = 123456789;
+
+  for (auto& row : rows) {
+    PgBinaryCopyBuffer buffer;
+    ASSERT_TRUE(AddBatchFileRow(buffer, row));
+    EXPECT_EQ(BinaryRowReader(Bytes(buffer)).TextRow(), TextRow(row));
+  }
+}
+
+TEST(postgresql_binary_copy, batch_row_out_of_range)
+{
+  PgBatchFileRow row;
+  row.Path = "/";
+  row.Name = "file";
+
+  PgBatchFileRow delta_seq = row;
+  delta_seq.DeltaSeq = INT16_MAX + 1;
+  PgBatchFileRow file_index = row;
+  file_index.FileIndex = uint32_t{INT32_MAX} + 1;
+  PgBatchFileRow job_id = row;
+  job_id.JobId = UINT32_MAX;
+
+  for (auto& bad : {delta_seq, file_index, job_id}) {
+    PgBinaryCopyBuffer buffer;
+    EXPECT_FALSE(AddBatchFileRow(buffer, bad));
+    // no partial row is left behind
+    EXPECT_TRUE(buffer.empty());
+  }
+}
@@ -0,0 +1,196 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "include/ch.h"
+#include "include/jcr.h"
+#include "include/streams.h"
+#include "filed/filed.h"
+#include "filed/filed_jcr_impl.h"
+#include "filed/restore_pipeline.h"
+#include "lib/compression.h"
+#include "lib/serial.h"
+
+using namespace filedaemon;
+
+namespace {
+constexpr std::size_t kBlockSize = 64 * 1024;
+
+std::vector<char> BlockData(std::size_t block)
+{
+  std::vector<char> data(kBlockSize);
+  for (std::size_t i = 0; i < data.size(); ++i) {
+    data[i] = 'a' + (i / 100 + block) % 26;
+  }
+  return data;
+}
+
+// a sparse record as sent by the filed: file address, then compressed data
+std::vector<char> SparseRecord(uint64_t addr, const std::vector<char>& data)
+{
+  std::vector<char> record(
+      OFFSET_FADDR_SIZE + sizeof(comp_stream_header)
+      + RequiredCompressionOutputBufferSize(COMPRESS_FZ4L, data.size()));
+  char* comp = record.data() + OFFSET_FADDR_SIZE;
+  result size = ThreadlocalCompress(
+      COMPRESS_FZ4L, 0, data.data(), data.size(),
+      comp + sizeof(comp_stream_header),
+      record.size() - OFFSET_FADDR_SIZE - sizeof(comp_stream_header));
+  EXPECT_FALSE(size.holds_error()) << size.error_unchecked().c_str();
+  if (size.holds_error()) { return {}; }
+
+  ser_declare;
+  SerBegin(record.data(), OFFSET_FADDR_SIZE);
+  ser_uint64(addr);
+  SerEnd(record.data(), OFFSET_FADDR_SIZE);
+  SerBegin(comp, sizeof(comp_stream_header));
+  ser_uint32(COMPRESS_FZ4L);
+  ser_uint32(size.value_unchecked());
+  ser_uint16(0);
+  ser_uint16(COMP_HEAD_VERSION);
+  SerEnd(comp, sizeof(comp_stream_header));
+
+  record.resize(OFFSET_FADDR_SIZE + sizeof(comp_stream_header)
+                + size.value_unchecked());
+  return record;
+}
+
+struct restore_test {
+  JobControlRecord jcr;
+  BareosFilePacket bfd;
+  char flags[FOPTS_BYTES]{};
+  std::string path = std::string{TEST_TEMP_DIR} + "/"
+                     + ::testing::UnitTest::GetInstance()
+                           ->current_test_info()
+                           ->name();
+
+  restore_test()
+  {
+    jcr.fd_impl = new FiledJcrImpl;
+    jcr.fd_impl->last_fname = GetPoolMemory(PM_FNAME);
+    PmStrcpy(jcr.fd_impl->last_fname, path.c_str());
+    SetBit(FO_COMPRESS, flags);
+    SetBit(FO_SPARSE, flags);
+
+    binit(&bfd);
+    int mode = O_WRONLY | O_CREAT | O_TRUNC | O_BINARY;
+    EXPECT_GE(bopen(&bfd, path.c_str(), mode, 0640, 0), 0);
+  }
+
+  ~restore_test()
+  {
+    if (IsBopen(&bfd)) { bclose(&bfd); }
+    FreePoolMemory(jcr.fd_impl->last_fname);
+    delete jcr.fd_impl;
+    jcr.fd_impl = nullptr;
+  }
+
+  std::vector<char> Content()
+  {
+    bclose(&bfd);
+    std::ifstream file(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(file), {}};
+  }
+};
+}  // namespace
+
+TEST(restore_pipeline, writes_blocks_in_order)
+{
+  restore_test test;
+  // the last block is written before a hole and then the file is filled
+  std::vector<std::size_t> blocks{0, 1, 2, 5, 3, 4, 6, 7};
+
+  std::vector<char> expected((blocks.size()) * kBlockSize);
+  uint64_t final_addr = 0;
+  {
+    restore_pipeline pipeline(&test.jcr, &test.bfd,
+                              STREAM_SPARSE_COMPRESSED_DATA, test.flags, 0, 4);
+    for (std::size_t block : blocks) {
+      auto data = BlockData(block);
+      std::copy(data.begin(), data.end(),
+                expected.begin() + block * kBlockSize);
+      auto record = SparseRecord(block * kBlockSize, data);
+      ASSERT_TRUE(pipeline.push(record.data(), record.size()));
+    }
+    result addr = pipeline.finish();
+    ASSERT_FALSE(addr.holds_error()) << addr.error_unchecked().c_str();
+    final_addr = addr.value_unchecked();
+  }
+
+  EXPECT_EQ(final_addr, 8 * kBlockSize);
+  EXPECT_EQ(test.jcr.JobBytes, expected.size());
+  EXPECT_EQ(test.Content(), expected);
+}
+
+TEST(restore_pipeline, returns_decompression_error)
+{
+  restore_test test;
+  restore_pipeline pipeline(&test.jcr, &test.bfd,
+                            STREAM_SPARSE_COMPRESSED_DATA, test.flags, 0, 2);
+
+  auto good = SparseRecord(0, BlockData(0));
+  auto bad = SparseRecord(kBlockSize, BlockData(1));
+  // an unknown compression algorithm in the header
+  bad[OFFSET_FADDR_SIZE] = 'X';
+
+  ASSERT_TRUE(pipeline.push(good.data(), good.size()));
+  pipeline.push(bad.data(), bad.size());
+  // the writer stops at the error, everything pushed after it is dropped
+  for (std::size_t block = 2; block < 50; ++block) {
+    auto record = SparseRecord(block * kBlockSize, BlockData(block));
+    if (!pipeline.push(record.data(), record.size())) { break; }
+  }
+
+  result addr = pipeline.finish();
+  ASSERT_TRUE(addr.holds_error());
+  EXPECT_NE(std::string{addr.error_unchecked().c_str()}.find(
+                "Uncompression error on file"),
+            std::string::npos);
+  EXPECT_EQ(test.jcr.JobBytes, kBlockSize);
+  EXPECT_EQ(test.Content(), BlockData(0));
+}
+
+TEST(restore_pipeline, rejects_short_sparse_record)
+{
+  restore_test test;
+  restore_pipeline pipeline(&test.jcr, &test.bfd,
+                            STREAM_SPARSE_COMPRESSED_DATA, test.flags, 0, 2);
+
+  char too_short[OFFSET_FADDR_SIZE - 1]{};
+  EXPECT_FALSE(pipeline.push(too_short, sizeof(too_short)));
+
+  result addr = pipeline.finish();
+  ASSERT_TRUE(addr.holds_error());
+  EXPECT_NE(
+      std::string{addr.error_unchecked().c_str()}.find("Data record too short"),
+      std::string::npos);
+}
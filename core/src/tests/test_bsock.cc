@@ -439,3 +439,177 @@ TEST(BNet, FormatAndSendResponseMessage)
   std::string test("1000 Test123");
   EXPECT_STREQ(args.JoinReadable().c_str(), test.c_str());
 }
+
+static std::vector<std::string> ReceiveMessages(BareosSocket* sock)
+{
+  std::vector<std::string> messages;
+  while (sock->recv() >= 0) {
+    messages.emplace_back(sock->msg, sock->message_length);
+  }
+  return messages;
+}
+
+static std::string Pattern(std::size_t size, char seed)
+{
+  std::string data(size, '\0');
+  for (std::size_t i = 0; i < size; ++i) { data[i] = (char)(seed + i % 251); }
+  return data;
+}
+
+TEST(BNet, SendBuffers)
+{
+  std::unique_ptr<TestSockets> test_sockets(
+      create_connected_server_and_client_bareos_socket());
+  ASSERT_NE(test_sockets.get(), nullptr)
+      << "Could not create Bareos test sockets.";
+
+  BareosSocket* client = test_sockets->client.get();
+  auto received = std::async(std::launch::async, ReceiveMessages,
+                             test_sockets->server.get());
+
+  std::string header = Pattern(8, 'h');
+  std::string small = Pattern(100, 's');
+  // larger than a single Bareos packet
+  std::string big = Pattern(1500000, 'b');
+
+  BnetBuffer two[] = {{header.data(), header.size()}, {small.data(), 0},
+                      {small.data(), small.size()}};
+  EXPECT_TRUE(client->SendBuffers(two, 3));
+  BnetBuffer one[] = {{big.data(), big.size()}};
+  EXPECT_TRUE(client->SendBuffers(one, 1));
+  EXPECT_TRUE(client->SendBuffers(nullptr, 0));
+  EXPECT_TRUE(client->signal(BNET_EOD));
+
+  auto messages = received.get();
+  ASSERT_EQ(messages.size(), 4u);
+  EXPECT_EQ(messages[0], header + small);
+  // every packet arrives as a message of its own
+  EXPECT_EQ(messages[1], big.substr(0, 999996));
+  EXPECT_EQ(messages[2], big.substr(999996));
+  EXPECT_EQ(messages[3], "");
+}
+
+TEST(BNet, SendBuffersZeroCopy)
+{
+  std::unique_ptr<TestSockets> test_sockets(
+      create_connected_server_and_client_bareos_socket());
+  ASSERT_NE(test_sockets.get(), nullptr)
+      << "Could not create Bareos test sockets.";
+
+  if (!test_sockets->client->EnableZeroCopy()) {
+    GTEST_SKIP() << "Zero copy send is not available.";
+  }
+
+  BareosSocket* client = test_sockets->client.get();
+  auto received = std::async(std::launch::async, ReceiveMessages,
+                             test_sockets->server.get());
+
+  std::vector<std::string> sent;
+  std::weak_ptr<std::string> last;
+  for (int i = 0; i < 300; ++i) {
+    auto data = std::make_shared<std::string>(Pattern(64 * 1024 + i, 'a' + i));
+    BnetBuffer buffer{data->data(), data->size()};
+    EXPECT_TRUE(client->SendBuffers(&buffer, 1, data));
+    sent.push_back(*data);
+    last = data;
+  }
+  EXPECT_TRUE(client->signal(BNET_EOD));
+
+  EXPECT_EQ(received.get(), sent);
+
+  // the socket only keeps the data until the kernel is done with it
+  client->close();
+  EXPECT_TRUE(last.expired());
+}
+
+// Messages and signals as they were sent, with the frames unpacked
+struct FramedMessages {
+  std::vector<std::string> messages;
+  int frames = 0;
+};
+
+static std::string SignalName(int32_t signal)
+{
+  return "signal " + std::to_string(signal);
+}
+
+static FramedMessages ReceiveFramedMessages(BareosSocket* sock)
+{
+  FramedMessages received;
+  for (;;) {
+    int32_t n = sock->recv();
+    if (n >= 0) {
+      received.messages.emplace_back(sock->msg, sock->message_length);
+    } else if (n != BNET_SIGNAL || sock->message_length == BNET_TERMINATE) {
+      break;
+    } else if (sock->message_length != BNET_FRAME) {
+      received.messages.push_back(SignalName(sock->message_length));
+    } else {
+      received.frames++;
+      n = sock->recv();
+      EXPECT_GE(n, 0);
+      EXPECT_TRUE(UnpackFrame(sock->msg, n, [&](const char* data,
+                                                int32_t length) {
+        received.messages.push_back(data ? std::string(data, length)
+                                         : SignalName(length));
+        return true;
+      }));
+    }
+  }
+  return received;
+}
+
+TEST(BNet, SendFrames)
+{
+  std::unique_ptr<TestSockets> test_sockets(
+      create_connected_server_and_client_bareos_socket());
+  ASSERT_NE(test_sockets.get(), nullptr)
+      << "Could not create Bareos test sockets.";
+
+  BareosSocket* client = test_sockets->client.get();
+  auto received = std::async(std::launch::async, ReceiveFramedMessages,
+                             test_sockets->server.get());
+
+  std::vector<std::string> sent;
+  EXPECT_TRUE(client->SetFrameSize(64 * 1024));
+  for (int i = 0; i < 1000; ++i) {
+    // like the header, data and end of data of a small file
+    EXPECT_TRUE(client->fsend("%d %d 0", i, 2));
+    sent.push_back(std::to_string(i) + " 2 0");
+    std::string data = Pattern(i % 200, 'a' + i % 20);
+    BnetBuffer buffer{data.data(), data.size()};
+    EXPECT_TRUE(client->SendBuffers(&buffer, 1));
+    sent.push_back(data);
+    EXPECT_TRUE(client->signal(BNET_EOD));
+    sent.push_back(SignalName(BNET_EOD));
+    if (i % 100 == 99) {
+      // large messages are sent on their own, after the collected ones
+      std::string large = Pattern(BareosSocket::framed_message_limit, 'l');
+      EXPECT_TRUE(client->send(large.data(), large.size()));
+      sent.push_back(large);
+    }
+  }
+  EXPECT_TRUE(client->SetFrameSize(0));
+  EXPECT_TRUE(client->fsend("after"));
+  sent.push_back("after");
+  EXPECT_TRUE(client->signal(BNET_TERMINATE));
+
+  FramedMessages framed = received.get();
+  EXPECT_EQ(framed.messages, sent);
+  EXPECT_GE(framed.frames, 10);
+  EXPECT_LT(framed.frames, 100);
+}
+
+TEST(BNet, UnpackMalformedFrame)
+{
+  auto ignore = [](const char*, int32_t) { return true; };
+  int32_t hdr = htonl(10);
+  char frame[sizeof(hdr) + 5] = {};
+  memcpy(frame, &hdr, sizeof(hdr));
+
+  EXPECT_TRUE(UnpackFrame(frame, 0, ignore));
+  // the message is shorter than its header says
+  EXPECT_FALSE(UnpackFrame(frame, sizeof(frame), ignore));
+  // incomplete header
+  EXPECT_FALSE(UnpackFrame(frame, 2, ignore));
+}
@@ -0,0 +1,195 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+
+#include "include/ch.h"
+#include "include/jcr.h"
+#include "include/streams.h"
+#include "lib/compression.h"
+#include "lib/serial.h"
+
+#include <random>
+#include <vector>
+
+static std::vector<char> CompressibleData(std::size_t size)
+{
+  std::vector<char> data(size);
+  std::mt19937 gen(1234);
+  std::uniform_int_distribution<int> dist(0, 7);
+  for (auto& c : data) { c = 'a' + dist(gen); }
+  return data;
+}
+
+// compress data the same way the filed does it: with a comp_stream_header
+static std::vector<char> CompressRecord(uint32_t algo,
+                                        const std::vector<char>& data,
+                                        uint16_t level = 6)
+{
+  std::vector<char> record(
+      RequiredCompressionOutputBufferSize(algo, data.size()));
+  result size = ThreadlocalCompress(
+      algo, level, data.data(), data.size(),
+      record.data() + sizeof(comp_stream_header),
+      record.size() - sizeof(comp_stream_header));
+  EXPECT_FALSE(size.holds_error()) << size.error_unchecked().c_str();
+  if (size.holds_error()) { return {}; }
+
+  ser_declare;
+  SerBegin(record.data(), sizeof(comp_stream_header));
+  ser_uint32(algo);
+  ser_uint32(size.value_unchecked());
+  ser_uint16(level);
+  ser_uint16(COMP_HEAD_VERSION);
+  SerEnd(record.data(), sizeof(comp_stream_header));
+
+  record.resize(size.value_unchecked() + sizeof(comp_stream_header));
+  return record;
+}
+
+static void CheckRoundTrip(uint32_t algo, uint16_t level = 6)
+{
+  auto data = CompressibleData(DEFAULT_NETWORK_BUFFER_SIZE);
+  auto record = CompressRecord(algo, data, level);
+  ASSERT_FALSE(record.empty());
+
+  // start with a too small buffer to check that it gets enlarged
+  std::vector<char> output(1024);
+  result size = ThreadlocalDecompress(STREAM_COMPRESSED_DATA, record.data(),
+                                      record.size(), output);
+  ASSERT_FALSE(size.holds_error()) << size.error_unchecked().c_str();
+  ASSERT_EQ(size.value_unchecked(), data.size());
+  output.resize(size.value_unchecked());
+  EXPECT_EQ(output, data);
+}
+
+#if defined(HAVE_LIBZ)
+TEST(compression, gzip_roundtrip) { CheckRoundTrip(COMPRESS_GZIP); }
+#endif
+
+#if defined(HAVE_LZO)
+TEST(compression, lzo_roundtrip) { CheckRoundTrip(COMPRESS_LZO1X); }
+#endif
+
+TEST(compression, fastlz_roundtrip) { CheckRoundTrip(COMPRESS_FZFZ); }
+TEST(compression, lz4_roundtrip) { CheckRoundTrip(COMPRESS_FZ4L); }
+TEST(compression, lz4hc_roundtrip) { CheckRoundTrip(COMPRESS_FZ4H); }
+
+#if defined(HAVE_ZSTD)
+TEST(compression, zstd_roundtrip)
+{
+  CheckRoundTrip(COMPRESS_ZSTD, 1);
+  CheckRoundTrip(COMPRESS_ZSTD, 3);
+  CheckRoundTrip(COMPRESS_ZSTD, 19);
+}
+
+TEST(compression, zstd_level_changes_output)
+{
+  auto data = CompressibleData(DEFAULT_NETWORK_BUFFER_SIZE);
+  auto fast = CompressRecord(COMPRESS_ZSTD, data, 1);
+  auto best = CompressRecord(COMPRESS_ZSTD, data, 19);
+  ASSERT_FALSE(fast.empty());
+  ASSERT_FALSE(best.empty());
+  EXPECT_LT(best.size(), fast.size());
+}
+
+TEST(compression, zstd_detects_corrupted_frame)
+{
+  auto data = CompressibleData(64 * 1024);
+  auto record = CompressRecord(COMPRESS_ZSTD, data);
+  ASSERT_FALSE(record.empty());
+
+  // destroy the zstd frame magic
+  record[sizeof(comp_stream_header)] ^= 0xff;
+  std::vector<char> output(data.size());
+  result size = ThreadlocalDecompress(STREAM_COMPRESSED_DATA, record.data(),
+                                      record.size(), output);
+  EXPECT_TRUE(size.holds_error());
+}
+
+TEST(compression, zstd_rejects_huge_content_size)
+{
+  // a frame header with a single segment and an 8 byte content size of 1 TiB
+  const unsigned char frame[] = {0x28, 0xb5, 0x2f, 0xfd, 0xe0, 0x00, 0x00,
+                                 0x00, 0x00, 0x00, 0x01, 0x00, 0x00};
+  std::vector<char> record(sizeof(comp_stream_header) + sizeof(frame));
+
+  ser_declare;
+  SerBegin(record.data(), sizeof(comp_stream_header));
+  ser_uint32(COMPRESS_ZSTD);
+  ser_uint32(sizeof(frame));
+  ser_uint16(3);
+  ser_uint16(COMP_HEAD_VERSION);
+  SerEnd(record.data(), sizeof(comp_stream_header));
+  memcpy(record.data() + sizeof(comp_stream_header), frame, sizeof(frame));
+
+  std::vector<char> output(1024);
+  result size = ThreadlocalDecompress(STREAM_COMPRESSED_DATA, record.data(),
+                                      record.size(), output);
+  EXPECT_TRUE(size.holds_error());
+  EXPECT_EQ(output.size(), 1024u);
+}
+#endif
+
+TEST(compression, detects_corrupted_header)
+{
+  auto data = CompressibleData(64 * 1024);
+  auto record = CompressRecord(COMPRESS_FZ4L, data);
+  ASSERT_FALSE(record.empty());
+
+  std::vector<char> output(data.size());
+  // claim a different size in the header than the record has
+  record.resize(record.size() - 1);
+  result size = ThreadlocalDecompress(STREAM_COMPRESSED_DATA, record.data(),
+                                      record.size(), output);
+  EXPECT_TRUE(size.holds_error());
+}
+
+// DecompressData() decodes into the (growing) inflate buffer of the jcr
+TEST(compression, decompress_data_into_inflate_buffer)
+{
+  auto data = CompressibleData(DEFAULT_NETWORK_BUFFER_SIZE);
+  auto record = CompressRecord(COMPRESS_FZ4L, data);
+  ASSERT_FALSE(record.empty());
+
+  JobControlRecord jcr;
+  jcr.compress.inflate_buffer_size = 1024;
+  jcr.compress.inflate_buffer = GetPoolMemory(PM_BSOCK);
+  jcr.compress.inflate_buffer = CheckPoolMemorySize(
+      jcr.compress.inflate_buffer, jcr.compress.inflate_buffer_size);
+
+  char* buf = record.data();
+  uint32_t length = record.size();
+  ASSERT_TRUE(DecompressData(&jcr, "file", STREAM_COMPRESSED_DATA, &buf,
+                             &length, false));
+  EXPECT_EQ(buf, jcr.compress.inflate_buffer);
+  ASSERT_EQ(length, data.size());
+  EXPECT_EQ(std::vector<char>(buf, buf + length), data);
+  EXPECT_GE(jcr.compress.inflate_buffer_size, data.size());
+
+  FreePoolMemory(jcr.compress.inflate_buffer);
+  jcr.compress.inflate_buffer = nullptr;
+}
@@ -351,4 +351,30 @@ TEST_F(ConfigParser_Dir, CFG_TYPE_TIME)
 {
   test_config_directive_type(test_CFG_TYPE_TIME);
 }
+
+void test_FILESET_COMPRESSION(DirectorResource*)
+{
+  FilesetResource* fileset1
+      = (FilesetResource*)my_config->GetResWithName(R_FILESET, "fileset1");
+  ASSERT_TRUE(fileset1);
+  ASSERT_EQ(fileset1->include_items.size(), 1);
+
+  auto& options = fileset1->include_items.at(0)->file_options_list;
+  ASSERT_EQ(options.size(), 4);
+  // the default options are appended to the configured ones
+  auto compression = [](FileOptions* fo) {
+    std::string opts{fo->opts};
+    return opts.substr(0, opts.find_first_not_of("Zs0123456789"));
+  };
+  // zstd without a level suffix uses the default level 3
+  EXPECT_EQ(compression(options.at(0)), "Zs03");
+  EXPECT_EQ(compression(options.at(1)), "Zs01");
+  EXPECT_EQ(compression(options.at(2)), "Zs19");
+  EXPECT_EQ(compression(options.at(3)), "Z9");
+}
+
+TEST_F(ConfigParser_Dir, FILESET_COMPRESSION)
+{
+  test_config_directive_type(test_FILESET_COMPRESSION);
+}
 }  // namespace directordaemon
@@ -28,6 +28,8 @@
 
 #include <array>
 #include <numeric>
+#include <random>
+#include <vector>
 #include "stored/crc32/crc32.h"
 
 
@@ -73,3 +75,41 @@ TEST(crc32, label_block)
   ASSERT_EQ(0xcb678ddd,
             crc32_fast(label_block.data() + 4, label_block.size() - 4));
 }
+
+TEST(crc32, hardware_matches_software)
+{
+  if (!crc32_hardware_available()) {
+    GTEST_SKIP() << "no hardware crc32 support on this cpu";
+  }
+
+  std::vector<uint8_t> buf(1024 * 1024 + 64);
+  std::mt19937 gen(1234);
+  for (auto& c : buf) { c = static_cast<uint8_t>(gen()); }
+
+  // cover all alignments, the short paths and every remainder after folding
+  std::vector<size_t> lengths;
+  for (size_t len = 0; len <= 300; ++len) { lengths.push_back(len); }
+  for (size_t len : {1023, 1024, 1025, 4096 + 13, 65536, 1024 * 1024}) {
+    lengths.push_back(len);
+  }
+
+  for (size_t offset = 0; offset < 16; ++offset) {
+    for (size_t len : lengths) {
+      const uint8_t* data = buf.data() + offset;
+      uint32_t previous = static_cast<uint32_t>(len * 0x9e3779b9u);
+      uint32_t expected = crc32_16bytes(data, len, previous);
+
+      ASSERT_EQ(crc32_hardware(data, len, previous), expected)
+          << "offset " << offset << " length " << len;
+      ASSERT_EQ(crc32_8bytes(data, len, previous), expected);
+      ASSERT_EQ(crc32_4x8bytes(data, len, previous), expected);
+      ASSERT_EQ(crc32_4bytes(data, len, previous), expected);
+      ASSERT_EQ(crc32_fast(data, len, previous), expected);
+    }
+  }
+
+  // checksums of consecutive pieces can be chained
+  uint32_t chained = crc32_hardware(buf.data(), 100);
+  chained = crc32_hardware(buf.data() + 100, 5000, chained);
+  EXPECT_EQ(chained, crc32_1byte(buf.data(), 5100));
+}
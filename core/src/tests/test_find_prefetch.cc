@@ -0,0 +1,179 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation, which is
+   listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#include "gtest/gtest.h"
+#include "include/bareos.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "include/jcr.h"
+#include "include/filetypes.h"
+#include "findlib/find.h"
+#include "findlib/prefetch.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+std::vector<std::string> seen;
+
+int RecordFile(JobControlRecord*, FindFilesPacket* ff, bool)
+{
+  seen.push_back(std::to_string(ff->type) + " " + ff->fname);
+  return 1;
+}
+
+/* A tree with some depth, a directory that is bigger than one stat batch
+ * and entries that cannot be walked into.  Every test gets its own, as ctest
+ * may run them in parallel. */
+std::string CreateTree()
+{
+  fs::path root = fs::path(TEST_TEMP_DIR)
+                  / ::testing::UnitTest::GetInstance()
+                        ->current_test_info()
+                        ->name();
+  fs::remove_all(root);
+
+  for (int i = 0; i < 5; ++i) {
+    fs::path dir = root / ("dir" + std::to_string(i));
+    for (int j = 0; j < 4; ++j) {
+      fs::path sub = dir / ("sub" + std::to_string(j)) / "deeper";
+      fs::create_directories(sub);
+      std::ofstream(sub / "file") << i << j;
+    }
+  }
+
+  fs::path big = root / "big";
+  fs::create_directories(big);
+  for (int i = 0; i < 300; ++i) {
+    std::ofstream(big / ("file" + std::to_string(i))) << i;
+    if (i % 50 == 0) {
+      fs::create_directory(big / ("dir" + std::to_string(i)));
+    }
+  }
+
+  fs::create_directory_symlink(root / "dir1", root / "link");
+  fs::create_directories(root / "dir2" / "excluded");
+  std::ofstream(root / "dir3" / ".nobackup");
+
+  return root.string();
+}
+
+FindFilesPacket* NewFindFiles(const std::string& root, int prefetch_depth)
+{
+  FindFilesPacket* ff = init_find_files();
+  ff->fileset = (findFILESET*)malloc(sizeof(findFILESET));
+  *ff->fileset = findFILESET{};
+  ff->fileset->include_list.init(1, true);
+  ff->fileset->exclude_list.init(1, true);
+
+  findIncludeExcludeItem* incexe = new_include(ff->fileset);
+  incexe->name_list.append(new_dlistString(root.c_str()));
+  findFOPTS* fo = start_options(ff);
+  fo->PrefetchDepth = prefetch_depth;
+  fo->wilddir.append(strdup("*/dir2/excluded"));
+  SetBit(FO_EXCLUDE, fo->flags);
+  incexe->ignoredir.append(strdup(".nobackup"));
+
+  return ff;
+}
+
+std::vector<std::string> Walk(const std::string& root, int prefetch_depth)
+{
+  JobControlRecord jcr;
+  FindFilesPacket* ff = NewFindFiles(root, prefetch_depth);
+
+  seen.clear();
+  EXPECT_EQ(FindFiles(&jcr, ff, RecordFile, nullptr), 1);
+  TermFindFiles(ff);
+
+  return std::move(seen);
+}
+}  // namespace
+
+TEST(find_prefetch, same_files_in_same_order)
+{
+  std::string root = CreateTree();
+  auto expected = Walk(root, 0);
+
+  EXPECT_GT(expected.size(), 300u);
+
+  for (int depth : {1, 2, 8, 64}) {
+    EXPECT_EQ(Walk(root, depth), expected) << "prefetch depth " << depth;
+  }
+}
+
+TEST(find_prefetch, take_and_release)
+{
+  std::string root = CreateTree();
+  struct stat statp;
+  ASSERT_EQ(lstat(root.c_str(), &statp), 0);
+
+  DirectoryPrefetcher prefetcher(4);
+  EXPECT_EQ(prefetcher.NumWorkers(), 4u);
+
+  auto big = prefetcher.Take(root + "/big", statp.st_dev);
+  ASSERT_EQ(big->open_errno, 0);
+  EXPECT_EQ(big->entries.size(), 306u);
+  for (auto& entry : big->entries) {
+    EXPECT_EQ(entry.stat_errno, 0) << entry.name;
+    EXPECT_EQ(S_ISDIR(entry.statp.st_mode), entry.name.find("dir") == 0)
+        << entry.name;
+  }
+
+  // subdirectories of a taken directory are read ahead in the background
+  auto dir = prefetcher.Take(root + "/big/dir50", statp.st_dev);
+  EXPECT_EQ(dir->open_errno, 0);
+  EXPECT_TRUE(dir->entries.empty());
+  prefetcher.Release(root + "/big");
+
+  auto missing = prefetcher.Take(root + "/missing", statp.st_dev);
+  EXPECT_EQ(missing->open_errno, ENOENT);
+  EXPECT_TRUE(missing->entries.empty());
+}
+
+TEST(find_prefetch, filter_skips_what_the_walk_skips)
+{
+  std::string root = CreateTree();
+  FindFilesPacket* ff = NewFindFiles(root, 4);
+  auto descend = PrefetchFilter(ff);
+
+  auto Descends = [&descend](const std::string& path, dev_t parent_dev) {
+    struct stat statp;
+    EXPECT_EQ(lstat(path.c_str(), &statp), 0) << path;
+    return descend(path, statp, parent_dev);
+  };
+
+  struct stat statp;
+  ASSERT_EQ(lstat(root.c_str(), &statp), 0);
+  EXPECT_TRUE(Descends(root + "/dir1", statp.st_dev));
+  EXPECT_TRUE(Descends(root + "/dir2", statp.st_dev));
+  // excluded by a wilddir
+  EXPECT_FALSE(Descends(root + "/dir2/excluded", statp.st_dev));
+  // contains the Exclude Dir Containing file
+  EXPECT_FALSE(Descends(root + "/dir3", statp.st_dev));
+  // on another file system without onefs=no
+  EXPECT_FALSE(Descends(root + "/dir1", statp.st_dev + 1));
+
+  TermFindFiles(ff);
+}
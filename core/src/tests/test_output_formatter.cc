@@ -1,7 +1,7 @@
 /*
    BAREOS® - Backup Archiving REcovery Open Sourced
 
-   Copyright (C) 2018-2019 Bareos GmbH & Co. KG
+   Copyright (C) 2018-2024 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -26,6 +26,189 @@
 #  include "include/bareos.h"
 #endif
 
+#define NEED_JANSSON_NAMESPACE
 #include "lib/output_formatter.h"
 
+#include <string>
+#include <vector>
+
 TEST(output_formatter, constructor_destructor) {}
+
+#if HAVE_JANSSON
+namespace {
+bool Collect(void* ctx, const char* fmt, ...)
+{
+  PoolMem msg;
+  va_list arg_ptr;
+
+  va_start(arg_ptr, fmt);
+  msg.Bvsprintf(fmt, arg_ptr);
+  va_end(arg_ptr);
+  static_cast<std::vector<std::string>*>(ctx)->emplace_back(msg.c_str());
+  return true;
+}
+
+std::string Join(const std::vector<std::string>& messages)
+{
+  std::string joined;
+  for (auto& msg : messages) { joined += msg; }
+  return joined;
+}
+
+// Shaped like the output of "list jobs" with some nesting added.
+void ListJobs(OutputFormatter& of, int jobs, int files)
+{
+  of.ObjectKeyValue("count", jobs);
+  of.ObjectStart("summary");
+  of.ObjectKeyValue("name", "quote \" and\nnewline");
+  of.ObjectEnd("summary");
+  of.ArrayStart("jobs");
+  for (int i = 0; i < jobs; i++) {
+    of.ObjectStart();
+    of.ObjectKeyValue("jobid", i);
+    of.ObjectKeyValue("name", "backup-client-fd");
+    of.ArrayStart("files");
+    for (int j = 0; j < files; j++) { of.ArrayItem("/etc/some/file"); }
+    of.ArrayEnd("files");
+    of.ObjectStart("empty");
+    of.ObjectEnd("empty");
+    of.ObjectKeyValueBool("ok", i % 2);
+    of.ObjectEnd();
+  }
+  of.ArrayEnd("jobs");
+  of.ArrayStart("none");
+  of.ArrayEnd("none");
+  of.ObjectKeyValue("total", jobs);
+}
+
+struct Output {
+  std::vector<std::string> messages;
+  OutputFormatter of{Collect, &messages, nullptr, nullptr, API_MODE_JSON};
+
+  Output(size_t threshold, bool compact)
+  {
+    of.SetJsonStreamThreshold(threshold);
+    of.SetCompact(compact);
+  }
+};
+}  // namespace
+
+TEST(output_formatter, json_streamed_equals_buffered)
+{
+  for (bool compact : {false, true}) {
+    for (int files : {0, 1, 5}) {
+      Output buffered(0, compact);
+      ListJobs(buffered.of, 7, files);
+      buffered.of.FinalizeResult(true);
+
+      for (size_t threshold : {1, 2, 3, 100}) {
+        Output streamed(threshold, compact);
+        ListJobs(streamed.of, 7, files);
+        streamed.of.FinalizeResult(true);
+        EXPECT_EQ(Join(streamed.messages), Join(buffered.messages))
+            << "compact " << compact << " files " << files << " threshold "
+            << threshold;
+      }
+    }
+  }
+}
+
+TEST(output_formatter, json_streamed_with_meta)
+{
+  Output buffered(0, false);
+  Output streamed(2, false);
+
+  for (Output* output : {&buffered, &streamed}) {
+    output->of.AddLimitFilterTuple(10);
+    output->of.AddOffsetFilterTuple(5);
+    ListJobs(output->of, 5, 1);
+    output->of.FinalizeResult(true);
+  }
+  EXPECT_NE(Join(buffered.messages).find("\"meta\""), std::string::npos);
+  EXPECT_EQ(Join(streamed.messages), Join(buffered.messages));
+}
+
+TEST(output_formatter, json_large_result_is_sent_after_finalize)
+{
+  Output buffered(0, true);
+  Output streamed(1000, true);
+
+  for (Output* output : {&buffered, &streamed}) {
+    ListJobs(output->of, 20000, 2);
+  }
+  // nothing is sent as long as the command can still fail
+  EXPECT_TRUE(buffered.messages.empty());
+  EXPECT_TRUE(streamed.messages.empty());
+
+  buffered.of.FinalizeResult(true);
+  streamed.of.FinalizeResult(true);
+  EXPECT_EQ(buffered.messages.size(), 1u);
+  EXPECT_GT(streamed.messages.size(), 1u);
+  EXPECT_EQ(Join(streamed.messages), Join(buffered.messages));
+
+  // the formatter is reused for the next command
+  streamed.messages.clear();
+  buffered.messages.clear();
+  ListJobs(streamed.of, 3, 1);
+  ListJobs(buffered.of, 3, 1);
+  streamed.of.FinalizeResult(true);
+  buffered.of.FinalizeResult(true);
+  EXPECT_EQ(Join(streamed.messages), Join(buffered.messages));
+}
+
+TEST(output_formatter, json_streamed_error_equals_buffered)
+{
+  for (bool compact : {false, true}) {
+    for (int jobs : {5, 20000}) {
+      Output buffered(0, compact);
+      Output streamed(2, compact);
+
+      for (Output* output : {&buffered, &streamed}) {
+        ListJobs(output->of, jobs, 1);
+        PoolMem msg("something went wrong");
+        output->of.message(MSG_TYPE_ERROR, msg);
+        output->of.FinalizeResult(true);
+      }
+      EXPECT_EQ(Join(streamed.messages), Join(buffered.messages))
+          << "compact " << compact << " jobs " << jobs;
+
+      // a json-rpc error, the result is only part of its data
+      json_error_t error;
+      json_t* json = json_loads(Join(streamed.messages).c_str(), 0, &error);
+      ASSERT_NE(json, nullptr) << error.text;
+      EXPECT_EQ(json_object_get(json, "result"), nullptr);
+      json_t* error_obj = json_object_get(json, "error");
+      ASSERT_NE(error_obj, nullptr);
+      EXPECT_STREQ(json_string_value(json_object_get(error_obj, "message")),
+                   "failed");
+      json_t* data = json_object_get(error_obj, "data");
+      json_t* result = json_object_get(data, "result");
+      EXPECT_EQ(json_array_size(json_object_get(result, "jobs")),
+                static_cast<size_t>(jobs));
+      EXPECT_NE(json_object_get(data, "messages"), nullptr);
+      json_decref(json);
+    }
+  }
+}
+
+TEST(output_formatter, json_array_not_last_member_is_buffered)
+{
+  Output buffered(0, false);
+  Output streamed(2, false);
+
+  for (Output* output : {&buffered, &streamed}) {
+    OutputFormatter& of = output->of;
+    of.ObjectStart("first");
+    of.ObjectEnd("first");
+    of.ObjectKeyValue("second", 2);
+    // reopens "first", which is not the last member anymore
+    of.ObjectStart("first");
+    of.ArrayStart("list");
+    for (uint64_t i = 0; i < 5; i++) { of.ArrayItem(i); }
+    of.ArrayEnd("list");
+    of.ObjectEnd("first");
+    of.FinalizeResult(true);
+  }
+  EXPECT_EQ(Join(streamed.messages), Join(buffered.messages));
+}
+#endif
@@ -30,7 +30,20 @@
 
 #include "lib/parse_conf.h"
 
+#include <cstdint>
+#include <random>
+#include <vector>
+
 typedef std::unique_ptr<ConfigurationParser> PConfigParser;
 
+// Reproducible data that neither compresses nor deduplicates
+inline std::vector<char> RandomData(std::size_t size, std::uint32_t seed)
+{
+  std::mt19937 gen(seed);
+  std::vector<char> data(size);
+  for (auto& c : data) { c = static_cast<char>(gen()); }
+  return data;
+}
+
 
 #endif  // BAREOS_TESTS_TESTING_COMMON_H_
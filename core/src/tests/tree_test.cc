@@ -0,0 +1,130 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2024-2024 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+#if defined(HAVE_MINGW)
+#  include "include/bareos.h"
+#  include "gtest/gtest.h"
+#else
+#  include "gtest/gtest.h"
+#  include "include/bareos.h"
+#endif
+#include "lib/tree.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+static TREE_NODE* Insert(TREE_ROOT* root, std::string path, std::string fname)
+{
+  TREE_NODE* node
+      = insert_tree_node(path.data(), fname.data(), TN_FILE, root, nullptr);
+  node->type = TN_FILE;
+  return node;
+}
+
+static std::vector<std::string> ChildNames(TREE_NODE* node)
+{
+  std::vector<std::string> names;
+  TREE_NODE* child;
+  foreach_child (child, node) { names.push_back(child->fname); }
+  EXPECT_EQ(child, nullptr);
+  return names;
+}
+
+TEST(tree, children_are_iterated_in_name_order)
+{
+  TREE_ROOT* root = new_tree(1);
+
+  for (const char* name : {"m", "b", "z", "a", "B", "y"}) {
+    Insert(root, "/dir/", name);
+  }
+  TREE_NODE* dir = tree_cwd((char*)"/dir", root, (TREE_NODE*)root);
+  ASSERT_NE(dir, nullptr);
+  EXPECT_EQ(ChildNames(dir),
+            (std::vector<std::string>{"B", "a", "b", "m", "y", "z"}));
+
+  // Children added after sorting are sorted again on the next iteration.
+  Insert(root, "/dir/", "c");
+  EXPECT_EQ(ChildNames(dir),
+            (std::vector<std::string>{"B", "a", "b", "c", "m", "y", "z"}));
+
+  FreeTree(root);
+}
+
+TEST(tree, existing_node_is_found_again)
+{
+  TREE_ROOT* root = new_tree(1);
+
+  TREE_NODE* first = Insert(root, "/dir/", "file");
+  EXPECT_TRUE(first->inserted);
+  TREE_NODE* second = Insert(root, "/dir/", "file");
+  EXPECT_EQ(first, second);
+  EXPECT_FALSE(second->inserted);
+
+  TREE_NODE* other = Insert(root, "/other/", "file");
+  EXPECT_NE(first, other);
+
+  char* path = tree_getpath(other);
+  EXPECT_STREQ(path, "/other/file");
+  FreePoolMemory(path);
+
+  FreeTree(root);
+}
+
+TEST(tree, removed_node_can_be_inserted_again)
+{
+  TREE_ROOT* root = new_tree(1);
+
+  Insert(root, "/dir/", "a");
+  TREE_NODE* node = Insert(root, "/dir/", "b");
+  TREE_NODE* dir = node->parent;
+  TreeRemoveNode(root, node);
+  EXPECT_EQ(ChildNames(dir), (std::vector<std::string>{"a"}));
+
+  TREE_NODE* again = Insert(root, "/dir/", "b");
+  EXPECT_NE(again, node);
+  EXPECT_TRUE(again->inserted);
+  EXPECT_EQ(ChildNames(dir), (std::vector<std::string>{"a", "b"}));
+
+  FreeTree(root);
+}
+
+TEST(tree, large_directory)
+{
+  TREE_ROOT* root = new_tree(1);
+  const int count = 200'000;
+
+  for (int i = count; i > 0; i--) {
+    Insert(root, "/big/", "file" + std::to_string(i));
+  }
+  for (int i = 1; i <= count; i++) {
+    EXPECT_FALSE(Insert(root, "/big/", "file" + std::to_string(i))->inserted);
+  }
+
+  TREE_NODE* dir = tree_cwd((char*)"/big", root, (TREE_NODE*)root);
+  ASSERT_NE(dir, nullptr);
+  EXPECT_EQ(dir->child_count, static_cast<uint32_t>(count));
+
+  std::vector<std::string> names = ChildNames(dir);
+  EXPECT_TRUE(std::is_sorted(names.begin(), names.end()));
+
+  FreeTree(root);
+}
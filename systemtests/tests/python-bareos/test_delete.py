@@ -139,6 +139,44 @@ class PythonBareosDeleteTest(bareos_unittest.Json):
         with self.assertRaises(bareos.exceptions.JsonRpcErrorReceivedException):
             result = director.call("delete jobid={}".format("1000_INVALID"))
 
+    def test_delete_many_jobids_with_invalid_jobid(self):
+        """
+        A result of more than 1000 entries is spooled by the director.
+        When the command fails afterwards,
+        the result must still be returned as error.
+        """
+        logger = logging.getLogger()
+
+        username = self.get_operator_username()
+        password = self.get_operator_password(username)
+
+        director = bareos.bsock.DirectorConsoleJson(
+            address=self.director_address,
+            port=self.director_port,
+            name=username,
+            password=password,
+            **self.director_extra_options
+        )
+
+        # Ranges of up to 25 jobids are deleted without confirmation.
+        ranges = ["{}-{}".format(i, i + 19) for i in range(3001, 4201, 20)]
+        number = 1200
+        with self.assertRaises(
+            bareos.exceptions.JsonRpcErrorReceivedException
+        ) as context:
+            director.call(
+                "delete jobid={},{}".format(",".join(ranges), "4201_INVALID")
+            )
+        jsondata = context.exception.jsondata
+        logger.debug(str(jsondata)[:1000])
+        self.assertNotIn("result", jsondata)
+        deleted_jobids = jsondata["error"]["data"]["result"]["deleted"]["jobids"]
+        self.assertEqual(len(deleted_jobids), number)
+        self.assertIn(
+            "Illegal JobId 4201_INVALID ignored\n",
+            jsondata["error"]["data"]["messages"]["error"],
+        )
+
     def test_delete_volume(self):
         """"""
         logger = logging.getLogger()